@@ -0,0 +1,1091 @@
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include "calculator_vecmath.h"
+#include "calculator_parallel.h"
+#include "calculator_program.h"
+#include "calculator_stats.h"
+#include "calculator_lexer.h"
+#include "calculator_random.h"
+#include "calculator_ode.h"
+#include "calculator_trace.h"
+#include "calculator_fixed.h"
+#include "calculator_cache.h"
+#include "calculator_sheet.h"
+#include "calculator_special.h"
+#include "calculator_numtheory.h"
+#include "calculator_rolling.h"
+#include <unistd.h>
+
+// Micro-benchmarks for the calculator kernels. Each case runs a fixed-size
+// working set repeatedly for at least BENCH_MIN_SECONDS and reports the
+// time per element.
+#define BENCH_ELEMENTS 4096
+#define BENCH_MIN_SECONDS 0.2
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static double checksum;
+
+static void fill_inputs(VecmathFunction function, AngleMode angle_mode, double* x) {
+    for (int i = 0; i < BENCH_ELEMENTS; i++) {
+        double u = (double)rand() / RAND_MAX;
+        switch (function) {
+            case VECMATH_SIN: case VECMATH_COS: case VECMATH_TAN:
+                x[i] = angle_mode == DEG ? (u - 0.5) * 720.0 : (u - 0.5) * 20.0;
+                break;
+            case VECMATH_ASIN: x[i] = 2.0 * u - 1.0; break;
+            case VECMATH_EXP: x[i] = (u - 0.5) * 100.0; break;
+            default: x[i] = exp((u - 0.5) * 100.0); break;
+        }
+    }
+}
+
+// Returns nanoseconds per element of vecmath_apply with the active ISA
+static double time_apply(VecmathFunction function, AngleMode angle_mode, const double* x, double* out) {
+    long iterations = 0;
+    double start = now_seconds(), elapsed;
+    do {
+        vecmath_apply(function, angle_mode, x, out, BENCH_ELEMENTS);
+        checksum += out[iterations % BENCH_ELEMENTS];
+        iterations++;
+        elapsed = now_seconds() - start;
+    } while (elapsed < BENCH_MIN_SECONDS);
+    return elapsed * 1e9 / ((double)iterations * BENCH_ELEMENTS);
+}
+
+static double time_pow(const double* x, const double* y, double* out) {
+    long iterations = 0;
+    double start = now_seconds(), elapsed;
+    do {
+        vecmath_pow(x, y, out, BENCH_ELEMENTS);
+        checksum += out[iterations % BENCH_ELEMENTS];
+        iterations++;
+        elapsed = now_seconds() - start;
+    } while (elapsed < BENCH_MIN_SECONDS);
+    return elapsed * 1e9 / ((double)iterations * BENCH_ELEMENTS);
+}
+
+static void bench_vecmath(void) {
+    static const struct {
+        const char* name;
+        VecmathFunction function;
+        AngleMode angle_mode;
+    } cases[] = {
+        {"sin", VECMATH_SIN, RAD}, {"sin (deg)", VECMATH_SIN, DEG},
+        {"cos", VECMATH_COS, RAD}, {"cos (deg)", VECMATH_COS, DEG},
+        {"tan", VECMATH_TAN, RAD}, {"tan (deg)", VECMATH_TAN, DEG},
+        {"asin", VECMATH_ASIN, RAD}, {"asin (deg)", VECMATH_ASIN, DEG},
+        {"exp", VECMATH_EXP, RAD}, {"log", VECMATH_LOG, RAD}, {"log10", VECMATH_LOG10, RAD},
+    };
+    double* x = malloc(BENCH_ELEMENTS * sizeof(double));
+    double* y = malloc(BENCH_ELEMENTS * sizeof(double));
+    double* out = malloc(BENCH_ELEMENTS * sizeof(double));
+    VecmathIsa best = vecmath_best_isa();
+
+    printf("vecmath: ns/element (speedup over scalar libm), best ISA %s\n", vecmath_isa_name(best));
+    printf("%-12s", "function");
+    for (int isa = VECMATH_ISA_SCALAR; isa <= (int)best; isa++) {
+        printf("%16s", vecmath_isa_name((VecmathIsa)isa));
+    }
+    printf("\n");
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        double scalar_ns = 0.0;
+        srand(42);
+        fill_inputs(cases[c].function, cases[c].angle_mode, x);
+        printf("%-12s", cases[c].name);
+        for (int isa = VECMATH_ISA_SCALAR; isa <= (int)best; isa++) {
+            vecmath_set_isa((VecmathIsa)isa);
+            double ns = time_apply(cases[c].function, cases[c].angle_mode, x, out);
+            if (isa == VECMATH_ISA_SCALAR) {
+                scalar_ns = ns;
+            }
+            printf("%9.2f (%4.1fx)", ns, scalar_ns / ns);
+        }
+        printf("\n");
+    }
+
+    srand(42);
+    for (int i = 0; i < BENCH_ELEMENTS; i++) {
+        x[i] = exp(((double)rand() / RAND_MAX - 0.5) * 10.0);
+        y[i] = ((double)rand() / RAND_MAX - 0.5) * 20.0;
+    }
+    printf("%-12s", "pow");
+    double scalar_ns = 0.0;
+    for (int isa = VECMATH_ISA_SCALAR; isa <= (int)best; isa++) {
+        vecmath_set_isa((VecmathIsa)isa);
+        double ns = time_pow(x, y, out);
+        if (isa == VECMATH_ISA_SCALAR) {
+            scalar_ns = ns;
+        }
+        printf("%9.2f (%4.1fx)", ns, scalar_ns / ns);
+    }
+    printf("\n\n");
+
+    vecmath_set_isa(best);
+    free(x);
+    free(y);
+    free(out);
+}
+
+// A generated sum of products, a few megabytes long, split across threads
+#define BENCH_EXPRESSION_TERMS 200000
+
+static void bench_parallel(void) {
+    char* expr = malloc(BENCH_EXPRESSION_TERMS * 32);
+    char* p = expr;
+    srand(42);
+    for (int i = 0; i < BENCH_EXPRESSION_TERMS; i++) {
+        p += sprintf(p, "%s%d.%03d*s%d", i ? "+" : "", rand() % 1000, rand() % 1000, rand() % 360);
+    }
+    size_t length = strlen(expr);
+
+    printf("parallel_evaluate: %.1f MB expression\n", length / 1e6);
+    printf("%-12s%12s%12s\n", "threads", "MB/s", "speedup");
+    Calculator* calc = calculator_new();
+    double single = 0.0;
+    for (int threads = 1; threads <= 8; threads *= 2) {
+        long iterations = 0;
+        double start = now_seconds(), elapsed, value = 0.0;
+        do {
+            parallel_evaluate(calc, expr, threads, &value);
+            checksum += value;
+            iterations++;
+            elapsed = now_seconds() - start;
+        } while (elapsed < BENCH_MIN_SECONDS);
+        double seconds = elapsed / (double)iterations;
+        if (threads == 1) {
+            single = seconds;
+        }
+        printf("%-12d%12.1f%11.1fx\n", threads, length / 1e6 / seconds, single / seconds);
+    }
+    printf("\n");
+    calculator_free(calc);
+    free(expr);
+}
+// A formula library of the size we ship: parsing the text at startup versus
+// mapping the precompiled file
+#define BENCH_FORMULAS 50000
+
+static void bench_programs(void) {
+    char path[64], name[32], expression[128];
+    snprintf(path, sizeof(path), "/tmp/bench_programs_%ld.mep", (long)getpid());
+
+    srand(42);
+    ProgramWriter* writer = program_writer_new();
+    double start = now_seconds();
+    for (int i = 0; i < BENCH_FORMULAS; i++) {
+        snprintf(name, sizeof(name), "f%d", i);
+        snprintf(expression, sizeof(expression), "$x*%d.%d+s($y)-%d/($z^2+1)+q(%d)*$x",
+                 rand() % 100, rand() % 100, rand() % 1000, rand() % 100);
+        program_writer_add(writer, name, expression);
+    }
+    double parse_seconds = now_seconds() - start;
+    program_writer_save(writer, path);
+    program_writer_free(writer);
+
+    start = now_seconds();
+    ProgramLibrary* library = program_library_open(path);
+    double open_seconds = now_seconds() - start;
+    if (!library) {
+        printf("programs: could not open %s\n\n", path);
+        unlink(path);
+        return;
+    }
+
+    Calculator* calc = calculator_new();
+    double variables[3] = {1.5, 30.0, 2.0}, value = 0.0;
+    start = now_seconds();
+    for (size_t i = 0; i < program_library_count(library); i++) {
+        program_run(library, i, calc, variables, &value);
+        checksum += value;
+    }
+    double run_seconds = now_seconds() - start;
+
+    printf("programs: %d formulas\n", BENCH_FORMULAS);
+    printf("%-24s%10.2f ms\n", "parse text", parse_seconds * 1e3);
+    printf("%-24s%10.2f ms\n", "open compiled file", open_seconds * 1e3);
+    printf("%-24s%10.1f ns/formula\n\n", "run every program", run_seconds * 1e9 / BENCH_FORMULAS);
+
+    calculator_free(calc);
+    program_library_close(library);
+    unlink(path);
+}
+
+// Generator throughput per kernel, the derived distributions, and a Monte
+// Carlo estimate of pi run entirely inside a compiled program
+#define BENCH_RANDOM_COUNT 4096
+
+static double bench_random_fill(RandomGenerator* generator, double* values, int distribution) {
+    long iterations = 0;
+    double start = now_seconds(), elapsed;
+    do {
+        switch (distribution) {
+            case 0: random_fill_uniform(generator, values, BENCH_RANDOM_COUNT); break;
+            case 1: random_fill_normal(generator, values, BENCH_RANDOM_COUNT); break;
+            case 2: random_fill_exponential(generator, values, BENCH_RANDOM_COUNT); break;
+            default: random_fill_poisson(generator, distribution == 3 ? 4.0 : 1000.0, values, BENCH_RANDOM_COUNT); break;
+        }
+        checksum += values[BENCH_RANDOM_COUNT - 1];
+        iterations++;
+        elapsed = now_seconds() - start;
+    } while (elapsed < BENCH_MIN_SECONDS);
+    return elapsed * 1e9 / ((double)iterations * BENCH_RANDOM_COUNT);
+}
+
+static void bench_random(void) {
+    static const char* distributions[] = {"uniform", "normal", "exponential", "poisson(4)", "poisson(1000)"};
+    double* values = malloc(BENCH_RANDOM_COUNT * sizeof(double));
+    RandomGenerator* generator = random_generator_new(1, 0);
+    if (!values || !generator) {
+        free(values);
+        random_generator_free(generator);
+        return;
+    }
+    RandomIsa best = random_best_isa();
+    printf("random: %d values per call\n", BENCH_RANDOM_COUNT);
+    printf("%-16s%-8s%12s\n", "distribution", "isa", "ns/value");
+    for (RandomIsa isa = RANDOM_ISA_SCALAR; isa <= best; isa++) {
+        random_set_isa(isa);
+        printf("%-16s%-8s%12.2f\n", distributions[0], random_isa_name(isa), bench_random_fill(generator, values, 0));
+    }
+    for (int d = 1; d < 5; d++) {
+        printf("%-16s%-8s%12.2f\n", distributions[d], random_isa_name(best), bench_random_fill(generator, values, d));
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/bench_random_%ld.mep", (long)getpid());
+    ProgramWriter* writer = program_writer_new();
+    program_writer_add(writer, "inside", "rand()^2+rand()^2");
+    program_writer_save(writer, path);
+    program_writer_free(writer);
+    ProgramLibrary* library = program_library_open(path);
+    Calculator* calc = calculator_new();
+    if (library && calc) {
+        long samples = 0, inside = 0;
+        double start = now_seconds(), elapsed, value = 0.0;
+        calculator_seed_random(calc, 1, 0);
+        do {
+            for (int i = 0; i < 1000; i++) {
+                program_run(library, 0, calc, NULL, &value);
+                inside += value < 1.0;
+            }
+            samples += 1000;
+            elapsed = now_seconds() - start;
+        } while (elapsed < BENCH_MIN_SECONDS);
+        checksum += 4.0 * (double)inside / (double)samples;
+        printf("%-24s%8.1f ns/sample\n", "pi, compiled program", elapsed * 1e9 / (double)samples);
+    }
+    printf("\n");
+    calculator_free(calc);
+    program_library_close(library);
+    unlink(path);
+    random_set_isa(best);
+    random_generator_free(generator);
+    free(values);
+}
+
+// Integration cost per method on a smooth and a stiff problem, in steps,
+// right-hand side evaluations and time per evaluation
+static void bench_ode(void) {
+    static const char* methods[] = {"dopri5", "rosenbrock"};
+    static const char* problems[] = {"smooth", "stiff"};
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/bench_ode_%ld.mep", (long)getpid());
+    ProgramWriter* writer = program_writer_new();
+    program_writer_add(writer, "smooth", "sin($t)-2*$y");
+    program_writer_add(writer, "stiff", "1000*(cos($t)-$y)-sin($t)");
+    program_writer_save(writer, path);
+    program_writer_free(writer);
+    ProgramLibrary* library = program_library_open(path);
+    Calculator* calc = calculator_new();
+    if (!library || !calc) {
+        calculator_free(calc);
+        program_library_close(library);
+        unlink(path);
+        return;
+    }
+    calculator_toggle_angle_mode(calc);
+
+    printf("ode: t in [0, 10], rtol 1e-4\n");
+    printf("%-10s%-12s%10s%10s%14s%12s\n", "problem", "method", "steps", "evals", "us/solve", "ns/eval");
+    const char* state[] = {"y"};
+    for (int p = 0; p < 2; p++) {
+        size_t program = (size_t)program_library_find(library, problems[p]);
+        OdeSystem* system = ode_system_new(library, &program, 1, state, "t");
+        for (int m = 0; m < 2; m++) {
+            OdeOptions options;
+            OdeStats stats;
+            ode_options_default(&options);
+            options.method = m ? ODE_ROSENBROCK : ODE_DORMAND_PRINCE;
+            options.relative_tolerance = 1e-4;
+            options.absolute_tolerance = 1e-7;
+            long iterations = 0;
+            double start = now_seconds(), elapsed, y;
+            do {
+                y = 1.0;
+                ode_integrate(system, calc, &options, 0.0, 10.0, &y, NULL, 0, NULL, &stats);
+                checksum += y;
+                iterations++;
+                elapsed = now_seconds() - start;
+            } while (elapsed < BENCH_MIN_SECONDS);
+            double solve = elapsed / (double)iterations;
+            printf("%-10s%-12s%10zu%10zu%14.1f%12.1f\n", problems[p], methods[m], stats.steps,
+                   stats.evaluations, solve * 1e6, solve * 1e9 / (double)stats.evaluations);
+        }
+        ode_system_free(system);
+    }
+    printf("\n");
+    calculator_free(calc);
+    program_library_close(library);
+    unlink(path);
+}
+
+// Recalculation of a sheet of independent chains over one shared input:
+// everything on one thread and on all of them, then after changing a single
+// chain's head
+#define BENCH_SHEET_CHAINS 128
+#define BENCH_SHEET_LENGTH 64
+
+static void bench_sheet(void) {
+    static const struct { const char* name; const char* cell; int threads; } cases[] = {
+        { "all, 1 thread", "x", 1 },
+        { "all, threads", "x", 0 },
+        { "one chain", "c0_0", 0 },
+    };
+    Sheet* sheet = sheet_new();
+    char name[32], expression[96];
+    sheet_set_value(sheet, "x", 1.0);
+    for (int i = 0; i < BENCH_SHEET_CHAINS; i++) {
+        for (int k = 0; k < BENCH_SHEET_LENGTH; k++) {
+            snprintf(name, sizeof(name), "c%d_%d", i, k);
+            if (k == 0) {
+                snprintf(expression, sizeof(expression), "$x*%d", i + 1);
+            } else {
+                snprintf(expression, sizeof(expression), "$c%d_%d*0.5+sin($x*%d)^2-cos($x)/3", i, k - 1, k);
+            }
+            sheet_set(sheet, name, expression);
+        }
+    }
+    sheet_recalculate(sheet, NULL, 1, NULL);
+
+    printf("sheet: %d chains of %d cells\n", BENCH_SHEET_CHAINS, BENCH_SHEET_LENGTH);
+    printf("%-16s%10s%10s%14s%12s\n", "recalculate", "cells", "threads", "us/recalc", "ns/cell");
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        SheetStats stats;
+        long iterations = 0;
+        double start = now_seconds(), elapsed, value = 0.0;
+        do {
+            sheet_set_value(sheet, cases[c].cell, (double)(iterations % 7));
+            sheet_recalculate(sheet, NULL, cases[c].threads, &stats);
+            sheet_get(sheet, "c0_1", &value);
+            checksum += value;
+            iterations++;
+            elapsed = now_seconds() - start;
+        } while (elapsed < BENCH_MIN_SECONDS);
+        double recalc = elapsed / (double)iterations;
+        printf("%-16s%10zu%10d%14.1f%12.1f\n", cases[c].name, stats.recomputed, stats.threads,
+               recalc * 1e6, recalc * 1e9 / (double)stats.recomputed);
+    }
+    printf("\n");
+    sheet_free(sheet);
+}
+
+// Evaluation time with no trace attached and with every step recorded
+static void bench_trace(void) {
+    static const char* expression = "3.5*2+sin(0.5)*4-1/7+2^0.5*(1.25-0.5)";
+    Calculator* calc = calculator_new();
+    TraceBuffer* trace = trace_buffer_new(4096);
+    if (!calc || !trace) {
+        calculator_free(calc);
+        trace_buffer_free(trace);
+        return;
+    }
+    double untraced = 0.0, value = 0.0;
+    calculator_set_trace(calc, trace);
+    calculator_evaluate_value(calc, expression, &value);
+    size_t steps = trace_buffer_count(trace);
+    printf("trace: %s (%zu steps)\n", expression, steps);
+    for (int traced = 0; traced < 2; traced++) {
+        calculator_set_trace(calc, traced ? trace : NULL);
+        long iterations = 0;
+        double start = now_seconds(), elapsed;
+        do {
+            calculator_evaluate_value(calc, expression, &value);
+            checksum += value;
+            iterations++;
+            elapsed = now_seconds() - start;
+        } while (elapsed < BENCH_MIN_SECONDS);
+        double ns = elapsed * 1e9 / (double)iterations;
+        if (traced) {
+            printf("%-12s%10.1f ns/eval  %6.1f ns/step\n", "traced", ns, (ns - untraced) / (double)steps);
+        } else {
+            untraced = ns;
+            printf("%-12s%10.1f ns/eval\n", "untraced", ns);
+        }
+    }
+    printf("\n");
+    trace_buffer_free(trace);
+    calculator_free(calc);
+}
+
+// One compiled formula run with and without strength reduction
+static const char* bench_rewrite_formulas[] = {"3$x^4+2$x^3-$x+7", "$x^3", "q($a^2+$b^2)", "$x/8"};
+
+static void bench_rewrite(void) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/bench_rewrite_%ld.mep", (long)getpid());
+    printf("strength reduction\n");
+    printf("%-22s%12s%12s%10s\n", "formula", "pow ns", "reduced ns", "speedup");
+
+    Calculator* calc = calculator_new();
+    double variables[2] = {1.37, 2.5};
+    for (size_t f = 0; f < sizeof(bench_rewrite_formulas) / sizeof(bench_rewrite_formulas[0]); f++) {
+        double ns[2];
+        for (int rewrite = 0; rewrite < 2; rewrite++) {
+            ProgramWriter* writer = program_writer_new();
+            program_writer_set_rewrite(writer, rewrite);
+            program_writer_add(writer, "f", bench_rewrite_formulas[f]);
+            program_writer_save(writer, path);
+            program_writer_free(writer);
+            ProgramLibrary* library = program_library_open(path);
+            if (!library) {
+                printf("%-22scould not compile\n", bench_rewrite_formulas[f]);
+                break;
+            }
+            long iterations = 0;
+            double start = now_seconds(), elapsed, value = 0.0;
+            do {
+                for (int i = 0; i < 1000; i++) {
+                    program_run(library, 0, calc, variables, &value);
+                    checksum += value;
+                }
+                iterations += 1000;
+                elapsed = now_seconds() - start;
+            } while (elapsed < BENCH_MIN_SECONDS);
+            ns[rewrite] = elapsed * 1e9 / (double)iterations;
+            program_library_close(library);
+        }
+        printf("%-22s%12.1f%12.1f%9.2fx\n", bench_rewrite_formulas[f], ns[0], ns[1], ns[0] / ns[1]);
+    }
+    printf("\n");
+    calculator_free(calc);
+    unlink(path);
+}
+
+// A compiled piecewise formula written with if, which skips the branches not
+// taken, and as a branch-free sum of masks, which evaluates every piece
+static const char* bench_conditional_formulas[] = {
+    "if($x<0,0-$x^3,if($x<1,2$x^2+$x,$x+2))",
+    "($x<0)*(0-$x^3)+($x>=0)*($x<1)*(2$x^2+$x)+($x>=1)*($x+2)",
+};
+
+static void bench_conditionals(void) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/bench_conditionals_%ld.mep", (long)getpid());
+    printf("conditionals (compiled, x cycling over all three pieces)\n");
+    printf("%-60s%10s\n", "formula", "ns");
+
+    Calculator* calc = calculator_new();
+    for (size_t f = 0; f < sizeof(bench_conditional_formulas) / sizeof(bench_conditional_formulas[0]); f++) {
+        ProgramWriter* writer = program_writer_new();
+        program_writer_add(writer, "f", bench_conditional_formulas[f]);
+        program_writer_save(writer, path);
+        program_writer_free(writer);
+        ProgramLibrary* library = program_library_open(path);
+        if (!library) {
+            printf("%-60scould not compile\n", bench_conditional_formulas[f]);
+            continue;
+        }
+        long iterations = 0;
+        double start = now_seconds(), elapsed, value = 0.0;
+        do {
+            for (int i = 0; i < 1000; i++) {
+                double x = (double)(i % 7) * 0.5 - 1.5;
+                program_run(library, 0, calc, &x, &value);
+                checksum += value;
+            }
+            iterations += 1000;
+            elapsed = now_seconds() - start;
+        } while (elapsed < BENCH_MIN_SECONDS);
+        printf("%-60s%10.1f\n", bench_conditional_formulas[f], elapsed * 1e9 / (double)iterations);
+        program_library_close(library);
+    }
+    printf("\n");
+    calculator_free(calc);
+    unlink(path);
+}
+
+// One expression evaluated from scratch and served from the shared cache
+#define BENCH_CACHE_EXPRESSION "s(30)*l(1234.5)+(2^0.5-C(0.3))/7"
+
+static void bench_cache(void) {
+    char name[64];
+    snprintf(name, sizeof(name), "/mathengine-bench-%ld", (long)getpid());
+    ResultCache* cache = result_cache_open(name, 0);
+    if (!cache) {
+        printf("shared cache: could not open %s\n\n", name);
+        return;
+    }
+    printf("shared cache: %s\n", BENCH_CACHE_EXPRESSION);
+    printf("%-12s%12s\n", "path", "ns");
+
+    Calculator* calc = calculator_new();
+    for (int cached = 0; cached < 2; cached++) {
+        calculator_set_cache(calc, cached ? cache : NULL);
+        long iterations = 0;
+        double start = now_seconds(), elapsed;
+        do {
+            for (int i = 0; i < 1000; i++) {
+                calculator_evaluate(calc, BENCH_CACHE_EXPRESSION);
+                checksum += (double)calc->buffer[0];
+            }
+            iterations += 1000;
+            elapsed = now_seconds() - start;
+        } while (elapsed < BENCH_MIN_SECONDS);
+        printf("%-12s%12.1f\n", cached ? "hit" : "evaluate", elapsed * 1e9 / (double)iterations);
+    }
+    ResultCacheStats stats;
+    result_cache_stats(cache, &stats);
+    printf("hit rate %.4f\n\n", stats.hit_rate);
+    calculator_free(calc);
+    result_cache_close(cache);
+    result_cache_unlink(name);
+}
+
+// The real-only path: the stack push every number and operator result goes
+// through, and a scalar expression end to end. The other modes' side arrays
+// must not show up here.
+#define BENCH_REAL_EXPRESSION "(1.5+2.25)*3.75-4.5/1.25+s(30)*2.5-(0.75+1.125)*(2.5-0.5)"
+
+static void bench_real(void) {
+    static NumberStack stack;
+    long iterations = 0;
+    double start = now_seconds(), elapsed;
+    do {
+        stack.top = -1;
+        for (int i = 0; i < MAX_STACK_SIZE; i++) {
+            ns_push(&stack, (double)i);
+        }
+        checksum += stack.items[iterations % MAX_STACK_SIZE];
+        iterations++;
+        elapsed = now_seconds() - start;
+    } while (elapsed < BENCH_MIN_SECONDS);
+    printf("real path: %s\n", BENCH_REAL_EXPRESSION);
+    printf("%-12s%12.2f ns/push\n", "ns_push", elapsed * 1e9 / ((double)iterations * MAX_STACK_SIZE));
+
+    Calculator* calc = calculator_new();
+    double value = 0.0;
+    iterations = 0;
+    start = now_seconds();
+    do {
+        calculator_evaluate_value(calc, BENCH_REAL_EXPRESSION, &value);
+        checksum += value;
+        iterations++;
+        elapsed = now_seconds() - start;
+    } while (elapsed < BENCH_MIN_SECONDS);
+    printf("%-12s%12.1f ns/eval\n\n", "evaluate", elapsed * 1e9 / (double)iterations);
+    calculator_free(calc);
+}
+
+// The arithmetic the decimal modes exist for, in each number mode
+#define BENCH_DECIMAL_EXPRESSION "(19.99*3+4.25)/1.07-12.5%3+0.1*0.2"
+
+static void bench_decimal(void) {
+    static const struct { const char* name; NumberMode mode; } modes[] = {
+        { "real", NUMBER_MODE_REAL },
+        { "decimal64", NUMBER_MODE_DECIMAL64 },
+        { "decimal128", NUMBER_MODE_DECIMAL128 },
+    };
+    printf("decimal modes: %s\n", BENCH_DECIMAL_EXPRESSION);
+    printf("%-12s%12s%12s\n", "mode", "ns/eval", "vs real");
+    Calculator* calc = calculator_new();
+    double real = 0.0;
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        calculator_set_number_mode(calc, modes[m].mode);
+        long iterations = 0;
+        double start = now_seconds(), elapsed, value = 0.0;
+        do {
+            calculator_evaluate_value(calc, BENCH_DECIMAL_EXPRESSION, &value);
+            checksum += value;
+            iterations++;
+            elapsed = now_seconds() - start;
+        } while (elapsed < BENCH_MIN_SECONDS);
+        double ns = elapsed * 1e9 / (double)iterations;
+        if (m == 0) {
+            real = ns;
+        }
+        printf("%-12s%12.1f%11.2fx\n", modes[m].name, ns, ns / real);
+    }
+    printf("\n");
+    calculator_free(calc);
+}
+
+// Fixed-point kernels against the libm function on the same inputs. On a
+// host with an FPU the double column wins; the fixed column is the integer
+// instruction cost that carries over to targets without one.
+static const struct {
+    const char* name;
+    char op;
+    double from, to;
+    double (*reference)(double);
+} bench_fixed_cases[] = {
+    { "sin", 's', -10.0, 10.0, sin },
+    { "atan", 'T', -10.0, 10.0, atan },
+    { "ln", 'l', 0.01, 1000.0, log },
+    { "exp", 'E', -10.0, 10.0, exp },
+    { "sqrt", 'q', 0.0, 1000.0, sqrt },
+};
+
+static void bench_fixed(void) {
+    static Fixed fixed_in[BENCH_ELEMENTS], fixed_out[BENCH_ELEMENTS];
+    static double double_in[BENCH_ELEMENTS], double_out[BENCH_ELEMENTS];
+    printf("fixed point Q%d.%d\n", 31 - FIXED_FRACTION_BITS, FIXED_FRACTION_BITS);
+    printf("%-12s%12s%12s\n", "function", "fixed ns", "double ns");
+    for (size_t c = 0; c < sizeof(bench_fixed_cases) / sizeof(bench_fixed_cases[0]); c++) {
+        for (int i = 0; i < BENCH_ELEMENTS; i++) {
+            double u = (double)rand() / RAND_MAX;
+            fixed_in[i] = fixed_from_double(bench_fixed_cases[c].from + u * (bench_fixed_cases[c].to - bench_fixed_cases[c].from));
+            double_in[i] = fixed_to_double(fixed_in[i]);
+        }
+        double ns[2];
+        for (int fixed = 1; fixed >= 0; fixed--) {
+            long iterations = 0;
+            double start = now_seconds(), elapsed;
+            do {
+                for (int i = 0; i < BENCH_ELEMENTS; i++) {
+                    if (fixed) {
+                        fixed_apply_unary(bench_fixed_cases[c].op, RAD, fixed_in[i], &fixed_out[i]);
+                    } else {
+                        double_out[i] = bench_fixed_cases[c].reference(double_in[i]);
+                    }
+                }
+                checksum += fixed ? fixed_to_double(fixed_out[iterations % BENCH_ELEMENTS])
+                                  : double_out[iterations % BENCH_ELEMENTS];
+                iterations++;
+                elapsed = now_seconds() - start;
+            } while (elapsed < BENCH_MIN_SECONDS);
+            ns[fixed] = elapsed * 1e9 / ((double)iterations * BENCH_ELEMENTS);
+        }
+        printf("%-12s%12.1f%12.1f\n", bench_fixed_cases[c].name, ns[1], ns[0]);
+    }
+
+    Calculator* calc = calculator_new();
+    for (int fixed = 0; fixed < 2; fixed++) {
+        calculator_set_number_mode(calc, fixed ? NUMBER_MODE_FIXED : NUMBER_MODE_REAL);
+        long iterations = 0;
+        double start = now_seconds(), elapsed, value = 0.0;
+        do {
+            calculator_evaluate_value(calc, BENCH_DECIMAL_EXPRESSION, &value);
+            checksum += value;
+            iterations++;
+            elapsed = now_seconds() - start;
+        } while (elapsed < BENCH_MIN_SECONDS);
+        printf("%-12s%12.1f ns/eval\n", fixed ? "fixed mode" : "real mode", elapsed * 1e9 / (double)iterations);
+    }
+    printf("\n");
+    calculator_free(calc);
+}
+
+// Fraction arithmetic on doubles and exactly, once with every value inside
+// 128 bits and once past them on the big-integer fallback
+#define BENCH_RATIONAL_EXPRESSION "1/2+1/3+1/5+1/7+1/11+1/13-(3/4)^5*(8/9)^2"
+#define BENCH_RATIONAL_BIG_EXPRESSION "(2/3)^90+(5/7)^60-(1/3)^90"
+
+static void bench_rational(void) {
+    static const struct { const char* name; NumberMode mode; const char* expression; } cases[] = {
+        { "double", NUMBER_MODE_REAL, BENCH_RATIONAL_EXPRESSION },
+        { "rational", NUMBER_MODE_RATIONAL, BENCH_RATIONAL_EXPRESSION },
+        { "double big", NUMBER_MODE_REAL, BENCH_RATIONAL_BIG_EXPRESSION },
+        { "rat big", NUMBER_MODE_RATIONAL, BENCH_RATIONAL_BIG_EXPRESSION },
+    };
+    printf("rational mode: %s\n", BENCH_RATIONAL_EXPRESSION);
+    printf("%-12s%12s%12s\n", "path", "ns/eval", "vs double");
+    Calculator* calc = calculator_new();
+    double reference = 0.0;
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        calculator_set_number_mode(calc, cases[c].mode);
+        long iterations = 0;
+        double start = now_seconds(), elapsed, value = 0.0;
+        do {
+            calculator_evaluate_value(calc, cases[c].expression, &value);
+            checksum += value;
+            iterations++;
+            elapsed = now_seconds() - start;
+        } while (elapsed < BENCH_MIN_SECONDS);
+        double ns = elapsed * 1e9 / (double)iterations;
+        if (c % 2 == 0) {
+            reference = ns;
+        }
+        printf("%-12s%12.1f%11.2fx\n", cases[c].name, ns, ns / reference);
+    }
+    printf("\n");
+    calculator_free(calc);
+}
+
+// Batch special functions against the nearest libm routine, where there is
+// one; Bessel cases use order 1 and order 5
+static double libm_normal_cdf(double x) { return 0.5 * erfc(-x * M_SQRT1_2); }
+static double libm_beta(double a, double b) { return exp(lgamma(a) + lgamma(b) - lgamma(a + b)); }
+
+static void bench_special(void) {
+    static const struct {
+        const char* name;
+        SpecialFunction function;
+        double lo, hi, order;
+        double (*unary)(double);
+        double (*binary)(double, double);
+    } cases[] = {
+        { "erf", SPECIAL_ERF, -6.0, 6.0, 0.0, erf, NULL },
+        { "erfc", SPECIAL_ERFC, -6.0, 27.0, 0.0, erfc, NULL },
+        { "gamma", SPECIAL_GAMMA, 0.01, 170.0, 0.0, tgamma, NULL },
+        { "lgamma", SPECIAL_LGAMMA, 0.01, 1e6, 0.0, lgamma, NULL },
+        { "beta", SPECIAL_BETA, 0.1, 50.0, 0.0, NULL, libm_beta },
+        { "besselj 1", SPECIAL_BESSEL_J, 0.0, 50.0, 1.0, j1, NULL },
+        { "besselj 5", SPECIAL_BESSEL_J, 0.0, 50.0, 5.0, NULL, NULL },
+        { "bessely 1", SPECIAL_BESSEL_Y, 0.1, 50.0, 1.0, y1, NULL },
+        { "lambertw", SPECIAL_LAMBERT_W, -0.36, 100.0, 0.0, NULL, NULL },
+        { "normcdf", SPECIAL_NORMAL_CDF, -38.0, 8.0, 0.0, libm_normal_cdf, NULL },
+        { "norminv", SPECIAL_NORMAL_QUANTILE, 1e-12, 1.0 - 1e-12, 0.0, NULL, NULL },
+    };
+    double* x = malloc(BENCH_ELEMENTS * sizeof(double));
+    double* y = malloc(BENCH_ELEMENTS * sizeof(double));
+    double* out = malloc(BENCH_ELEMENTS * sizeof(double));
+    printf("special functions: ns/element\n");
+    printf("%-12s%12s%12s\n", "function", "special", "libm");
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        srand(42);
+        for (int i = 0; i < BENCH_ELEMENTS; i++) {
+            double u = cases[c].lo + (cases[c].hi - cases[c].lo) * rand() / RAND_MAX;
+            double v = cases[c].lo + (cases[c].hi - cases[c].lo) * rand() / RAND_MAX;
+            // Bessel functions take (order, x); beta takes two arguments
+            x[i] = special_arity(cases[c].function) == 2 && cases[c].function != SPECIAL_BETA ? cases[c].order : u;
+            y[i] = cases[c].function == SPECIAL_BETA ? v : u;
+        }
+        const double* second = special_arity(cases[c].function) == 2 ? y : NULL;
+        long iterations = 0;
+        double start = now_seconds(), elapsed;
+        do {
+            special_apply(cases[c].function, x, second, out, BENCH_ELEMENTS);
+            checksum += out[iterations % BENCH_ELEMENTS];
+            iterations++;
+            elapsed = now_seconds() - start;
+        } while (elapsed < BENCH_MIN_SECONDS);
+        double ns = elapsed * 1e9 / ((double)iterations * BENCH_ELEMENTS);
+        printf("%-12s%12.2f", cases[c].name, ns);
+
+        if (cases[c].unary == NULL && cases[c].binary == NULL) {
+            printf("%12s\n", "-");
+            continue;
+        }
+        // The Bessel references read x from y
+        const double* arg = cases[c].function == SPECIAL_BESSEL_J || cases[c].function == SPECIAL_BESSEL_Y ? y : x;
+        iterations = 0;
+        start = now_seconds();
+        do {
+            for (int i = 0; i < BENCH_ELEMENTS; i++) {
+                out[i] = cases[c].unary != NULL ? cases[c].unary(arg[i]) : cases[c].binary(x[i], y[i]);
+            }
+            checksum += out[iterations % BENCH_ELEMENTS];
+            iterations++;
+            elapsed = now_seconds() - start;
+        } while (elapsed < BENCH_MIN_SECONDS);
+        printf("%12.2f\n", elapsed * 1e9 / ((double)iterations * BENCH_ELEMENTS));
+    }
+    printf("\n");
+    free(x);
+    free(y);
+    free(out);
+}
+
+// Miller-Rabin on random odd 64-bit numbers, powmod against square-and-
+// multiply with a 128-bit division per step, and factoring semiprimes of two
+// 32-bit primes
+#define BENCH_NUMTHEORY_COUNT 256
+
+static uint64_t bench_random64(void) {
+    return ((uint64_t)rand() << 42) ^ ((uint64_t)rand() << 21) ^ (uint64_t)rand();
+}
+
+static uint64_t powmod_by_division(uint64_t base, uint64_t exponent, uint64_t m) {
+    uint64_t result = 1 % m;
+    base %= m;
+    while (exponent) {
+        if (exponent & 1) {
+            result = numtheory_mulmod(result, base, m);
+        }
+        base = numtheory_mulmod(base, base, m);
+        exponent >>= 1;
+    }
+    return result;
+}
+
+static void bench_numtheory(void) {
+    uint64_t n[BENCH_NUMTHEORY_COUNT], semiprimes[BENCH_NUMTHEORY_COUNT];
+    srand(42);
+    for (int i = 0; i < BENCH_NUMTHEORY_COUNT; i++) {
+        n[i] = bench_random64() | (1ULL << 63) | 1;
+        uint64_t p = (bench_random64() >> 32) | (1ULL << 31), q = (bench_random64() >> 32) | (1ULL << 31);
+        while (!numtheory_is_prime(p)) {
+            p++;
+        }
+        while (!numtheory_is_prime(q)) {
+            q++;
+        }
+        semiprimes[i] = p * q;
+    }
+
+    printf("number theory: 64-bit operands\n");
+    printf("%-20s%12s\n", "case", "ns/call");
+    for (int c = 0; c < 4; c++) {
+        static const char* names[] = {"isprime", "powmod", "powmod (division)", "factor semiprime"};
+        long iterations = 0;
+        double start = now_seconds(), elapsed;
+        do {
+            for (int i = 0; i < BENCH_NUMTHEORY_COUNT; i++) {
+                uint64_t x = n[i], e = n[(i + 1) % BENCH_NUMTHEORY_COUNT];
+                uint64_t factors[NUMTHEORY_MAX_FACTORS];
+                switch (c) {
+                    case 0: checksum += numtheory_is_prime(x); break;
+                    case 1: checksum += (double)numtheory_powmod(e, x - 1, x); break;
+                    case 2: checksum += (double)powmod_by_division(e, x - 1, x); break;
+                    default: checksum += numtheory_factor(semiprimes[i], factors); break;
+                }
+            }
+            iterations++;
+            elapsed = now_seconds() - start;
+        } while (elapsed < BENCH_MIN_SECONDS);
+        printf("%-20s%12.1f\n", names[c], elapsed * 1e9 / ((double)iterations * BENCH_NUMTHEORY_COUNT));
+    }
+    printf("\n");
+}
+
+// The same integer arithmetic on the automatic integer path, on doubles
+// (forced by writing the literals with a fraction) and in the programmer modes
+#define BENCH_INTEGER_EXPRESSION "(123456*789+98765)%1000003-4321*12+(77-5)*3"
+#define BENCH_DOUBLE_EXPRESSION "(123456.0*789+98765)%1000003-4321*12+(77-5)*3"
+
+static void bench_integer(void) {
+    static const struct { const char* name; NumberMode mode; const char* expression; } cases[] = {
+        { "double", NUMBER_MODE_REAL, BENCH_DOUBLE_EXPRESSION },
+        { "real/int", NUMBER_MODE_REAL, BENCH_INTEGER_EXPRESSION },
+        { "int64", NUMBER_MODE_INT64, BENCH_INTEGER_EXPRESSION },
+        { "int128", NUMBER_MODE_INT128, BENCH_INTEGER_EXPRESSION },
+    };
+    printf("integer path: %s\n", BENCH_INTEGER_EXPRESSION);
+    printf("%-12s%12s%12s\n", "path", "ns/eval", "vs double");
+    Calculator* calc = calculator_new();
+    double reference = 0.0;
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        calculator_set_number_mode(calc, cases[c].mode);
+        long iterations = 0;
+        double start = now_seconds(), elapsed, value = 0.0;
+        do {
+            calculator_evaluate_value(calc, cases[c].expression, &value);
+            checksum += value;
+            iterations++;
+            elapsed = now_seconds() - start;
+        } while (elapsed < BENCH_MIN_SECONDS);
+        double ns = elapsed * 1e9 / (double)iterations;
+        if (c == 0) {
+            reference = ns;
+        }
+        printf("%-12s%12.1f%11.2fx\n", cases[c].name, ns, ns / reference);
+    }
+    printf("\n");
+    calculator_free(calc);
+}
+
+// Tokenizing alone, without evaluation, on a compact expression and on one
+// with wide padding and long literals where the vector scans skip most bytes
+#define BENCH_LEXER_BYTES (64 << 10)
+
+static char* repeat_to_size(const char* unit, size_t size) {
+    char* text = (char*)malloc(size + 1);
+    size_t length = strlen(unit), used = 0;
+    if (!text) {
+        return NULL;
+    }
+    while (used + length <= size) {
+        memcpy(text + used, unit, length);
+        used += length;
+    }
+    text[used] = '\0';
+    return text;
+}
+
+static void bench_lexer(void) {
+    static const struct { const char* name; const char* unit; } inputs[] = {
+        { "compact", "12.5*(3+4)/7-2^3+" },
+        { "padded", "    3.14159265358979323846   *   (   1000000000000000000000   +   42   )   -  " },
+    };
+    LexTokens* tokens = lex_tokens_new();
+    LexerIsa best = lexer_best_isa();
+    printf("lexer: %d KiB inputs\n", BENCH_LEXER_BYTES >> 10);
+    printf("%-10s%-8s%12s%12s\n", "input", "isa", "GB/s", "ns/token");
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+        char* text = repeat_to_size(inputs[i].unit, BENCH_LEXER_BYTES);
+        if (!text || !tokens) {
+            free(text);
+            break;
+        }
+        size_t bytes = strlen(text);
+        for (LexerIsa isa = LEXER_ISA_SCALAR; isa <= best; isa++) {
+            lexer_set_isa(isa);
+            long iterations = 0;
+            double start = now_seconds(), elapsed;
+            do {
+                lexer_tokenize(tokens, text, NUMBER_MODE_REAL);
+                checksum += (double)tokens->count;
+                iterations++;
+                elapsed = now_seconds() - start;
+            } while (elapsed < BENCH_MIN_SECONDS);
+            printf("%-10s%-8s%12.2f%12.2f\n", inputs[i].name, lexer_isa_name(isa),
+                   (double)bytes * (double)iterations / elapsed / 1e9,
+                   elapsed * 1e9 / ((double)iterations * (double)tokens->count));
+        }
+        free(text);
+    }
+    lexer_set_isa(best);
+    lex_tokens_free(tokens);
+    printf("\n");
+}
+
+// Streaming summary of a generated column file: the in-memory update alone,
+// then whole-file passes with one to four workers
+#define BENCH_STATS_VALUES 1000000
+
+static void bench_stats(void) {
+    char path[128];
+    snprintf(path, sizeof(path), "/tmp/bench_stats_%ld.txt", (long)getpid());
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        return;
+    }
+    for (int i = 0; i < BENCH_STATS_VALUES; i++) {
+        fprintf(file, "%.9g\n", 100.0 * rand() / RAND_MAX - 50.0);
+    }
+    long bytes = ftell(file);
+    fclose(file);
+
+    printf("statistics: %d values, %.1f MB\n", BENCH_STATS_VALUES, (double)bytes / 1e6);
+    printf("%-12s%12s%12s\n", "pass", "ns/value", "MB/s");
+    StatsSummary* summary = stats_summary_new();
+    double start = now_seconds();
+    for (int i = 0; i < BENCH_STATS_VALUES; i++) {
+        stats_summary_add(summary, (double)i);
+    }
+    double elapsed = now_seconds() - start, value = 0.0;
+    stats_quantile(summary, 0.5, &value);
+    checksum += value;
+    stats_summary_free(summary);
+    printf("%-12s%12.1f%12s\n", "add", elapsed * 1e9 / BENCH_STATS_VALUES, "-");
+
+    for (int threads = 1; threads <= 4; threads *= 2) {
+        summary = stats_summary_new();
+        start = now_seconds();
+        stats_summary_add_file(summary, path, threads, NULL);
+        elapsed = now_seconds() - start;
+        stats_quantile(summary, 0.5, &value);
+        checksum += value;
+        stats_summary_free(summary);
+        char name[24];
+        snprintf(name, sizeof(name), "file x%d", threads);
+        printf("%-12s%12.1f%12.1f\n", name, elapsed * 1e9 / BENCH_STATS_VALUES, (double)bytes / elapsed / 1e6);
+    }
+    printf("\n");
+    unlink(path);
+}
+
+// One tick of a rolling z-score: push the sample, refresh the bound
+// aggregates and run the compiled formula, against summarizing the whole
+// window again each tick
+#define BENCH_ROLLING_TICKS 200000
+
+static void bench_rolling(void) {
+    static const size_t lengths[] = {16, 256, 4096};
+    ProgramWriter* writer = program_writer_new();
+    program_writer_add(writer, "z", "($x-$x_mean)/$x_sd+$x_max-$x_min");
+    ProgramLibrary* library = program_writer_load(writer);
+    program_writer_free(writer);
+    Calculator* calc = calculator_new();
+    double variables[8] = {0.0}, value = 0.0;
+
+    printf("rolling window: z-score formula per tick\n");
+    printf("%-10s%14s%14s\n", "length", "ns/tick", "rescan ns");
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        RollingWindow* window = rolling_window_new(lengths[l], 0.1);
+        RollingBinding* binding = rolling_binding_new(library, 0);
+        rolling_binding_add(binding, "x", window);
+        double start = now_seconds();
+        for (long i = 0; i < BENCH_ROLLING_TICKS; i++) {
+            rolling_window_push(window, (double)(i % 97) + 0.001 * (double)i);
+            if (i > 0 && rolling_binding_update(binding, variables) == ERROR_NONE &&
+                program_run(library, 0, calc, variables, &value) == ERROR_NONE) {
+                checksum += value;
+            }
+        }
+        double elapsed = now_seconds() - start;
+
+        // The same aggregates recomputed over a full window every tick
+        size_t n = lengths[l];
+        double* samples = (double*)calloc(n, sizeof(double));
+        long ticks = BENCH_ROLLING_TICKS / (long)n * 16;
+        double rescan_start = now_seconds();
+        for (long i = 0; i < ticks; i++) {
+            samples[(size_t)i % n] = (double)(i % 97) + 0.001 * (double)i;
+            double sum = 0.0, squares = 0.0, min = samples[0], max = samples[0];
+            for (size_t k = 0; k < n; k++) {
+                sum += samples[k];
+                min = fmin(min, samples[k]);
+                max = fmax(max, samples[k]);
+            }
+            for (size_t k = 0; k < n; k++) {
+                squares += (samples[k] - sum / (double)n) * (samples[k] - sum / (double)n);
+            }
+            checksum += sum + squares + min + max;
+        }
+        double rescan = now_seconds() - rescan_start;
+        printf("%-10zu%14.1f%14.1f\n", lengths[l], elapsed * 1e9 / BENCH_ROLLING_TICKS, rescan * 1e9 / (double)ticks);
+        free(samples);
+        rolling_binding_free(binding);
+        rolling_window_free(window);
+    }
+    printf("\n");
+    calculator_free(calc);
+    program_library_close(library);
+}
+
+int main(void) {
+    bench_vecmath();
+    bench_parallel();
+    bench_programs();
+    bench_rewrite();
+    bench_conditionals();
+    bench_cache();
+    bench_real();
+    bench_decimal();
+    bench_fixed();
+    bench_rational();
+    bench_special();
+    bench_numtheory();
+    bench_integer();
+    bench_stats();
+    bench_rolling();
+    bench_random();
+    bench_ode();
+    bench_sheet();
+    bench_trace();
+    bench_lexer();
+    // Keeps the results observable so no loop is optimized away
+    fprintf(stderr, "checksum %g\n", checksum);
+    return 0;
+}
@@ -3,12 +3,129 @@
 #include <string.h>
 #include <stdlib.h>
 #include "calculator_logic.h"
+#include "calculator_history.h"
+#include "calculator_replay.h"
+
+#define HISTORY_SEARCH_LIMIT 1000
+
+/* History list model: exposes the mapped history newest-first without
+ * materializing rows, so GtkListView only builds items for visible rows. */
+#define CALC_TYPE_HISTORY_MODEL (calc_history_model_get_type())
+G_DECLARE_FINAL_TYPE(CalcHistoryModel, calc_history_model, CALC, HISTORY_MODEL, GObject)
+
+struct _CalcHistoryModel {
+    GObject parent_instance;
+    History *history;
+    size_t *matches;    /* Filtered history indices, newest first; NULL shows everything */
+    guint n_matches;
+    char *query;
+    gboolean prefix;
+};
+
+static GType calc_history_model_get_item_type(GListModel *list G_GNUC_UNUSED) {
+    return GTK_TYPE_STRING_OBJECT;
+}
+
+static guint calc_history_model_get_n_items(GListModel *list) {
+    CalcHistoryModel *self = CALC_HISTORY_MODEL(list);
+    if (!self->history) {
+        return 0;
+    }
+    return self->matches ? self->n_matches : (guint)history_count(self->history);
+}
+
+static gboolean calc_history_model_get_entry(CalcHistoryModel *self, guint position, HistoryEntry *entry) {
+    if (position >= calc_history_model_get_n_items(G_LIST_MODEL(self))) {
+        return FALSE;
+    }
+    size_t index = self->matches ? self->matches[position] : history_count(self->history) - 1 - position;
+    return history_get(self->history, index, entry);
+}
+
+static gpointer calc_history_model_get_item(GListModel *list, guint position) {
+    HistoryEntry entry;
+    if (!calc_history_model_get_entry(CALC_HISTORY_MODEL(list), position, &entry)) {
+        return NULL;
+    }
+    char *text = g_strdup_printf("%s = %s", entry.expression, entry.result);
+    GtkStringObject *item = gtk_string_object_new(text);
+    g_free(text);
+    return item;
+}
+
+static void calc_history_model_list_model_init(GListModelInterface *iface) {
+    iface->get_item_type = calc_history_model_get_item_type;
+    iface->get_n_items = calc_history_model_get_n_items;
+    iface->get_item = calc_history_model_get_item;
+}
+
+G_DEFINE_TYPE_WITH_CODE(CalcHistoryModel, calc_history_model, G_TYPE_OBJECT,
+                        G_IMPLEMENT_INTERFACE(G_TYPE_LIST_MODEL, calc_history_model_list_model_init))
+
+static void calc_history_model_finalize(GObject *object) {
+    CalcHistoryModel *self = CALC_HISTORY_MODEL(object);
+    g_free(self->matches);
+    g_free(self->query);
+    G_OBJECT_CLASS(calc_history_model_parent_class)->finalize(object);
+}
+
+static void calc_history_model_class_init(CalcHistoryModelClass *klass) {
+    G_OBJECT_CLASS(klass)->finalize = calc_history_model_finalize;
+}
+
+static void calc_history_model_init(CalcHistoryModel *self G_GNUC_UNUSED) {
+}
+
+static CalcHistoryModel *calc_history_model_new(History *history) {
+    CalcHistoryModel *self = g_object_new(CALC_TYPE_HISTORY_MODEL, NULL);
+    self->history = history;
+    return self;
+}
+
+static void calc_history_model_refilter(CalcHistoryModel *self) {
+    guint old_count = calc_history_model_get_n_items(G_LIST_MODEL(self));
+
+    g_clear_pointer(&self->matches, g_free);
+    self->n_matches = 0;
+    if (self->history && self->query && self->query[0] != '\0') {
+        self->matches = g_new(size_t, HISTORY_SEARCH_LIMIT);
+        self->n_matches = (guint)history_search(self->history, self->query,
+                                                self->prefix ? HISTORY_MATCH_PREFIX : HISTORY_MATCH_SUBSTRING,
+                                                self->matches, HISTORY_SEARCH_LIMIT);
+    }
+
+    g_list_model_items_changed(G_LIST_MODEL(self), 0, old_count, calc_history_model_get_n_items(G_LIST_MODEL(self)));
+}
+
+static void calc_history_model_set_query(CalcHistoryModel *self, const char *query, gboolean prefix) {
+    g_free(self->query);
+    self->query = g_strdup(query);
+    self->prefix = prefix;
+    calc_history_model_refilter(self);
+}
+
+/* Called after an entry was appended to the underlying history */
+static void calc_history_model_appended(CalcHistoryModel *self) {
+    if (self->matches) {
+        calc_history_model_refilter(self);
+    } else {
+        g_list_model_items_changed(G_LIST_MODEL(self), 0, 0, 1);
+    }
+}
+
+typedef struct ReplayRun ReplayRun;
 
 typedef struct {
     GtkWidget *window;
     GtkWidget *entry;
     GtkWidget *grid;
+    GtkWidget *history_search;
+    GtkWidget *history_prefix;
     Calculator *calc;
+    History *history;
+    CalcHistoryModel *history_model;
+    guint scientific_idle;
+    ReplayRun *replay;
 } CalculatorApp;
 
 /* Forward declarations */
@@ -42,6 +159,33 @@ static void on_deg_rad_pressed(GtkWidget *widget, gpointer data) {
     gtk_button_set_label(GTK_BUTTON(widget), label);
 }
 
+static void on_number_mode_pressed(GtkWidget *widget, gpointer data) {
+    CalculatorApp *app = (CalculatorApp *)data;
+    // Cycles REAL -> CPLX -> D64 -> D128 -> I64 -> I128 -> FIX -> RAT -> REAL
+    static const char* const labels[] = { "REAL", "CPLX", "D64", "D128", "I64", "I128", "FIX", "RAT" };
+    NumberMode mode = (NumberMode)((calculator_get_number_mode(app->calc) + 1) % 8);
+    calculator_set_number_mode(app->calc, mode);
+    gtk_button_set_label(GTK_BUTTON(widget), labels[mode]);
+}
+
+/* Output base of the integer modes; re-evaluates the entry so a result on
+ * screen is converted in place. */
+static void on_base_pressed(GtkWidget *widget, gpointer data) {
+    CalculatorApp *app = (CalculatorApp *)data;
+    int base = calculator_get_output_base(app->calc);
+    base = base == 10 ? 16 : base == 16 ? 8 : base == 8 ? 2 : 10;
+    calculator_set_output_base(app->calc, base);
+    gtk_button_set_label(GTK_BUTTON(widget), base == 16 ? "HEX" : base == 8 ? "OCT" : base == 2 ? "BIN" : "DEC");
+
+    NumberMode mode = calculator_get_number_mode(app->calc);
+    if (mode == NUMBER_MODE_INT64 || mode == NUMBER_MODE_INT128) {
+        calculator_evaluate(app->calc, gtk_entry_buffer_get_text(gtk_entry_get_buffer(GTK_ENTRY(app->entry))));
+        if (app->calc->error == ERROR_NONE) {
+            update_display(app);
+        }
+    }
+}
+
 typedef struct {
     const char *label;
     char mapped_char;
@@ -100,7 +244,15 @@ static void on_button_pressed(GtkWidget *widget, gpointer data) {
     CalculatorApp *app = (CalculatorApp *)data;
     const char *label = gtk_button_get_label(GTK_BUTTON(widget));
     char mapped_char = lookup_function_mapping(label);
+    size_t length;
 
+    if (mapped_char == '\0' && calculator_named_operator(label, &length) != '\0') {
+        /* Operator words are typed out with spaces around them */
+        char word[16];
+        g_snprintf(word, sizeof(word), " %s ", label);
+        append_to_entry(GTK_ENTRY(app->entry), word);
+        return;
+    }
     if (mapped_char == '\0') {
         mapped_char = label[0];
     }
@@ -114,9 +266,96 @@ static void on_button_pressed(GtkWidget *widget, gpointer data) {
 static void evaluate_expression(CalculatorApp *app) {
     const char *expression = gtk_entry_buffer_get_text(gtk_entry_get_buffer(GTK_ENTRY(app->entry)));
     calculator_evaluate(app->calc, expression);
+    if (app->history && app->calc->error == ERROR_NONE &&
+        history_append(app->history, expression, calculator_get_display(app->calc),
+                       calculator_get_angle_mode(app->calc), g_get_real_time() / G_USEC_PER_SEC)) {
+        calc_history_model_appended(app->history_model);
+    }
     update_display(app);
 }
 
+static History *open_history(void) {
+    char *dir = g_build_filename(g_get_user_data_dir(), "mathengine", NULL);
+    char *path = g_build_filename(dir, "history.log", NULL);
+    History *history = NULL;
+
+    if (g_mkdir_with_parents(dir, 0700) == 0) {
+        history = history_open(path);
+    }
+    if (!history) {
+        g_warning("Failed to open history at %s", path);
+    }
+    g_free(path);
+    g_free(dir);
+    return history;
+}
+
+static void on_history_search_changed(GtkWidget *widget G_GNUC_UNUSED, gpointer data) {
+    CalculatorApp *app = (CalculatorApp *)data;
+    calc_history_model_set_query(app->history_model,
+                                 gtk_editable_get_text(GTK_EDITABLE(app->history_search)),
+                                 gtk_check_button_get_active(GTK_CHECK_BUTTON(app->history_prefix)));
+}
+
+static void on_history_activate(GtkListView *list G_GNUC_UNUSED, guint position, gpointer data) {
+    CalculatorApp *app = (CalculatorApp *)data;
+    HistoryEntry entry;
+    if (calc_history_model_get_entry(app->history_model, position, &entry)) {
+        /* The entry usually shows the last result, so the expression
+         * replaces it rather than being appended */
+        gtk_entry_buffer_set_text(gtk_entry_get_buffer(GTK_ENTRY(app->entry)), entry.expression, -1);
+        gtk_widget_grab_focus(app->entry);
+        gtk_editable_set_position(GTK_EDITABLE(app->entry), -1);
+    }
+}
+
+static void on_history_item_setup(GtkSignalListItemFactory *factory G_GNUC_UNUSED, GtkListItem *item, gpointer data G_GNUC_UNUSED) {
+    GtkWidget *label = gtk_label_new(NULL);
+    gtk_label_set_xalign(GTK_LABEL(label), 0.0);
+    gtk_label_set_ellipsize(GTK_LABEL(label), PANGO_ELLIPSIZE_END);
+    gtk_list_item_set_child(item, label);
+}
+
+static void on_history_item_bind(GtkSignalListItemFactory *factory G_GNUC_UNUSED, GtkListItem *item, gpointer data G_GNUC_UNUSED) {
+    GtkStringObject *string = GTK_STRING_OBJECT(gtk_list_item_get_item(item));
+    gtk_label_set_text(GTK_LABEL(gtk_list_item_get_child(item)), gtk_string_object_get_string(string));
+}
+
+static GtkWidget *create_history_pane(CalculatorApp *app) {
+    GtkWidget *pane = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
+    gtk_widget_set_size_request(pane, 240, -1);
+    gtk_widget_add_css_class(pane, "history");
+
+    GtkWidget *search_row = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
+    app->history_search = gtk_search_entry_new();
+    gtk_widget_set_hexpand(app->history_search, TRUE);
+    app->history_prefix = gtk_check_button_new_with_label("Prefix");
+    g_signal_connect(app->history_search, "search-changed", G_CALLBACK(on_history_search_changed), app);
+    g_signal_connect(app->history_prefix, "toggled", G_CALLBACK(on_history_search_changed), app);
+    gtk_box_append(GTK_BOX(search_row), app->history_search);
+    gtk_box_append(GTK_BOX(search_row), app->history_prefix);
+    gtk_box_append(GTK_BOX(pane), search_row);
+
+    app->history_model = calc_history_model_new(app->history);
+    GtkListItemFactory *factory = gtk_signal_list_item_factory_new();
+    g_signal_connect(factory, "setup", G_CALLBACK(on_history_item_setup), NULL);
+    g_signal_connect(factory, "bind", G_CALLBACK(on_history_item_bind), NULL);
+
+    /* The selection model and list view take ownership of the model and factory */
+    GtkNoSelection *selection = gtk_no_selection_new(G_LIST_MODEL(g_object_ref(app->history_model)));
+    GtkWidget *list = gtk_list_view_new(GTK_SELECTION_MODEL(selection), factory);
+    gtk_list_view_set_single_click_activate(GTK_LIST_VIEW(list), TRUE);
+    g_signal_connect(list, "activate", G_CALLBACK(on_history_activate), app);
+
+    GtkWidget *scrolled = gtk_scrolled_window_new();
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scrolled), list);
+    gtk_widget_set_vexpand(scrolled, TRUE);
+    gtk_box_append(GTK_BOX(pane), scrolled);
+
+    return pane;
+}
+
 static void on_entry_activate(GtkEntry *entry G_GNUC_UNUSED, gpointer data) {
     evaluate_expression((CalculatorApp *)data);
 }
@@ -148,70 +387,231 @@ static GtkWidget* create_button(const char *label, GCallback callback, gpointer
     return button;
 }
 
-static void on_window_destroy(GtkWidget *widget, gpointer data) {
+static void replay_free(ReplayRun *run);
+
+static void on_window_destroy(GtkWidget *widget G_GNUC_UNUSED, gpointer data) {
     CalculatorApp *app = (CalculatorApp *)data;
+    if (app->scientific_idle) {
+        g_source_remove(app->scientific_idle);
+    }
+    if (app->replay) {
+        replay_free(app->replay);
+    }
+    /* The list view may outlive this handler; detach the model first */
+    app->history_model->history = NULL;
+    g_object_unref(app->history_model);
+    history_close(app->history);
     calculator_free(app->calc);
     free(app);
 }
 
-static void create_calculator_window(GtkApplication *app_gtk, gpointer user_data) {
-    CalculatorApp *app = (CalculatorApp *)calloc(1, sizeof(CalculatorApp));
-    if (!app) {
-        g_warning("Failed to allocate CalculatorApp");
-        return;
+/* Startup profiling, enabled with CALCULATOR_PROFILE_STARTUP=1. Times are
+ * measured from entry to main(). */
+static gint64 startup_begin_us;
+static gboolean startup_profile;
+
+typedef struct {
+    gint64 activate;
+    gint64 ui_loaded;
+    gint64 css_loaded;
+    gint64 first_frame;
+} StartupMarks;
+
+static StartupMarks startup_marks;
+
+static double startup_ms(gint64 mark) {
+    return (double)(mark - startup_begin_us) / 1000.0;
+}
+
+static void startup_mark(gint64 *mark) {
+    if (startup_profile && *mark == 0) {
+        *mark = g_get_monotonic_time();
     }
+}
 
-    app->calc = calculator_new();
-    if (!app->calc) {
-        g_warning("Failed to allocate Calculator");
-        free(app);
-        return;
+/* Interaction replay, enabled with CALCULATOR_REPLAY=<script>. GTK 4 cannot
+ * inject input events, so each event is delivered through the signal or
+ * editable call its real counterpart ends in, then a frame is requested and
+ * awaited. The timings are printed and the window closed when the script
+ * ends. */
+#define REPLAY_FRAME_TIMEOUT_MS 1000
+
+static ReplayScript *replay_script;
+static int replay_status;
+
+struct ReplayRun {
+    CalculatorApp *app;
+    ReplayStats *stats;
+    /* Button label at the start of the run to grid button */
+    GHashTable *buttons;
+    GdkFrameClock *clock;
+    gulong before_paint_handler;
+    gulong after_paint_handler;
+    size_t next;
+    int loop;
+    /* When the event waiting for its frame was dispatched, or 0 */
+    gint64 dispatched;
+    gint64 paint_begin;
+    guint source;
+};
+
+static double replay_ms(gint64 begin, gint64 end) {
+    return (double)(end - begin) / 1000.0;
+}
+
+static void replay_free(ReplayRun *run) {
+    if (run->source) {
+        g_source_remove(run->source);
     }
+    if (run->clock) {
+        g_signal_handler_disconnect(run->clock, run->before_paint_handler);
+        g_signal_handler_disconnect(run->clock, run->after_paint_handler);
+        g_object_unref(run->clock);
+    }
+    g_hash_table_destroy(run->buttons);
+    replay_stats_free(run->stats);
+    run->app->replay = NULL;
+    free(run);
+}
 
-    app->window = gtk_application_window_new(app_gtk);
-    if (!app->window) {
-        g_warning("Failed to create application window");
-        calculator_free(app->calc);
-        free(app);
-        return;
+static void replay_finish(ReplayRun *run) {
+    CalculatorApp *app = run->app;
+    replay_stats_print(run->stats, stdout);
+    replay_free(run);
+    gtk_window_destroy(GTK_WINDOW(app->window));
+}
+
+static void replay_advance(ReplayRun *run);
+
+static gboolean replay_step(gpointer data) {
+    ReplayRun *run = (ReplayRun *)data;
+    run->source = 0;
+    replay_advance(run);
+    return G_SOURCE_REMOVE;
+}
+
+/* No frame came, e.g. because the window is hidden: move on without a sample */
+static gboolean on_replay_frame_timeout(gpointer data) {
+    ReplayRun *run = (ReplayRun *)data;
+    run->source = 0;
+    run->dispatched = 0;
+    replay_advance(run);
+    return G_SOURCE_REMOVE;
+}
+
+static void on_replay_before_paint(GdkFrameClock *clock G_GNUC_UNUSED, gpointer data) {
+    ((ReplayRun *)data)->paint_begin = g_get_monotonic_time();
+}
+
+static void on_replay_after_paint(GdkFrameClock *clock G_GNUC_UNUSED, gpointer data) {
+    ReplayRun *run = (ReplayRun *)data;
+    gint64 now = g_get_monotonic_time();
+    if (run->paint_begin) {
+        replay_stats_add(run->stats, REPLAY_SERIES_FRAME, replay_ms(run->paint_begin, now));
+        run->paint_begin = 0;
     }
-    gtk_window_set_title(GTK_WINDOW(app->window), "Google Calculator");
-    gtk_window_set_default_size(GTK_WINDOW(app->window), 400, 550);
-    gtk_window_set_resizable(GTK_WINDOW(app->window), TRUE);
-    g_signal_connect(app->window, "destroy", G_CALLBACK(on_window_destroy), app);
+    if (run->dispatched) {
+        replay_stats_add(run->stats, REPLAY_SERIES_INPUT_TO_FRAME, replay_ms(run->dispatched, now));
+        run->dispatched = 0;
+        if (run->source) {
+            g_source_remove(run->source);
+        }
+        run->source = g_idle_add(replay_step, run);
+    }
+}
 
-    GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 10);
-    gtk_widget_set_margin_top(vbox, 10);
-    gtk_widget_set_margin_bottom(vbox, 10);
-    gtk_widget_set_margin_start(vbox, 10);
-    gtk_widget_set_margin_end(vbox, 10);
-    gtk_window_set_child(GTK_WINDOW(app->window), vbox);
-
-    /* Display */
-    app->entry = gtk_entry_new();
-    gtk_widget_set_halign(app->entry, GTK_ALIGN_FILL);
-    gtk_widget_set_valign(app->entry, GTK_ALIGN_CENTER);
-    gtk_widget_add_css_class(app->entry, "display");
-    gtk_entry_set_alignment(GTK_ENTRY(app->entry), 1.0);
-    gtk_editable_set_editable(GTK_EDITABLE(app->entry), TRUE);
-    gtk_widget_set_can_focus(app->entry, TRUE);
-    g_signal_connect(app->entry, "activate", G_CALLBACK(on_entry_activate), app);
-    
-    gtk_box_append(GTK_BOX(vbox), app->entry);
-    gtk_widget_set_vexpand(app->entry, FALSE);
+static void replay_dispatch(ReplayRun *run, const ReplayEvent *event) {
+    CalculatorApp *app = run->app;
+    GtkEditable *editable = GTK_EDITABLE(app->entry);
+    gint64 start = g_get_monotonic_time();
+
+    if (event->kind == REPLAY_BUTTON) {
+        g_signal_emit_by_name(g_hash_table_lookup(run->buttons, event->text), "clicked");
+    } else if (strcmp(event->text, "Return") == 0) {
+        g_signal_emit_by_name(app->entry, "activate");
+    } else if (strcmp(event->text, "BackSpace") == 0) {
+        int position = gtk_editable_get_position(editable);
+        if (position > 0) {
+            gtk_editable_delete_text(editable, position - 1, position);
+        }
+    } else {
+        /* What the entry does with a committed character */
+        int position = gtk_editable_get_position(editable);
+        gtk_editable_insert_text(editable, event->text, -1, &position);
+        gtk_editable_set_position(editable, position);
+    }
 
-    update_display(app);
-    gtk_widget_grab_focus(app->entry);
+    replay_stats_add(run->stats, event->kind == REPLAY_BUTTON ? REPLAY_SERIES_BUTTON : REPLAY_SERIES_KEY,
+                     replay_ms(start, g_get_monotonic_time()));
+    /* Events that change nothing on screen still get their frame */
+    run->dispatched = start;
+    gtk_widget_queue_draw(app->entry);
+    run->source = g_timeout_add(REPLAY_FRAME_TIMEOUT_MS, on_replay_frame_timeout, run);
+}
 
-    /* Grid of buttons */
-    app->grid = gtk_grid_new();
-    gtk_grid_set_row_spacing(GTK_GRID(app->grid), 8);
-    gtk_grid_set_column_spacing(GTK_GRID(app->grid), 8);
-    gtk_grid_set_row_homogeneous(GTK_GRID(app->grid), TRUE);
-    gtk_grid_set_column_homogeneous(GTK_GRID(app->grid), TRUE);
-    gtk_box_append(GTK_BOX(vbox), app->grid);
-    gtk_widget_set_vexpand(app->grid, TRUE);
-    gtk_widget_set_hexpand(app->grid, TRUE);
+static void replay_advance(ReplayRun *run) {
+    if (run->next == replay_script->count) {
+        run->next = 0;
+        if (++run->loop == replay_script->loops) {
+            replay_finish(run);
+            return;
+        }
+    }
+    const ReplayEvent *event = &replay_script->events[run->next++];
+    if (event->kind == REPLAY_WAIT) {
+        run->source = g_timeout_add(event->wait_ms, replay_step, run);
+    } else {
+        replay_dispatch(run, event);
+    }
+}
+
+/* Runs once every button is in the grid */
+static void replay_start(CalculatorApp *app) {
+    ReplayRun *run = (ReplayRun *)calloc(1, sizeof(ReplayRun));
+    if (!run || !(run->stats = replay_stats_new())) {
+        g_printerr("replay: out of memory\n");
+        free(run);
+        replay_status = 1;
+        gtk_window_destroy(GTK_WINDOW(app->window));
+        return;
+    }
+    run->app = app;
+    app->replay = run;
+    /* Keys are copies: DEG, REAL and DEC relabel themselves when pressed,
+     * which frees the label GTK handed out */
+    run->buttons = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    for (GtkWidget *child = gtk_widget_get_first_child(app->grid); child; child = gtk_widget_get_next_sibling(child)) {
+        if (GTK_IS_BUTTON(child) && gtk_button_get_label(GTK_BUTTON(child))) {
+            g_hash_table_insert(run->buttons, g_strdup(gtk_button_get_label(GTK_BUTTON(child))), child);
+        }
+    }
+    for (size_t i = 0; i < replay_script->count; i++) {
+        const ReplayEvent *event = &replay_script->events[i];
+        if (event->kind == REPLAY_BUTTON && !g_hash_table_contains(run->buttons, event->text)) {
+            g_printerr("replay: no button labelled \"%s\"\n", event->text);
+            replay_status = 1;
+            replay_free(run);
+            gtk_window_destroy(GTK_WINDOW(app->window));
+            return;
+        }
+    }
+
+    /* Without a frame clock (window not realized) every event ends on its
+     * frame timeout and only the dispatch times are recorded */
+    GdkFrameClock *clock = gtk_widget_get_frame_clock(app->window);
+    if (clock) {
+        run->clock = g_object_ref(clock);
+        run->before_paint_handler = g_signal_connect(run->clock, "before-paint", G_CALLBACK(on_replay_before_paint), run);
+        run->after_paint_handler = g_signal_connect(run->clock, "after-paint", G_CALLBACK(on_replay_after_paint), run);
+    }
+    run->source = g_idle_add(replay_step, run);
+}
+
+/* Row 0-3 scientific keys; built from an idle callback once the first frame
+ * is on screen since none of them are needed to show the window. */
+static gboolean build_scientific_block(gpointer data) {
+    CalculatorApp *app = (CalculatorApp *)data;
+    app->scientific_idle = 0;
 
     /* Row 0: Scientific Functions */
     GtkWidget *btn_deg_rad = create_button("DEG", G_CALLBACK(on_deg_rad_pressed), app, "btn-function");
@@ -257,151 +657,130 @@ static void create_calculator_window(GtkApplication *app_gtk, gpointer user_data
     gtk_grid_attach(GTK_GRID(app->grid), btn_pi, 2, 3, 1, 1);
     gtk_grid_attach(GTK_GRID(app->grid), btn_e, 3, 3, 1, 1);
 
-    /* Row 4: C, ←, %, / */
-    GtkWidget *btn_c = create_button("C", G_CALLBACK(on_clear_pressed), app, "btn-function");
-    GtkWidget *btn_backspace = create_button("←", G_CALLBACK(on_backspace_pressed), app, "btn-function");
-    GtkWidget *btn_percent = create_button("%", G_CALLBACK(on_button_pressed), app, "btn-operator");
-    GtkWidget *btn_divide = create_button("÷", G_CALLBACK(on_button_pressed), app, "btn-operator");
-    
-    gtk_grid_attach(GTK_GRID(app->grid), btn_c, 0, 4, 1, 1);
-    gtk_grid_attach(GTK_GRID(app->grid), btn_backspace, 1, 4, 1, 1);
-    gtk_grid_attach(GTK_GRID(app->grid), btn_percent, 2, 4, 1, 1);
-    gtk_grid_attach(GTK_GRID(app->grid), btn_divide, 3, 4, 1, 1);
-
-    /* Row 5: 7, 8, 9, × */
-    GtkWidget *btn_7 = create_button("7", G_CALLBACK(on_button_pressed), app, "btn-digit");
-    GtkWidget *btn_8 = create_button("8", G_CALLBACK(on_button_pressed), app, "btn-digit");
-    GtkWidget *btn_9 = create_button("9", G_CALLBACK(on_button_pressed), app, "btn-digit");
-    GtkWidget *btn_multiply = create_button("×", G_CALLBACK(on_button_pressed), app, "btn-operator");
-    
-    gtk_grid_attach(GTK_GRID(app->grid), btn_7, 0, 5, 1, 1);
-    gtk_grid_attach(GTK_GRID(app->grid), btn_8, 1, 5, 1, 1);
-    gtk_grid_attach(GTK_GRID(app->grid), btn_9, 2, 5, 1, 1);
-    gtk_grid_attach(GTK_GRID(app->grid), btn_multiply, 3, 5, 1, 1);
-
-    /* Row 6: 4, 5, 6, − */
-    GtkWidget *btn_4 = create_button("4", G_CALLBACK(on_button_pressed), app, "btn-digit");
-    GtkWidget *btn_5 = create_button("5", G_CALLBACK(on_button_pressed), app, "btn-digit");
-    GtkWidget *btn_6 = create_button("6", G_CALLBACK(on_button_pressed), app, "btn-digit");
-    GtkWidget *btn_minus = create_button("−", G_CALLBACK(on_button_pressed), app, "btn-operator");
-    
-    gtk_grid_attach(GTK_GRID(app->grid), btn_4, 0, 6, 1, 1);
-    gtk_grid_attach(GTK_GRID(app->grid), btn_5, 1, 6, 1, 1);
-    gtk_grid_attach(GTK_GRID(app->grid), btn_6, 2, 6, 1, 1);
-    gtk_grid_attach(GTK_GRID(app->grid), btn_minus, 3, 6, 1, 1);
-
-    /* Row 7: 1, 2, 3, + */
-    GtkWidget *btn_1 = create_button("1", G_CALLBACK(on_button_pressed), app, "btn-digit");
-    GtkWidget *btn_2 = create_button("2", G_CALLBACK(on_button_pressed), app, "btn-digit");
-    GtkWidget *btn_3 = create_button("3", G_CALLBACK(on_button_pressed), app, "btn-digit");
-    GtkWidget *btn_plus = create_button("+", G_CALLBACK(on_button_pressed), app, "btn-operator");
-    
-    gtk_grid_attach(GTK_GRID(app->grid), btn_1, 0, 7, 1, 1);
-    gtk_grid_attach(GTK_GRID(app->grid), btn_2, 1, 7, 1, 1);
-    gtk_grid_attach(GTK_GRID(app->grid), btn_3, 2, 7, 1, 1);
-    gtk_grid_attach(GTK_GRID(app->grid), btn_plus, 3, 7, 1, 1);
-
-    /* Row 8: 0, ., 1/x, = */
-    GtkWidget *btn_0 = create_button("0", G_CALLBACK(on_button_pressed), app, "btn-digit");
-    GtkWidget *btn_dot = create_button(".", G_CALLBACK(on_button_pressed), app, "btn-digit");
-    GtkWidget *btn_reciprocal = create_button("1/x", G_CALLBACK(on_button_pressed), app, "btn-function");
-    GtkWidget *btn_equals = create_button("=", G_CALLBACK(on_equals_pressed), app, "btn-equals");
-    
-    gtk_grid_attach(GTK_GRID(app->grid), btn_0, 0, 8, 1, 1);
-    gtk_grid_attach(GTK_GRID(app->grid), btn_dot, 1, 8, 1, 1);
-    gtk_grid_attach(GTK_GRID(app->grid), btn_reciprocal, 2, 8, 1, 1);
-    gtk_grid_attach(GTK_GRID(app->grid), btn_equals, 3, 8, 1, 1);
+    if (startup_profile) {
+        g_printerr("startup: activate %.1f ms, ui %.1f ms, css %.1f ms, first frame %.1f ms, scientific keys %.1f ms\n",
+                   startup_ms(startup_marks.activate), startup_ms(startup_marks.ui_loaded), startup_ms(startup_marks.css_loaded),
+                   startup_ms(startup_marks.first_frame), startup_ms(g_get_monotonic_time()));
+    }
+    if (replay_script) {
+        replay_start(app);
+    }
+    return G_SOURCE_REMOVE;
+}
 
-    /* Row 9: Factorial and Negate */
-    GtkWidget *btn_factorial = create_button("!", G_CALLBACK(on_button_pressed), app, "btn-function");
-    GtkWidget *btn_negate = create_button("+/−", G_CALLBACK(on_button_pressed), app, "btn-function");
-    gtk_grid_attach(GTK_GRID(app->grid), btn_factorial, 0, 9, 2, 1);
-    gtk_grid_attach(GTK_GRID(app->grid), btn_negate, 2, 9, 2, 1);
+static void on_first_frame(GdkFrameClock *clock, gpointer data) {
+    CalculatorApp *app = (CalculatorApp *)data;
+    startup_mark(&startup_marks.first_frame);
+    if (clock) {
+        g_signal_handlers_disconnect_by_func(clock, G_CALLBACK(on_first_frame), data);
+    }
+    app->scientific_idle = g_idle_add(build_scientific_block, app);
+}
 
-    /* Apply CSS styling */
-    const char *css_str = 
-        "entry.display { "
-        "  font-family: 'DejaVu Sans Mono', monospace; "
-        "  font-weight: bold; "
-        "  padding: 20px; "
-        "  background-color: #fef9e7; "
-        "  border-radius: 8px; "
-        "  color: #2c2412; "
-        "  font-size: 24px;"
-        "} "
-        "button { "
-        "  font-size: 16px; "
-        "  padding: 10px; "
-        "  font-weight: bold; "
-        "  border-radius: 4px; "
-        "  border: none; "
-        "  min-width: 60px; "
-        "  min-height: 40px; "
-        "} "
-        "button.btn-digit { "
-        "  background-color: #FFF59D; "
-        "  color: #2c2412; "
-        "  border: 1px solid #d4a017; "
-        "} "
-        "button.btn-digit:hover { "
-        "  background-color: #FFE082; "
-        "} "
-        "button.btn-digit:active { "
-        "  background-color: #FFD54F; "
-        "} "
-        "button.btn-operator { "
-        "  background-color: #FFC107; "
-        "  color: #1f1502; "
-        "  border: 1px solid #b28704; "
-        "} "
-        "button.btn-operator:hover { "
-        "  background-color: #FFB300; "
-        "} "
-        "button.btn-operator:active { "
-        "  background-color: #FFA000; "
-        "} "
-        "button.btn-function { "
-        "  background-color: #FFECB3; "
-        "  color: #2c2412; "
-        "  border: 1px solid #d4a017; "
-        "} "
-        "button.btn-function:hover { "
-        "  background-color: #FFE082; "
-        "} "
-        "button.btn-function:active { "
-        "  background-color: #FFD54F; "
-        "} "
-        "button.btn-equals { "
-        "  background-color: #FFB300; "
-        "  color: #1f1502; "
-        "  border: 1px solid #b28704; "
-        "} "
-        "button.btn-equals:hover { "
-        "  background-color: #FFA000; "
-        "} "
-        "button.btn-equals:active { "
-        "  background-color: #FF8F00; "
-        "} ";
+static void on_window_map(GtkWidget *widget, gpointer data) {
+    GdkFrameClock *clock = gtk_widget_get_frame_clock(widget);
+    g_signal_handlers_disconnect_by_func(widget, G_CALLBACK(on_window_map), data);
+    if (clock) {
+        g_signal_connect(clock, "after-paint", G_CALLBACK(on_first_frame), data);
+    } else {
+        on_first_frame(NULL, data);
+    }
+}
 
+/* Keypad buttons from the UI definition; the ones with an id have their own
+ * handler, every other button inserts its label. */
+static void connect_keypad(GtkBuilder *builder, CalculatorApp *app) {
+    g_signal_connect(gtk_builder_get_object(builder, "btn_clear"), "clicked", G_CALLBACK(on_clear_pressed), app);
+    g_signal_connect(gtk_builder_get_object(builder, "btn_backspace"), "clicked", G_CALLBACK(on_backspace_pressed), app);
+    g_signal_connect(gtk_builder_get_object(builder, "btn_equals"), "clicked", G_CALLBACK(on_equals_pressed), app);
+    g_signal_connect(gtk_builder_get_object(builder, "btn_number_mode"), "clicked", G_CALLBACK(on_number_mode_pressed), app);
+    g_signal_connect(gtk_builder_get_object(builder, "btn_base"), "clicked", G_CALLBACK(on_base_pressed), app);
+
+    for (GtkWidget *child = gtk_widget_get_first_child(app->grid); child; child = gtk_widget_get_next_sibling(child)) {
+        if (GTK_IS_BUTTON(child) && gtk_buildable_get_buildable_id(GTK_BUILDABLE(child)) == NULL) {
+            g_signal_connect(child, "clicked", G_CALLBACK(on_button_pressed), app);
+        }
+    }
+}
+
+static void create_calculator_window(GtkApplication *app_gtk, gpointer user_data G_GNUC_UNUSED) {
+    startup_mark(&startup_marks.activate);
+
+    CalculatorApp *app = (CalculatorApp *)calloc(1, sizeof(CalculatorApp));
+    if (!app) {
+        g_warning("Failed to allocate CalculatorApp");
+        return;
+    }
+
+    app->calc = calculator_new();
+    if (!app->calc) {
+        g_warning("Failed to allocate Calculator");
+        free(app);
+        return;
+    }
+
+    GtkBuilder *builder = gtk_builder_new_from_resource("/com/example/calculator/calculator.ui");
+    app->window = GTK_WIDGET(gtk_builder_get_object(builder, "window"));
+    if (!app->window) {
+        g_warning("Failed to create application window");
+        g_object_unref(builder);
+        calculator_free(app->calc);
+        free(app);
+        return;
+    }
+    app->entry = GTK_WIDGET(gtk_builder_get_object(builder, "entry"));
+    app->grid = GTK_WIDGET(gtk_builder_get_object(builder, "grid"));
+    gtk_window_set_application(GTK_WINDOW(app->window), app_gtk);
+    g_signal_connect(app->window, "destroy", G_CALLBACK(on_window_destroy), app);
+    g_signal_connect(app->entry, "activate", G_CALLBACK(on_entry_activate), app);
+    connect_keypad(builder, app);
+
+    app->history = open_history();
+    gtk_box_append(GTK_BOX(gtk_builder_get_object(builder, "hbox")), create_history_pane(app));
+    g_object_unref(builder);
+    startup_mark(&startup_marks.ui_loaded);
+
+    update_display(app);
+    gtk_widget_grab_focus(app->entry);
+
+    /* Apply CSS styling */
     GtkCssProvider *css_provider = gtk_css_provider_new();
-    gtk_css_provider_load_from_string(css_provider, css_str);
+    gtk_css_provider_load_from_resource(css_provider, "/com/example/calculator/calculator.css");
     gtk_style_context_add_provider_for_display(
         gdk_display_get_default(),
         GTK_STYLE_PROVIDER(css_provider),
         GTK_STYLE_PROVIDER_PRIORITY_APPLICATION
     );
     g_object_unref(css_provider);
+    startup_mark(&startup_marks.css_loaded);
 
-    gtk_widget_add_css_class(app->grid, "grid");
-    gtk_widget_add_css_class(app->entry, "display");
-
+    g_signal_connect(app->window, "map", G_CALLBACK(on_window_map), app);
     gtk_window_present(GTK_WINDOW(app->window));
 }
 
 int main(int argc, char *argv[]) {
+    startup_begin_us = g_get_monotonic_time();
+    startup_profile = g_getenv("CALCULATOR_PROFILE_STARTUP") != NULL;
+
+    const char *replay_path = g_getenv("CALCULATOR_REPLAY");
+    if (replay_path) {
+        size_t error_line;
+        replay_script = replay_script_load(replay_path, &error_line);
+        if (!replay_script || replay_script->count == 0) {
+            if (error_line) {
+                g_printerr("%s:%zu: invalid replay event\n", replay_path, error_line);
+            } else {
+                g_printerr("%s: no replay events\n", replay_path);
+            }
+            replay_script_free(replay_script);
+            return 1;
+        }
+    }
+
     GtkApplication *app_gtk = gtk_application_new("com.example.calculator", G_APPLICATION_DEFAULT_FLAGS);
     g_signal_connect(app_gtk, "activate", G_CALLBACK(create_calculator_window), NULL);
     int status = g_application_run(G_APPLICATION(app_gtk), argc, argv);
     g_object_unref(app_gtk);
-    return status;
+    replay_script_free(replay_script);
+    return status ? status : replay_status;
 }
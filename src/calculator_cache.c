@@ -0,0 +1,389 @@
+#define _GNU_SOURCE
+#include "calculator_cache.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// "MECACHE" and the layout version
+#define CACHE_MAGIC 0x014548434143454dULL
+#define CACHE_WAYS 8
+#define CACHE_STRIPES 16
+#define CACHE_LINE 64
+#define CACHE_MAX_SETS ((size_t)1 << 24)
+#define CACHE_READ_ATTEMPTS 4
+#define CACHE_EXPRESSION_WORDS (RESULT_CACHE_MAX_EXPRESSION / 8)
+#define CACHE_TEXT_WORDS (RESULT_CACHE_TEXT_SIZE / 8)
+
+// Every field is a word read and written atomically, so a reader racing a
+// store sees stale or torn values but never undefined behavior; the seqlock
+// tells it to throw them away.
+typedef struct {
+    // Low 32 bits: sequence, odd while a store is in progress. High 32 bits:
+    // pid of the storing process.
+    _Atomic uint64_t lock;
+    // Clock reference bit, set by hits and cleared as the hand passes
+    _Atomic uint64_t referenced;
+    // 0 for an empty slot
+    _Atomic uint64_t hash;
+    // angle mode | expression length << 8 | context << 32
+    _Atomic uint64_t key;
+    _Atomic uint64_t error;
+    _Atomic uint64_t value;
+    _Atomic uint64_t expression[CACHE_EXPRESSION_WORDS];
+    _Atomic uint64_t text[CACHE_TEXT_WORDS];
+} CacheSlot;
+
+_Static_assert(sizeof(CacheSlot) == 4 * CACHE_LINE, "slot is four cache lines");
+
+typedef struct {
+    _Atomic uint64_t magic;
+    uint64_t set_count;
+    uint64_t reserved[6];
+} CacheHeader;
+
+// Statistics are split across cache lines by pid so that processes do not
+// all write the same line on every lookup
+typedef struct {
+    _Atomic uint64_t lookups;
+    _Atomic uint64_t hits;
+    _Atomic uint64_t stores;
+    _Atomic uint64_t evictions;
+    _Atomic uint64_t reclaimed;
+    uint64_t reserved[3];
+} CacheCounters;
+
+struct ResultCache {
+    char* map;
+    size_t size;
+    size_t set_count;
+    CacheHeader* header;
+    CacheCounters* counters;
+    _Atomic uint32_t* hands;
+    CacheSlot* slots;
+    // Counter stripe of the process that opened the cache
+    CacheCounters* stripe;
+};
+
+static size_t hands_size(size_t set_count) {
+    return (set_count * sizeof(uint32_t) + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1);
+}
+
+static size_t segment_size(size_t set_count) {
+    return sizeof(CacheHeader) + CACHE_STRIPES * sizeof(CacheCounters) + hands_size(set_count) +
+           set_count * CACHE_WAYS * sizeof(CacheSlot);
+}
+
+// Fills the header of a segment nobody has finished initializing: either
+// just created, or left by a creator that died before writing the magic
+static void initialize_segment(char* map, size_t size) {
+    size_t set_count = 1;
+    while (set_count < CACHE_MAX_SETS && segment_size(set_count * 2) <= size) {
+        set_count *= 2;
+    }
+    memset(map + sizeof(CacheHeader), 0, size - sizeof(CacheHeader));
+    CacheHeader* header = (CacheHeader*)map;
+    header->set_count = set_count;
+    atomic_store_explicit(&header->magic, CACHE_MAGIC, memory_order_release);
+}
+
+static ResultCache* map_segment(int fd, size_t capacity) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return NULL;
+    }
+
+    size_t size = (size_t)st.st_size;
+    if (size == 0) {
+        size_t set_count = 1;
+        while (set_count < CACHE_MAX_SETS && set_count * CACHE_WAYS < capacity) {
+            set_count *= 2;
+        }
+        size = segment_size(set_count);
+        if (ftruncate(fd, (off_t)size) != 0) {
+            return NULL;
+        }
+    } else if (size < segment_size(1)) {
+        return NULL;
+    }
+
+    void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    CacheHeader* header = (CacheHeader*)map;
+    uint64_t magic = atomic_load_explicit(&header->magic, memory_order_acquire);
+    if (magic == 0) {
+        initialize_segment((char*)map, size);
+        magic = CACHE_MAGIC;
+    }
+    size_t set_count = (size_t)header->set_count;
+    if (magic != CACHE_MAGIC || set_count == 0 || set_count > CACHE_MAX_SETS ||
+        (set_count & (set_count - 1)) != 0 || segment_size(set_count) > size) {
+        munmap(map, size);
+        return NULL;
+    }
+
+    ResultCache* cache = (ResultCache*)malloc(sizeof(ResultCache));
+    if (!cache) {
+        munmap(map, size);
+        return NULL;
+    }
+    cache->map = (char*)map;
+    cache->size = size;
+    cache->set_count = set_count;
+    cache->header = header;
+    cache->counters = (CacheCounters*)(cache->map + sizeof(CacheHeader));
+    cache->hands = (_Atomic uint32_t*)(cache->map + sizeof(CacheHeader) + CACHE_STRIPES * sizeof(CacheCounters));
+    cache->slots = (CacheSlot*)((char*)cache->hands + hands_size(set_count));
+    cache->stripe = &cache->counters[(unsigned)getpid() % CACHE_STRIPES];
+    return cache;
+}
+
+ResultCache* result_cache_open(const char* name, size_t capacity) {
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        return NULL;
+    }
+    // Sizing and initialization happen under the file lock, which the kernel
+    // drops if the holder dies
+    ResultCache* cache = NULL;
+    if (flock(fd, LOCK_EX) == 0) {
+        cache = map_segment(fd, capacity ? capacity : RESULT_CACHE_DEFAULT_CAPACITY);
+        flock(fd, LOCK_UN);
+    }
+    close(fd);
+    return cache;
+}
+
+void result_cache_close(ResultCache* cache) {
+    if (cache) {
+        munmap(cache->map, cache->size);
+        free(cache);
+    }
+}
+
+int result_cache_unlink(const char* name) {
+    return shm_unlink(name) == 0;
+}
+
+static void count(_Atomic uint64_t* counter) {
+    atomic_fetch_add_explicit(counter, 1, memory_order_relaxed);
+}
+
+// A cache key: the hash and key word of a slot plus the expression padded
+// with NULs to whole words
+typedef struct {
+    uint64_t hash;
+    uint64_t key;
+    size_t words;
+    uint64_t expression[CACHE_EXPRESSION_WORDS];
+} CacheKey;
+
+static int make_key(CacheKey* key, const char* expression, AngleMode angle_mode, uint32_t context) {
+    size_t length = strlen(expression);
+    if (length >= RESULT_CACHE_MAX_EXPRESSION) {
+        return 0;
+    }
+    memset(key->expression, 0, sizeof(key->expression));
+    memcpy(key->expression, expression, length);
+    key->words = length / 8 + 1;
+    key->key = (uint64_t)angle_mode | (uint64_t)length << 8 | (uint64_t)context << 32;
+
+    // FNV-1a over the expression, then the rest of the key, then a
+    // splitmix64 finalizer so the low bits that pick the set are mixed
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)expression[i]) * 0x100000001b3ULL;
+    }
+    hash ^= key->key;
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    key->hash = hash ? hash : 1;
+    return 1;
+}
+
+static CacheSlot* cache_set(const ResultCache* cache, const CacheKey* key) {
+    return &cache->slots[(key->hash & (cache->set_count - 1)) * CACHE_WAYS];
+}
+
+static int slot_matches(CacheSlot* slot, const CacheKey* key) {
+    if (atomic_load_explicit(&slot->hash, memory_order_relaxed) != key->hash ||
+        atomic_load_explicit(&slot->key, memory_order_relaxed) != key->key) {
+        return 0;
+    }
+    for (size_t i = 0; i < key->words; i++) {
+        if (atomic_load_explicit(&slot->expression[i], memory_order_relaxed) != key->expression[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Seqlock read: copies the slot and keeps the copy only if no store started
+// or finished meanwhile
+static int read_slot(CacheSlot* slot, const CacheKey* key, ResultCacheEntry* entry) {
+    for (int attempt = 0; attempt < CACHE_READ_ATTEMPTS; attempt++) {
+        uint64_t seq = atomic_load_explicit(&slot->lock, memory_order_acquire);
+        if (seq & 1) {
+            return 0;
+        }
+        if (!slot_matches(slot, key)) {
+            return 0;
+        }
+        uint64_t error = atomic_load_explicit(&slot->error, memory_order_relaxed);
+        uint64_t value = atomic_load_explicit(&slot->value, memory_order_relaxed);
+        uint64_t text[CACHE_TEXT_WORDS];
+        for (size_t i = 0; i < CACHE_TEXT_WORDS; i++) {
+            text[i] = atomic_load_explicit(&slot->text[i], memory_order_relaxed);
+        }
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->lock, memory_order_relaxed) == seq) {
+            entry->error = (ErrorType)error;
+            memcpy(&entry->value, &value, sizeof(double));
+            memcpy(entry->text, text, sizeof(entry->text));
+            entry->text[RESULT_CACHE_TEXT_SIZE - 1] = '\0';
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int result_cache_lookup(ResultCache* cache, const char* expression, AngleMode angle_mode,
+                        uint32_t context, ResultCacheEntry* entry) {
+    CacheKey key;
+    if (!make_key(&key, expression, angle_mode, context)) {
+        return 0;
+    }
+    CacheCounters* stripe = cache->stripe;
+    count(&stripe->lookups);
+    CacheSlot* set = cache_set(cache, &key);
+    for (int way = 0; way < CACHE_WAYS; way++) {
+        if (read_slot(&set[way], &key, entry)) {
+            if (!atomic_load_explicit(&set[way].referenced, memory_order_relaxed)) {
+                atomic_store_explicit(&set[way].referenced, 1, memory_order_relaxed);
+            }
+            count(&stripe->hits);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int owner_is_gone(uint64_t lock) {
+    pid_t owner = (pid_t)(lock >> 32);
+    return owner > 0 && owner != getpid() && kill(owner, 0) != 0 && errno == ESRCH;
+}
+
+// Takes the slot for a store and returns the locked word, or 0 if another
+// store holds it. A slot still locked by a dead process is taken over.
+static uint64_t lock_slot(ResultCache* cache, CacheSlot* slot) {
+    uint64_t word = atomic_load_explicit(&slot->lock, memory_order_acquire);
+    uint64_t owner = (uint64_t)getpid() << 32;
+    uint64_t locked;
+    if (word & 1) {
+        if (!owner_is_gone(word)) {
+            return 0;
+        }
+        // Sequence stays odd: readers keep ignoring the half-written slot
+        locked = owner | (uint32_t)(word + 2);
+    } else {
+        locked = owner | (uint32_t)(word + 1);
+    }
+    if (!atomic_compare_exchange_strong_explicit(&slot->lock, &word, locked, memory_order_acq_rel,
+                                                 memory_order_relaxed)) {
+        return 0;
+    }
+    if (word & 1) {
+        count(&cache->stripe->reclaimed);
+    }
+    atomic_thread_fence(memory_order_release);
+    return locked;
+}
+
+static void unlock_slot(CacheSlot* slot, uint64_t locked) {
+    atomic_store_explicit(&slot->lock, (uint32_t)(locked + 1), memory_order_release);
+}
+
+// The slot already holding the key, else an empty one, else the clock victim
+static CacheSlot* choose_slot(ResultCache* cache, const CacheKey* key) {
+    CacheSlot* set = cache_set(cache, key);
+    for (int way = 0; way < CACHE_WAYS; way++) {
+        if (slot_matches(&set[way], key)) {
+            return &set[way];
+        }
+    }
+    for (int way = 0; way < CACHE_WAYS; way++) {
+        if (atomic_load_explicit(&set[way].hash, memory_order_relaxed) == 0) {
+            return &set[way];
+        }
+    }
+    _Atomic uint32_t* hand = &cache->hands[(key->hash & (cache->set_count - 1))];
+    uint32_t way = 0;
+    for (int step = 0; step < 2 * CACHE_WAYS; step++) {
+        way = atomic_fetch_add_explicit(hand, 1, memory_order_relaxed) % CACHE_WAYS;
+        if (!atomic_exchange_explicit(&set[way].referenced, 0, memory_order_relaxed)) {
+            break;
+        }
+    }
+    return &set[way];
+}
+
+int result_cache_store(ResultCache* cache, const char* expression, AngleMode angle_mode,
+                       uint32_t context, const ResultCacheEntry* entry) {
+    CacheKey key;
+    size_t text_length = strnlen(entry->text, RESULT_CACHE_TEXT_SIZE);
+    if (text_length >= RESULT_CACHE_TEXT_SIZE || !make_key(&key, expression, angle_mode, context)) {
+        return 0;
+    }
+    uint64_t text[CACHE_TEXT_WORDS] = {0};
+    memcpy(text, entry->text, text_length);
+    uint64_t value;
+    memcpy(&value, &entry->value, sizeof(double));
+
+    CacheSlot* slot = choose_slot(cache, &key);
+    uint64_t locked = lock_slot(cache, slot);
+    if (!locked) {
+        return 0;
+    }
+    CacheCounters* stripe = cache->stripe;
+    uint64_t previous = atomic_load_explicit(&slot->hash, memory_order_relaxed);
+    if (previous != 0 && !slot_matches(slot, &key)) {
+        count(&stripe->evictions);
+        atomic_store_explicit(&slot->referenced, 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&slot->hash, key.hash, memory_order_relaxed);
+    atomic_store_explicit(&slot->key, key.key, memory_order_relaxed);
+    atomic_store_explicit(&slot->error, (uint64_t)entry->error, memory_order_relaxed);
+    atomic_store_explicit(&slot->value, value, memory_order_relaxed);
+    for (size_t i = 0; i < CACHE_EXPRESSION_WORDS; i++) {
+        atomic_store_explicit(&slot->expression[i], key.expression[i], memory_order_relaxed);
+    }
+    for (size_t i = 0; i < CACHE_TEXT_WORDS; i++) {
+        atomic_store_explicit(&slot->text[i], text[i], memory_order_relaxed);
+    }
+    unlock_slot(slot, locked);
+    count(&stripe->stores);
+    return 1;
+}
+
+void result_cache_stats(const ResultCache* cache, ResultCacheStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    for (int i = 0; i < CACHE_STRIPES; i++) {
+        CacheCounters* stripe = &cache->counters[i];
+        stats->lookups += atomic_load_explicit(&stripe->lookups, memory_order_relaxed);
+        stats->hits += atomic_load_explicit(&stripe->hits, memory_order_relaxed);
+        stats->stores += atomic_load_explicit(&stripe->stores, memory_order_relaxed);
+        stats->evictions += atomic_load_explicit(&stripe->evictions, memory_order_relaxed);
+        stats->reclaimed += atomic_load_explicit(&stripe->reclaimed, memory_order_relaxed);
+    }
+    stats->hit_rate = stats->lookups ? (double)stats->hits / (double)stats->lookups : 0.0;
+}
@@ -0,0 +1,61 @@
+#ifndef CALCULATOR_CACHE_H
+#define CALCULATOR_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "calculator_logic.h"
+
+// Result cache in a POSIX shared-memory segment, shared by every process on
+// the host that opens the same name. Entries are keyed by the expression, its
+// angle mode and a caller-chosen context word, and live in 8-way sets picked
+// by a hash of the key; a full set evicts with the clock algorithm.
+//
+// Readers take no locks: each slot is a seqlock, and a lookup that races a
+// store retries or reports a miss. Stores are best-effort and give up rather
+// than wait. A process that dies in the middle of a store leaves its slot
+// locked with its pid; the next store that finds the slot with its owner gone
+// clears it and takes it back, so a crash costs at most one entry. This
+// relies on pids, so every process must share one pid namespace.
+typedef struct ResultCache ResultCache;
+
+// Longest expression (in bytes) and display text, NUL included, that fit in
+// a slot; longer ones are never cached.
+#define RESULT_CACHE_MAX_EXPRESSION 128
+#define RESULT_CACHE_TEXT_SIZE 80
+#define RESULT_CACHE_DEFAULT_CAPACITY 4096
+
+typedef struct {
+    ErrorType error;
+    double value;
+    char text[RESULT_CACHE_TEXT_SIZE];
+} ResultCacheEntry;
+
+// Totals over every process using the segment
+typedef struct {
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t stores;
+    uint64_t evictions;
+    // Slots taken back from a process that died while storing
+    uint64_t reclaimed;
+    double hit_rate;
+} ResultCacheStats;
+
+// Opens or creates the segment `name` ("/mathengine-cache"). `capacity` is in
+// entries and is rounded up to a power of two of at least 8; it only applies
+// when this call creates the segment. Returns NULL if the segment cannot be
+// mapped or holds something else.
+ResultCache* result_cache_open(const char* name, size_t capacity);
+void result_cache_close(ResultCache* cache);
+// Removes the name; processes that have the segment open keep using it.
+int result_cache_unlink(const char* name);
+
+// Copies the entry into *entry and returns 1 on a hit.
+int result_cache_lookup(ResultCache* cache, const char* expression, AngleMode angle_mode,
+                        uint32_t context, ResultCacheEntry* entry);
+// Returns 0 if the key or text is too long or every candidate slot is busy.
+int result_cache_store(ResultCache* cache, const char* expression, AngleMode angle_mode,
+                       uint32_t context, const ResultCacheEntry* entry);
+void result_cache_stats(const ResultCache* cache, ResultCacheStats* stats);
+
+#endif
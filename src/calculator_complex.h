@@ -0,0 +1,32 @@
+#ifndef CALCULATOR_COMPLEX_H
+#define CALCULATOR_COMPLEX_H
+
+#include <stddef.h>
+#include "calculator_logic.h"
+
+// Structure-of-arrays storage for batches of complex values. Keeping the real
+// and imaginary parts in separate arrays lets the compiler vectorize the
+// arithmetic kernels below without shuffling interleaved pairs.
+typedef struct {
+    double* re;
+    double* im;
+    size_t count;
+} ComplexBatch;
+
+// Scalar operations on a single complex value. Operators use the same
+// character codes as apply_operator; inverse trig, log and sqrt return their
+// principal branch values.
+ErrorType complex_apply_binary(char op, double ar, double ai, double br, double bi,
+                               double* out_re, double* out_im);
+ErrorType complex_apply_unary(char op, AngleMode angle_mode, double re, double im,
+                              double* out_re, double* out_im);
+
+ComplexBatch* complex_batch_new(size_t count);
+void complex_batch_free(ComplexBatch* batch);
+
+// Element-wise batch kernels. `out` may alias either input. The first error
+// encountered is returned; the offending elements are set to NaN.
+ErrorType complex_batch_binary(char op, const ComplexBatch* a, const ComplexBatch* b, ComplexBatch* out);
+ErrorType complex_batch_unary(char op, AngleMode angle_mode, const ComplexBatch* in, ComplexBatch* out);
+
+#endif
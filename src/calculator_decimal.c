@@ -0,0 +1,677 @@
+#include "calculator_decimal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <pthread.h>
+
+typedef unsigned __int128 uint128;
+
+// Longest coefficient an intermediate result may carry in a uint128
+#define DECIMAL_WORK_DIGITS 38
+
+typedef enum {
+    DECIMAL_FINITE,
+    DECIMAL_INFINITE,
+    DECIMAL_NAN
+} DecimalKind;
+
+// Unpacked value: (-1)^sign * coefficient * 10^exponent
+typedef struct {
+    DecimalKind kind;
+    int sign;
+    uint128 coefficient;
+    int exponent;
+} DecimalParts;
+
+typedef struct {
+    int digits;
+    int bias;
+    int max_exponent;   // largest unbiased exponent of the coefficient's last digit
+} DecimalParams;
+
+static const DecimalParams decimal_params[] = {
+    {16, 398, 369},
+    {34, 6176, 6111},
+};
+
+#define DECIMAL_SIGN_BIT ((uint64_t)1 << 63)
+#define DECIMAL_INF_BITS 0x7800000000000000ULL
+#define DECIMAL_NAN_BITS 0x7C00000000000000ULL
+#define DECIMAL_SPECIAL_MASK 0x7800000000000000ULL
+
+static uint128 pow10_table[DECIMAL_WORK_DIGITS + 1];
+static pthread_once_t pow10_once = PTHREAD_ONCE_INIT;
+
+static void build_pow10(void) {
+    uint128 p = 1;
+    for (int i = 0; i <= DECIMAL_WORK_DIGITS; i++) {
+        pow10_table[i] = p;
+        p *= 10;
+    }
+}
+
+static void init_pow10(void) {
+    pthread_once(&pow10_once, build_pow10);
+}
+
+static int digit_count(uint128 c) {
+    int n = 1;
+    while (n <= DECIMAL_WORK_DIGITS && c >= pow10_table[n]) {
+        n++;
+    }
+    return n;
+}
+
+// uint128 division is a libgcc call; most coefficients fit in 64 bits
+static uint128 divide(uint128 a, uint128 b, uint128* remainder) {
+    if ((a >> 64) == 0 && (b >> 64) == 0) {
+        uint64_t q = (uint64_t)a / (uint64_t)b;
+        *remainder = (uint64_t)a - q * (uint64_t)b;
+        return q;
+    }
+    uint128 q = a / b;
+    *remainder = a - q * b;
+    return q;
+}
+
+static Decimal encode(DecimalFormat format, const DecimalParts* p) {
+    Decimal d = {0, 0};
+    uint64_t sign = p->sign ? DECIMAL_SIGN_BIT : 0;
+    uint64_t biased = (uint64_t)(p->exponent + decimal_params[format].bias);
+
+    if (format == DECIMAL_64) {
+        if (p->kind != DECIMAL_FINITE) {
+            d.low = sign | (p->kind == DECIMAL_NAN ? DECIMAL_NAN_BITS : DECIMAL_INF_BITS);
+        } else if (p->coefficient < ((uint128)1 << 53)) {
+            d.low = sign | biased << 53 | (uint64_t)p->coefficient;
+        } else {
+            // Large coefficients imply the leading bits 100
+            d.low = sign | 0x6000000000000000ULL | biased << 51 | ((uint64_t)p->coefficient & 0x7FFFFFFFFFFFFULL);
+        }
+        return d;
+    }
+    if (p->kind != DECIMAL_FINITE) {
+        d.high = sign | (p->kind == DECIMAL_NAN ? DECIMAL_NAN_BITS : DECIMAL_INF_BITS);
+    } else {
+        // 34 digits always fit the 113-bit coefficient field
+        d.high = sign | biased << 49 | (uint64_t)(p->coefficient >> 64);
+        d.low = (uint64_t)p->coefficient;
+    }
+    return d;
+}
+
+static void decode(DecimalFormat format, Decimal d, DecimalParts* p) {
+    uint64_t word = format == DECIMAL_64 ? d.low : d.high;
+    p->sign = (word & DECIMAL_SIGN_BIT) != 0;
+    p->coefficient = 0;
+    p->exponent = 0;
+
+    if ((word & DECIMAL_SPECIAL_MASK) == DECIMAL_SPECIAL_MASK) {
+        p->kind = (word & DECIMAL_NAN_BITS) == DECIMAL_NAN_BITS ? DECIMAL_NAN : DECIMAL_INFINITE;
+        return;
+    }
+    p->kind = DECIMAL_FINITE;
+    int large = ((word >> 61) & 3) == 3;
+    if (format == DECIMAL_64) {
+        if (large) {
+            p->exponent = (int)((word >> 51) & 0x3FF);
+            p->coefficient = 0x20000000000000ULL | (word & 0x7FFFFFFFFFFFFULL);
+        } else {
+            p->exponent = (int)((word >> 53) & 0x3FF);
+            p->coefficient = word & 0x1FFFFFFFFFFFFFULL;
+        }
+    } else if (large) {
+        // Only non-canonical coefficients use this form in decimal128
+        p->exponent = (int)((word >> 47) & 0x3FFF);
+    } else {
+        p->exponent = (int)((word >> 49) & 0x3FFF);
+        p->coefficient = (uint128)(word & 0x1FFFFFFFFFFFFULL) << 64 | d.low;
+    }
+    p->exponent -= decimal_params[format].bias;
+    // Non-canonical coefficients read as zero
+    if (p->coefficient >= pow10_table[decimal_params[format].digits]) {
+        p->coefficient = 0;
+    }
+}
+
+// Rounds to the format's precision with round-half-even and encodes.
+// `sticky` marks a nonzero fraction below the last digit of the coefficient.
+static Decimal pack(DecimalFormat format, int sign, uint128 coefficient, int exponent, int sticky) {
+    const DecimalParams* params = &decimal_params[format];
+    int drop = digit_count(coefficient) - params->digits;
+    int min_exponent = -params->bias;
+    DecimalParts p = {DECIMAL_FINITE, sign, 0, 0};
+
+    if (exponent + (drop > 0 ? drop : 0) < min_exponent) {
+        drop = min_exponent - exponent;
+    }
+    if (drop > DECIMAL_WORK_DIGITS) {
+        // Far below the smallest subnormal
+        sticky |= coefficient != 0;
+        coefficient = 0;
+        exponent += drop;
+        drop = 0;
+    }
+    if (drop > 0) {
+        uint128 remainder;
+        uint128 divisor = pow10_table[drop];
+        uint128 half = divisor / 2;
+        coefficient = divide(coefficient, divisor, &remainder);
+        exponent += drop;
+        if (remainder > half || (remainder == half && (sticky || (coefficient & 1)))) {
+            coefficient++;
+            if (coefficient == pow10_table[params->digits]) {
+                coefficient /= 10;
+                exponent++;
+            }
+        }
+    }
+    // Fold a large exponent into the coefficient while there is room
+    while (exponent > params->max_exponent && coefficient != 0 && coefficient < pow10_table[params->digits - 1]) {
+        coefficient *= 10;
+        exponent--;
+    }
+    if (exponent > params->max_exponent) {
+        if (coefficient == 0) {
+            exponent = params->max_exponent;
+        } else {
+            p.kind = DECIMAL_INFINITE;
+        }
+    }
+    p.coefficient = coefficient;
+    p.exponent = exponent;
+    return encode(format, &p);
+}
+
+static Decimal special(DecimalFormat format, DecimalKind kind, int sign) {
+    DecimalParts p = {kind, sign, 0, 0};
+    return encode(format, &p);
+}
+
+Decimal decimal_parse(DecimalFormat format, const char* text, const char** end) {
+    const char* s = text;
+    uint128 coefficient = 0;
+    int exponent = 0, digits = 0, sticky = 0, sign = 0, seen = 0;
+
+    init_pow10();
+    if (*s == '+' || *s == '-') {
+        sign = *s == '-';
+        s++;
+    }
+    for (int fraction = 0;; s++) {
+        if (*s == '.' && !fraction) {
+            fraction = 1;
+            continue;
+        }
+        if (*s < '0' || *s > '9') {
+            break;
+        }
+        seen = 1;
+        if (digits < DECIMAL_WORK_DIGITS) {
+            coefficient = coefficient * 10 + (uint128)(*s - '0');
+            if (coefficient != 0) {
+                digits++;
+            }
+            exponent -= fraction;
+        } else {
+            // Beyond the working precision only whether a digit is nonzero matters
+            sticky |= *s != '0';
+            exponent += !fraction;
+        }
+    }
+    if (!seen) {
+        *end = text;
+        return special(format, DECIMAL_NAN, 0);
+    }
+    if (*s == 'e' || *s == 'E') {
+        const char* e = s + 1;
+        int exponent_sign = 1;
+        long value = 0;
+        if (*e == '+' || *e == '-') {
+            exponent_sign = *e == '-' ? -1 : 1;
+            e++;
+        }
+        if (*e >= '0' && *e <= '9') {
+            while (*e >= '0' && *e <= '9') {
+                if (value < 100000) {
+                    value = value * 10 + (*e - '0');
+                }
+                e++;
+            }
+            exponent += (int)(exponent_sign * value);
+            s = e;
+        }
+    }
+    *end = s;
+    return pack(format, sign, coefficient, exponent, sticky);
+}
+
+size_t decimal_format(DecimalFormat format, Decimal value, char* buffer, size_t size) {
+    DecimalParts p;
+    char digits[DECIMAL_WORK_DIGITS + 1];
+    char text[DECIMAL_WORK_DIGITS + 16];
+    size_t n = 0, count = 0;
+
+    init_pow10();
+    decode(format, value, &p);
+    if (p.sign && p.kind != DECIMAL_NAN && !(p.kind == DECIMAL_FINITE && p.coefficient == 0)) {
+        text[n++] = '-';
+    }
+    if (p.kind != DECIMAL_FINITE) {
+        const char* word = p.kind == DECIMAL_NAN ? "nan" : "inf";
+        memcpy(text + n, word, 3);
+        n += 3;
+    } else {
+        uint128 c = p.coefficient;
+        int exponent = p.exponent;
+        while (c != 0 && c % 10 == 0) {
+            c /= 10;
+            exponent++;
+        }
+        do {
+            digits[count++] = (char)('0' + (int)(c % 10));
+            c /= 10;
+        } while (c != 0);
+        if (p.coefficient == 0) {
+            exponent = 0;
+        }
+
+        // Position of the decimal point relative to the first digit
+        int point = (int)count + exponent;
+        if (point > decimal_params[format].digits || point < -5) {
+            text[n++] = digits[count - 1];
+            if (count > 1) {
+                text[n++] = '.';
+                for (size_t i = count - 1; i > 0; i--) {
+                    text[n++] = digits[i - 1];
+                }
+            }
+            int e = point - 1;
+            text[n++] = 'e';
+            text[n++] = e < 0 ? '-' : '+';
+            e = abs(e);
+            char exponent_digits[8];
+            int k = 0;
+            do {
+                exponent_digits[k++] = (char)('0' + e % 10);
+                e /= 10;
+            } while (e != 0);
+            while (k > 0) {
+                text[n++] = exponent_digits[--k];
+            }
+        } else if (point <= 0) {
+            text[n++] = '0';
+            text[n++] = '.';
+            for (int i = point; i < 0; i++) {
+                text[n++] = '0';
+            }
+            for (size_t i = count; i > 0; i--) {
+                text[n++] = digits[i - 1];
+            }
+        } else {
+            for (int i = 0; i < point; i++) {
+                text[n++] = i < (int)count ? digits[count - 1 - (size_t)i] : '0';
+            }
+            if ((int)count > point) {
+                text[n++] = '.';
+                for (size_t i = count - (size_t)point; i > 0; i--) {
+                    text[n++] = digits[i - 1];
+                }
+            }
+        }
+    }
+    if (size == 0) {
+        return 0;
+    }
+    if (n >= size) {
+        n = size - 1;
+    }
+    memcpy(buffer, text, n);
+    buffer[n] = '\0';
+    return n;
+}
+
+Decimal decimal_from_int(DecimalFormat format, int64_t value) {
+    init_pow10();
+    uint128 magnitude = value < 0 ? (uint128)(-(value + 1)) + 1 : (uint128)value;
+    return pack(format, value < 0, magnitude, 0, 0);
+}
+
+Decimal decimal_from_double(DecimalFormat format, double value) {
+    char text[32];
+    const char* end;
+    if (isnan(value)) {
+        return special(format, DECIMAL_NAN, 0);
+    }
+    if (isinf(value)) {
+        return special(format, DECIMAL_INFINITE, value < 0);
+    }
+    snprintf(text, sizeof(text), "%.14e", value);
+    return decimal_parse(format, text, &end);
+}
+
+double decimal_to_double(DecimalFormat format, Decimal value) {
+    char text[64];
+    decimal_format(format, value, text, sizeof(text));
+    return strtod(text, NULL);
+}
+
+int decimal_to_int64(DecimalFormat format, Decimal value, int64_t* out) {
+    DecimalParts p;
+    init_pow10();
+    decode(format, value, &p);
+    if (p.kind != DECIMAL_FINITE) {
+        return 0;
+    }
+    uint128 c = p.coefficient;
+    for (int e = p.exponent; e < 0; e++) {
+        if (c % 10 != 0) {
+            return 0;
+        }
+        c /= 10;
+    }
+    for (int e = p.exponent; e > 0 && c != 0; e--) {
+        if (c > (uint128)INT64_MAX) {
+            return 0;
+        }
+        c *= 10;
+    }
+    if (c > (uint128)INT64_MAX) {
+        return 0;
+    }
+    *out = p.sign ? -(int64_t)c : (int64_t)c;
+    return 1;
+}
+
+int decimal_is_nan(DecimalFormat format, Decimal value) {
+    uint64_t word = format == DECIMAL_64 ? value.low : value.high;
+    return (word & DECIMAL_NAN_BITS) == DECIMAL_NAN_BITS;
+}
+
+int decimal_is_finite(DecimalFormat format, Decimal value) {
+    uint64_t word = format == DECIMAL_64 ? value.low : value.high;
+    return (word & DECIMAL_SPECIAL_MASK) != DECIMAL_SPECIAL_MASK;
+}
+
+int decimal_is_negative(DecimalFormat format, Decimal value) {
+    uint64_t word = format == DECIMAL_64 ? value.low : value.high;
+    return (word & DECIMAL_SIGN_BIT) != 0 && !decimal_is_zero(format, value) && !decimal_is_nan(format, value);
+}
+
+int decimal_is_zero(DecimalFormat format, Decimal value) {
+    DecimalParts p;
+    init_pow10();
+    decode(format, value, &p);
+    return p.kind == DECIMAL_FINITE && p.coefficient == 0;
+}
+
+Decimal decimal_negate(DecimalFormat format, Decimal value) {
+    if (format == DECIMAL_64) {
+        value.low ^= DECIMAL_SIGN_BIT;
+    } else {
+        value.high ^= DECIMAL_SIGN_BIT;
+    }
+    return value;
+}
+
+// Handles NaN and infinity operands of add and subtract; returns 0 when both
+// operands are finite
+static int add_special(DecimalFormat format, const DecimalParts* a, const DecimalParts* b, Decimal* out) {
+    if (a->kind == DECIMAL_NAN || b->kind == DECIMAL_NAN) {
+        *out = special(format, DECIMAL_NAN, 0);
+    } else if (a->kind == DECIMAL_INFINITE && b->kind == DECIMAL_INFINITE) {
+        *out = special(format, a->sign == b->sign ? DECIMAL_INFINITE : DECIMAL_NAN, a->sign);
+    } else if (a->kind == DECIMAL_INFINITE || b->kind == DECIMAL_INFINITE) {
+        *out = special(format, DECIMAL_INFINITE, a->kind == DECIMAL_INFINITE ? a->sign : b->sign);
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+static Decimal add_parts(DecimalFormat format, DecimalParts a, DecimalParts b) {
+    Decimal out;
+    if (add_special(format, &a, &b, &out)) {
+        return out;
+    }
+    if (b.coefficient == 0) {
+        if (a.coefficient == 0) {
+            return pack(format, a.sign && b.sign, 0, a.exponent < b.exponent ? a.exponent : b.exponent, 0);
+        }
+        return pack(format, a.sign, a.coefficient, a.exponent, 0);
+    }
+    if (a.coefficient == 0) {
+        return pack(format, b.sign, b.coefficient, b.exponent, 0);
+    }
+    if (a.exponent < b.exponent) {
+        DecimalParts t = a;
+        a = b;
+        b = t;
+    }
+
+    // Scale the operand with the larger exponent up as far as the working
+    // precision allows; what is left of the gap shifts the other one down
+    int gap = a.exponent - b.exponent;
+    int scale = DECIMAL_WORK_DIGITS - 1 - digit_count(a.coefficient);
+    if (scale > gap) {
+        scale = gap;
+    }
+    a.coefficient *= pow10_table[scale];
+    a.exponent -= scale;
+    gap -= scale;
+
+    int sticky = 0;
+    uint128 shifted = b.coefficient;
+    if (gap > 0) {
+        uint128 remainder = 0;
+        if (gap > DECIMAL_WORK_DIGITS) {
+            remainder = shifted;
+            shifted = 0;
+        } else {
+            shifted = divide(shifted, pow10_table[gap], &remainder);
+        }
+        sticky = remainder != 0;
+    }
+
+    // `a` now has at least 37 digits whenever `sticky` is set, so it
+    // dominates and the lost fraction only steers the final rounding
+    if (a.sign == b.sign) {
+        return pack(format, a.sign, a.coefficient + shifted, a.exponent, sticky);
+    }
+    if (sticky) {
+        return pack(format, a.sign, a.coefficient - shifted - 1, a.exponent, 1);
+    }
+    if (a.coefficient >= shifted) {
+        uint128 difference = a.coefficient - shifted;
+        return pack(format, difference == 0 ? 0 : a.sign, difference, a.exponent, 0);
+    }
+    return pack(format, b.sign, shifted - a.coefficient, a.exponent, 0);
+}
+
+Decimal decimal_add(DecimalFormat format, Decimal a, Decimal b) {
+    DecimalParts pa, pb;
+    init_pow10();
+    decode(format, a, &pa);
+    decode(format, b, &pb);
+    return add_parts(format, pa, pb);
+}
+
+Decimal decimal_subtract(DecimalFormat format, Decimal a, Decimal b) {
+    return decimal_add(format, a, decimal_negate(format, b));
+}
+
+// 256-bit product as four 64-bit limbs, least significant first
+static void multiply_wide(uint128 a, uint128 b, uint64_t limbs[4]) {
+    uint64_t x[2] = {(uint64_t)a, (uint64_t)(a >> 64)};
+    uint64_t y[2] = {(uint64_t)b, (uint64_t)(b >> 64)};
+    memset(limbs, 0, 4 * sizeof(uint64_t));
+    for (int i = 0; i < 2; i++) {
+        uint128 carry = 0;
+        for (int j = 0; j < 2; j++) {
+            uint128 t = (uint128)x[i] * y[j] + limbs[i + j] + carry;
+            limbs[i + j] = (uint64_t)t;
+            carry = t >> 64;
+        }
+        limbs[i + 2] = (uint64_t)carry;
+    }
+}
+
+// limbs /= divisor; returns the remainder
+static uint64_t divide_wide(uint64_t limbs[4], uint64_t divisor) {
+    uint128 remainder = 0;
+    for (int i = 3; i >= 0; i--) {
+        uint128 t = remainder << 64 | limbs[i];
+        limbs[i] = (uint64_t)(t / divisor);
+        remainder = t % divisor;
+    }
+    return (uint64_t)remainder;
+}
+
+Decimal decimal_multiply(DecimalFormat format, Decimal a, Decimal b) {
+    DecimalParts pa, pb;
+    init_pow10();
+    decode(format, a, &pa);
+    decode(format, b, &pb);
+    int sign = pa.sign ^ pb.sign;
+
+    if (pa.kind == DECIMAL_NAN || pb.kind == DECIMAL_NAN) {
+        return special(format, DECIMAL_NAN, 0);
+    }
+    if (pa.kind == DECIMAL_INFINITE || pb.kind == DECIMAL_INFINITE) {
+        int zero = (pa.kind == DECIMAL_FINITE && pa.coefficient == 0) || (pb.kind == DECIMAL_FINITE && pb.coefficient == 0);
+        return special(format, zero ? DECIMAL_NAN : DECIMAL_INFINITE, zero ? 0 : sign);
+    }
+
+    int exponent = pa.exponent + pb.exponent;
+    if ((pa.coefficient >> 64) == 0 && (pb.coefficient >> 64) == 0) {
+        // Decimal64 coefficients: the product always fits in 128 bits
+        return pack(format, sign, pa.coefficient * pb.coefficient, exponent, 0);
+    }
+
+    uint64_t limbs[4];
+    multiply_wide(pa.coefficient, pb.coefficient, limbs);
+    int sticky = 0;
+    if (limbs[2] != 0 || limbs[3] != 0) {
+        // Drop low digits until the product fits, keeping at least 37 of
+        // them; the bit length bounds the digit count from above
+        int bits = limbs[3] ? 256 - __builtin_clzll(limbs[3]) : 192 - __builtin_clzll(limbs[2]);
+        int drop = bits * 30103 / 100000 + 1 - DECIMAL_WORK_DIGITS;
+        while (drop > 0) {
+            int step = drop > 19 ? 19 : drop;
+            sticky |= divide_wide(limbs, (uint64_t)pow10_table[step]) != 0;
+            exponent += step;
+            drop -= step;
+        }
+    }
+    return pack(format, sign, (uint128)limbs[1] << 64 | limbs[0], exponent, sticky);
+}
+
+ErrorType decimal_divide(DecimalFormat format, Decimal a, Decimal b, Decimal* out) {
+    DecimalParts pa, pb;
+    init_pow10();
+    decode(format, a, &pa);
+    decode(format, b, &pb);
+    int sign = pa.sign ^ pb.sign;
+
+    if (pa.kind == DECIMAL_NAN || pb.kind == DECIMAL_NAN) {
+        *out = special(format, DECIMAL_NAN, 0);
+        return ERROR_NONE;
+    }
+    if (pa.kind == DECIMAL_INFINITE) {
+        *out = special(format, pb.kind == DECIMAL_INFINITE ? DECIMAL_NAN : DECIMAL_INFINITE, sign);
+        return ERROR_NONE;
+    }
+    if (pb.kind == DECIMAL_INFINITE) {
+        *out = pack(format, sign, 0, 0, 0);
+        return ERROR_NONE;
+    }
+    if (pb.coefficient == 0) {
+        *out = special(format, DECIMAL_NAN, 0);
+        return ERROR_MATH_DIV_ZERO;
+    }
+
+    // Long division in chunks of as many digits as keep the remainder and
+    // the quotient inside 128 bits, until there is a guard digit
+    int precision = decimal_params[format].digits;
+    int exponent = pa.exponent - pb.exponent;
+    uint128 remainder;
+    uint128 quotient = divide(pa.coefficient, pb.coefficient, &remainder);
+    int chunk = DECIMAL_WORK_DIGITS - digit_count(pb.coefficient);
+    while (remainder != 0 && digit_count(quotient) <= precision) {
+        int step = chunk;
+        if (digit_count(quotient) + step > DECIMAL_WORK_DIGITS) {
+            step = DECIMAL_WORK_DIGITS - digit_count(quotient);
+        }
+        uint128 part = divide(remainder * pow10_table[step], pb.coefficient, &remainder);
+        quotient = quotient * pow10_table[step] + part;
+        exponent -= step;
+    }
+    *out = pack(format, sign, quotient, exponent, remainder != 0);
+    return ERROR_NONE;
+}
+
+ErrorType decimal_remainder(DecimalFormat format, Decimal a, Decimal b, Decimal* out) {
+    DecimalParts pa, pb;
+    init_pow10();
+    decode(format, a, &pa);
+    decode(format, b, &pb);
+
+    if (pa.kind != DECIMAL_FINITE || pb.kind == DECIMAL_NAN) {
+        *out = special(format, DECIMAL_NAN, 0);
+        return ERROR_NONE;
+    }
+    if (pb.kind == DECIMAL_INFINITE) {
+        *out = a;
+        return ERROR_NONE;
+    }
+    if (pb.coefficient == 0) {
+        *out = special(format, DECIMAL_NAN, 0);
+        return ERROR_MATH_DIV_ZERO;
+    }
+
+    uint128 remainder;
+    int exponent;
+    if (pa.exponent >= pb.exponent) {
+        // (ca * 10^gap) mod cb, a few digits at a time so nothing overflows
+        int gap = pa.exponent - pb.exponent;
+        int chunk = DECIMAL_WORK_DIGITS - digit_count(pb.coefficient);
+        divide(pa.coefficient, pb.coefficient, &remainder);
+        while (gap > 0 && remainder != 0) {
+            int step = gap < chunk ? gap : chunk;
+            divide(remainder * pow10_table[step], pb.coefficient, &remainder);
+            gap -= step;
+        }
+        exponent = pb.exponent;
+    } else {
+        int gap = pb.exponent - pa.exponent;
+        remainder = pa.coefficient;
+        if (gap + digit_count(pb.coefficient) <= DECIMAL_WORK_DIGITS) {
+            divide(pa.coefficient, pb.coefficient * pow10_table[gap], &remainder);
+        }
+        exponent = pa.exponent;
+    }
+    *out = pack(format, pa.sign, remainder, exponent, 0);
+    return ERROR_NONE;
+}
+
+Decimal decimal_power(DecimalFormat format, Decimal base, int64_t exponent) {
+    Decimal result = decimal_from_int(format, 1);
+    uint64_t n = exponent < 0 ? (uint64_t)(-(exponent + 1)) + 1 : (uint64_t)exponent;
+    while (n != 0) {
+        if (n & 1) {
+            result = decimal_multiply(format, result, base);
+        }
+        n >>= 1;
+        if (n != 0) {
+            base = decimal_multiply(format, base, base);
+        }
+    }
+    if (exponent < 0) {
+        Decimal one = decimal_from_int(format, 1);
+        if (decimal_divide(format, one, result, &result) != ERROR_NONE) {
+            result = special(format, DECIMAL_INFINITE, 0);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,53 @@
+#ifndef CALCULATOR_DECIMAL_H
+#define CALCULATOR_DECIMAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "calculator_logic.h"
+
+// IEEE 754 decimal floating point in the BID (binary integer decimal)
+// encoding: the coefficient is stored as a plain binary integer, so the
+// arithmetic is integer multiply, divide and a power-of-ten scale. Decimal64
+// keeps 16 significant digits, decimal128 keeps 34. Every operation is
+// correctly rounded with round-half-even (banker's rounding).
+//
+// A decimal64 value lives in `low` with `high` zero. Parsing and formatting
+// work on the digits directly, without strtod or printf, so "0.1" is
+// exactly one tenth and prints back as "0.1".
+typedef enum {
+    DECIMAL_64,
+    DECIMAL_128
+} DecimalFormat;
+
+// Reads [sign] digits [. digits] [e [sign] digits] and sets *end past it;
+// *end == text if there is no number. Extra digits are rounded.
+Decimal decimal_parse(DecimalFormat format, const char* text, const char** end);
+// Plain notation with trailing zeros removed, or d.ddde+N when the
+// exponent is far from zero. Returns the length written (truncated to fit).
+size_t decimal_format(DecimalFormat format, Decimal value, char* buffer, size_t size);
+
+Decimal decimal_from_int(DecimalFormat format, int64_t value);
+// Binary fallback for the functions with no decimal kernel; the double is
+// rounded to 15 significant digits, which always round-trip.
+Decimal decimal_from_double(DecimalFormat format, double value);
+double decimal_to_double(DecimalFormat format, Decimal value);
+// Returns 1 and stores the value if it is an integer that fits in int64_t.
+int decimal_to_int64(DecimalFormat format, Decimal value, int64_t* out);
+
+int decimal_is_nan(DecimalFormat format, Decimal value);
+int decimal_is_finite(DecimalFormat format, Decimal value);
+int decimal_is_negative(DecimalFormat format, Decimal value);
+int decimal_is_zero(DecimalFormat format, Decimal value);
+
+Decimal decimal_negate(DecimalFormat format, Decimal value);
+Decimal decimal_add(DecimalFormat format, Decimal a, Decimal b);
+Decimal decimal_subtract(DecimalFormat format, Decimal a, Decimal b);
+Decimal decimal_multiply(DecimalFormat format, Decimal a, Decimal b);
+// Division and remainder by zero give NaN and ERROR_MATH_DIV_ZERO.
+ErrorType decimal_divide(DecimalFormat format, Decimal a, Decimal b, Decimal* out);
+// a - trunc(a / b) * b, which is always exact.
+ErrorType decimal_remainder(DecimalFormat format, Decimal a, Decimal b, Decimal* out);
+// Integer powers by repeated squaring; other exponents are left to the caller.
+Decimal decimal_power(DecimalFormat format, Decimal base, int64_t exponent);
+
+#endif
@@ -0,0 +1,525 @@
+#include "calculator_fixed.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#define F FIXED_FRACTION_BITS
+#define FIXED_ONE64 ((int64_t)1 << F)
+// Significant digits kept while parsing; later ones only move the point
+#define FIXED_PARSE_DIGITS 48
+// Guard bits below the last fraction bit while converting decimal fractions
+#define FIXED_GUARD_BITS 8
+
+// Internal angles are Q30 radians (Q32 during range reduction)
+#define TWO_PI_Q32 INT64_C(26986075409)
+#define PI_Q32 INT64_C(13493037705)
+#define HALF_PI_Q32 INT64_C(6746518852)
+#define HALF_PI_Q30 1686629713
+#define PI_OVER_180_Q32 INT64_C(74961321)
+#define RAD_TO_DEG_Q24 INT64_C(961263669)
+// Product of the CORDIC gains, Q30
+#define CORDIC_GAIN 652032874
+#define CORDIC_STEPS 31
+#define LN2_Q28 INT64_C(186065279)
+#define LN2_Q30 UINT64_C(744261118)
+// Fraction bits of exp2 taken from the table; the rest are linear
+#define EXP2_TABLE_BITS 15
+#define LOG10_2_Q28 INT64_C(80807124)
+#define LOG2_E_Q30 INT64_C(1549082005)
+
+// atan(2^-i), Q30
+static const int32_t cordic_angles[CORDIC_STEPS] = {
+    843314857, 497837829, 263043837, 133525159, 67021687, 33543516, 16775851, 8388437,
+    4194283, 2097149, 1048576, 524288, 262144, 131072, 65536, 32768,
+    16384, 8192, 4096, 2048, 1024, 512, 256, 128,
+    64, 32, 16, 8, 4, 2, 1
+};
+
+// 2^(2^-i) for i = 1..EXP2_TABLE_BITS, Q30
+static const uint32_t exp2_factors[EXP2_TABLE_BITS] = {
+    1518500250, 1276901417, 1170923762, 1121280436, 1097253708, 1085434106, 1079572136, 1076653033,
+    1075196443, 1074468888, 1074105294, 1073923544, 1073832680, 1073787251, 1073764537
+};
+
+// v / 2^s rounded to nearest, ties upward
+static int64_t shift_round(int64_t v, int s) {
+    if (s <= 0) {
+        return v;
+    }
+    if (s > 62) {
+        return 0;
+    }
+    return (v + ((int64_t)1 << (s - 1))) >> s;
+}
+
+static ErrorType saturate(int64_t v, Fixed* out) {
+    if (v > FIXED_MAX) {
+        *out = FIXED_MAX;
+        return ERROR_OVERFLOW;
+    }
+    if (v < FIXED_MIN) {
+        *out = FIXED_MIN;
+        return ERROR_OVERFLOW;
+    }
+    *out = (Fixed)v;
+    return ERROR_NONE;
+}
+
+static ErrorType overflow(int negative, Fixed* out) {
+    *out = negative ? FIXED_MIN : FIXED_MAX;
+    return ERROR_OVERFLOW;
+}
+
+// n / d rounded to nearest, ties away from zero
+static int64_t divide_round(int64_t n, int64_t d) {
+    int64_t q = n / d;
+    int64_t r = n % d;
+    int64_t twice = r < 0 ? -2 * r : 2 * r;
+    if (twice >= (d < 0 ? -d : d)) {
+        q += (n < 0) != (d < 0) ? -1 : 1;
+    }
+    return q;
+}
+
+static ErrorType multiply(Fixed a, Fixed b, Fixed* out) {
+    return saturate(shift_round((int64_t)a * b, F), out);
+}
+
+static ErrorType divide(Fixed a, Fixed b, Fixed* out) {
+    if (b == 0) {
+        *out = 0;
+        return ERROR_MATH_DIV_ZERO;
+    }
+    return saturate(divide_round((int64_t)a * FIXED_ONE64, b), out);
+}
+
+static int is_integral(Fixed a) {
+    return (a & (FIXED_ONE - 1)) == 0;
+}
+
+ErrorType fixed_from_integer(int64_t integer, Fixed* value) {
+    if (integer > (FIXED_MAX >> F) || integer < (FIXED_MIN >> F)) {
+        return overflow(integer < 0, value);
+    }
+    *value = (Fixed)(integer * FIXED_ONE64);
+    return ERROR_NONE;
+}
+
+Fixed fixed_from_double(double value) {
+    if (isnan(value)) {
+        return 0;
+    }
+    double scaled = nearbyint(ldexp(value, F));
+    return scaled >= (double)FIXED_MAX ? FIXED_MAX : scaled <= (double)FIXED_MIN ? FIXED_MIN : (Fixed)scaled;
+}
+
+double fixed_to_double(Fixed value) {
+    return ldexp((double)value, -F);
+}
+
+ErrorType fixed_parse(const char* text, const char** end, Fixed* value) {
+    const char* p = text;
+    uint8_t digits[FIXED_PARSE_DIGITS];
+    int count = 0;
+    // Position of the decimal point, in digits from the first stored one
+    long point = 0;
+    int seen = 0, negative = 0;
+
+    if (*p == '+' || *p == '-') {
+        negative = *p == '-';
+        p++;
+    }
+    for (; *p >= '0' && *p <= '9'; p++, seen = 1) {
+        if (count == 0 && *p == '0') {
+            continue;
+        }
+        if (count < FIXED_PARSE_DIGITS) {
+            digits[count++] = (uint8_t)(*p - '0');
+        }
+        point++;
+    }
+    if (*p == '.') {
+        for (p++; *p >= '0' && *p <= '9'; p++, seen = 1) {
+            if (count == 0 && *p == '0') {
+                point--;
+            } else if (count < FIXED_PARSE_DIGITS) {
+                digits[count++] = (uint8_t)(*p - '0');
+            }
+        }
+    }
+    if (!seen) {
+        *end = text;
+        *value = 0;
+        return ERROR_SYNTAX;
+    }
+    if ((*p == 'e' || *p == 'E') &&
+        ((p[1] >= '0' && p[1] <= '9') || ((p[1] == '+' || p[1] == '-') && p[2] >= '0' && p[2] <= '9'))) {
+        int exponent_negative = p[1] == '-';
+        long exponent = 0;
+        for (p += (p[1] == '+' || p[1] == '-') ? 2 : 1; *p >= '0' && *p <= '9'; p++) {
+            if (exponent < 100000) {
+                exponent = exponent * 10 + (*p - '0');
+            }
+        }
+        point += exponent_negative ? -exponent : exponent;
+    }
+    *end = p;
+    if (count == 0) {
+        *value = 0;
+        return ERROR_NONE;
+    }
+
+    // Integer part, with the limit one past the largest magnitude
+    int64_t limit = negative ? -(int64_t)FIXED_MIN : (int64_t)FIXED_MAX;
+    int64_t integer = 0;
+    for (long i = 0; i < point; i++) {
+        integer = integer * 10 + (i < count ? digits[i] : 0);
+        if (integer > (limit >> F)) {
+            return overflow(negative, value);
+        }
+    }
+
+    // Fraction, folded in from the last digit: each step divides by ten with
+    // guard bits, so only the final rounding loses precision
+    uint64_t fraction = 0;
+    long first = point > 0 ? point : 0;
+    for (long i = count - 1; i >= first; i--) {
+        fraction = (fraction + ((uint64_t)digits[i] << (F + FIXED_GUARD_BITS))) / 10;
+    }
+    for (long i = point; i < 0 && fraction != 0; i++) {
+        fraction /= 10;
+    }
+    int64_t magnitude = integer * FIXED_ONE64 + (int64_t)((fraction + (1u << (FIXED_GUARD_BITS - 1))) >> FIXED_GUARD_BITS);
+    if (magnitude > limit) {
+        return overflow(negative, value);
+    }
+    *value = (Fixed)(negative ? -magnitude : magnitude);
+    return ERROR_NONE;
+}
+
+size_t fixed_format(Fixed value, char* buffer, size_t size) {
+    uint64_t magnitude = value < 0 ? (uint64_t)(-(int64_t)value) : (uint64_t)value;
+    uint64_t whole = magnitude >> F;
+    uint64_t fraction = magnitude & (FIXED_ONE64 - 1);
+    // Fewest decimals that read back as the same value; 10^-digits below
+    // half the resolution always does
+    int digits = 0;
+    uint64_t scale = 1, decimals = 0;
+    while (fraction != 0) {
+        digits++;
+        scale *= 10;
+        decimals = (fraction * scale + ((uint64_t)1 << (F - 1))) >> F;
+        if (((decimals << F) + scale / 2) / scale == fraction) {
+            break;
+        }
+    }
+    if (decimals == scale) {
+        // Rounded up to the next integer
+        whole++;
+        decimals = 0;
+    }
+    while (decimals != 0 && decimals % 10 == 0) {
+        decimals /= 10;
+        digits--;
+    }
+
+    char text[48];
+    int length = snprintf(text, sizeof(text), "%s%llu", value < 0 ? "-" : "", (unsigned long long)whole);
+    if (decimals != 0) {
+        length += snprintf(text + length, sizeof(text) - (size_t)length, ".%0*llu", digits,
+                           (unsigned long long)decimals);
+    }
+    if (size > 0) {
+        size_t n = (size_t)length < size - 1 ? (size_t)length : size - 1;
+        memcpy(buffer, text, n);
+        buffer[n] = '\0';
+        return n;
+    }
+    return 0;
+}
+
+// a^n by repeated squaring; a negative n inverts a first
+static ErrorType power_integer(Fixed a, int64_t n, Fixed* out) {
+    Fixed base = a, result = FIXED_ONE;
+    int negative = a < 0 && (n & 1);
+    if (n < 0) {
+        ErrorType err = divide(FIXED_ONE, a, &base);
+        if (err != ERROR_NONE) {
+            *out = err == ERROR_OVERFLOW ? (negative ? FIXED_MIN : FIXED_MAX) : 0;
+            return err;
+        }
+        n = -n;
+    }
+    while (n != 0) {
+        if ((n & 1) && multiply(result, base, &result) != ERROR_NONE) {
+            return overflow(negative, out);
+        }
+        n >>= 1;
+        if (n != 0 && multiply(base, base, &base) != ERROR_NONE) {
+            return overflow(negative, out);
+        }
+    }
+    *out = result;
+    return ERROR_NONE;
+}
+
+// log2 of a positive Fixed, Q30: the exponent from the leading bit, then
+// one fraction bit per squaring of the mantissa
+static int64_t log2_q30(Fixed a) {
+    int k = 31 - __builtin_clz((uint32_t)a);
+    uint64_t m = (uint64_t)a << (30 - k);
+    int64_t fraction = 0;
+    for (int i = 1; i <= 30; i++) {
+        m = (m * m) >> 30;
+        // Squares of [1, 2) are below 4, so the bit is m >> 31
+        uint64_t bit = m >> 31;
+        m >>= bit;
+        fraction |= (int64_t)bit << (30 - i);
+    }
+    return (int64_t)(k - F) * ((int64_t)1 << 30) + fraction;
+}
+
+// 2^t for t in Q30: 2^floor(t) as a shift, the rest as a product of table
+// entries, one per fraction bit
+static ErrorType exp2_q30(int64_t t, Fixed* out) {
+    int64_t whole = t >> 30;
+    uint32_t fraction = (uint32_t)(t & ((1 << 30) - 1));
+    uint64_t r = (uint64_t)1 << 30;
+    for (int i = 1; i <= EXP2_TABLE_BITS; i++) {
+        uint64_t factor = (fraction >> (30 - i)) & 1 ? exp2_factors[i - 1] : (uint64_t)1 << 30;
+        r = (r * factor) >> 30;
+    }
+    // Below 2^-15, 2^x = 1 + x ln 2 to within 2^-31
+    uint32_t rest = fraction & ((1u << (30 - EXP2_TABLE_BITS)) - 1);
+    r = (r * (((uint64_t)1 << 30) + (((uint64_t)rest * LN2_Q30) >> 30))) >> 30;
+    // r is in [2^30, 2^31), so any shift to the left overflows
+    int64_t shift = whole + F - 30;
+    if (shift > 0) {
+        return overflow(0, out);
+    }
+    *out = (Fixed)shift_round((int64_t)r, shift < -63 ? 63 : (int)-shift);
+    return ERROR_NONE;
+}
+
+static ErrorType power(Fixed a, Fixed b, Fixed* out) {
+    if (is_integral(b)) {
+        return power_integer(a, b >> F, out);
+    }
+    if (a < 0) {
+        *out = 0;
+        return ERROR_MATH_DOMAIN;
+    }
+    if (a == 0) {
+        *out = 0;
+        return b > 0 ? ERROR_NONE : ERROR_MATH_DIV_ZERO;
+    }
+    int64_t exponent;
+    if (__builtin_mul_overflow(log2_q30(a), (int64_t)b, &exponent)) {
+        // Far beyond the range either way
+        if ((a > FIXED_ONE) == (b > 0)) {
+            return overflow(0, out);
+        }
+        *out = 0;
+        return ERROR_NONE;
+    }
+    return exp2_q30(shift_round(exponent, F), out);
+}
+
+// The CORDIC direction of each step is data dependent and unpredictable, so
+// it is applied as a sign mask: (v ^ m) - m is v for m = 0 and -v for m = -1
+
+// Rotates (K, 0) by z (Q30 radians, |z| <= pi/2) to get cos z and sin z, Q30
+static void cordic_rotate(int32_t z, int32_t* c, int32_t* s) {
+    int32_t x = CORDIC_GAIN, y = 0;
+    for (int i = 0; i < CORDIC_STEPS; i++) {
+        int32_t m = z >> 31;
+        int32_t dx = y >> i, dy = x >> i;
+        x -= (dx ^ m) - m;
+        y += (dy ^ m) - m;
+        z -= (cordic_angles[i] ^ m) - m;
+    }
+    *c = x;
+    *s = y;
+}
+
+// Angle of (x, y) with x >= 0, Q30 radians, by rotating it onto the x axis
+static int32_t cordic_vector(int64_t x, int64_t y) {
+    int32_t z = 0;
+    for (int i = 0; i < CORDIC_STEPS; i++) {
+        // -1 while y <= 0
+        int64_t m = -(int64_t)(y <= 0);
+        int64_t dx = y >> i, dy = x >> i;
+        x += (dx ^ m) - m;
+        y -= (dy ^ m) - m;
+        z += (cordic_angles[i] ^ (int32_t)m) - (int32_t)m;
+    }
+    return z;
+}
+
+// Reduces an angle to Q30 radians in [-pi/2, pi/2]; *flip is set when the
+// cosine changes sign. Degrees are reduced exactly before converting.
+static int32_t reduce_angle(Fixed a, AngleMode angle_mode, int* flip) {
+    int64_t r;
+    *flip = 0;
+    if (angle_mode == DEG) {
+        int64_t d = (int64_t)a % (360 * FIXED_ONE64);
+        if (d > 180 * FIXED_ONE64) {
+            d -= 360 * FIXED_ONE64;
+        } else if (d < -180 * FIXED_ONE64) {
+            d += 360 * FIXED_ONE64;
+        }
+        if (d > 90 * FIXED_ONE64) {
+            d = 180 * FIXED_ONE64 - d;
+            *flip = 1;
+        } else if (d < -90 * FIXED_ONE64) {
+            d = -180 * FIXED_ONE64 - d;
+            *flip = 1;
+        }
+        r = shift_round(d * PI_OVER_180_Q32, F);
+    } else {
+        r = ((int64_t)a * ((int64_t)1 << (32 - F))) % TWO_PI_Q32;
+        if (r > PI_Q32) {
+            r -= TWO_PI_Q32;
+        } else if (r < -PI_Q32) {
+            r += TWO_PI_Q32;
+        }
+        if (r > HALF_PI_Q32) {
+            r = PI_Q32 - r;
+            *flip = 1;
+        } else if (r < -HALF_PI_Q32) {
+            r = -PI_Q32 - r;
+            *flip = 1;
+        }
+    }
+    return (int32_t)shift_round(r, 2);
+}
+
+static Fixed from_q30(int64_t v) {
+    return (Fixed)shift_round(v, 30 - F);
+}
+
+// A Q30 angle in radians as a result in the angle mode; degrees can exceed
+// the range when there are few integer bits
+static ErrorType angle_result(int64_t z, AngleMode angle_mode, Fixed* out) {
+    return saturate(angle_mode == DEG ? shift_round(z * RAD_TO_DEG_Q24, 54 - F) : shift_round(z, 30 - F), out);
+}
+
+static uint64_t isqrt64(uint64_t v, uint64_t* remainder) {
+    uint64_t result = 0, bit = (uint64_t)1 << 62;
+    while (bit > v) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        uint64_t trial = result + bit;
+        // All ones when the trial fits
+        uint64_t fits = -(uint64_t)(v >= trial);
+        v -= trial & fits;
+        result = (result >> 1) + (bit & fits);
+        bit >>= 2;
+    }
+    *remainder = v;
+    return result;
+}
+
+// asin in Q30 radians, for |a| <= 1
+static int32_t arcsine_q30(Fixed a) {
+    uint64_t remainder;
+    int64_t one = FIXED_ONE64 * FIXED_ONE64;
+    uint64_t cosine = isqrt64((uint64_t)(one - (int64_t)a * a) << (60 - 2 * F), &remainder);
+    return cordic_vector((int64_t)cosine, (int64_t)a * ((int64_t)1 << (30 - F)));
+}
+
+static ErrorType logarithm(Fixed a, int64_t base_factor_q28, Fixed* out) {
+    if (a <= 0) {
+        *out = 0;
+        return ERROR_MATH_DOMAIN;
+    }
+    // Only saturates with few integer bits, e.g. ln of a tiny value
+    return saturate(shift_round(log2_q30(a) * base_factor_q28, 58 - F), out);
+}
+
+ErrorType fixed_apply_binary(char op, Fixed a, Fixed b, Fixed* out) {
+    switch (op) {
+        case '+': return saturate((int64_t)a + b, out);
+        case '-': return saturate((int64_t)a - b, out);
+        case '*': return multiply(a, b, out);
+        case '/': return divide(a, b, out);
+        case '%':
+            if (b == 0) {
+                *out = 0;
+                return ERROR_MATH_DIV_ZERO;
+            }
+            // Sign of the dividend, like fmod; 64 bits for FIXED_MIN % -1
+            *out = (Fixed)((int64_t)a % b);
+            return ERROR_NONE;
+        case '^': return power(a, b, out);
+        default:
+            *out = 0;
+            return ERROR_SYNTAX;
+    }
+}
+
+ErrorType fixed_apply_unary(char op, AngleMode angle_mode, Fixed a, Fixed* out) {
+    int32_t c, s;
+    int flip;
+    switch (op) {
+        case 's':
+        case 'c':
+        case 't':
+            cordic_rotate(reduce_angle(a, angle_mode, &flip), &c, &s);
+            c = flip ? -c : c;
+            if (op == 's') {
+                *out = from_q30(s);
+            } else if (op == 'c') {
+                *out = from_q30(c);
+            } else if (c == 0) {
+                return overflow(s < 0, out);
+            } else {
+                return saturate(divide_round((int64_t)s * FIXED_ONE64, c), out);
+            }
+            return ERROR_NONE;
+        case 'S':
+        case 'C':
+            if (a > FIXED_ONE || a < -FIXED_ONE) {
+                *out = 0;
+                return ERROR_MATH_DOMAIN;
+            }
+            s = arcsine_q30(a);
+            return angle_result(op == 'S' ? s : HALF_PI_Q30 - (int64_t)s, angle_mode, out);
+        case 'T':
+            return angle_result(cordic_vector((int64_t)1 << 30, (int64_t)a * ((int64_t)1 << (30 - F))), angle_mode, out);
+        case 'l': return logarithm(a, LN2_Q28, out);
+        case 'L': return logarithm(a, LOG10_2_Q28, out);
+        case 'E': return exp2_q30(shift_round((int64_t)a * LOG2_E_Q30, F), out);
+        case 'q': {
+            if (a < 0) {
+                *out = 0;
+                return ERROR_MATH_DOMAIN;
+            }
+            uint64_t remainder;
+            uint64_t root = isqrt64((uint64_t)a << F, &remainder);
+            *out = (Fixed)(root + (remainder > root));
+            return ERROR_NONE;
+        }
+        case 'R': return divide(FIXED_ONE, a, out);
+        case 'N': return saturate(-(int64_t)a, out);
+        case '!': {
+            if (a < 0 || !is_integral(a)) {
+                *out = 0;
+                return ERROR_MATH_DOMAIN;
+            }
+            int64_t result = 1;
+            for (int64_t i = 2; i <= (a >> F); i++) {
+                result *= i;
+                if (result > (FIXED_MAX >> F)) {
+                    return overflow(0, out);
+                }
+            }
+            *out = (Fixed)(result * FIXED_ONE64);
+            return ERROR_NONE;
+        }
+        default:
+            *out = 0;
+            return ERROR_SYNTAX;
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef CALCULATOR_FIXED_H
+#define CALCULATOR_FIXED_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "calculator_logic.h"
+
+// Binary fixed-point arithmetic for targets without a floating-point unit,
+// where every double operation is a slow library call. A Fixed holds a
+// signed 32-bit value with FIXED_FRACTION_BITS bits after the binary point
+// (Q15.16 by default; build with -DFIXED_FRACTION_BITS=n for another Q
+// format). Only integer instructions are used, with 64-bit intermediates:
+//
+//   + - * / %    exact or correctly rounded; '^' with an integer exponent
+//                multiplies by repeated squaring
+//   sin cos tan  CORDIC rotation after exact range reduction
+//   asin acos atan  CORDIC vectoring
+//   ln log exp, non-integer powers  bit-by-bit log2 and a table of
+//                2^(2^-i) for exp2
+//   sqrt         integer square root
+//
+// Results outside the range saturate to the largest or smallest Fixed and
+// report ERROR_OVERFLOW; results smaller than the resolution round to zero.
+// Each result is within a few units in the last place (2^-FIXED_FRACTION_BITS)
+// of the exact value; tan near its poles, asin and acos near +-1 and large
+// powers lose more because their inputs are already rounded.
+//
+// The evaluator runs this arithmetic in NUMBER_MODE_FIXED. Building with
+// -DCALCULATOR_FIXED_POINT makes that mode the default for new calculators.
+#ifndef FIXED_FRACTION_BITS
+#define FIXED_FRACTION_BITS 16
+#endif
+#if FIXED_FRACTION_BITS < 1 || FIXED_FRACTION_BITS > 28
+#error "FIXED_FRACTION_BITS must be between 1 and 28"
+#endif
+
+typedef int32_t Fixed;
+
+#define FIXED_ONE ((Fixed)1 << FIXED_FRACTION_BITS)
+#define FIXED_MAX INT32_MAX
+#define FIXED_MIN INT32_MIN
+
+// Reads [sign] digits [. digits] [e [sign] digits], rounded to the nearest
+// Fixed, and sets *end past it. Returns ERROR_SYNTAX with *end == text if
+// there is no number, and ERROR_OVERFLOW with a saturated value if it is out
+// of range.
+ErrorType fixed_parse(const char* text, const char** end, Fixed* value);
+// Decimal form with just enough fraction digits to tell neighbouring values
+// apart, without trailing zeros. Returns the length written (truncated to
+// fit).
+size_t fixed_format(Fixed value, char* buffer, size_t size);
+// Returns ERROR_OVERFLOW with a saturated value if out of range.
+ErrorType fixed_from_integer(int64_t integer, Fixed* value);
+// Conversions for hosts with floating point, e.g. to compare with doubles.
+Fixed fixed_from_double(double value);
+double fixed_to_double(Fixed value);
+
+// + - * / % and ^. Division and remainder by zero give ERROR_MATH_DIV_ZERO,
+// a non-integer power of a negative number ERROR_MATH_DOMAIN. Any other
+// operator code gives ERROR_SYNTAX.
+ErrorType fixed_apply_binary(char op, Fixed a, Fixed b, Fixed* out);
+// The function codes of apply_operator: s c t S C T (in `angle_mode`),
+// l (ln) L (log10) q (sqrt) E (exp) R (1/x) N (negation) and ! (integers
+// only). Any other code gives ERROR_SYNTAX.
+ErrorType fixed_apply_unary(char op, AngleMode angle_mode, Fixed a, Fixed* out);
+
+#endif
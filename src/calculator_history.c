@@ -0,0 +1,483 @@
+#define _GNU_SOURCE
+#include "calculator_history.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define HISTORY_LOG_MAGIC "MEHLOG1"
+#define HISTORY_INDEX_MAGIC "MEHIDX1"
+#define HISTORY_HEADER_SIZE 64
+#define HISTORY_INITIAL_SIZE (64 * 1024)
+#define SEARCH_PREFIX_KEY (1u << 24)
+#define SEARCH_INITIAL_SLOTS 1024
+#define HISTORY_RECORD_ALIGNMENT 8
+
+typedef struct {
+    char magic[8];
+    uint64_t end;   // log: bytes in use; index: number of entries
+} HistoryFileHeader;
+
+typedef struct {
+    uint32_t expression_length;
+    uint32_t result_length;
+    int64_t timestamp;
+    uint32_t angle_mode;
+    uint32_t reserved;
+} HistoryRecordHeader;
+
+typedef struct {
+    int fd;
+    char* map;
+    size_t size;
+} MappedFile;
+
+// Entries whose expression contains a trigram, oldest first. The first
+// trigram of each expression is also kept under its own key, with
+// SEARCH_PREFIX_KEY set, for prefix queries.
+typedef struct {
+    uint32_t key;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t* entries;
+} Posting;
+
+// Open-addressed on the key; zero marks a free slot, which no trigram of a
+// NUL-terminated string can be
+typedef struct {
+    Posting* slots;
+    size_t capacity;
+    size_t used;
+    // Entries added so far; the rest are added by the next search
+    size_t indexed;
+    int failed;
+} SearchIndex;
+
+struct History {
+    MappedFile log;
+    MappedFile index;
+    SearchIndex search;
+};
+
+static HistoryFileHeader* file_header(const MappedFile* file) {
+    return (HistoryFileHeader*)file->map;
+}
+
+static const uint64_t* index_offsets(const History* history) {
+    return (const uint64_t*)(history->index.map + HISTORY_HEADER_SIZE);
+}
+
+static size_t record_size(uint32_t expression_length, uint32_t result_length) {
+    size_t size = sizeof(HistoryRecordHeader) + expression_length + 1 + result_length + 1;
+    return (size + HISTORY_RECORD_ALIGNMENT - 1) & ~(size_t)(HISTORY_RECORD_ALIGNMENT - 1);
+}
+
+static int mapped_file_open(MappedFile* file, const char* path, const char* magic) {
+    struct stat st;
+
+    file->fd = open(path, O_RDWR | O_CREAT, 0600);
+    file->map = NULL;
+    if (file->fd < 0 || fstat(file->fd, &st) != 0) {
+        return 0;
+    }
+
+    int fresh = st.st_size < HISTORY_HEADER_SIZE;
+    file->size = fresh ? HISTORY_INITIAL_SIZE : (size_t)st.st_size;
+    if (fresh && ftruncate(file->fd, (off_t)file->size) != 0) {
+        return 0;
+    }
+
+    void* map = mmap(NULL, file->size, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, 0);
+    if (map == MAP_FAILED) {
+        return 0;
+    }
+    file->map = (char*)map;
+
+    HistoryFileHeader* header = file_header(file);
+    if (fresh) {
+        memcpy(header->magic, magic, sizeof(header->magic));
+        header->end = 0;
+    }
+    return memcmp(header->magic, magic, sizeof(header->magic)) == 0;
+}
+
+static void mapped_file_close(MappedFile* file) {
+    if (file->map) {
+        munmap(file->map, file->size);
+    }
+    if (file->fd >= 0) {
+        close(file->fd);
+    }
+}
+
+// Grows the file geometrically so appends amortize to O(1) remaps.
+static int mapped_file_reserve(MappedFile* file, size_t needed) {
+    if (needed <= file->size) {
+        return 1;
+    }
+    size_t size = file->size;
+    while (size < needed) {
+        size *= 2;
+    }
+    if (ftruncate(file->fd, (off_t)size) != 0) {
+        return 0;
+    }
+    void* map = mremap(file->map, file->size, size, MREMAP_MAYMOVE);
+    if (map == MAP_FAILED) {
+        return 0;
+    }
+    file->map = (char*)map;
+    file->size = size;
+    return 1;
+}
+
+static const HistoryRecordHeader* record_at(const History* history, uint64_t offset) {
+    uint64_t log_end = HISTORY_HEADER_SIZE + file_header(&history->log)->end;
+    // Offsets come from the files, so compare against what is left of the
+    // log rather than adding to them
+    if (offset < HISTORY_HEADER_SIZE || offset > log_end || log_end - offset < sizeof(HistoryRecordHeader) ||
+        offset % HISTORY_RECORD_ALIGNMENT != 0) {
+        return NULL;
+    }
+    const HistoryRecordHeader* record = (const HistoryRecordHeader*)(history->log.map + offset);
+    if (log_end - offset < record_size(record->expression_length, record->result_length)) {
+        return NULL;
+    }
+    // Both strings must end where their lengths say
+    const char* text = (const char*)(record + 1);
+    if (text[record->expression_length] != '\0' ||
+        text[record->expression_length + 1 + (size_t)record->result_length] != '\0') {
+        return NULL;
+    }
+    return record;
+}
+
+static int index_push(History* history, uint64_t offset) {
+    uint64_t count = file_header(&history->index)->end;
+    if (!mapped_file_reserve(&history->index, HISTORY_HEADER_SIZE + (count + 1) * sizeof(uint64_t))) {
+        return 0;
+    }
+    ((uint64_t*)(history->index.map + HISTORY_HEADER_SIZE))[count] = offset;
+    file_header(&history->index)->end = count + 1;
+    return 1;
+}
+
+// Brings the index up to date with the log after a crash between the two
+// writes of an append, or after the index file was lost. Normal startup
+// never scans the log.
+static int history_recover_index(History* history) {
+    uint64_t count = file_header(&history->index)->end;
+    uint64_t capacity = (history->index.size - HISTORY_HEADER_SIZE) / sizeof(uint64_t);
+    uint64_t log_end = HISTORY_HEADER_SIZE + file_header(&history->log)->end;
+    uint64_t offset = HISTORY_HEADER_SIZE;
+
+    if (count > capacity) {
+        count = 0;
+    }
+    // Drop index entries that do not point at a valid record
+    while (count > 0 && !record_at(history, index_offsets(history)[count - 1])) {
+        count--;
+    }
+    file_header(&history->index)->end = count;
+
+    if (count > 0) {
+        const HistoryRecordHeader* last = record_at(history, index_offsets(history)[count - 1]);
+        offset = index_offsets(history)[count - 1] + record_size(last->expression_length, last->result_length);
+    }
+    while (offset < log_end) {
+        const HistoryRecordHeader* record = record_at(history, offset);
+        if (!record) {
+            // Truncate a torn record at the tail of the log
+            file_header(&history->log)->end = offset - HISTORY_HEADER_SIZE;
+            break;
+        }
+        if (!index_push(history, offset)) {
+            return 0;
+        }
+        offset += record_size(record->expression_length, record->result_length);
+    }
+    return 1;
+}
+
+History* history_open(const char* path) {
+    History* history = (History*)calloc(1, sizeof(History));
+    if (!history) {
+        return NULL;
+    }
+    history->log.fd = -1;
+    history->index.fd = -1;
+
+    size_t length = strlen(path);
+    char* index_path = (char*)malloc(length + sizeof(".idx"));
+    if (!index_path) {
+        free(history);
+        return NULL;
+    }
+    memcpy(index_path, path, length);
+    memcpy(index_path + length, ".idx", sizeof(".idx"));
+
+    int ok = mapped_file_open(&history->log, path, HISTORY_LOG_MAGIC);
+    if (ok && !mapped_file_open(&history->index, index_path, HISTORY_INDEX_MAGIC)) {
+        // A damaged index is only a cache of the log; rebuild it from scratch
+        mapped_file_close(&history->index);
+        unlink(index_path);
+        ok = mapped_file_open(&history->index, index_path, HISTORY_INDEX_MAGIC);
+    }
+    free(index_path);
+
+    if (ok) {
+        uint64_t count = file_header(&history->index)->end;
+        uint64_t log_end = HISTORY_HEADER_SIZE + file_header(&history->log)->end;
+        const uint64_t* offsets = index_offsets(history);
+        const HistoryRecordHeader* last = NULL;
+        if (file_header(&history->log)->end > history->log.size - HISTORY_HEADER_SIZE) {
+            file_header(&history->log)->end = 0;
+            log_end = HISTORY_HEADER_SIZE;
+        }
+        if (count > 0 && HISTORY_HEADER_SIZE + count * sizeof(uint64_t) <= history->index.size) {
+            last = record_at(history, offsets[count - 1]);
+        }
+        // Fast path: the last indexed record ends exactly where the log does
+        int consistent = count == 0 ? log_end == HISTORY_HEADER_SIZE
+                         : last && offsets[count - 1] + record_size(last->expression_length, last->result_length) == log_end;
+        if (!consistent) {
+            ok = history_recover_index(history);
+        }
+    }
+
+    if (!ok) {
+        history_close(history);
+        return NULL;
+    }
+    return history;
+}
+
+static void search_index_free(SearchIndex* index) {
+    for (size_t i = 0; i < index->capacity; i++) {
+        free(index->slots[i].entries);
+    }
+    free(index->slots);
+}
+
+void history_close(History* history) {
+    if (history) {
+        search_index_free(&history->search);
+        mapped_file_close(&history->log);
+        mapped_file_close(&history->index);
+        free(history);
+    }
+}
+
+size_t history_count(const History* history) {
+    return (size_t)file_header(&history->index)->end;
+}
+
+int history_get(const History* history, size_t index, HistoryEntry* entry) {
+    if (index >= history_count(history)) {
+        return 0;
+    }
+    const HistoryRecordHeader* record = record_at(history, index_offsets(history)[index]);
+    if (!record) {
+        return 0;
+    }
+    const char* text = (const char*)(record + 1);
+    entry->expression = text;
+    entry->result = text + record->expression_length + 1;
+    entry->timestamp = record->timestamp;
+    entry->angle_mode = record->angle_mode == RAD ? RAD : DEG;
+    return 1;
+}
+
+int history_append(History* history, const char* expression, const char* result,
+                   AngleMode angle_mode, int64_t timestamp) {
+    size_t expression_length = strlen(expression);
+    size_t result_length = strlen(result);
+    if (expression_length > UINT32_MAX / 2 || result_length > UINT32_MAX / 2) {
+        return 0;
+    }
+
+    uint64_t offset = HISTORY_HEADER_SIZE + file_header(&history->log)->end;
+    size_t size = record_size((uint32_t)expression_length, (uint32_t)result_length);
+    if (!mapped_file_reserve(&history->log, offset + size)) {
+        return 0;
+    }
+
+    HistoryRecordHeader* record = (HistoryRecordHeader*)(history->log.map + offset);
+    record->expression_length = (uint32_t)expression_length;
+    record->result_length = (uint32_t)result_length;
+    record->timestamp = timestamp;
+    record->angle_mode = (uint32_t)angle_mode;
+    record->reserved = 0;
+    char* text = (char*)(record + 1);
+    memcpy(text, expression, expression_length + 1);
+    memcpy(text + expression_length + 1, result, result_length + 1);
+
+    // Commit the record before indexing it so a crash can only leave an
+    // unindexed record, which history_open recovers
+    file_header(&history->log)->end = offset + size - HISTORY_HEADER_SIZE;
+    return index_push(history, offset);
+}
+
+// Search index
+
+static uint32_t gram_key(const char* text) {
+    return (uint32_t)(unsigned char)text[0] << 16 | (uint32_t)(unsigned char)text[1] << 8 | (unsigned char)text[2];
+}
+
+static size_t slot_of(uint32_t key, size_t capacity) {
+    return (size_t)(key * 2654435761u) & (capacity - 1);
+}
+
+static const Posting* search_index_find(const SearchIndex* index, uint32_t key) {
+    if (!index->capacity) {
+        return NULL;
+    }
+    for (size_t i = slot_of(key, index->capacity);; i = (i + 1) & (index->capacity - 1)) {
+        if (index->slots[i].key == key) {
+            return &index->slots[i];
+        }
+        if (index->slots[i].key == 0) {
+            return NULL;
+        }
+    }
+}
+
+static int search_index_grow(SearchIndex* index) {
+    size_t capacity = index->capacity ? index->capacity * 2 : SEARCH_INITIAL_SLOTS;
+    Posting* slots = (Posting*)calloc(capacity, sizeof(Posting));
+    if (!slots) {
+        return 0;
+    }
+    for (size_t i = 0; i < index->capacity; i++) {
+        if (index->slots[i].key) {
+            size_t j = slot_of(index->slots[i].key, capacity);
+            while (slots[j].key) {
+                j = (j + 1) & (capacity - 1);
+            }
+            slots[j] = index->slots[i];
+        }
+    }
+    free(index->slots);
+    index->slots = slots;
+    index->capacity = capacity;
+    return 1;
+}
+
+// Appends `entry` to the key's list unless it is already last there, as it
+// is for a trigram repeated within one expression
+static int search_index_add(SearchIndex* index, uint32_t key, uint32_t entry) {
+    if ((index->used + 1) * 2 > index->capacity && !search_index_grow(index)) {
+        return 0;
+    }
+    size_t i = slot_of(key, index->capacity);
+    while (index->slots[i].key && index->slots[i].key != key) {
+        i = (i + 1) & (index->capacity - 1);
+    }
+    Posting* posting = &index->slots[i];
+    if (!posting->key) {
+        posting->key = key;
+        index->used++;
+    }
+    if (posting->count > 0 && posting->entries[posting->count - 1] == entry) {
+        return 1;
+    }
+    if (posting->count == posting->capacity) {
+        if (posting->capacity > UINT32_MAX / 2) {
+            return 0;
+        }
+        uint32_t capacity = posting->capacity ? posting->capacity * 2 : 4;
+        uint32_t* entries = (uint32_t*)realloc(posting->entries, capacity * sizeof(uint32_t));
+        if (!entries) {
+            return 0;
+        }
+        posting->entries = entries;
+        posting->capacity = capacity;
+    }
+    posting->entries[posting->count++] = entry;
+    return 1;
+}
+
+// Indexes the entries appended since the last search. The first search
+// reads the whole log once; the index lives in memory only, so opening a
+// history stays cheap.
+static int search_index_update(History* history) {
+    SearchIndex* index = &history->search;
+    size_t count = history_count(history);
+
+    if (index->failed || count > UINT32_MAX) {
+        return 0;
+    }
+    for (; index->indexed < count; index->indexed++) {
+        const HistoryRecordHeader* record = record_at(history, index_offsets(history)[index->indexed]);
+        if (!record || record->expression_length < 3) {
+            continue;
+        }
+        const char* expression = (const char*)(record + 1);
+        uint32_t entry = (uint32_t)index->indexed;
+        int ok = search_index_add(index, gram_key(expression) | SEARCH_PREFIX_KEY, entry);
+        for (uint32_t i = 0; ok && i + 3 <= record->expression_length; i++) {
+            ok = search_index_add(index, gram_key(expression + i), entry);
+        }
+        if (!ok) {
+            // Out of memory: searches go back to scanning
+            search_index_free(index);
+            memset(index, 0, sizeof(*index));
+            index->failed = 1;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int expression_matches(const History* history, size_t i, const char* query, size_t query_length,
+                              HistoryMatch match) {
+    const HistoryRecordHeader* record = record_at(history, index_offsets(history)[i]);
+    if (!record || record->expression_length < query_length) {
+        return 0;
+    }
+    const char* expression = (const char*)(record + 1);
+    return match == HISTORY_MATCH_PREFIX
+        ? memcmp(expression, query, query_length) == 0
+        : memmem(expression, record->expression_length, query, query_length) != NULL;
+}
+
+size_t history_search(History* history, const char* query, HistoryMatch match,
+                      size_t* indices, size_t max_results) {
+    size_t query_length = strlen(query);
+    size_t found = 0;
+
+    if (query_length < 3 || !search_index_update(history)) {
+        // Short queries have no trigram to look up, but match often, so the
+        // scan from the newest entry usually stops early
+        for (size_t i = history_count(history); i > 0 && found < max_results; i--) {
+            if (expression_matches(history, i - 1, query, query_length, match)) {
+                indices[found++] = i - 1;
+            }
+        }
+        return found;
+    }
+
+    // Every match has each of the query's trigrams, so only the entries on
+    // the shortest of their lists need to be checked
+    const Posting* shortest = NULL;
+    for (size_t i = 0; i + 3 <= query_length; i++) {
+        uint32_t key = gram_key(query + i) | (match == HISTORY_MATCH_PREFIX && i == 0 ? SEARCH_PREFIX_KEY : 0);
+        const Posting* posting = search_index_find(&history->search, key);
+        if (!posting) {
+            return 0;
+        }
+        if (!shortest || posting->count < shortest->count) {
+            shortest = posting;
+        }
+    }
+    for (uint32_t k = shortest->count; k > 0 && found < max_results; k--) {
+        uint32_t entry = shortest->entries[k - 1];
+        if (expression_matches(history, entry, query, query_length, match)) {
+            indices[found++] = entry;
+        }
+    }
+    return found;
+}
@@ -0,0 +1,48 @@
+#ifndef CALCULATOR_HISTORY_H
+#define CALCULATOR_HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "calculator_logic.h"
+
+// Persistent evaluation history. Entries are appended to a memory-mapped log
+// file and a fixed-width offset index is kept in a sidecar file ("<path>.idx"),
+// so opening a history with millions of entries only maps two files and reads
+// a count; nothing is parsed until an entry is requested.
+typedef struct History History;
+
+// Strings point into the mapping and stay valid until the next append or
+// until the history is closed.
+typedef struct {
+    const char* expression;
+    const char* result;
+    int64_t timestamp;
+    AngleMode angle_mode;
+} HistoryEntry;
+
+typedef enum {
+    HISTORY_MATCH_PREFIX,
+    HISTORY_MATCH_SUBSTRING
+} HistoryMatch;
+
+History* history_open(const char* path);
+void history_close(History* history);
+
+size_t history_count(const History* history);
+int history_get(const History* history, size_t index, HistoryEntry* entry);
+int history_append(History* history, const char* expression, const char* result,
+                   AngleMode angle_mode, int64_t timestamp);
+
+// Writes the indices of matching entries, newest first, and returns how many
+// were written. An empty query matches every entry.
+//
+// Queries of three bytes or more look up an in-memory trigram index and
+// check only the entries on the rarest of the query's trigram lists, so
+// their cost follows the number of candidates rather than the history
+// size; prefix queries use a separate list per leading trigram. The first
+// search builds the index in one pass over the log, later ones add only
+// new entries. Shorter queries scan from the newest entry.
+size_t history_search(History* history, const char* query, HistoryMatch match,
+                      size_t* indices, size_t max_results);
+
+#endif
@@ -0,0 +1,240 @@
+#include "calculator_integer.h"
+#include <ctype.h>
+
+typedef unsigned __int128 UInteger;
+
+static Integer integer_max(int bits) {
+    return (Integer)(((UInteger)1 << (bits - 1)) - 1);
+}
+
+static Integer integer_min(int bits) {
+    return -integer_max(bits) - 1;
+}
+
+static int in_range(int bits, Integer value) {
+    return value >= integer_min(bits) && value <= integer_max(bits);
+}
+
+static UInteger bit_mask(int bits) {
+    return bits >= 128 ? ~(UInteger)0 : ((UInteger)1 << bits) - 1;
+}
+
+// Sign-extends the low `bits` of a pattern
+static Integer from_pattern(int bits, UInteger pattern) {
+    if (bits < 128 && (pattern >> (bits - 1)) & 1) {
+        pattern |= ~bit_mask(bits);
+    }
+    return (Integer)pattern;
+}
+
+int integer_is_bitwise_operator(char op) {
+    return op == OP_BIT_AND || op == OP_BIT_OR || op == OP_XOR || op == OP_SHIFT_LEFT || op == OP_SHIFT_RIGHT;
+}
+
+static int prefix_base(const char* p) {
+    if (p[0] != '0') {
+        return 0;
+    }
+    switch (p[1]) {
+        case 'x': case 'X': return isxdigit((unsigned char)p[2]) ? 16 : 0;
+        case 'o': case 'O': return p[2] >= '0' && p[2] <= '7' ? 8 : 0;
+        case 'b': case 'B': return p[2] == '0' || p[2] == '1' ? 2 : 0;
+        default: return 0;
+    }
+}
+
+int integer_has_base_prefix(const char* text) {
+    if (*text == '+' || *text == '-') {
+        text++;
+    }
+    return prefix_base(text) != 0;
+}
+
+static int digit_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return 99;
+}
+
+ErrorType integer_parse(int bits, int bit_patterns, const char* text, const char** end, Integer* value) {
+    const char* p = text;
+    int negative = 0, base = 10, overflow = 0;
+    UInteger magnitude = 0;
+
+    *end = text;
+    if (*p == '+' || *p == '-') {
+        negative = *p == '-';
+        p++;
+    }
+    if (prefix_base(p)) {
+        base = prefix_base(p);
+        p += 2;
+    }
+    if (digit_value(*p) >= base) {
+        return ERROR_NONE;
+    }
+    for (; digit_value(*p) < base; p++) {
+        UInteger next = magnitude * (UInteger)base + (UInteger)digit_value(*p);
+        if (magnitude > (~(UInteger)0 - (UInteger)digit_value(*p)) / (UInteger)base) {
+            overflow = 1;
+        }
+        magnitude = next;
+    }
+    *end = p;
+
+    if (!overflow && base != 10 && bit_patterns && magnitude <= bit_mask(bits)) {
+        Integer pattern = from_pattern(bits, magnitude);
+        if (negative && pattern == integer_min(bits)) {
+            return ERROR_OVERFLOW;
+        }
+        *value = negative ? -pattern : pattern;
+        return ERROR_NONE;
+    }
+    UInteger limit = (UInteger)integer_max(bits) + (negative ? 1 : 0);
+    if (overflow || magnitude > limit) {
+        return ERROR_OVERFLOW;
+    }
+    *value = negative ? (Integer)(0 - magnitude) : (Integer)magnitude;
+    return ERROR_NONE;
+}
+
+size_t integer_format(int bits, int base, Integer value, char* buffer, size_t size) {
+    char digits[140];
+    size_t n = 0, length = 0;
+    const char* prefix = base == 16 ? "0x" : base == 8 ? "0o" : base == 2 ? "0b" : "";
+    int negative = base == 10 && value < 0;
+    UInteger magnitude = base == 10 ? (negative ? 0 - (UInteger)value : (UInteger)value)
+                                    : (UInteger)value & bit_mask(bits);
+    char text[160];
+
+    do {
+        digits[n++] = "0123456789abcdef"[magnitude % (UInteger)base];
+        magnitude /= (UInteger)base;
+    } while (magnitude != 0);
+
+    if (negative) {
+        text[length++] = '-';
+    }
+    while (*prefix) {
+        text[length++] = *prefix++;
+    }
+    while (n > 0) {
+        text[length++] = digits[--n];
+    }
+    if (size == 0) {
+        return 0;
+    }
+    if (length >= size) {
+        length = size - 1;
+    }
+    for (size_t i = 0; i < length; i++) {
+        buffer[i] = text[i];
+    }
+    buffer[length] = '\0';
+    return length;
+}
+
+static ErrorType checked(int bits, int overflow, const Integer* value, Integer* out) {
+    if (overflow || !in_range(bits, *value)) {
+        return ERROR_OVERFLOW;
+    }
+    *out = *value;
+    return ERROR_NONE;
+}
+
+static ErrorType integer_power(int bits, Integer base, Integer exponent, Integer* out) {
+    Integer result = 1;
+    if (exponent < 0) {
+        return ERROR_MATH_DOMAIN;
+    }
+    // Powers of 0, 1 and -1 never overflow, whatever the exponent
+    if (base == 0 || base == 1) {
+        *out = exponent == 0 ? 1 : base;
+        return ERROR_NONE;
+    }
+    if (base == -1) {
+        *out = exponent % 2 == 0 ? 1 : -1;
+        return ERROR_NONE;
+    }
+    while (exponent > 0) {
+        if (exponent & 1) {
+            if (__builtin_mul_overflow(result, base, &result) || !in_range(bits, result)) {
+                return ERROR_OVERFLOW;
+            }
+        }
+        exponent >>= 1;
+        if (exponent > 0 && (__builtin_mul_overflow(base, base, &base) || !in_range(bits, base))) {
+            return ERROR_OVERFLOW;
+        }
+    }
+    *out = result;
+    return ERROR_NONE;
+}
+
+ErrorType integer_apply_binary(int bits, char op, Integer a, Integer b, Integer* out) {
+    Integer result;
+    switch (op) {
+        case '+': return checked(bits, __builtin_add_overflow(a, b, &result), &result, out);
+        case '-': return checked(bits, __builtin_sub_overflow(a, b, &result), &result, out);
+        case '*': return checked(bits, __builtin_mul_overflow(a, b, &result), &result, out);
+        case '/':
+            if (b == 0) {
+                return ERROR_MATH_DIV_ZERO;
+            }
+            if (a == integer_min(bits) && b == -1) {
+                return ERROR_OVERFLOW;
+            }
+            *out = a / b;
+            return ERROR_NONE;
+        case '%':
+            if (b == 0) {
+                return ERROR_MATH_DIV_ZERO;
+            }
+            *out = b == -1 ? 0 : a % b;
+            return ERROR_NONE;
+        case '^': return integer_power(bits, a, b, out);
+        case OP_BIT_AND: *out = a & b; return ERROR_NONE;
+        case OP_BIT_OR: *out = a | b; return ERROR_NONE;
+        case OP_XOR: *out = a ^ b; return ERROR_NONE;
+        case OP_SHIFT_LEFT:
+        case OP_SHIFT_RIGHT:
+            if (b < 0 || b >= bits) {
+                return ERROR_MATH_DOMAIN;
+            }
+            if (op == OP_SHIFT_RIGHT) {
+                *out = a >> (int)b;
+                return ERROR_NONE;
+            }
+            result = (Integer)((UInteger)a << (int)b);
+            // The shift loses bits if shifting back does not restore a
+            return checked(bits, (result >> (int)b) != a, &result, out);
+        default:
+            return ERROR_SYNTAX;
+    }
+}
+
+ErrorType integer_apply_unary(int bits, char op, Integer a, Integer* out) {
+    Integer result = 1;
+    switch (op) {
+        case 'N':
+            if (a == integer_min(bits)) {
+                return ERROR_OVERFLOW;
+            }
+            *out = -a;
+            return ERROR_NONE;
+        case '!':
+            if (a < 0) {
+                return ERROR_MATH_DOMAIN;
+            }
+            for (Integer i = 2; i <= a; i++) {
+                if (__builtin_mul_overflow(result, i, &result) || !in_range(bits, result)) {
+                    return ERROR_OVERFLOW;
+                }
+            }
+            *out = result;
+            return ERROR_NONE;
+        default:
+            return ERROR_SYNTAX;
+    }
+}
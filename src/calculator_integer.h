@@ -0,0 +1,42 @@
+#ifndef CALCULATOR_INTEGER_H
+#define CALCULATOR_INTEGER_H
+
+#include <stddef.h>
+#include "calculator_logic.h"
+
+// Exact two's-complement integer arithmetic for the programmer modes and
+// the integer fast path. Values are held in an Integer whatever the width;
+// `bits` (64 or 128) selects the range every result is checked against, and
+// a result outside it is ERROR_OVERFLOW rather than a wrapped value.
+
+// Operator codes of the integer operators. `&` and `|` are typed as is;
+// xor, << and >> are spelled out and map to these codes, `mod` maps to '%'.
+#define OP_BIT_AND '&'
+#define OP_BIT_OR '|'
+#define OP_XOR '#'
+#define OP_SHIFT_LEFT '{'
+#define OP_SHIFT_RIGHT '}'
+
+// True for the operators that only make sense on integers.
+int integer_is_bitwise_operator(char op);
+// True if `text` starts with a 0x, 0o or 0b prefix, after an optional sign.
+int integer_has_base_prefix(const char* text);
+
+// Reads [sign] digits, or a 0x/0o/0b literal, and sets *end past it;
+// *end == text if there is no number. Decimal literals must fit in `bits`.
+// Prefixed literals may also spell a full-width bit pattern (0xFF..FF is -1)
+// when `bit_patterns` is set. Returns ERROR_OVERFLOW if the literal is out
+// of range.
+ErrorType integer_parse(int bits, int bit_patterns, const char* text, const char** end, Integer* value);
+// Base 10 is signed; bases 2, 8 and 16 show the two's-complement bit pattern
+// with a 0b, 0o or 0x prefix. Returns the length written (truncated to fit).
+size_t integer_format(int bits, int base, Integer value, char* buffer, size_t size);
+
+// `/` truncates toward zero, `%` takes the sign of the dividend, `^` needs
+// a non-negative exponent and shifts need a count below `bits`; a left shift
+// that loses bits overflows. Any other operator code gives ERROR_SYNTAX.
+ErrorType integer_apply_binary(int bits, char op, Integer a, Integer b, Integer* out);
+// Negation ('N') and factorial ('!'); any other code gives ERROR_SYNTAX.
+ErrorType integer_apply_unary(int bits, char op, Integer a, Integer* out);
+
+#endif
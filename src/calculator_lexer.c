@@ -0,0 +1,468 @@
+#include "calculator_lexer.h"
+#include "calculator_decimal.h"
+#include "calculator_integer.h"
+#include "calculator_fixed.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Longest literal read without strtod: up to 15 significant digits fit a
+// double exactly, and so does 10^15, so one division rounds correctly
+#define LEXER_FAST_DIGITS 15
+#define LEXER_INITIAL_CAPACITY 64
+
+typedef const char* (*LexerScan)(const char* p, const char* end);
+
+static pthread_once_t lexer_once = PTHREAD_ONCE_INIT;
+static LexerIsa lexer_best = LEXER_ISA_SCALAR;
+static LexerIsa lexer_active = LEXER_ISA_SCALAR;
+
+static const double powers_of_ten[LEXER_FAST_DIGITS + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15
+};
+
+static int is_space(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static int is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static int is_letter(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static const char* skip_space_scalar(const char* p, const char* end) {
+    while (p < end && is_space(*p)) {
+        p++;
+    }
+    return p;
+}
+
+static const char* skip_digits_scalar(const char* p, const char* end) {
+    while (p < end && is_digit(*p)) {
+        p++;
+    }
+    return p;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// A byte is in [lo, lo + span] if subtracting lo leaves it no larger than
+// span as an unsigned byte; _mm_min_epu8 does the unsigned compare
+
+__attribute__((target("sse2")))
+static const char* skip_space_sse2(const char* p, const char* end) {
+    const __m128i blank = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t'), span = _mm_set1_epi8('\r' - '\t');
+    while (end - p >= 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)p);
+        __m128i t = _mm_sub_epi8(x, tab);
+        __m128i space = _mm_or_si128(_mm_cmpeq_epi8(x, blank), _mm_cmpeq_epi8(_mm_min_epu8(t, span), t));
+        unsigned mask = ~(unsigned)_mm_movemask_epi8(space) & 0xffffu;
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+    return skip_space_scalar(p, end);
+}
+
+__attribute__((target("sse2")))
+static const char* skip_digits_sse2(const char* p, const char* end) {
+    const __m128i zero = _mm_set1_epi8('0'), span = _mm_set1_epi8(9);
+    while (end - p >= 16) {
+        __m128i t = _mm_sub_epi8(_mm_loadu_si128((const __m128i*)p), zero);
+        unsigned mask = ~(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(t, span), t)) & 0xffffu;
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+    return skip_digits_scalar(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char* skip_space_avx2(const char* p, const char* end) {
+    const __m256i blank = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t'), span = _mm256_set1_epi8('\r' - '\t');
+    while (end - p >= 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)p);
+        __m256i t = _mm256_sub_epi8(x, tab);
+        __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(x, blank), _mm256_cmpeq_epi8(_mm256_min_epu8(t, span), t));
+        unsigned mask = ~(unsigned)_mm256_movemask_epi8(space);
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return skip_space_sse2(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char* skip_digits_avx2(const char* p, const char* end) {
+    const __m256i zero = _mm256_set1_epi8('0'), span = _mm256_set1_epi8(9);
+    while (end - p >= 32) {
+        __m256i t = _mm256_sub_epi8(_mm256_loadu_si256((const __m256i*)p), zero);
+        unsigned mask = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(t, span), t));
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return skip_digits_sse2(p, end);
+}
+#endif
+
+static void lexer_init(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        lexer_best = LEXER_ISA_AVX2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        lexer_best = LEXER_ISA_SSE2;
+    }
+#endif
+    lexer_active = lexer_best;
+}
+
+LexerIsa lexer_best_isa(void) {
+    pthread_once(&lexer_once, lexer_init);
+    return lexer_best;
+}
+
+LexerIsa lexer_get_isa(void) {
+    pthread_once(&lexer_once, lexer_init);
+    return lexer_active;
+}
+
+int lexer_set_isa(LexerIsa isa) {
+    pthread_once(&lexer_once, lexer_init);
+    if (isa > lexer_best) {
+        return 0;
+    }
+    lexer_active = isa;
+    return 1;
+}
+
+const char* lexer_isa_name(LexerIsa isa) {
+    switch (isa) {
+        case LEXER_ISA_SCALAR: return "scalar";
+        case LEXER_ISA_SSE2: return "sse2";
+        case LEXER_ISA_AVX2: return "avx2";
+    }
+    return "unknown";
+}
+
+LexTokens* lex_tokens_new(void) {
+    LexTokens* tokens = (LexTokens*)malloc(sizeof(LexTokens));
+    if (tokens) {
+        tokens->items = NULL;
+        tokens->count = 0;
+        tokens->capacity = 0;
+    }
+    return tokens;
+}
+
+void lex_tokens_free(LexTokens* tokens) {
+    if (tokens) {
+        free(tokens->items);
+        free(tokens);
+    }
+}
+
+// Scanning state of one call to lexer_tokenize. It is never written while
+// scanning; the output position stays in a local of the main loop, so the
+// byte-sized stores of a token cannot force it back to memory.
+typedef struct {
+    const char* end;
+    NumberMode mode;
+    LexerScan skip_space;
+    LexerScan skip_digits;
+} Lexer;
+
+// A token recognized by one of the helpers below, or an error
+typedef struct {
+    const char* stop;
+    LexKind kind;
+    char op;
+    double value;
+} Lexeme;
+
+static Lexeme lexeme(LexKind kind, char op, const char* stop, double value) {
+    Lexeme result = {stop, kind, op, value};
+    return result;
+}
+
+static Lexeme lex_error(ErrorType error, const char* at) {
+    return lexeme(LEX_ERROR, (char)error, at, 0.0);
+}
+
+// Short digit runs are the common case; only a run longer than a vector's
+// setup cost goes to the vector scan
+static const char* scan_digits(const Lexer* lexer, const char* p) {
+    for (int i = 0; i < 8; i++, p++) {
+        if (!is_digit(*p)) {
+            return p;
+        }
+    }
+    return lexer->skip_digits(p, lexer->end);
+}
+
+// Reads a real-mode literal. Plain digits with an optional fraction take
+// Clinger's fast path; exponents and longer mantissas go through strtod.
+static const char* lex_real_number(const Lexer* lexer, const char* start, double* value) {
+    const char* p = start;
+    int negative = 0;
+    if (*p == '+' || *p == '-') {
+        negative = *p == '-';
+        p++;
+    }
+    const char* int_end = scan_digits(lexer, p);
+    const char* frac_start = int_end;
+    const char* frac_end = int_end;
+    if (*int_end == '.') {
+        frac_start = int_end + 1;
+        frac_end = scan_digits(lexer, frac_start);
+    }
+    size_t int_digits = (size_t)(int_end - p);
+    size_t frac_digits = (size_t)(frac_end - frac_start);
+    if (int_digits + frac_digits > 0 && int_digits + frac_digits <= LEXER_FAST_DIGITS &&
+        *frac_end != 'e' && *frac_end != 'E') {
+        uint64_t mantissa = 0;
+        for (const char* d = p; d < int_end; d++) {
+            mantissa = mantissa * 10 + (uint64_t)(*d - '0');
+        }
+        for (const char* d = frac_start; d < frac_end; d++) {
+            mantissa = mantissa * 10 + (uint64_t)(*d - '0');
+        }
+        double v = (double)mantissa;
+        if (frac_digits > 0) {
+            v /= powers_of_ten[frac_digits];
+        }
+        *value = negative ? -v : v;
+        return frac_end;
+    }
+    char* stop;
+    *value = strtod(start, &stop);
+    return stop;
+}
+
+static const char* lex_number(const Lexer* lexer, const char* start, double* value) {
+    const char* stop = start;
+    const char* digits = start + (*start == '+' || *start == '-');
+    Integer integer = 0;
+    *value = 0.0;
+    if (lexer->mode == NUMBER_MODE_INT64 || lexer->mode == NUMBER_MODE_INT128) {
+        // Range errors are left to the evaluator, which parses the literal
+        // again with the mode's width
+        integer_parse(128, 0, start, &stop, &integer);
+    } else if (*digits == '0' && is_letter(digits[1]) && integer_has_base_prefix(start)) {
+        if (lexer->mode == NUMBER_MODE_DECIMAL64 || lexer->mode == NUMBER_MODE_DECIMAL128) {
+            integer_parse(128, 0, start, &stop, &integer);
+        } else if (integer_parse(64, 0, start, &stop, &integer) != ERROR_NONE) {
+            return NULL;
+        }
+        *value = (double)integer;
+    } else if (lexer->mode == NUMBER_MODE_FIXED) {
+        // The evaluator reads the literal again; a range error is its to report
+        Fixed fixed;
+        fixed_parse(start, &stop, &fixed);
+    } else if (lexer->mode == NUMBER_MODE_DECIMAL64 || lexer->mode == NUMBER_MODE_DECIMAL128) {
+        decimal_parse(lexer->mode == NUMBER_MODE_DECIMAL64 ? DECIMAL_64 : DECIMAL_128, start, &stop);
+    } else {
+        stop = lex_real_number(lexer, start, value);
+    }
+    return stop;
+}
+
+static Lexeme lex_number_token(const Lexer* lexer, const char* start, int after_value) {
+    double value;
+    if (*start == '.' && after_value) {
+        return lex_error(ERROR_SYNTAX, start);
+    }
+    const char* stop = lex_number(lexer, start, &value);
+    if (!stop) {
+        return lex_error(ERROR_OVERFLOW, start);
+    }
+    if (stop == start || stop - start > UINT16_MAX) {
+        return lex_error(ERROR_SYNTAX, start);
+    }
+    return lexeme(LEX_NUMBER, '\0', stop, value);
+}
+
+static Lexeme lex_name_token(const Lexer* lexer, const char* start) {
+    const char* p = start;
+    size_t name_length = 0;
+    char op;
+
+    if ((op = calculator_named_operator(p, &name_length)) != '\0') {
+        return lexeme(LEX_OPERATOR, op, p + name_length, 0.0);
+    }
+    if ((op = calculator_named_function(p, &name_length)) != '\0') {
+        return lexeme(LEX_FUNCTION, op, p + name_length, 0.0);
+    }
+    if ((*p == 'p' || *p == 'e') && (lexer->mode == NUMBER_MODE_INT64 || lexer->mode == NUMBER_MODE_INT128)) {
+        // The constants have no integer value
+        return lex_error(ERROR_SYNTAX, p);
+    }
+    if (*p == 'p' || *p == 'e' || (*p == 'i' && lexer->mode == NUMBER_MODE_COMPLEX && !is_letter(p[1]))) {
+        return lexeme(LEX_CONSTANT, *p, p + 1, 0.0);
+    }
+    // Any other name is a function called by its first letter
+    for (int letters = 0; is_letter(*p) && letters < MAX_FUNCTION_NAME_LENGTH - 1; letters++) {
+        p++;
+    }
+    return lexeme(LEX_FUNCTION, *start, p, 0.0);
+}
+
+static Lexeme lex_quoted_token(const Lexer* lexer, const char* start) {
+    const char* close = memchr(start + 1, '"', (size_t)(lexer->end - start - 1));
+    if (!close || close + 1 - start > UINT16_MAX) {
+        return lex_error(ERROR_SYNTAX, start);
+    }
+    return lexeme(LEX_STRING, '"', close + 1, 0.0);
+}
+
+static Lexeme lex_variable_token(const char* start) {
+    const char* p = start + 1;
+    while (is_letter(*p) || is_digit(*p) || *p == '_') {
+        p++;
+    }
+    if (p - start == 1 || p - start > UINT16_MAX) {
+        return lex_error(ERROR_SYNTAX, start);
+    }
+    return lexeme(LEX_VARIABLE, '$', p, 0.0);
+}
+
+static LexToken* put(LexToken* out, const char* expression, LexKind kind, char op, const char* start, const char* stop, double value) {
+    out->value = value;
+    out->offset = (uint32_t)(start - expression);
+    out->length = (uint16_t)(stop - start);
+    out->kind = (uint8_t)kind;
+    out->op = op;
+    return out + 1;
+}
+
+ErrorType lexer_tokenize(LexTokens* tokens, const char* expression, NumberMode mode) {
+    pthread_once(&lexer_once, lexer_init);
+    size_t length = strlen(expression);
+    // Every token but a final error consumes at least one byte, so this
+    // many never needs to grow while scanning
+    size_t needed = length > UINT32_MAX ? 1 : length + 1;
+    Lexer lexer = {expression + length, mode, skip_space_scalar, skip_digits_scalar};
+#if defined(__x86_64__) || defined(__i386__)
+    if (lexer_active == LEXER_ISA_AVX2) {
+        lexer.skip_space = skip_space_avx2;
+        lexer.skip_digits = skip_digits_avx2;
+    } else if (lexer_active == LEXER_ISA_SSE2) {
+        lexer.skip_space = skip_space_sse2;
+        lexer.skip_digits = skip_digits_sse2;
+    }
+#endif
+    tokens->count = 0;
+    if (tokens->capacity < needed) {
+        size_t capacity = needed < LEXER_INITIAL_CAPACITY ? LEXER_INITIAL_CAPACITY : needed;
+        LexToken* items = (LexToken*)realloc(tokens->items, capacity * sizeof(LexToken));
+        if (!items) {
+            return ERROR_OUT_OF_MEMORY;
+        }
+        tokens->items = items;
+        tokens->capacity = capacity;
+    }
+    LexToken* out = tokens->items;
+    if (length > UINT32_MAX) {
+        out = put(out, expression, LEX_ERROR, (char)ERROR_SYNTAX, expression, expression, 0.0);
+        tokens->count = 1;
+        return ERROR_NONE;
+    }
+
+    const char* p = expression;
+    const char* end = lexer.end;
+    // Whether the last token ends a value: a sign after one is a binary
+    // operator, and a '.' after one is malformed
+    int after_value = 0;
+
+    while (p < end) {
+        const char* start = p;
+        Lexeme token;
+        switch (*p) {
+            case ' ': case '\t': case '\n': case '\v': case '\f': case '\r':
+                // Single blanks between tokens are the common case
+                p = is_space(p[1]) ? lexer.skip_space(p + 1, end) : p + 1;
+                continue;
+            case '(': case '[': case ',':
+                out = put(out, expression, LEX_PUNCTUATION, *p, start, p + 1, 0.0);
+                p++;
+                after_value = 0;
+                continue;
+            case ')': case ']':
+                out = put(out, expression, LEX_PUNCTUATION, *p, start, p + 1, 0.0);
+                p++;
+                after_value = 1;
+                continue;
+            case '+': case '-':
+                if (after_value || !(is_digit(p[1]) || p[1] == '.')) {
+                    token = lexeme(LEX_OPERATOR, *p, p + 1, 0.0);
+                } else {
+                    token = lex_number_token(&lexer, p, after_value);
+                }
+                break;
+            case '.':
+                token = lex_number_token(&lexer, p, after_value);
+                break;
+            case '<': case '>':
+                if (p[1] == *p) {
+                    token = lexeme(LEX_OPERATOR, *p == '<' ? OP_SHIFT_LEFT : OP_SHIFT_RIGHT, p + 2, 0.0);
+                } else if (p[1] == '=') {
+                    token = lexeme(LEX_OPERATOR, *p == '<' ? OP_LESS_EQUAL : OP_GREATER_EQUAL, p + 2, 0.0);
+                } else {
+                    token = lexeme(LEX_OPERATOR, *p == '<' ? OP_LESS : OP_GREATER, p + 1, 0.0);
+                }
+                break;
+            case '=': case '!':
+                // "3!=6" is a comparison, not a factorial
+                token = p[1] == '=' ? lexeme(LEX_OPERATOR, *p == '=' ? OP_EQUAL : OP_NOT_EQUAL, p + 2, 0.0)
+                                    : lexeme(LEX_OPERATOR, *p, p + 1, 0.0);
+                break;
+            case '&': case '|':
+                token = p[1] == *p ? lexeme(LEX_OPERATOR, *p == '&' ? OP_AND : OP_OR, p + 2, 0.0)
+                                   : lexeme(LEX_OPERATOR, *p, p + 1, 0.0);
+                break;
+            case '$':
+                token = lex_variable_token(p);
+                break;
+            case '"':
+                token = lex_quoted_token(&lexer, p);
+                break;
+            default:
+                if (is_digit(*p)) {
+                    token = lex_number_token(&lexer, p, after_value);
+                } else if (is_letter(*p)) {
+                    token = lex_name_token(&lexer, p);
+                } else {
+                    token = lexeme(LEX_OPERATOR, *p, p + 1, 0.0);
+                }
+                break;
+        }
+
+        if (token.kind == LEX_ERROR) {
+            out = put(out, expression, LEX_ERROR, token.op, token.stop, token.stop, 0.0);
+            break;
+        }
+        out = put(out, expression, token.kind, token.op, start, token.stop, token.value);
+        p = token.stop;
+        after_value = token.kind == LEX_NUMBER || token.kind == LEX_CONSTANT ||
+                      token.kind == LEX_VARIABLE || token.kind == LEX_STRING;
+        // A '.' right after a complete number ("2.3.4") is reported once the
+        // number itself has been evaluated
+        if (token.kind == LEX_NUMBER && *p == '.') {
+            out = put(out, expression, LEX_ERROR, (char)ERROR_SYNTAX, p, p, 0.0);
+            break;
+        }
+    }
+    tokens->count = (size_t)(out - tokens->items);
+    return ERROR_NONE;
+}
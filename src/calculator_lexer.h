@@ -0,0 +1,71 @@
+#ifndef CALCULATOR_LEXER_H
+#define CALCULATOR_LEXER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "calculator_logic.h"
+
+// First stage of evaluation: turns an expression into a flat token array
+// before any operator is applied. Character classes are plain ASCII, never
+// the locale's <ctype.h> tables. Whitespace and digit runs are classified
+// 16 bytes at a time with SSE2 or 32 with AVX2, whichever the CPU supports.
+typedef enum {
+    LEXER_ISA_SCALAR,
+    LEXER_ISA_SSE2,
+    LEXER_ISA_AVX2
+} LexerIsa;
+
+typedef enum {
+    // `value` holds the number in the real and complex modes; the decimal
+    // and integer modes parse the text again at `offset` for the exact value
+    LEX_NUMBER,
+    // `op` is the operator code, also for "<<", ">>", the two-character
+    // comparisons and logical operators, and operator words
+    LEX_OPERATOR,
+    // `op` is the function code
+    LEX_FUNCTION,
+    // `op` is 'p', 'e', or 'i' for the imaginary unit in complex mode
+    LEX_CONSTANT,
+    // "$name", including the '$'
+    LEX_VARIABLE,
+    // "\"path\"", including both quotes
+    LEX_STRING,
+    // `op` is one of ( ) [ ] ,
+    LEX_PUNCTUATION,
+    // Always the last token; `op` holds the ErrorType
+    LEX_ERROR
+} LexKind;
+
+typedef struct {
+    double value;
+    uint32_t offset;
+    uint16_t length;
+    uint8_t kind;
+    char op;
+} LexToken;
+
+struct LexTokens {
+    LexToken* items;
+    size_t count;
+    size_t capacity;
+};
+
+LexTokens* lex_tokens_new(void);
+void lex_tokens_free(LexTokens* tokens);
+
+// Replaces the contents of `tokens` with the tokens of `expression`. Number
+// syntax and the letters 'p', 'e' and 'i' depend on `mode`. A malformed
+// number, an unterminated string or a token longer than 65535 bytes ends
+// the array with a LEX_ERROR token at the point it occurs, so errors are
+// still reported in expression order. Returns ERROR_OUT_OF_MEMORY if the
+// array cannot grow, otherwise ERROR_NONE.
+ErrorType lexer_tokenize(LexTokens* tokens, const char* expression, NumberMode mode);
+
+LexerIsa lexer_best_isa(void);
+LexerIsa lexer_get_isa(void);
+// Selects the scanning kernels, mainly for tests and benchmarks. Returns 0
+// and keeps the current ones if the CPU does not support `isa`.
+int lexer_set_isa(LexerIsa isa);
+const char* lexer_isa_name(LexerIsa isa);
+
+#endif
@@ -1,10 +1,28 @@
 #include "calculator_logic.h"
+#include "calculator_complex.h"
+#include "calculator_matrix.h"
+#include "calculator_vecmath.h"
+#include "calculator_parallel.h"
+#include "calculator_program.h"
+#include "calculator_decimal.h"
+#include "calculator_integer.h"
+#include "calculator_stats.h"
+#include "calculator_lexer.h"
+#include "calculator_random.h"
+#include "calculator_trace.h"
+#include "calculator_fixed.h"
+#include "calculator_cache.h"
+#include "calculator_rational.h"
+#include "calculator_special.h"
+#include "calculator_numtheory.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
-#include <ctype.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <limits.h>
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -13,6 +31,67 @@
 #define M_E 2.71828182845904523536
 #endif
 
+// Constants to decimal128 precision for the decimal modes
+#define DECIMAL_PI "3.141592653589793238462643383279503"
+#define DECIMAL_E "2.718281828459045235360287471352662"
+
+// The clock is read once per this many charged operations
+#define BUDGET_CLOCK_INTERVAL 256
+
+// 2^53: a literal that rounds to a smaller magnitude was an exact double.
+// One that rounds to 2^53 itself may have been 2^53 + 1.
+#define INTEGER_FAST_PATH_EXACT 9007199254740992.0
+
+// Precedence of the function codes, above every binary operator
+#define FUNCTION_PRECEDENCE 12
+
+// Operator codes for the matrix functions; reachable by name or by letter
+#define OP_MATMUL '@'
+#define OP_DETERMINANT 'D'
+#define OP_INVERSE 'I'
+#define OP_TRANSPOSE 'X'
+#define OP_SOLVE 'V'
+
+// Operator codes for the statistics functions
+#define OP_MEAN 'A'
+#define OP_VARIANCE 'W'
+#define OP_STDDEV 'Z'
+#define OP_MIN 'J'
+#define OP_MAX 'K'
+#define OP_MEDIAN 'M'
+#define OP_PERCENTILE 'P'
+
+// Operator codes for the random functions
+#define OP_RAND 'U'
+#define OP_RANDN 'G'
+#define OP_UNIFORM 'F'
+#define OP_NORMAL 'H'
+#define OP_EXPONENTIAL 'Y'
+#define OP_POISSON 'O'
+
+// if(cond, a, b); only the branch taken is evaluated
+#define OP_IF '?'
+
+// Operator codes for the special functions. They are reachable only by
+// name, so they take control characters, clear of the bytecode's own
+#define OP_ERF '\x10'
+#define OP_ERFC '\x11'
+#define OP_GAMMA '\x12'
+#define OP_LGAMMA '\x13'
+#define OP_BETA '\x14'
+#define OP_BESSEL_J '\x15'
+#define OP_BESSEL_Y '\x16'
+#define OP_LAMBERT_W '\x17'
+#define OP_NORMAL_CDF '\x18'
+#define OP_NORMAL_QUANTILE '\x19'
+
+// Operator codes for the number-theory functions, also reachable only by name
+#define OP_GCD '\x1a'
+#define OP_LCM '\x1b'
+#define OP_IS_PRIME '\x1c'
+#define OP_FACTOR '\x1d'
+#define OP_POWMOD '\x1e'
+
 // Function prototypes for stack operations
 int ns_push(NumberStack* s, double item);
 double ns_pop(NumberStack* s, Calculator* calc);
@@ -23,6 +102,22 @@ int get_precedence(char op);
 void apply_operator(Calculator* calc, char op);
 double factorial(double n, Calculator* calc);
 int is_right_associative(char op);
+static void apply_complex_operator(Calculator* calc, char op);
+static void apply_decimal_operator(Calculator* calc, char op);
+static void apply_integer_operator(Calculator* calc, char op);
+static void apply_stats_operator(Calculator* calc, char op);
+static void apply_random_operator(Calculator* calc, char op);
+static void apply_number_theory_operator(Calculator* calc, char op);
+static int is_number_theory_operator(char op);
+static void apply_fixed_operator(Calculator* calc, char op);
+static void apply_rational_operator(Calculator* calc, char op);
+static void apply_boolean_operator(Calculator* calc, char op);
+static int begin_logical_operator(Calculator* calc, char op);
+static int conditional_comma(Calculator* calc);
+static Decimal pop_decimal(Calculator* calc);
+static void apply_matrix_operator(Calculator* calc, char op);
+static int push_matrix(Calculator* calc, Matrix* m);
+static MatrixArena* calculator_arena(Calculator* calc);
 
 typedef enum {
     TOKEN_NONE,
@@ -34,6 +129,111 @@ typedef enum {
     TOKEN_CONSTANT
 } TokenType;
 
+typedef struct {
+    const char* name;
+    char op;
+} NamedFunction;
+
+// Multi-letter names that do not follow the first-letter convention
+static const NamedFunction named_functions[] = {
+    {"det", OP_DETERMINANT},
+    {"inv", OP_INVERSE},
+    {"transpose", OP_TRANSPOSE},
+    {"solve", OP_SOLVE},
+    {"mean", OP_MEAN},
+    {"var", OP_VARIANCE},
+    {"stddev", OP_STDDEV},
+    {"min", OP_MIN},
+    {"max", OP_MAX},
+    {"median", OP_MEDIAN},
+    {"percentile", OP_PERCENTILE},
+    {"rand", OP_RAND},
+    {"randn", OP_RANDN},
+    {"uniform", OP_UNIFORM},
+    {"normal", OP_NORMAL},
+    {"exponential", OP_EXPONENTIAL},
+    {"poisson", OP_POISSON},
+    {"if", OP_IF},
+    {"erf", OP_ERF},
+    {"erfc", OP_ERFC},
+    {"gamma", OP_GAMMA},
+    {"lgamma", OP_LGAMMA},
+    {"beta", OP_BETA},
+    {"besselj", OP_BESSEL_J},
+    {"bessely", OP_BESSEL_Y},
+    {"lambertw", OP_LAMBERT_W},
+    {"normcdf", OP_NORMAL_CDF},
+    {"norminv", OP_NORMAL_QUANTILE},
+    {"gcd", OP_GCD},
+    {"lcm", OP_LCM},
+    {"isprime", OP_IS_PRIME},
+    {"factor", OP_FACTOR},
+    {"powmod", OP_POWMOD},
+};
+
+// Binary operators spelled as words
+static const NamedFunction named_operators[] = {
+    {"xor", OP_XOR},
+    {"mod", '%'},
+};
+
+// Operators whose spelling differs from their code, for calculator_operator_name
+static const NamedFunction symbol_operators[] = {
+    {"<=", OP_LESS_EQUAL},
+    {">=", OP_GREATER_EQUAL},
+    {"==", OP_EQUAL},
+    {"!=", OP_NOT_EQUAL},
+    {"&&", OP_AND},
+    {"||", OP_OR},
+};
+
+// Length of the run of ASCII letters at `p`
+static size_t letter_run(const char* p) {
+    size_t n = 0;
+    while ((p[n] >= 'a' && p[n] <= 'z') || (p[n] >= 'A' && p[n] <= 'Z')) {
+        n++;
+    }
+    return n;
+}
+
+static char lookup_name(const NamedFunction* table, size_t count, const char* p, size_t* length) {
+    size_t n = letter_run(p);
+    for (size_t i = 0; i < count; i++) {
+        if (strlen(table[i].name) == n && strncmp(p, table[i].name, n) == 0) {
+            *length = n;
+            return table[i].op;
+        }
+    }
+    return '\0';
+}
+
+char calculator_named_operator(const char* p, size_t* length) {
+    return lookup_name(named_operators, sizeof(named_operators) / sizeof(named_operators[0]), p, length);
+}
+
+char calculator_named_function(const char* p, size_t* length) {
+    return lookup_name(named_functions, sizeof(named_functions) / sizeof(named_functions[0]), p, length);
+}
+
+const char* calculator_operator_name(char op) {
+    for (size_t i = 0; i < sizeof(named_functions) / sizeof(named_functions[0]); i++) {
+        if (named_functions[i].op == op) {
+            return named_functions[i].name;
+        }
+    }
+    for (size_t i = 0; i < sizeof(named_operators) / sizeof(named_operators[0]); i++) {
+        if (named_operators[i].op == op) {
+            return named_operators[i].name;
+        }
+    }
+    for (size_t i = 0; i < sizeof(symbol_operators) / sizeof(symbol_operators[0]); i++) {
+        if (symbol_operators[i].op == op) {
+            return symbol_operators[i].name;
+        }
+    }
+    return NULL;
+}
+
 static int needs_implicit_multiplication(TokenType prev, TokenType current) {
     if (prev == TOKEN_NONE) {
         return 0;
@@ -88,21 +288,331 @@ static void format_result(char* buffer, size_t size, double value) {
     }
 }
 
+// Parts smaller than this fraction of the other part are rounding noise from
+// the complex transcendental functions (e.g. e^(i*p)) and are not displayed.
+#define COMPLEX_DISPLAY_EPSILON 1e-14
+
+static void format_complex_result(char* buffer, size_t size, double re, double im) {
+    char re_text[32];
+    char im_text[32];
+
+    if (fabs(im) <= COMPLEX_DISPLAY_EPSILON * fabs(re)) {
+        im = 0.0;
+    }
+    if (fabs(re) <= COMPLEX_DISPLAY_EPSILON * fabs(im)) {
+        re = 0.0;
+    }
+    if (im == 0.0) {
+        format_result(buffer, size, re);
+        return;
+    }
+
+    if (fabs(im) == 1.0) {
+        snprintf(im_text, sizeof(im_text), "%s", im < 0 ? "-" : "");
+    } else {
+        format_result(im_text, sizeof(im_text), im);
+    }
+    if (re == 0.0) {
+        snprintf(buffer, size, "%si", im_text);
+        return;
+    }
+    format_result(re_text, sizeof(re_text), re);
+    snprintf(buffer, size, "%s%s%si", re_text, im < 0 ? "" : "+", im_text);
+}
+
+static int append_text(char* buffer, size_t size, size_t* used, const char* text) {
+    int n = snprintf(buffer + *used, size - *used, "%s", text);
+    if (n < 0 || (size_t)n >= size - *used) {
+        return 0;
+    }
+    *used += (size_t)n;
+    return 1;
+}
+
+static void format_matrix_result(char* buffer, size_t size, const Matrix* m) {
+    size_t used = 0;
+    char number[32];
+    int ok = 1;
+
+    if (m->rows > 1) {
+        ok = append_text(buffer, size, &used, "[");
+    }
+    for (int i = 0; ok && i < m->rows; i++) {
+        ok = append_text(buffer, size, &used, i > 0 ? ", [" : "[");
+        for (int j = 0; ok && j < m->cols; j++) {
+            format_result(number, sizeof(number), m->data[(size_t)i * m->cols + j]);
+            ok = (j == 0 || append_text(buffer, size, &used, ", ")) && append_text(buffer, size, &used, number);
+        }
+        ok = ok && append_text(buffer, size, &used, "]");
+    }
+    if (ok && m->rows > 1) {
+        ok = append_text(buffer, size, &used, "]");
+    }
+    if (!ok) {
+        snprintf(buffer, size, "[%dx%d matrix]", m->rows, m->cols);
+    }
+}
+
+// The matrix or column file an entry holds, or NULL. Pushing only sets the
+// kind, so the pointers are stale for entries of any other kind.
+static inline Matrix* entry_matrix(const NumberStack* numbers, int index) {
+    return numbers->kinds[index] == ENTRY_MATRIX ? numbers->matrices[index] : NULL;
+}
+
+static inline StatsSummary* entry_dataset(const NumberStack* numbers, int index) {
+    return numbers->kinds[index] == ENTRY_DATASET ? numbers->datasets[index] : NULL;
+}
+
+// Folds the values pushed since the matching '[' into a vector (all scalars)
+// or a matrix (all row vectors of the same length).
+static int reduce_matrix_literal(Calculator* calc, int base) {
+    NumberStack* numbers = &calc->numbers;
+    int count = numbers->top - base;
+    if (count <= 0) {
+        calc->error = ERROR_SYNTAX;
+        return 0;
+    }
+
+    Matrix* first = entry_matrix(numbers, base + 1);
+    int rows = first ? count : 1;
+    int cols = first ? first->cols : count;
+    for (int k = base + 1; k <= numbers->top; k++) {
+        Matrix* m = entry_matrix(numbers, k);
+        if ((first == NULL) != (m == NULL) || (m && (m->rows != 1 || m->cols != cols))) {
+            calc->error = ERROR_DIMENSION_MISMATCH;
+            return 0;
+        }
+    }
+
+    MatrixArena* arena = calculator_arena(calc);
+    Matrix* result = arena ? matrix_new(arena, rows, cols) : NULL;
+    if (!result) {
+        calc->error = ERROR_OUT_OF_MEMORY;
+        return 0;
+    }
+    for (int k = 0; k < count; k++) {
+        if (first) {
+            memcpy(result->data + (size_t)k * cols, entry_matrix(numbers, base + 1 + k)->data, (size_t)cols * sizeof(double));
+        } else {
+            result->data[k] = numbers->items[base + 1 + k];
+        }
+    }
+    numbers->top = base;
+    return push_matrix(calc, result);
+}
+
+// Pushes a real literal or constant; in complex mode the imaginary part is
+// cleared so the real path pays only for the mode check.
+static int push_number(Calculator* calc, double value) {
+    if (!ns_push(&calc->numbers, value)) {
+        return 0;
+    }
+    if (calc->recorder) {
+        program_recorder_constant(calc->recorder, value);
+    }
+    if (calc->number_mode == NUMBER_MODE_COMPLEX) {
+        calc->numbers.imag[calc->numbers.top] = 0.0;
+    } else if (calc->number_mode == NUMBER_MODE_RATIONAL) {
+        // A double in rational mode is inexact
+        memset(&calc->numbers.rationals[calc->numbers.top], 0, sizeof(Rational));
+    }
+    return 1;
+}
+
+static int is_decimal_mode(const Calculator* calc) {
+    return calc->number_mode == NUMBER_MODE_DECIMAL64 || calc->number_mode == NUMBER_MODE_DECIMAL128;
+}
+
+static DecimalFormat decimal_format_of(const Calculator* calc) {
+    return calc->number_mode == NUMBER_MODE_DECIMAL64 ? DECIMAL_64 : DECIMAL_128;
+}
+
+static int push_decimal(Calculator* calc, Decimal value) {
+    if (!ns_push(&calc->numbers, 0.0)) {
+        return 0;
+    }
+    calc->numbers.decimals[calc->numbers.top] = value;
+    return 1;
+}
+
+static int is_integer_mode(const Calculator* calc) {
+    return calc->number_mode == NUMBER_MODE_INT64 || calc->number_mode == NUMBER_MODE_INT128;
+}
+
+static int integer_bits(const Calculator* calc) {
+    return calc->number_mode == NUMBER_MODE_INT128 ? 128 : 64;
+}
+
+static int push_integer(Calculator* calc, Integer value) {
+    if (!ns_push(&calc->numbers, 0.0)) {
+        return 0;
+    }
+    calc->numbers.integers[calc->numbers.top] = value;
+    return 1;
+}
+
+static int push_rational(Calculator* calc, Rational value) {
+    if (!ns_push(&calc->numbers, 0.0)) {
+        return 0;
+    }
+    calc->numbers.rationals[calc->numbers.top] = value;
+    return 1;
+}
+
+// The factor() vector from its exact entries, in the display base of the
+// integer modes
+static void format_factors(Calculator* calc) {
+    const Matrix* m = calc->factor_matrix;
+    int bits = is_integer_mode(calc) ? integer_bits(calc) : 128;
+    int base = is_integer_mode(calc) ? calc->output_base : 10;
+    size_t used = 0;
+    // 128 binary digits and the 0b prefix
+    char number[136];
+    int ok = append_text(calc->buffer, sizeof(calc->buffer), &used, "[");
+
+    for (int j = 0; ok && j < m->cols; j++) {
+        integer_format(bits, base, calc->factor_values[j], number, sizeof(number));
+        ok = (j == 0 || append_text(calc->buffer, sizeof(calc->buffer), &used, ", ")) &&
+             append_text(calc->buffer, sizeof(calc->buffer), &used, number);
+    }
+    if (!ok || !append_text(calc->buffer, sizeof(calc->buffer), &used, "]")) {
+        snprintf(calc->buffer, sizeof(calc->buffer), "[1x%d matrix]", m->cols);
+    }
+}
+
+// Value of a rational-mode entry as a double, exact or not
+static double rational_entry_value(const NumberStack* numbers, int index) {
+    const Rational* value = &numbers->rationals[index];
+    return rational_is_exact(value) ? rational_to_double(value) : numbers->items[index];
+}
+
+// Keeps the digits of the real-mode literal just pushed if it is a decimal
+// integer below 2^64 that the double rounded, so the number-theory functions
+// see the number that was typed
+static void mark_exact_literal(Calculator* calc, const char* text, size_t length) {
+    NumberStack* numbers = &calc->numbers;
+    const char* parsed;
+    Integer integer;
+    if (!integer_has_base_prefix(text) && integer_parse(128, 0, text, &parsed, &integer) == ERROR_NONE &&
+        (size_t)(parsed - text) == length && integer < ((Integer)1 << 64)) {
+        numbers->integers[numbers->top] = integer;
+        numbers->kinds[numbers->top] = ENTRY_EXACT;
+    }
+}
+
+// A quoted path: the column file is summarized in one streaming pass, in
+// parallel, and the summary is what the statistics functions consume
+static int push_column_file(Calculator* calc, const char* path, size_t length) {
+    char* name = (char*)malloc(length + 1);
+    StatsSummary* summary = stats_summary_new();
+    ErrorType err = ERROR_NONE;
+
+    // The file can change between evaluations
+    calc->nondeterministic = 1;
+    if (calc->column_count == calc->column_capacity) {
+        int capacity = calc->column_capacity ? calc->column_capacity * 2 : 4;
+        StatsSummary** columns = (StatsSummary**)realloc(calc->columns, (size_t)capacity * sizeof(StatsSummary*));
+        if (columns) {
+            calc->columns = columns;
+            calc->column_capacity = capacity;
+        }
+    }
+    if (!name || !summary || calc->column_count == calc->column_capacity) {
+        err = ERROR_OUT_OF_MEMORY;
+    } else {
+        memcpy(name, path, length);
+        name[length] = '\0';
+        err = stats_summary_add_file(summary, name, 0, calc->cancel);
+    }
+    free(name);
+    if (err != ERROR_NONE) {
+        stats_summary_free(summary);
+        calc->error = err;
+        return 0;
+    }
+    calc->columns[calc->column_count++] = summary;
+    // One operation per value read
+    if (!calculator_charge(calc, (long)stats_count(summary))) {
+        return 0;
+    }
+    if (!ns_push(&calc->numbers, NAN)) {
+        calc->error = ERROR_STACK_OVERFLOW;
+        return 0;
+    }
+    calc->numbers.datasets[calc->numbers.top] = summary;
+    calc->numbers.kinds[calc->numbers.top] = ENTRY_DATASET;
+    return 1;
+}
+
+static int push_constant(Calculator* calc, double value, const char* digits) {
+    if (calc->number_mode == NUMBER_MODE_FIXED) {
+        const char* end;
+        Fixed fixed;
+        fixed_parse(digits, &end, &fixed);
+        return push_integer(calc, fixed);
+    }
+    if (is_decimal_mode(calc)) {
+        const char* end;
+        return push_decimal(calc, decimal_parse(decimal_format_of(calc), digits, &end));
+    }
+    return push_number(calc, value);
+}
+
 Calculator* calculator_new(void) {
     Calculator* calc = (Calculator*)malloc(sizeof(Calculator));
     if (calc) {
         strcpy(calc->buffer, "0");
         calc->angle_mode = DEG;
+#ifdef CALCULATOR_FIXED_POINT
+        calc->number_mode = NUMBER_MODE_FIXED;
+#else
+        calc->number_mode = NUMBER_MODE_REAL;
+#endif
+        calc->output_base = 10;
+        calc->integer_fast_path = 0;
         calc->error = ERROR_NONE;
+        calc->arena = NULL;
+        calc->matrix_count = 0;
+        calc->matrix_result = NULL;
+        calc->factor_matrix = NULL;
+        calc->factor_values = NULL;
+        calc->recorder = NULL;
+        calc->random = NULL;
+        calc->trace = NULL;
+        calc->cache = NULL;
+        calc->nondeterministic = 0;
+        calc->tokens = NULL;
+        calc->columns = NULL;
+        calc->column_count = 0;
+        calc->column_capacity = 0;
+        memset(&calc->budget, 0, sizeof(calc->budget));
+        calc->cancel = NULL;
+        calc->operations = 0;
+        calc->clock_countdown = BUDGET_CLOCK_INTERVAL;
+        calc->deadline = 0.0;
         calc->numbers.top = -1;
         calc->operators.top = -1;
         calc->operators.total_pushed = 0;
+        calc->conditional_count = 0;
+        calc->skipping = 0;
     }
     return calc;
 }
 
+static void free_columns(Calculator* calc) {
+    for (int i = 0; i < calc->column_count; i++) {
+        stats_summary_free(calc->columns[i]);
+    }
+    calc->column_count = 0;
+}
+
 void calculator_free(Calculator* calc) {
     if (calc) {
+        matrix_arena_free(calc->arena);
+        lex_tokens_free(calc->tokens);
+        random_generator_free(calc->random);
+        free_columns(calc);
+        free(calc->columns);
         free(calc);
     }
 }
@@ -112,6 +622,96 @@ void calculator_clear(Calculator* calc) {
     calc->error = ERROR_NONE;
 }
 
+struct CancelToken {
+    atomic_int cancelled;
+};
+
+CancelToken* cancel_token_new(void) {
+    CancelToken* token = (CancelToken*)malloc(sizeof(CancelToken));
+    if (token) {
+        atomic_init(&token->cancelled, 0);
+    }
+    return token;
+}
+
+void cancel_token_free(CancelToken* token) {
+    free(token);
+}
+
+void cancel_token_cancel(CancelToken* token) {
+    atomic_store_explicit(&token->cancelled, 1, memory_order_release);
+}
+
+void cancel_token_reset(CancelToken* token) {
+    atomic_store_explicit(&token->cancelled, 0, memory_order_release);
+}
+
+int cancel_token_is_cancelled(const CancelToken* token) {
+    return atomic_load_explicit((atomic_int*)&token->cancelled, memory_order_acquire);
+}
+
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+void calculator_set_budget(Calculator* calc, const EvaluationBudget* budget) {
+    if (budget) {
+        calc->budget = *budget;
+    } else {
+        memset(&calc->budget, 0, sizeof(calc->budget));
+    }
+}
+
+void calculator_set_cancel_token(Calculator* calc, CancelToken* cancel) {
+    calc->cancel = cancel;
+}
+
+void calculator_set_trace(Calculator* calc, TraceBuffer* trace) {
+    calc->trace = trace;
+}
+
+void calculator_set_cache(Calculator* calc, ResultCache* cache) {
+    calc->cache = cache;
+}
+
+ErrorType calculator_seed_random(Calculator* calc, uint64_t seed, uint64_t stream) {
+    if (calc->random) {
+        random_seed(calc->random, seed, stream);
+    } else if (!(calc->random = random_generator_new(seed, stream))) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+    return ERROR_NONE;
+}
+
+void calculator_start_budget(Calculator* calc) {
+    calc->operations = 0;
+    calc->clock_countdown = BUDGET_CLOCK_INTERVAL;
+    calc->deadline = calc->budget.max_seconds > 0.0 ? monotonic_seconds() + calc->budget.max_seconds : 0.0;
+}
+
+int calculator_charge(Calculator* calc, long cost) {
+    calc->operations = cost < LONG_MAX - calc->operations ? calc->operations + cost : LONG_MAX;
+    if (calc->budget.max_operations > 0 && calc->operations > calc->budget.max_operations) {
+        calc->error = ERROR_BUDGET_EXCEEDED;
+        return 0;
+    }
+    if (calc->cancel && cancel_token_is_cancelled(calc->cancel)) {
+        calc->error = ERROR_CANCELLED;
+        return 0;
+    }
+    calc->clock_countdown -= cost;
+    if (calc->deadline > 0.0 && calc->clock_countdown <= 0) {
+        calc->clock_countdown = BUDGET_CLOCK_INTERVAL;
+        if (monotonic_seconds() > calc->deadline) {
+            calc->error = ERROR_BUDGET_EXCEEDED;
+            return 0;
+        }
+    }
+    return 1;
+}
+
 void calculator_toggle_angle_mode(Calculator* calc) {
     if (calc->angle_mode == DEG) {
         calc->angle_mode = RAD;
@@ -124,138 +724,476 @@ AngleMode calculator_get_angle_mode(const Calculator* calc) {
     return calc ? calc->angle_mode : DEG;
 }
 
+void calculator_set_number_mode(Calculator* calc, NumberMode mode) {
+    calc->number_mode = mode;
+}
+
+NumberMode calculator_get_number_mode(const Calculator* calc) {
+    return calc ? calc->number_mode : NUMBER_MODE_REAL;
+}
+
+void calculator_set_output_base(Calculator* calc, int base) {
+    if (base == 2 || base == 8 || base == 10 || base == 16) {
+        calc->output_base = base;
+    }
+}
+
+int calculator_get_output_base(const Calculator* calc) {
+    return calc ? calc->output_base : 10;
+}
+
 const char* calculator_get_display(const Calculator* calc) {
     return calc->buffer;
 }
 
-void calculator_evaluate(Calculator* calc, const char* expression) {
+const Matrix* calculator_get_matrix(const Calculator* calc) {
+    return calc->matrix_result;
+}
+
+// Runs the shunting-yard pass over the token array of `expression`, leaving
+// the result on the number stack. Returns 1 if it stopped on a syntax error
+// it already wrote to the display.
+static int evaluate_tokens(Calculator* calc, const char* expression, const LexTokens* tokens) {
     calc->numbers.top = -1;
     calc->operators.top = -1;
     calc->operators.total_pushed = 0;
+    calc->conditional_count = 0;
+    calc->skipping = 0;
     calc->error = ERROR_NONE;
+    calc->matrix_count = 0;
+    calc->matrix_result = NULL;
+    calc->factor_matrix = NULL;
+    if (calc->arena) {
+        matrix_arena_reset(calc->arena);
+    }
+    free_columns(calc);
+    calculator_start_budget(calc);
+    if (!tokens) {
+        calc->error = ERROR_OUT_OF_MEMORY;
+        return 0;
+    }
 
     TokenType prev_token = TOKEN_NONE;
-    const char* p = expression;
+    // numbers.top at each open '[' so ']' knows how many elements it closes
+    int bracket_base[MAX_STACK_SIZE];
+    int bracket_depth = 0;
+    int depth = 0;
+
+    for (size_t i = 0; i < tokens->count; i++) {
+        const LexToken* token = &tokens->items[i];
+        const char* text = expression + token->offset;
+        char op = token->op;
 
-    while (*p) {
-        if (isspace((unsigned char)*p)) {
-            p++;
-            continue;
+        if (!calculator_charge(calc, 1)) {
+            break;
+        }
+        if (token->kind == LEX_PUNCTUATION && (op == '(' || op == '[')) {
+            if (calc->budget.max_depth > 0 && ++depth > calc->budget.max_depth) {
+                calc->error = ERROR_BUDGET_EXCEEDED;
+                break;
+            }
+        } else if (token->kind == LEX_PUNCTUATION && (op == ')' || op == ']')) {
+            depth--;
         }
 
-        if (isdigit((unsigned char)*p) || *p == '.' || ((*p == '+' || *p == '-') && (prev_token == TOKEN_NONE || prev_token == TOKEN_OPERATOR || prev_token == TOKEN_LPAREN || prev_token == TOKEN_FUNCTION) && (isdigit((unsigned char)*(p + 1)) || *(p + 1) == '.'))) {
-            // Disallow a fractional token starting with '.' immediately after a value (e.g., "2.3.4")
-            if (*p == '.' && (prev_token == TOKEN_NUMBER || prev_token == TOKEN_RPAREN || prev_token == TOKEN_CONSTANT)) {
-                calc->error = ERROR_SYNTAX;
+        if (token->kind == LEX_ERROR) {
+            calc->error = (ErrorType)op;
+            if (calc->error == ERROR_SYNTAX) {
                 snprintf(calc->buffer, sizeof(calc->buffer), "Syntax Error: Invalid expression");
-                return;
+                return 1;
             }
+            break;
+        } else if (token->kind == LEX_NUMBER) {
             if (!insert_implicit_multiplication(calc, &prev_token, TOKEN_NUMBER)) {
                 break;
             }
 
-            const char* start = p;
-
-            // Parse number with optional leading sign using strtod
-            char* end;
-            double num = strtod(start, &end);
-            if (end == start) {
-                calc->error = ERROR_SYNTAX;
-                snprintf(calc->buffer, sizeof(calc->buffer), "Syntax Error: Invalid expression");
-                return;
-            }
-            // If a '.' immediately follows a completed number (e.g., "2.3.4" or "2..3"), it's invalid
-            if (*end == '.') {
-                calc->error = ERROR_SYNTAX;
-                snprintf(calc->buffer, sizeof(calc->buffer), "Syntax Error: Invalid expression");
-                return;
+            int pushed;
+            if (calc->integer_fast_path && fabs(token->value) < INTEGER_FAST_PATH_EXACT) {
+                // Every literal here is an integer, so the lexer's double is exact
+                pushed = push_integer(calc, (Integer)token->value);
+            } else if (calc->number_mode == NUMBER_MODE_FIXED) {
+                // Rounded to the nearest Fixed; 0x/0o/0b literals are integers
+                const char* parsed;
+                Fixed fixed = 0;
+                Integer integer = 0;
+                ErrorType err;
+                if (integer_has_base_prefix(text)) {
+                    err = integer_parse(64, 0, text, &parsed, &integer);
+                    if (err == ERROR_NONE) {
+                        err = fixed_from_integer((int64_t)integer, &fixed);
+                    }
+                } else {
+                    err = fixed_parse(text, &parsed, &fixed);
+                }
+                if (err != ERROR_NONE) {
+                    calc->error = err;
+                    break;
+                }
+                pushed = push_integer(calc, fixed);
+            } else if (calc->number_mode == NUMBER_MODE_RATIONAL) {
+                // Exact digits; a literal past RATIONAL_MAX_BITS stays a double
+                const char* parsed;
+                Rational rational;
+                ErrorType err = rational_parse(calculator_arena(calc), text, &parsed, &rational);
+                if (err == ERROR_OVERFLOW) {
+                    pushed = push_number(calc, token->value);
+                } else if (err != ERROR_NONE) {
+                    calc->error = err;
+                    break;
+                } else {
+                    pushed = push_rational(calc, rational);
+                }
+            } else if (is_integer_mode(calc) || (is_decimal_mode(calc) && integer_has_base_prefix(text))) {
+                // Integer modes, and 0x/0o/0b literals in decimal mode. Only
+                // the programmer modes read a prefixed literal as a bit pattern.
+                const char* parsed;
+                Integer integer = 0;
+                ErrorType err = integer_parse(is_integer_mode(calc) ? integer_bits(calc) : 64,
+                                              is_integer_mode(calc) && !calc->integer_fast_path,
+                                              text, &parsed, &integer);
+                if (err != ERROR_NONE) {
+                    calc->error = err;
+                    break;
+                }
+                pushed = is_integer_mode(calc) ? push_integer(calc, integer)
+                                               : push_decimal(calc, decimal_from_int(decimal_format_of(calc), (int64_t)integer));
+            } else if (is_decimal_mode(calc)) {
+                // Exact decimal digits, never rounded through binary
+                const char* parsed;
+                pushed = push_decimal(calc, decimal_parse(decimal_format_of(calc), text, &parsed));
+            } else {
+                pushed = push_number(calc, token->value);
+                if (pushed && fabs(token->value) >= INTEGER_FAST_PATH_EXACT) {
+                    mark_exact_literal(calc, text, token->length);
+                }
             }
-
-            if (!ns_push(&calc->numbers, num)) {
+            if (!pushed) {
                 calc->error = ERROR_STACK_OVERFLOW;
                 break;
             }
-            p = end;
             prev_token = TOKEN_NUMBER;
-            continue;
-        } else if (*p == 'p') {
-            if (!insert_implicit_multiplication(calc, &prev_token, TOKEN_CONSTANT)) {
+        } else if (token->kind == LEX_OPERATOR) {
+            if (!process_operator_token(calc, op)) {
                 break;
             }
-            if (!ns_push(&calc->numbers, M_PI)) {
-                calc->error = ERROR_STACK_OVERFLOW;
+            if ((op == OP_AND || op == OP_OR) && !begin_logical_operator(calc, op)) {
+                if (calc->error == ERROR_SYNTAX) {
+                    snprintf(calc->buffer, sizeof(calc->buffer), "Syntax Error: Invalid expression");
+                    return 1;
+                }
                 break;
             }
-            prev_token = TOKEN_CONSTANT;
-        } else if (*p == 'e') {
-            if (!insert_implicit_multiplication(calc, &prev_token, TOKEN_CONSTANT)) {
+            prev_token = TOKEN_OPERATOR;
+        } else if (token->kind == LEX_FUNCTION) {
+            if (!insert_implicit_multiplication(calc, &prev_token, TOKEN_FUNCTION)) {
                 break;
             }
-            if (!ns_push(&calc->numbers, M_E)) {
+            if (!os_push(&calc->operators, op)) {
                 calc->error = ERROR_STACK_OVERFLOW;
                 break;
             }
-            prev_token = TOKEN_CONSTANT;
-        } else if (*p == '(') {
-            if (!insert_implicit_multiplication(calc, &prev_token, TOKEN_LPAREN)) {
-                break;
-            }
-            if (!os_push(&calc->operators, *p)) {
-                calc->error = ERROR_STACK_OVERFLOW;
+            prev_token = TOKEN_FUNCTION;
+        } else if (token->kind == LEX_CONSTANT) {
+            if (!insert_implicit_multiplication(calc, &prev_token, TOKEN_CONSTANT)) {
                 break;
             }
-            prev_token = TOKEN_LPAREN;
-        } else if (*p == ')') {
-            while (calc->operators.top != -1 && os_peek(&calc->operators) != '(') {
-                apply_operator(calc, os_pop(&calc->operators));
-                if (calc->error != ERROR_NONE) {
-                    break;
+            int pushed;
+            if (op == 'i') {
+                pushed = ns_push(&calc->numbers, 0.0);
+                if (pushed) {
+                    calc->numbers.imag[calc->numbers.top] = 1.0;
                 }
+            } else {
+                pushed = op == 'p' ? push_constant(calc, M_PI, DECIMAL_PI) : push_constant(calc, M_E, DECIMAL_E);
             }
-            if (calc->error != ERROR_NONE) {
+            if (!pushed) {
+                calc->error = ERROR_STACK_OVERFLOW;
                 break;
             }
-
-            if (calc->operators.top != -1) {
-                os_pop(&calc->operators);
-            } else {
+            prev_token = TOKEN_CONSTANT;
+        } else if (token->kind == LEX_VARIABLE) {
+            // Variables only exist in compiled programs
+            if (!calc->recorder) {
                 calc->error = ERROR_SYNTAX;
-                snprintf(calc->buffer, sizeof(calc->buffer), "Syntax Error: Mismatched parentheses");
-                return;
+                snprintf(calc->buffer, sizeof(calc->buffer), "Syntax Error: Invalid expression");
+                return 1;
             }
-            prev_token = TOKEN_RPAREN;
-        } else if (isalpha((unsigned char)*p)) {
-            if (!insert_implicit_multiplication(calc, &prev_token, TOKEN_FUNCTION)) {
+            if (!insert_implicit_multiplication(calc, &prev_token, TOKEN_CONSTANT)) {
                 break;
             }
-            char func[MAX_FUNCTION_NAME_LENGTH];
-            int i = 0;
-            while (isalpha((unsigned char)*p) && i < MAX_FUNCTION_NAME_LENGTH - 1) {
-                func[i++] = *p++;
-            }
-            func[i] = '\0';
-            if (!os_push(&calc->operators, func[0])) {
+            // The value is only known when the program runs
+            if (!ns_push(&calc->numbers, NAN)) {
                 calc->error = ERROR_STACK_OVERFLOW;
                 break;
             }
-            p--;
-            prev_token = TOKEN_FUNCTION;
-        } else {
-            if (!process_operator_token(calc, *p)) {
-                break;
-            }
-            prev_token = TOKEN_OPERATOR;
+            program_recorder_variable(calc->recorder, text + 1, (size_t)token->length - 1);
+            prev_token = TOKEN_CONSTANT;
+        } else if (token->kind == LEX_STRING) {
+            if (calc->number_mode != NUMBER_MODE_REAL || calc->recorder) {
+                calc->error = ERROR_SYNTAX;
+                snprintf(calc->buffer, sizeof(calc->buffer), "Syntax Error: Invalid expression");
+                return 1;
+            }
+            if (!insert_implicit_multiplication(calc, &prev_token, TOKEN_CONSTANT)) {
+                break;
+            }
+            if (calc->skipping > 0) {
+                // A branch not taken reads no file
+                if (!ns_push(&calc->numbers, NAN)) {
+                    calc->error = ERROR_STACK_OVERFLOW;
+                    break;
+                }
+            } else if (!push_column_file(calc, text + 1, (size_t)token->length - 2)) {
+                // An unreadable file or a line that is not a number
+                if (calc->error == ERROR_SYNTAX) {
+                    snprintf(calc->buffer, sizeof(calc->buffer), "Syntax Error: Invalid expression");
+                    return 1;
+                }
+                break;
+            }
+            prev_token = TOKEN_CONSTANT;
+        } else if (op == '(') {
+            if (!insert_implicit_multiplication(calc, &prev_token, TOKEN_LPAREN)) {
+                break;
+            }
+            if (!os_push(&calc->operators, op)) {
+                calc->error = ERROR_STACK_OVERFLOW;
+                break;
+            }
+            prev_token = TOKEN_LPAREN;
+        } else if (op == '[') {
+            if (calc->number_mode != NUMBER_MODE_REAL || calc->recorder) {
+                calc->error = ERROR_SYNTAX;
+                snprintf(calc->buffer, sizeof(calc->buffer), "Syntax Error: Invalid expression");
+                return 1;
+            }
+            if (!insert_implicit_multiplication(calc, &prev_token, TOKEN_LPAREN)) {
+                break;
+            }
+            if (!os_push(&calc->operators, op)) {
+                calc->error = ERROR_STACK_OVERFLOW;
+                break;
+            }
+            bracket_base[bracket_depth++] = calc->numbers.top;
+            prev_token = TOKEN_LPAREN;
+        } else if (op == ',') {
+            while (calc->operators.top != -1 && os_peek(&calc->operators) != '(' && os_peek(&calc->operators) != '[') {
+                apply_operator(calc, os_pop(&calc->operators));
+                if (calc->error != ERROR_NONE) {
+                    break;
+                }
+            }
+            if (calc->error != ERROR_NONE) {
+                break;
+            }
+            if (calc->operators.top == -1) {
+                calc->error = ERROR_SYNTAX;
+                snprintf(calc->buffer, sizeof(calc->buffer), "Syntax Error: Invalid expression");
+                return 1;
+            }
+            if (os_peek(&calc->operators) == '(' && calc->operators.top > 0 &&
+                calc->operators.items[calc->operators.top - 1] == OP_IF && !conditional_comma(calc)) {
+                if (calc->error == ERROR_SYNTAX) {
+                    snprintf(calc->buffer, sizeof(calc->buffer), "Syntax Error: Invalid expression");
+                    return 1;
+                }
+                break;
+            }
+            prev_token = TOKEN_OPERATOR;
+        } else if (op == ']') {
+            while (calc->operators.top != -1 && os_peek(&calc->operators) != '[' && os_peek(&calc->operators) != '(') {
+                apply_operator(calc, os_pop(&calc->operators));
+                if (calc->error != ERROR_NONE) {
+                    break;
+                }
+            }
+            if (calc->error != ERROR_NONE) {
+                break;
+            }
+            if (calc->operators.top == -1 || os_peek(&calc->operators) != '[') {
+                calc->error = ERROR_SYNTAX;
+                snprintf(calc->buffer, sizeof(calc->buffer), "Syntax Error: Mismatched parentheses");
+                return 1;
+            }
+            os_pop(&calc->operators);
+            if (calc->skipping > 0) {
+                // Not built in a branch that is not taken
+                calc->numbers.top = bracket_base[--bracket_depth];
+                ns_push(&calc->numbers, NAN);
+            } else if (!reduce_matrix_literal(calc, bracket_base[--bracket_depth])) {
+                break;
+            }
+            prev_token = TOKEN_RPAREN;
+        } else if (op == ')') {
+            while (calc->operators.top != -1 && os_peek(&calc->operators) != '(' && os_peek(&calc->operators) != '[') {
+                apply_operator(calc, os_pop(&calc->operators));
+                if (calc->error != ERROR_NONE) {
+                    break;
+                }
+            }
+            if (calc->error != ERROR_NONE) {
+                break;
+            }
+
+            if (calc->operators.top != -1 && os_peek(&calc->operators) == '(') {
+                os_pop(&calc->operators);
+            } else {
+                calc->error = ERROR_SYNTAX;
+                snprintf(calc->buffer, sizeof(calc->buffer), "Syntax Error: Mismatched parentheses");
+                return 1;
+            }
+            prev_token = TOKEN_RPAREN;
         }
-        p++;
     }
 
     while (calc->operators.top != -1 && calc->error == ERROR_NONE) {
-        if (os_peek(&calc->operators) == '(') {
+        if (os_peek(&calc->operators) == '(' || os_peek(&calc->operators) == '[') {
             calc->error = ERROR_SYNTAX;
             break;
         }
         apply_operator(calc, os_pop(&calc->operators));
     }
+    return 0;
+}
+
+// Tokenizes `expression` into the calculator's token array, or returns NULL
+// if the array cannot grow
+static const LexTokens* tokenize(Calculator* calc, const char* expression) {
+    if (!calc->tokens) {
+        calc->tokens = lex_tokens_new();
+    }
+    if (!calc->tokens || lexer_tokenize(calc->tokens, expression, calc->number_mode) != ERROR_NONE) {
+        return NULL;
+    }
+    return calc->tokens;
+}
+
+// True if the expression has only integer literals and operators and
+// functions that are exact on integers, so real mode can run it on the
+// integer path
+static int is_integer_expression(const char* expression, const LexTokens* tokens) {
+    int literals = 0;
+    for (size_t i = 0; i < tokens->count; i++) {
+        const LexToken* token = &tokens->items[i];
+        const char* text = expression + token->offset;
+        if (token->kind == LEX_NUMBER) {
+            if (!integer_has_base_prefix(text)) {
+                for (uint16_t j = 0; j < token->length; j++) {
+                    if (text[j] == '.' || text[j] == 'e' || text[j] == 'E') {
+                        return 0;
+                    }
+                }
+            }
+            literals++;
+        } else if (token->kind == LEX_OPERATOR) {
+            switch (token->op) {
+                case '+': case '-': case '*': case '/': case '%': case '^': case '!':
+                case OP_BIT_AND: case OP_BIT_OR: case OP_XOR: case OP_SHIFT_LEFT: case OP_SHIFT_RIGHT:
+                case OP_LESS: case OP_GREATER: case OP_LESS_EQUAL: case OP_GREATER_EQUAL: case OP_EQUAL:
+                case OP_NOT_EQUAL: case OP_AND: case OP_OR:
+                    break;
+                default:
+                    return 0;
+            }
+        } else if (token->kind == LEX_FUNCTION) {
+            if (!is_number_theory_operator(token->op) || token->op == OP_FACTOR) {
+                return 0;
+            }
+        } else if (token->kind != LEX_PUNCTUATION || (token->op != '(' && token->op != ')' && token->op != ',')) {
+            return 0;
+        }
+    }
+    return literals > 0;
+}
+
+// Integer-only real expressions are evaluated exactly on int64, which is
+// also cheaper than double. An inexact division, a negative power, an
+// overflow or any other error reruns the expression on doubles, so error
+// messages match the double path. A result the integers computed is kept
+// exact, so it is not rounded past 2^53 and is shown with all its digits.
+// Both passes share one token array.
+static int evaluate_expression(Calculator* calc, const char* expression) {
+    const LexTokens* tokens = tokenize(calc, expression);
+    if (tokens && calc->number_mode == NUMBER_MODE_REAL && !calc->recorder && is_integer_expression(expression, tokens)) {
+        calc->number_mode = NUMBER_MODE_INT64;
+        calc->integer_fast_path = 1;
+        evaluate_tokens(calc, expression, tokens);
+        calc->number_mode = NUMBER_MODE_REAL;
+        calc->integer_fast_path = 0;
+        if (calc->error == ERROR_NONE && calc->numbers.top == 0) {
+            Integer result = calc->numbers.integers[0];
+            if (result == 0) {
+                // Integers have no -0, so a zero takes its sign from the
+                // double pass, unless rounding left that one nonzero or
+                // out of range
+                evaluate_tokens(calc, expression, tokens);
+                if (calc->error == ERROR_NONE && calc->numbers.top == 0 && calc->numbers.items[0] == 0.0) {
+                    return 0;
+                }
+                calc->error = ERROR_NONE;
+                calc->numbers.top = 0;
+            }
+            calc->numbers.items[0] = (double)result;
+            calc->numbers.integers[0] = result;
+            calc->numbers.kinds[0] = ENTRY_EXACT;
+            return 0;
+        }
+        if (calc->error == ERROR_BUDGET_EXCEEDED || calc->error == ERROR_CANCELLED) {
+            return 0;
+        }
+    }
+    return evaluate_tokens(calc, expression, tokens);
+}
+
+static ErrorType evaluate_value(Calculator* calc, const char* expression, double* value) {
+    evaluate_expression(calc, expression);
+    if (calc->error != ERROR_NONE) {
+        return calc->error;
+    }
+    if (calc->numbers.top != 0 || entry_matrix(&calc->numbers, 0) || calc->number_mode == NUMBER_MODE_COMPLEX) {
+        return ERROR_SYNTAX;
+    }
+    if (is_decimal_mode(calc)) {
+        *value = decimal_to_double(decimal_format_of(calc), calc->numbers.decimals[0]);
+    } else if (calc->number_mode == NUMBER_MODE_FIXED) {
+        *value = fixed_to_double((Fixed)calc->numbers.integers[0]);
+    } else if (is_integer_mode(calc)) {
+        *value = (double)calc->numbers.integers[0];
+    } else if (calc->number_mode == NUMBER_MODE_RATIONAL) {
+        *value = rational_entry_value(&calc->numbers, 0);
+    } else {
+        *value = calc->numbers.items[0];
+    }
+    return ERROR_NONE;
+}
+
+ErrorType calculator_compile(Calculator* calc, const char* expression, ProgramRecorder* recorder) {
+    if (calc->number_mode != NUMBER_MODE_REAL) {
+        return ERROR_SYNTAX;
+    }
+    calc->recorder = recorder;
+    evaluate_tokens(calc, expression, tokenize(calc, expression));
+    calc->recorder = NULL;
+    if (calc->error != ERROR_NONE) {
+        return calc->error;
+    }
+    return calc->numbers.top == 0 ? ERROR_NONE : ERROR_SYNTAX;
+}
+
+static void evaluate_display(Calculator* calc, const char* expression) {
+    if (calc->number_mode == NUMBER_MODE_REAL && strlen(expression) >= PARALLEL_MIN_LENGTH && !strchr(expression, '[')) {
+        double value = 0.0;
+        calc->numbers.top = -1;
+        calc->operators.top = -1;
+        calc->matrix_result = NULL;
+        calc->error = parallel_evaluate(calc, expression, 0, &value);
+        if (calc->error == ERROR_NONE) {
+            ns_push(&calc->numbers, value);
+        }
+    } else if (evaluate_expression(calc, expression)) {
+        return;
+    }
 
     if (calc->error != ERROR_NONE) {
         if (calc->error == ERROR_MATH_DIV_ZERO) {
@@ -266,11 +1204,83 @@ void calculator_evaluate(Calculator* calc, const char* expression) {
             snprintf(calc->buffer, sizeof(calc->buffer), "Error: Operator stack overflow");
         } else if (calc->error == ERROR_SYNTAX) {
             snprintf(calc->buffer, sizeof(calc->buffer), "Syntax Error: Mismatched parentheses");
+        } else if (calc->error == ERROR_DIMENSION_MISMATCH) {
+            snprintf(calc->buffer, sizeof(calc->buffer), "Math Error: Dimension mismatch");
+        } else if (calc->error == ERROR_SINGULAR_MATRIX) {
+            snprintf(calc->buffer, sizeof(calc->buffer), "Math Error: Singular matrix");
+        } else if (calc->error == ERROR_OUT_OF_MEMORY) {
+            snprintf(calc->buffer, sizeof(calc->buffer), "Error: Out of memory");
+        } else if (calc->error == ERROR_BUDGET_EXCEEDED) {
+            snprintf(calc->buffer, sizeof(calc->buffer), "Error: Evaluation budget exceeded");
+        } else if (calc->error == ERROR_CANCELLED) {
+            snprintf(calc->buffer, sizeof(calc->buffer), "Error: Evaluation cancelled");
+        } else if (calc->error == ERROR_OVERFLOW) {
+            snprintf(calc->buffer, sizeof(calc->buffer), "Error: Overflow");
+        } else if (calc->error == ERROR_CIRCULAR_REFERENCE) {
+            snprintf(calc->buffer, sizeof(calc->buffer), "Error: Circular reference");
+        } else if (calc->error == ERROR_FILE) {
+            snprintf(calc->buffer, sizeof(calc->buffer), "Error: Cannot read file");
+        }
+        return;
+    }
+
+    if (calc->numbers.top == 0 && entry_matrix(&calc->numbers, 0)) {
+        calc->matrix_result = entry_matrix(&calc->numbers, 0);
+        calc->numbers.top = -1;
+        if (calc->matrix_result == calc->factor_matrix) {
+            format_factors(calc);
+        } else {
+            format_matrix_result(calc->buffer, sizeof(calc->buffer), calc->matrix_result);
         }
         return;
     }
 
-    if (calc->numbers.top == 0) {
+    if (calc->numbers.top == 0 && calc->number_mode == NUMBER_MODE_COMPLEX) {
+        double im = calc->numbers.imag[0];
+        double re = ns_pop(&calc->numbers, calc);
+        if (isnan(re) || isnan(im)) {
+            snprintf(calc->buffer, sizeof(calc->buffer), "Math Error: Domain error (e.g., sqrt(-1))");
+        } else if (!isfinite(re) || !isfinite(im)) {
+            snprintf(calc->buffer, sizeof(calc->buffer), "Error: Overflow");
+        } else {
+            format_complex_result(calc->buffer, sizeof(calc->buffer), re, im);
+        }
+    } else if (calc->numbers.top == 0 && calc->number_mode == NUMBER_MODE_FIXED) {
+        fixed_format((Fixed)calc->numbers.integers[calc->numbers.top--], calc->buffer, sizeof(calc->buffer));
+    } else if (calc->numbers.top == 0 && is_integer_mode(calc)) {
+        Integer val = calc->numbers.integers[calc->numbers.top--];
+        integer_format(integer_bits(calc), calc->output_base, val, calc->buffer, sizeof(calc->buffer));
+    } else if (calc->numbers.top == 0 && is_decimal_mode(calc)) {
+        DecimalFormat format = decimal_format_of(calc);
+        Decimal val = pop_decimal(calc);
+        if (decimal_is_nan(format, val)) {
+            if (calc->error == ERROR_MATH_DIV_ZERO) {
+                snprintf(calc->buffer, sizeof(calc->buffer), "Math Error: Division by zero");
+            } else {
+                snprintf(calc->buffer, sizeof(calc->buffer), "Math Error: Domain error (e.g., sqrt(-1))");
+            }
+        } else if (!decimal_is_finite(format, val)) {
+            snprintf(calc->buffer, sizeof(calc->buffer), "Error: Overflow");
+        } else {
+            decimal_format(format, val, calc->buffer, sizeof(calc->buffer));
+        }
+    } else if (calc->numbers.top == 0 && calc->number_mode == NUMBER_MODE_RATIONAL &&
+               rational_is_exact(&calc->numbers.rationals[0])) {
+        // Fractions too long to show whole are rounded from the exact value,
+        // which a double may not be able to hold
+        const Rational* val = &calc->numbers.rationals[calc->numbers.top--];
+        if (!rational_format(val, calc->buffer, sizeof(calc->buffer)) &&
+            !rational_format_scientific(val, calc->buffer, sizeof(calc->buffer))) {
+            calc->error = ERROR_OVERFLOW;
+            snprintf(calc->buffer, sizeof(calc->buffer), "Error: Overflow");
+        }
+    } else if (calc->numbers.top == 0 && calc->number_mode == NUMBER_MODE_REAL && calc->numbers.kinds[0] == ENTRY_EXACT) {
+        integer_format(128, 10, calc->numbers.integers[calc->numbers.top--], calc->buffer, sizeof(calc->buffer));
+    } else if (calc->numbers.top == 0) {
+        // Inexact values as a decimal
+        if (calc->number_mode == NUMBER_MODE_RATIONAL) {
+            calc->numbers.items[0] = rational_entry_value(&calc->numbers, 0);
+        }
         double val = ns_pop(&calc->numbers, calc);
         if (isnan(val)) {
             if (calc->error == ERROR_MATH_DIV_ZERO) {
@@ -288,10 +1298,75 @@ void calculator_evaluate(Calculator* calc, const char* expression) {
     }
 }
 
+// Everything besides the expression and angle mode that a cached result
+// depends on, and whether it is display text or a value
+static uint32_t cache_context(const Calculator* calc, int value) {
+    return (uint32_t)calc->number_mode | (uint32_t)calc->output_base << 8 |
+           (uint32_t)FIXED_FRACTION_BITS << 16 | (uint32_t)value << 24;
+}
+
+static int use_cache(const Calculator* calc) {
+    return calc->cache && !calc->trace;
+}
+
+static int is_cacheable(const Calculator* calc, ErrorType error) {
+    return !calc->nondeterministic && error != ERROR_BUDGET_EXCEEDED && error != ERROR_CANCELLED &&
+           error != ERROR_OUT_OF_MEMORY;
+}
+
+ErrorType calculator_evaluate_value(Calculator* calc, const char* expression, double* value) {
+    ResultCacheEntry entry;
+    if (!use_cache(calc)) {
+        return evaluate_value(calc, expression, value);
+    }
+    if (result_cache_lookup(calc->cache, expression, calc->angle_mode, cache_context(calc, 1), &entry)) {
+        if (entry.error == ERROR_NONE) {
+            *value = entry.value;
+        }
+        return entry.error;
+    }
+    calc->nondeterministic = 0;
+    entry.value = 0.0;
+    entry.error = evaluate_value(calc, expression, &entry.value);
+    entry.text[0] = '\0';
+    if (is_cacheable(calc, entry.error)) {
+        result_cache_store(calc->cache, expression, calc->angle_mode, cache_context(calc, 1), &entry);
+    }
+    if (entry.error == ERROR_NONE) {
+        *value = entry.value;
+    }
+    return entry.error;
+}
+
+void calculator_evaluate(Calculator* calc, const char* expression) {
+    ResultCacheEntry entry;
+    if (!use_cache(calc)) {
+        evaluate_display(calc, expression);
+        return;
+    }
+    if (result_cache_lookup(calc->cache, expression, calc->angle_mode, cache_context(calc, 0), &entry)) {
+        memcpy(calc->buffer, entry.text, sizeof(entry.text));
+        calc->error = entry.error;
+        calc->matrix_result = NULL;
+        calc->numbers.top = -1;
+        return;
+    }
+    calc->nondeterministic = 0;
+    evaluate_display(calc, expression);
+    // A matrix result also has to be available from calculator_get_matrix
+    if (is_cacheable(calc, calc->error) && !calc->matrix_result && strlen(calc->buffer) < sizeof(entry.text)) {
+        entry.error = calc->error;
+        entry.value = 0.0;
+        memcpy(entry.text, calc->buffer, strlen(calc->buffer) + 1);
+        result_cache_store(calc->cache, expression, calc->angle_mode, cache_context(calc, 0), &entry);
+    }
+}
+
 // Stack implementations
 int ns_push(NumberStack* s, double item) {
     if (s->top < MAX_STACK_SIZE - 1) {
         s->items[++s->top] = item;
+        s->kinds[s->top] = ENTRY_SCALAR;
         return 1;
     }
     return 0;
@@ -335,10 +1410,30 @@ char os_peek(OperatorStack* s) {
 
 int get_precedence(char op) {
     switch (op) {
-        case '+': case '-': return 1;
-        case '*': case '/': case '%': return 2;
-        case '^': return 3; // exponent should be right-associative
-        case 's': case 'c': case 't': case 'l': case 'L': case 'q': case '!': case 'S': case 'C': case 'T': case 'E': case 'R': case 'N': return 4;
+        // Logical, bitwise and comparison operators bind looser than
+        // arithmetic, in C order
+        case OP_OR: return 1;
+        case OP_AND: return 2;
+        case OP_BIT_OR: return 3;
+        case OP_XOR: return 4;
+        case OP_BIT_AND: return 5;
+        case OP_EQUAL: case OP_NOT_EQUAL: return 6;
+        case OP_LESS: case OP_GREATER: case OP_LESS_EQUAL: case OP_GREATER_EQUAL: return 7;
+        case OP_SHIFT_LEFT: case OP_SHIFT_RIGHT: return 8;
+        case '+': case '-': return 9;
+        case '*': case '/': case '%': case OP_MATMUL: return 10;
+        case '^': return 11; // exponent should be right-associative
+        case 's': case 'c': case 't': case 'l': case 'L': case 'q': case '!': case 'S': case 'C': case 'T': case 'E': case 'R': case 'N': return FUNCTION_PRECEDENCE;
+        case OP_DETERMINANT: case OP_INVERSE: case OP_TRANSPOSE: case OP_SOLVE: return FUNCTION_PRECEDENCE;
+        case OP_MEAN: case OP_VARIANCE: case OP_STDDEV: case OP_MIN: case OP_MAX: case OP_MEDIAN: case OP_PERCENTILE:
+            return FUNCTION_PRECEDENCE;
+        case OP_RAND: case OP_RANDN: case OP_UNIFORM: case OP_NORMAL: case OP_EXPONENTIAL: case OP_POISSON:
+            return FUNCTION_PRECEDENCE;
+        case OP_IF: return FUNCTION_PRECEDENCE;
+        case OP_ERF: case OP_ERFC: case OP_GAMMA: case OP_LGAMMA: case OP_BETA: case OP_BESSEL_J: case OP_BESSEL_Y:
+        case OP_LAMBERT_W: case OP_NORMAL_CDF: case OP_NORMAL_QUANTILE:
+            return FUNCTION_PRECEDENCE;
+        case OP_GCD: case OP_LCM: case OP_IS_PRIME: case OP_FACTOR: case OP_POWMOD: return FUNCTION_PRECEDENCE;
         default: return 0;
     }
 }
@@ -346,177 +1441,1571 @@ int is_right_associative(char op) {
     return op == '^';
 }
 
-void apply_operator(Calculator* calc, char op) {
-    double a, b;
-    NumberStack* numbers = &calc->numbers;
-    AngleMode angle_mode = calc->angle_mode;
+static int is_boolean_operator(char op) {
+    return op == OP_LESS || op == OP_GREATER || op == OP_LESS_EQUAL || op == OP_GREATER_EQUAL || op == OP_EQUAL ||
+           op == OP_NOT_EQUAL || op == OP_AND || op == OP_OR;
+}
+
+static int is_binary_operator(char op) {
+    return op == '+' || op == '-' || op == '*' || op == '/' || op == '%' || op == '^' || integer_is_bitwise_operator(op) ||
+           is_boolean_operator(op);
+}
+
+// Operators that can skip an operand: their code is never recorded
+static int is_conditional_operator(char op) {
+    return op == OP_AND || op == OP_OR || op == OP_IF;
+}
+
+static int is_matrix_operator(char op) {
+    return op == OP_MATMUL || op == OP_DETERMINANT || op == OP_INVERSE || op == OP_TRANSPOSE || op == OP_SOLVE;
+}
+
+static int is_stats_operator(char op) {
+    return op == OP_MEAN || op == OP_VARIANCE || op == OP_STDDEV || op == OP_MIN || op == OP_MAX ||
+           op == OP_MEDIAN || op == OP_PERCENTILE;
+}
+
+static int is_random_operator(char op) {
+    return op == OP_RAND || op == OP_RANDN || op == OP_UNIFORM || op == OP_NORMAL || op == OP_EXPONENTIAL ||
+           op == OP_POISSON;
+}
+
+// The special function behind `op`, if it is one
+static int special_function_for(char op, SpecialFunction* function) {
+    switch (op) {
+        case OP_ERF: *function = SPECIAL_ERF; return 1;
+        case OP_ERFC: *function = SPECIAL_ERFC; return 1;
+        case OP_GAMMA: *function = SPECIAL_GAMMA; return 1;
+        case OP_LGAMMA: *function = SPECIAL_LGAMMA; return 1;
+        case OP_BETA: *function = SPECIAL_BETA; return 1;
+        case OP_BESSEL_J: *function = SPECIAL_BESSEL_J; return 1;
+        case OP_BESSEL_Y: *function = SPECIAL_BESSEL_Y; return 1;
+        case OP_LAMBERT_W: *function = SPECIAL_LAMBERT_W; return 1;
+        case OP_NORMAL_CDF: *function = SPECIAL_NORMAL_CDF; return 1;
+        case OP_NORMAL_QUANTILE: *function = SPECIAL_NORMAL_QUANTILE; return 1;
+        default: return 0;
+    }
+}
+
+static int is_special_operator(char op) {
+    SpecialFunction function;
+    return special_function_for(op, &function);
+}
+
+// beta(a, b), besselj(n, x) and bessely(n, x)
+static int is_binary_special_operator(char op) {
+    return op == OP_BETA || op == OP_BESSEL_J || op == OP_BESSEL_Y;
+}
+
+static int is_number_theory_operator(char op) {
+    return op == OP_GCD || op == OP_LCM || op == OP_IS_PRIME || op == OP_FACTOR || op == OP_POWMOD;
+}
+
+int calculator_operator_arity(char op) {
+    if (is_conditional_operator(op) || op == OP_FACTOR) {
+        return -1;
+    }
+    if (op == OP_POWMOD) {
+        return 3;
+    }
+    if (is_binary_operator(op) || op == OP_UNIFORM || op == OP_NORMAL || is_binary_special_operator(op) ||
+        op == OP_GCD || op == OP_LCM) {
+        return 2;
+    }
+    if (op == OP_RAND || op == OP_RANDN) {
+        return 0;
+    }
+    return get_precedence(op) == FUNCTION_PRECEDENCE && !is_matrix_operator(op) && !is_stats_operator(op) ? 1 : -1;
+}
+
+// Compiling: check the operand count, record the operator and leave a
+// placeholder for its result
+static void record_operator(Calculator* calc, char op) {
+    int arity = calculator_operator_arity(op);
+    if (arity < 0) {
+        if (is_matrix_operator(op) || is_stats_operator(op) || op == OP_FACTOR) {
+            calc->error = ERROR_SYNTAX;
+        }
+        return;
+    }
+    if (calc->numbers.top < arity - 1) {
+        calc->error = ERROR_SYNTAX;
+        return;
+    }
+    if (arity == 0 && calc->numbers.top == MAX_STACK_SIZE - 1) {
+        calc->error = ERROR_STACK_OVERFLOW;
+        return;
+    }
+    calc->numbers.top -= arity - 1;
+    calc->numbers.items[calc->numbers.top] = NAN;
+    program_recorder_operator(calc->recorder, op);
+}
+
+// Bitwise operators on doubles: both operands must be integers in int64 range
+static double apply_bitwise_scalar(Calculator* calc, char op, double a, double b) {
+    Integer result;
+    ErrorType err;
+    if (floor(a) != a || floor(b) != b || fabs(a) >= 0x1p63 || fabs(b) >= 0x1p63) {
+        calc->error = ERROR_MATH_DOMAIN;
+        return NAN;
+    }
+    err = integer_apply_binary(64, op, (Integer)(int64_t)a, (Integer)(int64_t)b, &result);
+    if (err != ERROR_NONE) {
+        calc->error = err;
+        return NAN;
+    }
+    return (double)result;
+}
+
+// Special functions on doubles; b is ignored by the one-argument ones. A
+// NaN from arguments that were not NaN means they were outside the domain.
+static double apply_special_scalar(Calculator* calc, char op, double a, double b) {
+    SpecialFunction function = SPECIAL_ERF;
+    special_function_for(op, &function);
+    double value = special_eval(function, a, b);
+    if (isnan(value) && !isnan(a) && !isnan(b)) {
+        calc->error = ERROR_MATH_DOMAIN;
+    }
+    return value;
+}
 
+static double apply_binary_scalar(Calculator* calc, char op, double a, double b) {
     switch (op) {
-        case '+': b = ns_pop(numbers, calc); a = ns_pop(numbers, calc); ns_push(numbers, a + b); break;
-        case '-': b = ns_pop(numbers, calc); a = ns_pop(numbers, calc); ns_push(numbers, a - b); break;
-        case '*': b = ns_pop(numbers, calc); a = ns_pop(numbers, calc); ns_push(numbers, a * b); break;
-        case '/': 
-            b = ns_pop(numbers, calc); a = ns_pop(numbers, calc); 
+        case '+': return a + b;
+        case '-': return a - b;
+        case '*': return a * b;
+        case '/':
             if (b == 0.0) {
                 calc->error = ERROR_MATH_DIV_ZERO;
-                ns_push(numbers, NAN);
-            } else {
-                ns_push(numbers, a / b);
+                return NAN;
             }
-            break;
-        case '%': 
-            b = ns_pop(numbers, calc); a = ns_pop(numbers, calc); 
+            return a / b;
+        case '%':
             if (b == 0.0) {
                 calc->error = ERROR_MATH_DIV_ZERO;
-                ns_push(numbers, NAN);
-            }
-            else {
-                ns_push(numbers, fmod(a, b));
-            }
-            break;
-        case '^': b = ns_pop(numbers, calc); a = ns_pop(numbers, calc); ns_push(numbers, pow(a, b)); break;
-
-        case 's': 
-            if (numbers->top < 0) {
-                calc->error = ERROR_SYNTAX;
-                ns_push(numbers, NAN);
-                return;
-            }
-            a = ns_pop(numbers, calc); 
-            ns_push(numbers, angle_mode == DEG ? sin(a * M_PI / 180.0) : sin(a)); 
-            break;
-        case 'c': 
-            if (numbers->top < 0) {
-                calc->error = ERROR_SYNTAX;
-                ns_push(numbers, NAN);
-                return;
+                return NAN;
             }
-            a = ns_pop(numbers, calc); 
-            ns_push(numbers, angle_mode == DEG ? cos(a * M_PI / 180.0) : cos(a)); 
-            break;
-        case 't': 
-            if (numbers->top < 0) {
-                calc->error = ERROR_SYNTAX;
-                ns_push(numbers, NAN);
-                return;
-            }
-            a = ns_pop(numbers, calc); 
-            ns_push(numbers, angle_mode == DEG ? tan(a * M_PI / 180.0) : tan(a)); 
-            break;
+            return fmod(a, b);
+        case '^': return pow(a, b);
+        case OP_BIT_AND: case OP_BIT_OR: case OP_XOR: case OP_SHIFT_LEFT: case OP_SHIFT_RIGHT:
+            return apply_bitwise_scalar(calc, op, a, b);
+        case OP_LESS: return a < b;
+        case OP_GREATER: return a > b;
+        case OP_LESS_EQUAL: return a <= b;
+        case OP_GREATER_EQUAL: return a >= b;
+        case OP_EQUAL: return a == b;
+        case OP_NOT_EQUAL: return a != b;
+        case OP_AND: return a != 0.0 && b != 0.0;
+        case OP_OR: return a != 0.0 || b != 0.0;
+        case OP_BETA: case OP_BESSEL_J: case OP_BESSEL_Y:
+            return apply_special_scalar(calc, op, a, b);
+        default: return NAN;
+    }
+}
 
-        case 'S': 
-            if (numbers->top < 0) {
-                calc->error = ERROR_SYNTAX;
-                ns_push(numbers, NAN);
-                return;
-            }
-            a = ns_pop(numbers, calc); 
-            ns_push(numbers, angle_mode == DEG ? asin(a) * 180.0 / M_PI : asin(a)); 
-            break;
-        case 'C': 
-            if (numbers->top < 0) {
-                calc->error = ERROR_SYNTAX;
-                ns_push(numbers, NAN);
-                return;
-            }
-            a = ns_pop(numbers, calc); 
-            ns_push(numbers, angle_mode == DEG ? acos(a) * 180.0 / M_PI : acos(a)); 
-            break;
-        case 'T': 
-            if (numbers->top < 0) {
-                calc->error = ERROR_SYNTAX;
-                ns_push(numbers, NAN);
-                return;
-            }
-            a = ns_pop(numbers, calc); 
-            ns_push(numbers, angle_mode == DEG ? atan(a) * 180.0 / M_PI : atan(a)); 
-            break;
+static double apply_unary_scalar(Calculator* calc, char op, double a) {
+    AngleMode angle_mode = calc->angle_mode;
 
-        case 'l': 
-            if (numbers->top < 0) {
-                calc->error = ERROR_SYNTAX;
-                ns_push(numbers, NAN);
-                return;
-            }
-            a = ns_pop(numbers, calc); 
+    switch (op) {
+        // The matrix kernels' scalar reference, so degrees are reduced
+        // modulo 90 exactly for scalars too
+        case 's': return vecmath_scalar(VECMATH_SIN, angle_mode, a);
+        case 'c': return vecmath_scalar(VECMATH_COS, angle_mode, a);
+        case 't': return vecmath_scalar(VECMATH_TAN, angle_mode, a);
+        case 'S': return vecmath_scalar(VECMATH_ASIN, angle_mode, a);
+        case 'C': return angle_mode == DEG ? acos(a) * 180.0 / M_PI : acos(a);
+        case 'T': return angle_mode == DEG ? atan(a) * 180.0 / M_PI : atan(a);
+        case 'l':
             if (a <= 0.0) {
                 calc->error = ERROR_MATH_DOMAIN;
-                ns_push(numbers, NAN);
-            } else {
-                ns_push(numbers, log(a));
+                return NAN;
             }
-            break;
-        case 'L': 
-            if (numbers->top < 0) {
-                calc->error = ERROR_SYNTAX;
-                ns_push(numbers, NAN);
-                return;
-            }
-            a = ns_pop(numbers, calc); 
+            return log(a);
+        case 'L':
             if (a <= 0.0) {
                 calc->error = ERROR_MATH_DOMAIN;
-                ns_push(numbers, NAN);
-            } else {
-                ns_push(numbers, log10(a));
+                return NAN;
             }
-            break;
-        case 'q': 
-            if (numbers->top < 0) {
-                calc->error = ERROR_SYNTAX;
-                ns_push(numbers, NAN);
-                return;
-            }
-            a = ns_pop(numbers, calc); 
+            return log10(a);
+        case 'q':
             if (a < 0.0) {
                 calc->error = ERROR_MATH_DOMAIN;
-                ns_push(numbers, NAN);
-            }
-            else {
-                ns_push(numbers, sqrt(a));
+                return NAN;
             }
+            return sqrt(a);
+        case '!': return factorial(a, calc);
+        case 'E': return exp(a);
+        case 'R':
+            if (a == 0.0) {
+                calc->error = ERROR_MATH_DIV_ZERO;
+                return NAN;
+            }
+            return 1.0 / a;
+        case 'N': return -a;
+        // A scalar is its own 1x1 matrix
+        case OP_DETERMINANT: case OP_TRANSPOSE: return a;
+        case OP_INVERSE: return apply_binary_scalar(calc, '/', 1.0, a);
+        case OP_ERF: case OP_ERFC: case OP_GAMMA: case OP_LGAMMA: case OP_LAMBERT_W: case OP_NORMAL_CDF:
+        case OP_NORMAL_QUANTILE:
+            return apply_special_scalar(calc, op, a, 0.0);
+        default: return NAN;
+    }
+}
+
+// Conditionals. A scalar condition decides which operand is needed while the
+// expression is still being read; the other one is skipped, applying no
+// operator, so `if(x, 1/x, 0)` and `x != 0 && 1/x > 2` never divide by zero.
+// When compiling, the branches become jumps instead:
+//
+//   if(c, a, b)   c JUMP_IF_FALSE L1  a JUMP L2  L1: b  L2:
+//   a && b        a JUMP_IF_FALSE L1  b 0 !=  JUMP L2  L1: 0  L2:
+//   a || b        a JUMP_IF_FALSE L1  1  JUMP L2  L1: b 0 !=  L2:
+
+// Operands an operator takes, for skipping it; -1 for codes that take none
+static int skipped_operand_count(char op) {
+    if (op == OP_IF || op == OP_POWMOD) {
+        return 3;
+    }
+    if (is_binary_operator(op) || op == OP_MATMUL || op == OP_SOLVE || op == OP_PERCENTILE || op == OP_UNIFORM ||
+        op == OP_NORMAL || is_binary_special_operator(op) || op == OP_GCD || op == OP_LCM) {
+        return 2;
+    }
+    if (op == OP_RAND || op == OP_RANDN) {
+        return 0;
+    }
+    return get_precedence(op) == FUNCTION_PRECEDENCE ? 1 : -1;
+}
+
+// Inside a branch that is not taken: the operands are replaced by a
+// placeholder, without evaluating or charging anything
+static void skip_operator(Calculator* calc, char op) {
+    int operands = skipped_operand_count(op);
+    if (operands < 0) {
+        return;
+    }
+    if (calc->numbers.top < operands - 1) {
+        calc->error = ERROR_SYNTAX;
+        operands = calc->numbers.top + 1;
+    }
+    calc->numbers.top -= operands;
+    if (!ns_push(&calc->numbers, NAN)) {
+        calc->error = ERROR_STACK_OVERFLOW;
+    }
+}
+
+static int is_scalar_entry(const Calculator* calc, int index) {
+    unsigned char kind = calc->numbers.kinds[index];
+    return kind != ENTRY_MATRIX && kind != ENTRY_DATASET;
+}
+
+// Truth of a scalar entry in the current number mode: anything nonzero
+static int is_true_entry(const Calculator* calc, int index) {
+    const NumberStack* numbers = &calc->numbers;
+    if (is_decimal_mode(calc)) {
+        return !decimal_is_zero(decimal_format_of(calc), numbers->decimals[index]);
+    }
+    if (calc->number_mode == NUMBER_MODE_FIXED || is_integer_mode(calc)) {
+        return numbers->integers[index] != 0;
+    }
+    if (calc->number_mode == NUMBER_MODE_RATIONAL && rational_is_exact(&numbers->rationals[index])) {
+        return !rational_is_zero(&numbers->rationals[index]);
+    }
+    if (calc->number_mode == NUMBER_MODE_COMPLEX && numbers->imag[index] != 0.0) {
+        return 1;
+    }
+    return numbers->items[index] != 0.0;
+}
+
+// Stores 1 or 0 at `index` in the current number mode
+static void set_boolean_entry(Calculator* calc, int index, int value) {
+    NumberStack* numbers = &calc->numbers;
+    numbers->items[index] = value;
+    numbers->imag[index] = 0.0;
+    numbers->kinds[index] = ENTRY_SCALAR;
+    if (is_decimal_mode(calc)) {
+        numbers->decimals[index] = decimal_from_int(decimal_format_of(calc), value);
+    } else if (calc->number_mode == NUMBER_MODE_FIXED) {
+        numbers->integers[index] = value ? FIXED_ONE : 0;
+    } else if (calc->number_mode == NUMBER_MODE_RATIONAL) {
+        numbers->rationals[index] = rational_from_integer(value);
+    } else {
+        numbers->integers[index] = value;
+    }
+}
+
+static void move_entry(NumberStack* numbers, int from, int to) {
+    numbers->items[to] = numbers->items[from];
+    numbers->imag[to] = numbers->imag[from];
+    numbers->decimals[to] = numbers->decimals[from];
+    numbers->integers[to] = numbers->integers[from];
+    numbers->rationals[to] = numbers->rationals[from];
+    numbers->kinds[to] = numbers->kinds[from];
+    numbers->matrices[to] = numbers->matrices[from];
+    numbers->datasets[to] = numbers->datasets[from];
+}
+
+static Conditional* push_conditional(Calculator* calc, char op) {
+    if (calc->conditional_count == MAX_STACK_SIZE) {
+        calc->error = ERROR_STACK_OVERFLOW;
+        return NULL;
+    }
+    Conditional* entry = &calc->conditionals[calc->conditional_count++];
+    entry->op = op;
+    entry->stage = 0;
+    entry->branch = -1;
+    entry->skipping = 0;
+    entry->paren = calc->operators.top;
+    entry->jump = 0;
+    return entry;
+}
+
+static void set_skipping(Calculator* calc, Conditional* entry, int skipping) {
+    calc->skipping += skipping - entry->skipping;
+    entry->skipping = (uint8_t)skipping;
+}
+
+// `&&` or `||` has just been pushed and its left operand is on top. A left
+// operand that already decides the result makes the right one skipped.
+static int begin_logical_operator(Calculator* calc, char op) {
+    NumberStack* numbers = &calc->numbers;
+    Conditional* entry;
+    if (numbers->top < 0) {
+        calc->error = ERROR_SYNTAX;
+        return 0;
+    }
+    if (!(entry = push_conditional(calc, op))) {
+        return 0;
+    }
+    if (calc->recorder) {
+        entry->jump = program_recorder_branch(calc->recorder, PROGRAM_OP_JUMP_IF_FALSE);
+        numbers->top--;
+        if (op == OP_OR) {
+            program_recorder_constant(calc->recorder, 1.0);
+            size_t jump = program_recorder_branch(calc->recorder, PROGRAM_OP_JUMP);
+            program_recorder_patch(calc->recorder, entry->jump);
+            entry->jump = jump;
+        }
+    } else if (calc->skipping == 0 && is_scalar_entry(calc, numbers->top)) {
+        entry->branch = (int8_t)is_true_entry(calc, numbers->top);
+        set_skipping(calc, entry, entry->branch == (op == OP_OR));
+    }
+    return 1;
+}
+
+// A top-level ',' inside `if(`: the first ends the condition, the second the
+// branch taken when it is true
+static int conditional_comma(Calculator* calc) {
+    NumberStack* numbers = &calc->numbers;
+    Conditional* entry = calc->conditional_count > 0 ? &calc->conditionals[calc->conditional_count - 1] : NULL;
+
+    if (!entry || entry->op != OP_IF || entry->paren != calc->operators.top) {
+        if (numbers->top < 0) {
+            calc->error = ERROR_SYNTAX;
+            return 0;
+        }
+        if (!(entry = push_conditional(calc, OP_IF))) {
+            return 0;
+        }
+        entry->stage = 1;
+        if (calc->recorder) {
+            entry->jump = program_recorder_branch(calc->recorder, PROGRAM_OP_JUMP_IF_FALSE);
+            numbers->top--;
+        } else if (calc->skipping == 0 && is_scalar_entry(calc, numbers->top)) {
+            entry->branch = (int8_t)is_true_entry(calc, numbers->top);
+            set_skipping(calc, entry, entry->branch == 0);
+        }
+        return 1;
+    }
+    if (entry->stage != 1) {
+        calc->error = ERROR_SYNTAX;
+        return 0;
+    }
+    entry->stage = 2;
+    if (calc->recorder) {
+        size_t jump = program_recorder_branch(calc->recorder, PROGRAM_OP_JUMP);
+        program_recorder_patch(calc->recorder, entry->jump);
+        entry->jump = jump;
+        // Only one branch's value is on the stack when the program runs
+        numbers->top--;
+    }
+    set_skipping(calc, entry, entry->branch == 1);
+    return 1;
+}
+
+// if() with a matrix condition picks element by element from both branches,
+// each a matrix of the same shape or a scalar
+static void select_elementwise(Calculator* calc) {
+    NumberStack* numbers = &calc->numbers;
+    const Matrix* condition = entry_matrix(numbers, numbers->top - 2);
+    size_t count = (size_t)condition->rows * (size_t)condition->cols;
+    const double* branches[2];
+    Matrix* out = NULL;
+
+    if (!calculator_charge(calc, (long)count)) {
+        numbers->top -= 3;
+        ns_push(numbers, NAN);
+        return;
+    }
+    for (int k = 0; k < 2 && calc->error == ERROR_NONE; k++) {
+        int index = numbers->top - 1 + k;
+        Matrix* m = entry_matrix(numbers, index);
+        if (entry_dataset(numbers, index) || (m && (m->rows != condition->rows || m->cols != condition->cols))) {
+            calc->error = ERROR_DIMENSION_MISMATCH;
+        } else if (!m) {
+            m = matrix_new(calculator_arena(calc), condition->rows, condition->cols);
+            if (!m) {
+                calc->error = ERROR_OUT_OF_MEMORY;
+                break;
+            }
+            for (size_t i = 0; i < count; i++) {
+                m->data[i] = numbers->items[index];
+            }
+        }
+        branches[k] = m ? m->data : NULL;
+    }
+    if (calc->error == ERROR_NONE) {
+        out = matrix_new(calculator_arena(calc), condition->rows, condition->cols);
+        if (!out) {
+            calc->error = ERROR_OUT_OF_MEMORY;
+        } else {
+            vecmath_select(condition->data, branches[0], branches[1], out->data, count);
+        }
+    }
+    numbers->top -= 3;
+    if (out) {
+        push_matrix(calc, out);
+    } else {
+        ns_push(numbers, NAN);
+    }
+}
+
+// Applies `&&`, `||` or `if` once its last operand is complete: ends the
+// skip it started and, when compiling, emits the code joining its branches.
+// Returns 1 if the operator still has to be applied as a plain binary
+// operator, because both operands were evaluated or it is itself skipped.
+static int end_conditional(Calculator* calc, char op) {
+    NumberStack* numbers = &calc->numbers;
+    Conditional* entry = calc->conditional_count > 0 ? &calc->conditionals[calc->conditional_count - 1] : NULL;
+    int operands = op == OP_IF ? 3 : 2;
+
+    if (!entry || entry->op != op ||
+        (op == OP_IF && (entry->stage != 2 || entry->paren != calc->operators.top + 2))) {
+        calc->error = ERROR_SYNTAX;
+        ns_push(numbers, NAN);
+        return 0;
+    }
+    calc->conditional_count--;
+    int short_circuit = entry->skipping;
+    set_skipping(calc, entry, 0);
+
+    if (calc->recorder) {
+        // The branches have already taken their operands off the stack
+        if (numbers->top < 0) {
+            calc->error = ERROR_SYNTAX;
+            return 0;
+        }
+        if (op != OP_IF) {
+            program_recorder_constant(calc->recorder, 0.0);
+            program_recorder_operator(calc->recorder, OP_NOT_EQUAL);
+        }
+        if (op == OP_AND) {
+            size_t jump = program_recorder_branch(calc->recorder, PROGRAM_OP_JUMP);
+            program_recorder_patch(calc->recorder, entry->jump);
+            program_recorder_constant(calc->recorder, 0.0);
+            entry->jump = jump;
+        }
+        program_recorder_patch(calc->recorder, entry->jump);
+        return 0;
+    }
+    if (calc->skipping > 0 || (op != OP_IF && !short_circuit)) {
+        return 1;
+    }
+    if (numbers->top < operands - 1) {
+        calc->error = ERROR_SYNTAX;
+        ns_push(numbers, NAN);
+        return 0;
+    }
+    if (!calculator_charge(calc, 1)) {
+        ns_push(numbers, NAN);
+        return 0;
+    }
+    if (op != OP_IF) {
+        // The right operand was skipped: the left one decided the result
+        numbers->top--;
+        set_boolean_entry(calc, numbers->top, op == OP_OR);
+    } else if (entry->branch >= 0) {
+        move_entry(numbers, entry->branch ? numbers->top - 1 : numbers->top, numbers->top - 2);
+        numbers->top -= 2;
+    } else if (entry_matrix(numbers, numbers->top - 2)) {
+        select_elementwise(calc);
+    } else {
+        // A column file is no condition
+        calc->error = ERROR_SYNTAX;
+        numbers->top -= 3;
+        ns_push(numbers, NAN);
+    }
+    return 0;
+}
+
+static void apply_operator_step(Calculator* calc, char op);
+
+// Stack entry as a double for the trace; NaN for matrices and data sets
+static double traced_value(const Calculator* calc, int index) {
+    const NumberStack* numbers = &calc->numbers;
+    if (index < 0 || entry_matrix(numbers, index) || entry_dataset(numbers, index)) {
+        return NAN;
+    }
+    if (is_decimal_mode(calc)) {
+        return decimal_to_double(decimal_format_of(calc), numbers->decimals[index]);
+    }
+    if (calc->number_mode == NUMBER_MODE_FIXED) {
+        return fixed_to_double((Fixed)numbers->integers[index]);
+    }
+    if (is_integer_mode(calc)) {
+        return (double)numbers->integers[index];
+    }
+    if (calc->number_mode == NUMBER_MODE_RATIONAL) {
+        return rational_entry_value(numbers, index);
+    }
+    return numbers->items[index];
+}
+
+// Tracing: the same step between two time stamps, with the top of the
+// stack before and after. Kept out of line so the untraced path stays a
+// test and a tail call.
+__attribute__((noinline))
+static void apply_operator_traced(Calculator* calc, char op) {
+    NumberStack* numbers = &calc->numbers;
+    TraceEvent* event = trace_buffer_next(calc->trace);
+    int depth = numbers->top + 1;
+    double top = traced_value(calc, numbers->top);
+    double below = traced_value(calc, numbers->top - 1);
+    event->op = op;
+    event->number_depth = (int16_t)depth;
+    event->operator_depth = (int16_t)(calc->operators.top + 1);
+    event->reserved = 0;
+    event->start = trace_timestamp();
+    apply_operator_step(calc, op);
+    event->end = trace_timestamp();
+
+    int arity = depth - numbers->top;
+    arity = arity < 0 ? 0 : arity > 2 ? 2 : arity;
+    event->arity = (uint8_t)arity;
+    event->operands[0] = arity == 2 ? below : arity == 1 ? top : NAN;
+    event->operands[1] = arity == 2 ? top : NAN;
+    event->result = traced_value(calc, numbers->top);
+    event->error = (uint8_t)calc->error;
+}
+
+void apply_operator(Calculator* calc, char op) {
+#ifndef CALCULATOR_NO_TRACE
+    if (__builtin_expect(calc->trace != NULL, 0)) {
+        apply_operator_traced(calc, op);
+        return;
+    }
+#endif
+    apply_operator_step(calc, op);
+}
+
+static void apply_operator_step(Calculator* calc, char op) {
+    double a, b;
+    NumberStack* numbers = &calc->numbers;
+
+    if (is_conditional_operator(op) && !end_conditional(calc, op)) {
+        return;
+    }
+    if (calc->skipping > 0) {
+        skip_operator(calc, op);
+        return;
+    }
+    if (calc->recorder) {
+        record_operator(calc, op);
+        return;
+    }
+    if (!calculator_charge(calc, 1)) {
+        ns_push(numbers, NAN);
+        return;
+    }
+    if (is_stats_operator(op)) {
+        apply_stats_operator(calc, op);
+        return;
+    }
+    if (is_random_operator(op)) {
+        apply_random_operator(calc, op);
+        return;
+    }
+    if (is_number_theory_operator(op)) {
+        apply_number_theory_operator(calc, op);
+        return;
+    }
+    if (calc->matrix_count > 0 && calc->number_mode != NUMBER_MODE_REAL) {
+        // Only factor() makes a vector outside real mode, and no other
+        // operator there takes one
+        calc->error = ERROR_SYNTAX;
+        ns_push(numbers, NAN);
+        return;
+    }
+    if (is_special_operator(op) &&
+        (calc->number_mode != NUMBER_MODE_REAL || numbers->top < calculator_operator_arity(op) - 1)) {
+        // The special functions are defined on doubles only
+        calc->error = ERROR_SYNTAX;
+        ns_push(numbers, NAN);
+        return;
+    }
+    if (is_boolean_operator(op) && calc->number_mode != NUMBER_MODE_REAL) {
+        apply_boolean_operator(calc, op);
+        return;
+    }
+    if (calc->number_mode == NUMBER_MODE_FIXED) {
+        apply_fixed_operator(calc, op);
+        return;
+    }
+    if (calc->number_mode == NUMBER_MODE_RATIONAL) {
+        apply_rational_operator(calc, op);
+        return;
+    }
+    if (calc->number_mode == NUMBER_MODE_COMPLEX) {
+        apply_complex_operator(calc, op);
+        return;
+    }
+    if (is_decimal_mode(calc)) {
+        apply_decimal_operator(calc, op);
+        return;
+    }
+    if (is_integer_mode(calc)) {
+        apply_integer_operator(calc, op);
+        return;
+    }
+    if (calc->matrix_count > 0 || is_matrix_operator(op)) {
+        apply_matrix_operator(calc, op);
+        return;
+    }
+
+    if (is_binary_operator(op) || is_binary_special_operator(op)) {
+        b = ns_pop(numbers, calc);
+        a = ns_pop(numbers, calc);
+        ns_push(numbers, apply_binary_scalar(calc, op, a, b));
+    } else if (get_precedence(op) == FUNCTION_PRECEDENCE) {
+        if (numbers->top < 0) {
+            calc->error = ERROR_SYNTAX;
+            ns_push(numbers, NAN);
+            return;
+        }
+        a = ns_pop(numbers, calc);
+        ns_push(numbers, apply_unary_scalar(calc, op, a));
+    }
+}
+
+static int push_matrix(Calculator* calc, Matrix* m) {
+    if (!ns_push(&calc->numbers, NAN)) {
+        calc->error = ERROR_STACK_OVERFLOW;
+        return 0;
+    }
+    calc->numbers.matrices[calc->numbers.top] = m;
+    calc->numbers.kinds[calc->numbers.top] = ENTRY_MATRIX;
+    calc->matrix_count++;
+    return 1;
+}
+
+static Matrix* pop_matrix_value(Calculator* calc, double* scalar) {
+    NumberStack* numbers = &calc->numbers;
+    Matrix* m = numbers->top >= 0 ? entry_matrix(numbers, numbers->top) : NULL;
+    *scalar = ns_pop(numbers, calc);
+    return m;
+}
+
+static MatrixArena* calculator_arena(Calculator* calc) {
+    if (!calc->arena) {
+        calc->arena = matrix_arena_new(0);
+    }
+    return calc->arena;
+}
+
+static Matrix* promote_scalar(Calculator* calc, double value) {
+    Matrix* m = matrix_new(calculator_arena(calc), 1, 1);
+    if (m) {
+        m->data[0] = value;
+    }
+    return m;
+}
+
+// Element-wise operators broadcast a scalar operand over the matrix one.
+// Unary functions with a vectorized kernel for whole-matrix arguments
+static int vecmath_function_for(char op, VecmathFunction* function) {
+    switch (op) {
+        case 's': *function = VECMATH_SIN; return 1;
+        case 'c': *function = VECMATH_COS; return 1;
+        case 't': *function = VECMATH_TAN; return 1;
+        case 'S': *function = VECMATH_ASIN; return 1;
+        case 'E': *function = VECMATH_EXP; return 1;
+        case 'l': *function = VECMATH_LOG; return 1;
+        case 'L': *function = VECMATH_LOG10; return 1;
+        default: return 0;
+    }
+}
+
+// Comparisons and && || with a vectorized kernel; `swapped` when the
+// operands go to the kernel in reverse order
+static int vecmath_predicate_for(char op, VecmathPredicate* predicate, int* swapped) {
+    *swapped = op == OP_GREATER || op == OP_GREATER_EQUAL;
+    switch (op) {
+        case OP_LESS: case OP_GREATER: *predicate = VECMATH_LESS; return 1;
+        case OP_LESS_EQUAL: case OP_GREATER_EQUAL: *predicate = VECMATH_LESS_EQUAL; return 1;
+        case OP_EQUAL: *predicate = VECMATH_EQUAL; return 1;
+        case OP_NOT_EQUAL: *predicate = VECMATH_NOT_EQUAL; return 1;
+        case OP_AND: *predicate = VECMATH_AND; return 1;
+        case OP_OR: *predicate = VECMATH_OR; return 1;
+        default: return 0;
+    }
+}
+
+static Matrix* apply_elementwise(Calculator* calc, char op, Matrix* am, double a, Matrix* bm, double b) {
+    const Matrix* shape = am ? am : bm;
+    if (am && bm && (am->rows != bm->rows || am->cols != bm->cols)) {
+        calc->error = ERROR_DIMENSION_MISMATCH;
+        return NULL;
+    }
+
+    Matrix* out = matrix_new(calculator_arena(calc), shape->rows, shape->cols);
+    if (!out) {
+        calc->error = ERROR_OUT_OF_MEMORY;
+        return NULL;
+    }
+
+    size_t count = (size_t)shape->rows * (size_t)shape->cols;
+    VecmathFunction function;
+    VecmathPredicate predicate = VECMATH_LESS;
+    SpecialFunction special;
+    int swapped = 0;
+    if (!bm && !is_binary_operator(op) && vecmath_function_for(op, &function)) {
+        vecmath_apply(function, calc->angle_mode, am->data, out->data, count);
+        // As for a scalar: a NaN from an argument that was not NaN, or the
+        // logarithm of zero, is outside the domain
+        for (size_t k = 0; k < count; k++) {
+            if ((isnan(out->data[k]) && !isnan(am->data[k])) || ((op == 'l' || op == 'L') && am->data[k] <= 0.0)) {
+                calc->error = ERROR_MATH_DOMAIN;
+                out->data[k] = NAN;
+            }
+        }
+        return out;
+    }
+    if (special_function_for(op, &special)) {
+        // The batch kernel, with a scalar argument broadcast through `out`
+        int binary = is_binary_special_operator(op);
+        if (binary && (!am || !bm)) {
+            for (size_t k = 0; k < count; k++) {
+                out->data[k] = am ? b : a;
+            }
+        }
+        special_apply(special, am ? am->data : out->data, !binary ? NULL : bm ? bm->data : out->data, out->data,
+                      count);
+        for (size_t k = 0; k < count; k++) {
+            double x = am ? am->data[k] : a;
+            double y = !binary ? 0.0 : bm ? bm->data[k] : b;
+            if (isnan(out->data[k]) && !isnan(x) && !isnan(y)) {
+                calc->error = ERROR_MATH_DOMAIN;
+            }
+        }
+        return out;
+    }
+    if (op == '^' || vecmath_predicate_for(op, &predicate, &swapped)) {
+        // Broadcast a scalar operand through `out` so the kernel sees two arrays
+        if (!am || !bm) {
+            for (size_t k = 0; k < count; k++) {
+                out->data[k] = am ? b : a;
+            }
+        }
+        const double* x = am ? am->data : out->data;
+        const double* y = bm ? bm->data : out->data;
+        if (op == '^') {
+            vecmath_pow(x, y, out->data, count);
+            for (size_t k = 0; k < count; k++) {
+                if (isnan(out->data[k]) && !isnan(am ? am->data[k] : a) && !isnan(bm ? bm->data[k] : b)) {
+                    calc->error = ERROR_MATH_DOMAIN;
+                    out->data[k] = NAN;
+                }
+            }
+        } else {
+            vecmath_compare(predicate, swapped ? y : x, swapped ? x : y, out->data, count);
+        }
+        return out;
+    }
+
+    for (size_t k = 0; k < count; k++) {
+        double x = am ? am->data[k] : a;
+        if (bm || is_binary_operator(op)) {
+            double y = bm ? bm->data[k] : b;
+            out->data[k] = apply_binary_scalar(calc, op, x, y);
+        } else {
+            out->data[k] = apply_unary_scalar(calc, op, x);
+        }
+    }
+    return out;
+}
+
+// Work charged to the budget before a matrix operator runs: multiply-adds
+// for the product and the factorizations, elements for everything else
+static long matrix_operator_cost(char op, const Matrix* am, const Matrix* bm) {
+    const Matrix* shape = am ? am : bm;
+    double n = (double)shape->rows;
+    double cost = (double)shape->rows * (double)shape->cols;
+
+    if (op == OP_MATMUL && am && bm) {
+        cost = (double)am->rows * (double)am->cols * (double)bm->cols;
+    } else if (op == OP_INVERSE || op == OP_DETERMINANT || (op == OP_SOLVE && am)) {
+        cost = n * n * n;
+    }
+    return cost < (double)LONG_MAX ? (long)cost : LONG_MAX;
+}
+
+static void apply_matrix_operator(Calculator* calc, char op) {
+    NumberStack* numbers = &calc->numbers;
+    MatrixArena* arena;
+    Matrix *am = NULL, *bm = NULL, *result = NULL;
+    double a = 0.0, b = 0.0;
+    ErrorType err = ERROR_NONE;
+
+    if (is_binary_operator(op) || is_binary_special_operator(op) || op == OP_MATMUL || op == OP_SOLVE) {
+        bm = pop_matrix_value(calc, &b);
+        am = pop_matrix_value(calc, &a);
+    } else if (get_precedence(op) == FUNCTION_PRECEDENCE) {
+        if (numbers->top < 0) {
+            calc->error = ERROR_SYNTAX;
+            ns_push(numbers, NAN);
+            return;
+        }
+        am = pop_matrix_value(calc, &a);
+    } else {
+        return;
+    }
+
+    if (!am && !bm) {
+        if (op == OP_MATMUL) {
+            ns_push(numbers, a * b);
+        } else if (op == OP_SOLVE) {
+            ns_push(numbers, apply_binary_scalar(calc, '/', b, a));
+        } else if (is_binary_operator(op) || is_binary_special_operator(op)) {
+            ns_push(numbers, apply_binary_scalar(calc, op, a, b));
+        } else {
+            ns_push(numbers, apply_unary_scalar(calc, op, a));
+        }
+        return;
+    }
+
+    if (!calculator_charge(calc, matrix_operator_cost(op, am, bm))) {
+        ns_push(numbers, NAN);
+        return;
+    }
+    arena = calculator_arena(calc);
+    if (!arena) {
+        calc->error = ERROR_OUT_OF_MEMORY;
+        ns_push(numbers, NAN);
+        return;
+    }
+
+    switch (op) {
+        case OP_MATMUL:
+            if (!am || !bm) {
+                // Scaling by a scalar is the element-wise product
+                result = apply_elementwise(calc, '*', am, a, bm, b);
+                break;
+            }
+            err = matrix_multiply(arena, am, bm, &result);
             break;
-        case '!': 
-            if (numbers->top < 0) {
-                calc->error = ERROR_SYNTAX;
-                ns_push(numbers, NAN);
-                return;
+        case OP_SOLVE:
+            if (!am) {
+                am = promote_scalar(calc, a);
+            }
+            if (!bm) {
+                bm = promote_scalar(calc, b);
             }
-            a = ns_pop(numbers, calc); 
-            ns_push(numbers, factorial(a, calc)); 
+            err = am && bm ? matrix_solve(arena, am, bm, &result) : ERROR_OUT_OF_MEMORY;
             break;
-        case 'E': 
-            if (numbers->top < 0) {
-                calc->error = ERROR_SYNTAX;
-                ns_push(numbers, NAN);
-                return;
+        case OP_TRANSPOSE:
+            err = matrix_transpose(arena, am, &result);
+            break;
+        case OP_INVERSE:
+            err = matrix_inverse(arena, am, &result);
+            break;
+        case OP_DETERMINANT: {
+            double det = NAN;
+            err = matrix_determinant(arena, am, &det);
+            if (err != ERROR_NONE) {
+                calc->error = err;
             }
-            a = ns_pop(numbers, calc); 
-            ns_push(numbers, exp(a)); 
+            ns_push(numbers, det);
+            return;
+        }
+        default:
+            result = apply_elementwise(calc, op, am, a, bm, b);
             break;
-        case 'R': 
-            if (numbers->top < 0) {
-                calc->error = ERROR_SYNTAX;
-                ns_push(numbers, NAN);
-                return;
+    }
+
+    if (err != ERROR_NONE) {
+        calc->error = err;
+    }
+    if (result) {
+        push_matrix(calc, result);
+    } else {
+        if (calc->error == ERROR_NONE) {
+            calc->error = ERROR_OUT_OF_MEMORY;
+        }
+        ns_push(numbers, NAN);
+    }
+}
+
+static void apply_complex_operator(Calculator* calc, char op) {
+    NumberStack* numbers = &calc->numbers;
+    double ar, ai, br, bi, re, im;
+    ErrorType err;
+
+    if (get_precedence(op) == FUNCTION_PRECEDENCE) {
+        if (numbers->top < 0) {
+            calc->error = ERROR_SYNTAX;
+            ns_push(numbers, NAN);
+            numbers->imag[numbers->top] = NAN;
+            return;
+        }
+        ai = numbers->imag[numbers->top];
+        ar = ns_pop(numbers, calc);
+        err = complex_apply_unary(op, calc->angle_mode, ar, ai, &re, &im);
+    } else if (is_binary_operator(op)) {
+        bi = numbers->top >= 0 ? numbers->imag[numbers->top] : 0.0;
+        br = ns_pop(numbers, calc);
+        ai = numbers->top >= 0 ? numbers->imag[numbers->top] : 0.0;
+        ar = ns_pop(numbers, calc);
+        if (integer_is_bitwise_operator(op)) {
+            // Defined on the real integers only
+            err = ai == 0.0 && bi == 0.0 ? ERROR_NONE : ERROR_MATH_DOMAIN;
+            re = err == ERROR_NONE ? apply_bitwise_scalar(calc, op, ar, br) : NAN;
+            im = 0.0;
+        } else {
+            err = complex_apply_binary(op, ar, ai, br, bi, &re, &im);
+        }
+    } else {
+        return;
+    }
+
+    if (err != ERROR_NONE) {
+        calc->error = err;
+    }
+    ns_push(numbers, re);
+    numbers->imag[numbers->top] = im;
+}
+
+static Decimal pop_decimal(Calculator* calc) {
+    NumberStack* numbers = &calc->numbers;
+    Decimal value = numbers->top >= 0 ? numbers->decimals[numbers->top] : (Decimal){0, 0};
+    ns_pop(numbers, calc);
+    return value;
+}
+
+// Exact n! for integer n; overflows to infinity like the other operators
+static Decimal decimal_factorial(Calculator* calc, DecimalFormat format, Decimal a) {
+    int64_t n;
+    if (!decimal_to_int64(format, a, &n) || n < 0) {
+        calc->error = ERROR_MATH_DOMAIN;
+        return decimal_from_double(format, NAN);
+    }
+    Decimal result = decimal_from_int(format, 1);
+    for (int64_t i = 2; i <= n && decimal_is_finite(format, result); i++) {
+        result = decimal_multiply(format, result, decimal_from_int(format, i));
+    }
+    if (!decimal_is_finite(format, result)) {
+        calc->error = ERROR_MATH_DOMAIN;
+        return decimal_from_double(format, NAN);
+    }
+    return result;
+}
+
+// The arithmetic operators, integer powers, negation, reciprocal and
+// factorial are exact decimal; the transcendental functions have no decimal
+// kernel and go through the binary scalar path.
+static void apply_decimal_operator(Calculator* calc, char op) {
+    DecimalFormat format = decimal_format_of(calc);
+    Decimal a, b, result;
+    ErrorType err = ERROR_NONE;
+    int64_t exponent, x, y;
+
+    if (op == OP_MATMUL || op == OP_SOLVE) {
+        calc->error = ERROR_SYNTAX;
+        push_decimal(calc, decimal_from_double(format, NAN));
+        return;
+    }
+    if (is_binary_operator(op)) {
+        b = pop_decimal(calc);
+        a = pop_decimal(calc);
+        switch (op) {
+            case '+': result = decimal_add(format, a, b); break;
+            case '-': result = decimal_subtract(format, a, b); break;
+            case '*': result = decimal_multiply(format, a, b); break;
+            case '/': err = decimal_divide(format, a, b, &result); break;
+            case '%': err = decimal_remainder(format, a, b, &result); break;
+            case '^':
+                if (decimal_to_int64(format, b, &exponent)) {
+                    if (exponent < 0 && decimal_is_zero(format, a)) {
+                        err = ERROR_MATH_DIV_ZERO;
+                        result = decimal_from_double(format, NAN);
+                    } else {
+                        result = decimal_power(format, a, exponent);
+                    }
+                } else {
+                    result = decimal_from_double(format, pow(decimal_to_double(format, a),
+                                                             decimal_to_double(format, b)));
+                }
+                break;
+            default:
+                if (decimal_to_int64(format, a, &x) && decimal_to_int64(format, b, &y)) {
+                    Integer bits;
+                    err = integer_apply_binary(64, op, x, y, &bits);
+                    result = decimal_from_int(format, err == ERROR_NONE ? (int64_t)bits : 0);
+                } else {
+                    err = ERROR_MATH_DOMAIN;
+                    result = decimal_from_double(format, NAN);
+                }
+                break;
+        }
+    } else if (get_precedence(op) == FUNCTION_PRECEDENCE) {
+        if (calc->numbers.top < 0) {
+            calc->error = ERROR_SYNTAX;
+            push_decimal(calc, decimal_from_double(format, NAN));
+            return;
+        }
+        a = pop_decimal(calc);
+        switch (op) {
+            case 'N': result = decimal_negate(format, a); break;
+            case OP_DETERMINANT: case OP_TRANSPOSE: result = a; break;
+            case 'R': case OP_INVERSE:
+                err = decimal_divide(format, decimal_from_int(format, 1), a, &result);
+                break;
+            case '!': result = decimal_factorial(calc, format, a); break;
+            default:
+                result = decimal_from_double(format, apply_unary_scalar(calc, op, decimal_to_double(format, a)));
+                break;
+        }
+    } else {
+        return;
+    }
+
+    if (err != ERROR_NONE) {
+        calc->error = err;
+    }
+    push_decimal(calc, result);
+}
+
+// Exact integer arithmetic for the programmer modes and the real-mode fast
+// path; functions with no integer meaning are domain errors
+static void apply_integer_operator(Calculator* calc, char op) {
+    NumberStack* numbers = &calc->numbers;
+    int bits = integer_bits(calc);
+    Integer a, b, result = 0;
+    ErrorType err;
+
+    if (is_binary_operator(op)) {
+        if (numbers->top < 1) {
+            calc->error = ERROR_SYNTAX;
+            push_integer(calc, 0);
+            return;
+        }
+        b = numbers->integers[numbers->top--];
+        a = numbers->integers[numbers->top--];
+        // The fast path must match real division, so it only takes exact quotients
+        if (calc->integer_fast_path && op == '/' && b != 0 && a % b != 0) {
+            err = ERROR_MATH_DOMAIN;
+        } else {
+            err = integer_apply_binary(bits, op, a, b, &result);
+        }
+    } else if (get_precedence(op) == FUNCTION_PRECEDENCE) {
+        if (numbers->top < 0) {
+            calc->error = ERROR_SYNTAX;
+            push_integer(calc, 0);
+            return;
+        }
+        a = numbers->integers[numbers->top--];
+        err = integer_apply_unary(bits, op, a, &result);
+        if (err == ERROR_SYNTAX) {
+            err = ERROR_MATH_DOMAIN;
+        }
+    } else {
+        return;
+    }
+
+    if (err != ERROR_NONE) {
+        calc->error = err;
+    }
+    push_integer(calc, result);
+}
+
+// Fixed-point mode keeps raw Fixed values in numbers.integers[]. Bitwise
+// operators act on integral values; the matrix functions act on the scalar
+// as in decimal mode.
+static void apply_fixed_operator(Calculator* calc, char op) {
+    NumberStack* numbers = &calc->numbers;
+    Fixed a, b, result = 0;
+    ErrorType err;
+
+    if (op == OP_MATMUL || op == OP_SOLVE) {
+        calc->error = ERROR_SYNTAX;
+        push_integer(calc, 0);
+        return;
+    }
+    if (is_binary_operator(op)) {
+        if (numbers->top < 1) {
+            calc->error = ERROR_SYNTAX;
+            push_integer(calc, 0);
+            return;
+        }
+        b = (Fixed)numbers->integers[numbers->top--];
+        a = (Fixed)numbers->integers[numbers->top--];
+        if (integer_is_bitwise_operator(op)) {
+            Integer bits = 0;
+            if (((a | b) & (FIXED_ONE - 1)) != 0) {
+                err = ERROR_MATH_DOMAIN;
+            } else {
+                err = integer_apply_binary(64, op, a >> FIXED_FRACTION_BITS, b >> FIXED_FRACTION_BITS, &bits);
+                if (err == ERROR_NONE) {
+                    err = fixed_from_integer((int64_t)bits, &result);
+                }
             }
-            a = ns_pop(numbers, calc); 
-            if (a == 0.0) {
-                calc->error = ERROR_MATH_DIV_ZERO;
-                ns_push(numbers, NAN);
+        } else {
+            err = fixed_apply_binary(op, a, b, &result);
+        }
+    } else if (get_precedence(op) == FUNCTION_PRECEDENCE) {
+        if (numbers->top < 0) {
+            calc->error = ERROR_SYNTAX;
+            push_integer(calc, 0);
+            return;
+        }
+        a = (Fixed)numbers->integers[numbers->top--];
+        if (op == OP_DETERMINANT || op == OP_TRANSPOSE) {
+            result = a;
+            err = ERROR_NONE;
+        } else {
+            err = fixed_apply_unary(op == OP_INVERSE ? 'R' : op, calc->angle_mode, a, &result);
+            if (err == ERROR_SYNTAX) {
+                err = ERROR_MATH_DOMAIN;
+            }
+        }
+    } else {
+        return;
+    }
+
+    if (err != ERROR_NONE) {
+        calc->error = err;
+    }
+    push_integer(calc, result);
+}
+
+// The double an exact operation past RATIONAL_MAX_BITS carries on with.
+// The exact result was not zero, so a double of zero or infinity cannot
+// stand in for it.
+static void push_rational_fallback(Calculator* calc, int past_limit, double value) {
+    if (past_limit && (value == 0.0 || isinf(value))) {
+        calc->error = ERROR_OVERFLOW;
+        value = NAN;
+    }
+    push_number(calc, value);
+}
+
+// Rational mode: `+ - * /`, integer powers, negation, reciprocal and
+// factorial stay exact, and `%` and the bitwise operators are exact on
+// integers. Anything else, an inexact operand, or an exact result past
+// RATIONAL_MAX_BITS goes through the real scalar path and leaves a double.
+static void apply_rational_operator(Calculator* calc, char op) {
+    NumberStack* numbers = &calc->numbers;
+    Rational result;
+    Integer p, q, bits;
+    ErrorType err = ERROR_OVERFLOW;
+
+    if (op == OP_MATMUL || op == OP_SOLVE) {
+        calc->error = ERROR_SYNTAX;
+        push_number(calc, NAN);
+        return;
+    }
+    if (is_binary_operator(op)) {
+        if (numbers->top < 1) {
+            calc->error = ERROR_SYNTAX;
+            push_number(calc, NAN);
+            return;
+        }
+        int j = numbers->top--, i = numbers->top--;
+        const Rational* a = &numbers->rationals[i];
+        const Rational* b = &numbers->rationals[j];
+        if (rational_is_exact(a) && rational_is_exact(b)) {
+            if (integer_is_bitwise_operator(op) || op == '%') {
+                if (rational_to_integer(a, &p) && rational_to_integer(b, &q)) {
+                    err = integer_apply_binary(128, op, p, q, &bits);
+                    result = rational_from_integer(bits);
+                } else if (op != '%') {
+                    err = ERROR_MATH_DOMAIN;
+                }
             } else {
-                ns_push(numbers, 1.0 / a);
+                err = rational_apply_binary(calculator_arena(calc), op, a, b, &result);
+            }
+        }
+        if (err == ERROR_OVERFLOW || err == ERROR_SYNTAX) {
+            double x = rational_entry_value(numbers, i), y = rational_entry_value(numbers, j);
+            push_rational_fallback(calc, err == ERROR_OVERFLOW && rational_is_exact(a) && rational_is_exact(b),
+                                   apply_binary_scalar(calc, op, x, y));
+            return;
+        }
+    } else if (get_precedence(op) == FUNCTION_PRECEDENCE) {
+        if (numbers->top < 0) {
+            calc->error = ERROR_SYNTAX;
+            push_number(calc, NAN);
+            return;
+        }
+        if (op == OP_DETERMINANT || op == OP_TRANSPOSE) {
+            // A scalar is its own determinant and transpose
+            return;
+        }
+        int i = numbers->top--;
+        const Rational* a = &numbers->rationals[i];
+        if (rational_is_exact(a)) {
+            err = rational_apply_unary(calculator_arena(calc), op == OP_INVERSE ? 'R' : op, a, &result);
+        }
+        if (err == ERROR_OVERFLOW || err == ERROR_SYNTAX) {
+            push_rational_fallback(calc, err == ERROR_OVERFLOW && rational_is_exact(a),
+                                   apply_unary_scalar(calc, op, rational_entry_value(numbers, i)));
+            return;
+        }
+    } else {
+        return;
+    }
+
+    if (err != ERROR_NONE) {
+        calc->error = err;
+        push_number(calc, NAN);
+        return;
+    }
+    push_rational(calc, result);
+}
+
+// Three-way comparison of two scalar entries: -1, 0 or 1, or 2 if they are
+// unordered (NaN). Integers, fixed values and fractions compare exactly.
+static int entry_order(const Calculator* calc, int i, int j) {
+    const NumberStack* numbers = &calc->numbers;
+    double x, y;
+
+    if (calc->number_mode == NUMBER_MODE_FIXED || is_integer_mode(calc)) {
+        return (numbers->integers[i] > numbers->integers[j]) - (numbers->integers[i] < numbers->integers[j]);
+    }
+    if (is_decimal_mode(calc)) {
+        DecimalFormat format = decimal_format_of(calc);
+        Decimal p = numbers->decimals[i], q = numbers->decimals[j];
+        if (decimal_is_finite(format, p) && decimal_is_finite(format, q)) {
+            // The difference of two different decimals never rounds to zero
+            Decimal difference = decimal_subtract(format, p, q);
+            return decimal_is_zero(format, difference) ? 0 : decimal_is_negative(format, difference) ? -1 : 1;
+        }
+        x = decimal_to_double(format, p);
+        y = decimal_to_double(format, q);
+    } else if (calc->number_mode == NUMBER_MODE_RATIONAL) {
+        if (rational_is_exact(&numbers->rationals[i]) && rational_is_exact(&numbers->rationals[j])) {
+            return rational_compare(&numbers->rationals[i], &numbers->rationals[j]);
+        }
+        x = rational_entry_value(numbers, i);
+        y = rational_entry_value(numbers, j);
+    } else {
+        x = numbers->items[i];
+        y = numbers->items[j];
+    }
+    return x < y ? -1 : x > y ? 1 : x == y ? 0 : 2;
+}
+
+// Comparisons, && and || outside real mode. Complex values can only be
+// tested for equality unless both are real.
+static void apply_boolean_operator(Calculator* calc, char op) {
+    NumberStack* numbers = &calc->numbers;
+    int a = numbers->top - 1, b = numbers->top, order, result = 0;
+
+    if (numbers->top < 1) {
+        calc->error = ERROR_SYNTAX;
+        ns_push(numbers, NAN);
+        set_boolean_entry(calc, numbers->top, 0);
+        return;
+    }
+    if (op == OP_AND || op == OP_OR) {
+        result = op == OP_AND ? is_true_entry(calc, a) && is_true_entry(calc, b)
+                              : is_true_entry(calc, a) || is_true_entry(calc, b);
+    } else {
+        if (calc->number_mode == NUMBER_MODE_COMPLEX && (numbers->imag[a] != 0.0 || numbers->imag[b] != 0.0)) {
+            if (op != OP_EQUAL && op != OP_NOT_EQUAL) {
+                calc->error = ERROR_MATH_DOMAIN;
+            }
+            order = numbers->items[a] == numbers->items[b] && numbers->imag[a] == numbers->imag[b] ? 0 : 2;
+        } else {
+            order = entry_order(calc, a, b);
+        }
+        switch (op) {
+            case OP_LESS: result = order == -1; break;
+            case OP_GREATER: result = order == 1; break;
+            case OP_LESS_EQUAL: result = order == -1 || order == 0; break;
+            case OP_GREATER_EQUAL: result = order == 0 || order == 1; break;
+            case OP_EQUAL: result = order == 0; break;
+            default: result = order != 0; break;
+        }
+    }
+    numbers->top--;
+    set_boolean_entry(calc, numbers->top, result);
+}
+
+// Statistics over a column file, a vector or matrix (all elements) or a
+// single number. percentile(x, p) takes p in percent.
+static void apply_stats_operator(Calculator* calc, char op) {
+    NumberStack* numbers = &calc->numbers;
+    StatsSummary* summary;
+    StatsSummary* owned = NULL;
+    double q = 0.5, value = NAN, scalar;
+    ErrorType err;
+
+    if (calc->number_mode != NUMBER_MODE_REAL || numbers->top < (op == OP_PERCENTILE ? 1 : 0) ||
+        (op == OP_PERCENTILE && (entry_matrix(numbers, numbers->top) || entry_dataset(numbers, numbers->top)))) {
+        calc->error = ERROR_SYNTAX;
+        ns_push(numbers, NAN);
+        return;
+    }
+    if (op == OP_PERCENTILE) {
+        q = ns_pop(numbers, calc) / 100.0;
+    }
+
+    summary = entry_dataset(numbers, numbers->top);
+    if (summary) {
+        numbers->top--;
+    } else {
+        Matrix* m = pop_matrix_value(calc, &scalar);
+        long n = m ? (long)m->rows * m->cols : 1;
+        if (!calculator_charge(calc, n)) {
+            ns_push(numbers, NAN);
+            return;
+        }
+        summary = owned = stats_summary_new();
+        if (!summary) {
+            calc->error = ERROR_OUT_OF_MEMORY;
+            ns_push(numbers, NAN);
+            return;
+        }
+        for (long i = 0; i < n; i++) {
+            stats_summary_add(summary, m ? m->data[i] : scalar);
+        }
+    }
+
+    switch (op) {
+        case OP_MEAN: err = stats_mean(summary, &value); break;
+        case OP_VARIANCE: err = stats_variance(summary, &value); break;
+        case OP_STDDEV: err = stats_stddev(summary, &value); break;
+        case OP_MIN: err = stats_min(summary, &value); break;
+        case OP_MAX: err = stats_max(summary, &value); break;
+        default: err = stats_quantile(summary, q, &value); break;
+    }
+    stats_summary_free(owned);
+    if (err != ERROR_NONE) {
+        calc->error = err;
+        value = NAN;
+    }
+    ns_push(numbers, value);
+}
+
+// Random draws from the calculator's generator: rand() and randn() take no
+// operands, uniform(a, b) and normal(mean, stddev) two, and exponential(rate)
+// and poisson(mean) one
+static void apply_random_operator(Calculator* calc, char op) {
+    NumberStack* numbers = &calc->numbers;
+    int arity = calculator_operator_arity(op);
+    double a = 0.0, b = 0.0, value = NAN;
+
+    calc->nondeterministic = 1;
+    if (calc->number_mode != NUMBER_MODE_REAL || numbers->top < arity - 1) {
+        calc->error = ERROR_SYNTAX;
+        ns_push(numbers, NAN);
+        return;
+    }
+    for (int i = 0; i < arity; i++) {
+        if (entry_matrix(numbers, numbers->top) || entry_dataset(numbers, numbers->top)) {
+            calc->error = ERROR_SYNTAX;
+            ns_push(numbers, NAN);
+            return;
+        }
+        b = a;
+        a = ns_pop(numbers, calc);
+    }
+    if (!calc->random && !(calc->random = random_generator_new(random_clock_seed(), 0))) {
+        calc->error = ERROR_OUT_OF_MEMORY;
+        ns_push(numbers, NAN);
+        return;
+    }
+
+    switch (op) {
+        case OP_RAND: value = random_uniform(calc->random); break;
+        case OP_RANDN: value = random_normal(calc->random); break;
+        case OP_UNIFORM:
+            if (isfinite(a) && isfinite(b) && a <= b) {
+                value = a + (b - a) * random_uniform(calc->random);
+                // Rounding may reach b itself
+                value = value < b ? value : a;
             }
             break;
-        case 'N': 
-            if (numbers->top < 0) {
-                calc->error = ERROR_SYNTAX;
-                ns_push(numbers, NAN);
-                return;
+        case OP_NORMAL:
+            if (isfinite(a) && b >= 0.0 && isfinite(b)) {
+                value = a + b * random_normal(calc->random);
+            }
+            break;
+        case OP_EXPONENTIAL:
+            if (a > 0.0 && isfinite(a)) {
+                value = random_exponential(calc->random) / a;
             }
-            a = ns_pop(numbers, calc); 
-            ns_push(numbers, -a); 
             break;
-        default: break;
+        case OP_POISSON:
+            if (a >= 0.0 && a <= RANDOM_POISSON_MAX) {
+                value = random_poisson(calc->random, a);
+            }
+            break;
+    }
+    if (isnan(value)) {
+        calc->error = ERROR_MATH_DOMAIN;
+    }
+    ns_push(numbers, value);
+}
+
+// Operand `index` of a number-theory function: an exact integer of
+// magnitude below 2^64. A real operand must be an integral double below
+// 2^53, past which it may have been rounded, or a literal whose digits were
+// kept.
+static int number_theory_operand(const Calculator* calc, int index, Integer* value) {
+    const NumberStack* numbers = &calc->numbers;
+    if (is_integer_mode(calc)) {
+        *value = numbers->integers[index];
+    } else if (calc->number_mode == NUMBER_MODE_RATIONAL && rational_is_exact(&numbers->rationals[index])) {
+        if (!rational_to_integer(&numbers->rationals[index], value)) {
+            return 0;
+        }
+    } else if (numbers->kinds[index] == ENTRY_EXACT) {
+        *value = numbers->integers[index];
+    } else {
+        double x = numbers->items[index];
+        if (!(fabs(x) < INTEGER_FAST_PATH_EXACT) || floor(x) != x) {
+            return 0;
+        }
+        *value = (Integer)x;
+    }
+    return *value > -((Integer)1 << 64) && *value < ((Integer)1 << 64);
+}
+
+// factor(n) as a row vector of the prime factors, ascending and repeated by
+// multiplicity, led by -1 if n is negative; factor(1) is [1]. A factor past
+// 2^53 is rounded in the matrix, so the exact entries are kept alongside for
+// the display.
+static void push_factors(Calculator* calc, Integer n) {
+    uint64_t factors[NUMTHEORY_MAX_FACTORS];
+    int negative = n < 0;
+    int count = numtheory_factor((uint64_t)(negative ? -n : n), factors);
+    int cols = negative + count > 0 ? negative + count : 1;
+    MatrixArena* arena = calculator_arena(calc);
+    Matrix* m = arena ? matrix_new(arena, 1, cols) : NULL;
+    Integer* values = arena ? (Integer*)matrix_arena_alloc(arena, (size_t)cols * sizeof(Integer)) : NULL;
+    if (!m || !values) {
+        calc->error = ERROR_OUT_OF_MEMORY;
+        ns_push(&calc->numbers, NAN);
+        return;
+    }
+    values[0] = negative ? -1 : 1;
+    for (int k = 0; k < count; k++) {
+        values[negative + k] = factors[k];
+    }
+    for (int k = 0; k < cols; k++) {
+        m->data[k] = (double)values[k];
+    }
+    if (!push_matrix(calc, m)) {
+        ns_push(&calc->numbers, NAN);
+        return;
+    }
+    calc->factor_matrix = m;
+    calc->factor_values = values;
+}
+
+// gcd(a, b), lcm(a, b), isprime(n), factor(n) and powmod(b, e, m) on
+// integers of magnitude below 2^64, computed exactly in real, integer and
+// rational mode; in real mode only the final result is rounded to a double.
+// gcd and lcm are non-negative, powmod needs e >= 0 and m >= 1 and returns a
+// value in [0, m), and factor gives a vector, which outside real mode can
+// only be the result of the expression.
+static void apply_number_theory_operator(Calculator* calc, char op) {
+    NumberStack* numbers = &calc->numbers;
+    int arity = op == OP_POWMOD ? 3 : op == OP_GCD || op == OP_LCM ? 2 : 1;
+    int real = calc->number_mode == NUMBER_MODE_REAL;
+    Integer args[3], result = 0;
+    uint64_t magnitude[3];
+
+    if ((!real && !is_integer_mode(calc) && calc->number_mode != NUMBER_MODE_RATIONAL) || numbers->top < arity - 1) {
+        calc->error = ERROR_SYNTAX;
+        ns_push(numbers, NAN);
+        return;
+    }
+    for (int i = 0; i < arity; i++) {
+        int index = numbers->top - arity + 1 + i;
+        if (!is_scalar_entry(calc, index)) {
+            calc->error = ERROR_SYNTAX;
+            ns_push(numbers, NAN);
+            return;
+        }
+        if (!number_theory_operand(calc, index, &args[i])) {
+            calc->error = ERROR_MATH_DOMAIN;
+            ns_push(numbers, NAN);
+            return;
+        }
+        magnitude[i] = (uint64_t)(args[i] < 0 ? -args[i] : args[i]);
+    }
+    numbers->top -= arity;
+
+    switch (op) {
+        case OP_GCD:
+            result = numtheory_gcd(magnitude[0], magnitude[1]);
+            break;
+        case OP_LCM: {
+            uint64_t g = numtheory_gcd(magnitude[0], magnitude[1]);
+            Integer quotient = g ? magnitude[0] / g : 0;
+            if (__builtin_mul_overflow(quotient, (Integer)magnitude[1], &result)) {
+                // Only real mode has room for it, rounded
+                if (real) {
+                    ns_push(numbers, (double)quotient * (double)magnitude[1]);
+                    return;
+                }
+                calc->error = ERROR_OVERFLOW;
+            }
+            break;
+        }
+        case OP_IS_PRIME:
+            result = args[0] > 1 && numtheory_is_prime(magnitude[0]);
+            break;
+        case OP_FACTOR:
+            if (args[0] == 0) {
+                calc->error = ERROR_MATH_DOMAIN;
+                break;
+            }
+            push_factors(calc, args[0]);
+            return;
+        default:
+            if (args[1] < 0 || args[2] < 1) {
+                calc->error = ERROR_MATH_DOMAIN;
+                break;
+            }
+            result = numtheory_powmod(magnitude[0], magnitude[1], magnitude[2]);
+            // (-b)^e is -(b^e) for odd e
+            if (args[0] < 0 && (magnitude[1] & 1) && result != 0) {
+                result = (Integer)magnitude[2] - result;
+            }
+            break;
+    }
+
+    if (is_integer_mode(calc)) {
+        if (calc->error == ERROR_NONE && integer_bits(calc) == 64 && result > INT64_MAX) {
+            calc->error = ERROR_OVERFLOW;
+        }
+        push_integer(calc, result);
+    } else if (calc->number_mode == NUMBER_MODE_RATIONAL && calc->error == ERROR_NONE) {
+        push_rational(calc, rational_from_integer(result));
+    } else {
+        push_number(calc, calc->error == ERROR_NONE ? (double)result : NAN);
     }
 }
 
@@ -2,17 +2,39 @@
 #define CALCULATOR_LOGIC_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 #define MAX_STACK_SIZE 100
 #define DISPLAY_BUFFER_SIZE 256
 #define MAX_FUNCTION_NAME_LENGTH 10
 
+// Comparison and logical operator codes. They yield 1 or 0, and any nonzero
+// value (NaN included) counts as true, as in C.
+#define OP_LESS '<'
+#define OP_GREATER '>'
+#define OP_LESS_EQUAL ';'
+#define OP_GREATER_EQUAL ':'
+#define OP_EQUAL '\''
+#define OP_NOT_EQUAL '~'
+#define OP_AND '`'
+#define OP_OR '\\'
+
 typedef enum {
     ERROR_NONE,
     ERROR_SYNTAX,
     ERROR_MATH_DIV_ZERO,
     ERROR_MATH_DOMAIN,
-    ERROR_STACK_OVERFLOW
+    ERROR_STACK_OVERFLOW,
+    ERROR_DIMENSION_MISMATCH,
+    ERROR_SINGULAR_MATRIX,
+    ERROR_OUT_OF_MEMORY,
+    ERROR_BUDGET_EXCEEDED,
+    ERROR_CANCELLED,
+    ERROR_OVERFLOW,
+    // A sheet cell that would depend on itself; see calculator_sheet.h
+    ERROR_CIRCULAR_REFERENCE,
+    // A column file that is missing, unreadable or not a regular file
+    ERROR_FILE
 } ErrorType;
 
 typedef enum {
@@ -20,8 +42,90 @@ typedef enum {
     RAD
 } AngleMode;
 
+typedef enum {
+    NUMBER_MODE_REAL,
+    NUMBER_MODE_COMPLEX,
+    NUMBER_MODE_DECIMAL64,
+    NUMBER_MODE_DECIMAL128,
+    // Programmer modes: exact 64- or 128-bit signed integers
+    NUMBER_MODE_INT64,
+    NUMBER_MODE_INT128,
+    // Binary fixed point on integer instructions only; see calculator_fixed.h
+    NUMBER_MODE_FIXED,
+    // Exact fractions; see calculator_rational.h
+    NUMBER_MODE_RATIONAL
+} NumberMode;
+
+// IEEE 754 decimal value in BID encoding; see calculator_decimal.h
+typedef struct {
+    uint64_t low;
+    uint64_t high;
+} Decimal;
+
+// Exact value in the integer modes; see calculator_integer.h
+__extension__ typedef __int128 Integer;
+
+// Value of rational mode; see calculator_rational.h. `den` is positive for
+// a fraction in lowest terms that fits in 128 bits, and `big` is set instead
+// once it outgrows them. With neither, the value is an inexact double kept
+// in the stack's `items`.
+typedef struct BigRational BigRational;
+typedef struct {
+    Integer num;
+    Integer den;
+    const BigRational* big;
+} Rational;
+
+// Per-evaluation limits; zero leaves a limit off. Operations count parsed
+// tokens and applied operators, with matrix operators charged for their
+// element or multiply-add count. Exceeding any limit stops the evaluation
+// with ERROR_BUDGET_EXCEEDED.
+typedef struct {
+    long max_operations;
+    int max_depth;
+    double max_seconds;
+} EvaluationBudget;
+
+// Thread-safe flag another thread can raise to stop an evaluation that is
+// in progress with ERROR_CANCELLED. It stays raised until reset.
+typedef struct CancelToken CancelToken;
+
+typedef struct Matrix Matrix;
+typedef struct MatrixArena MatrixArena;
+typedef struct ProgramRecorder ProgramRecorder;
+typedef struct StatsSummary StatsSummary;
+typedef struct LexTokens LexTokens;
+typedef struct RandomGenerator RandomGenerator;
+typedef struct TraceBuffer TraceBuffer;
+typedef struct ResultCache ResultCache;
+
+// What a NumberStack entry holds besides its number in the current mode
+typedef enum {
+    ENTRY_SCALAR,
+    // Real mode: an integer literal too wide for a double, or the result of
+    // the integer fast path, whose digits are kept in `integers` for the
+    // number-theory functions and the display
+    ENTRY_EXACT,
+    // A vector or matrix value in `matrices`
+    ENTRY_MATRIX,
+    // A column file in `datasets`, which only the statistics functions take
+    ENTRY_DATASET
+} EntryKind;
+
+// In complex mode `imag` holds the imaginary part of each entry in `items`;
+// the real-only path never touches it. The decimal, integer and rational
+// modes keep the exact value in `decimals`, `integers` or `rationals`.
+// `kinds` holds an EntryKind per entry, and a push only resets that byte:
+// `matrices` and `datasets` are meaningful only for entries of their kind.
 typedef struct {
     double items[MAX_STACK_SIZE];
+    double imag[MAX_STACK_SIZE];
+    Decimal decimals[MAX_STACK_SIZE];
+    Integer integers[MAX_STACK_SIZE];
+    Rational rationals[MAX_STACK_SIZE];
+    unsigned char kinds[MAX_STACK_SIZE];
+    Matrix* matrices[MAX_STACK_SIZE];
+    StatsSummary* datasets[MAX_STACK_SIZE];
     int top;
 } NumberStack;
 
@@ -32,22 +136,142 @@ typedef struct {
     int total_pushed;
 } OperatorStack;
 
+// An `&&` or `||` whose right operand is being read, or an `if(` past its
+// first comma
+typedef struct {
+    char op;
+    // Commas of an `if` read so far
+    uint8_t stage;
+    // The condition if it is a known scalar, else -1: a matrix condition
+    // blends both branches, and a compiled one is only known when it runs
+    int8_t branch;
+    // Set while the branch being read is the one not taken
+    uint8_t skipping;
+    // operators.top of the `if`'s '('
+    int paren;
+    // Compiling: the jump to point at the end of the branch being read
+    size_t jump;
+} Conditional;
+
 typedef struct {
     char buffer[DISPLAY_BUFFER_SIZE];
     AngleMode angle_mode;
+    NumberMode number_mode;
+    // Display base of the integer modes: 2, 8, 10 or 16
+    int output_base;
+    // Set while a real-mode expression runs on the integer fast path
+    int integer_fast_path;
     NumberStack numbers;
     OperatorStack operators;
+    // Open conditionals, innermost last. While `skipping` is non-zero the
+    // operators of a branch that is not taken are checked for their operand
+    // count but not evaluated.
+    Conditional conditionals[MAX_STACK_SIZE];
+    int conditional_count;
+    int skipping;
     ErrorType error;
+    // Storage for matrix values, reset at the start of every evaluation.
+    // Once matrix_count is non-zero the evaluation uses the matrix-aware
+    // operator path.
+    MatrixArena* arena;
+    int matrix_count;
+    const Matrix* matrix_result;
+    // The vector factor() pushed last and its entries as exact integers,
+    // which a matrix of doubles cannot hold past 2^53; it is shown from
+    // these when it is the result
+    const Matrix* factor_matrix;
+    const Integer* factor_values;
+    // Token array of the expression being evaluated
+    LexTokens* tokens;
+    // Summaries of the column files read by the evaluation in progress
+    StatsSummary** columns;
+    int column_count;
+    int column_capacity;
+    // Set only inside calculator_compile
+    ProgramRecorder* recorder;
+    // Generator behind rand() and the other random functions; created on
+    // first use with a seed from the clock unless calculator_seed_random
+    // chose one
+    RandomGenerator* random;
+    // Receives one event per applied operator when set; see calculator_trace.h
+    TraceBuffer* trace;
+    // Shared result cache consulted by calculator_evaluate and
+    // calculator_evaluate_value when set; see calculator_cache.h
+    ResultCache* cache;
+    // Set when the evaluation in progress draws random numbers or reads a
+    // column file, so its result is not cached
+    int nondeterministic;
+    EvaluationBudget budget;
+    CancelToken* cancel;
+    // Usage of the evaluation in progress
+    long operations;
+    long clock_countdown;
+    double deadline;
 } Calculator;
 
 Calculator* calculator_new(void);
 void calculator_free(Calculator* calc);
 
 void calculator_evaluate(Calculator* calc, const char* expression);
+// Evaluates a real-valued expression without touching the display. Any
+// result other than a single scalar is reported as ERROR_SYNTAX.
+ErrorType calculator_evaluate_value(Calculator* calc, const char* expression, double* value);
+// Parses a real-valued scalar expression, which may use `$name` variables,
+// and hands its postfix form to `recorder` instead of evaluating it.
+ErrorType calculator_compile(Calculator* calc, const char* expression, ProgramRecorder* recorder);
+// Operands taken by a scalar operator code: 2 for binary operators and
+// two-argument functions, 1 for functions, 0 for rand() and randn(), and -1
+// for codes a compiled program cannot contain.
+int calculator_operator_arity(char op);
+// Stack primitives, also used by programs that run without parsing
+int ns_push(NumberStack* s, double item);
+void apply_operator(Calculator* calc, char op);
 void calculator_clear(Calculator* calc);
+// Applies to every later evaluation; NULL removes the budget or token.
+void calculator_set_budget(Calculator* calc, const EvaluationBudget* budget);
+void calculator_set_cancel_token(Calculator* calc, CancelToken* cancel);
+// Records every later operator step into `trace` until set back to NULL. The
+// buffer is not owned by the calculator.
+void calculator_set_trace(Calculator* calc, TraceBuffer* trace);
+// Serves later evaluations from `cache` and adds their results to it until
+// set back to NULL. Results that depend on random numbers, files, a budget
+// or cancellation are not cached, and the cache is skipped while a trace is
+// attached. The cache is not owned by the calculator.
+void calculator_set_cache(Calculator* calc, ResultCache* cache);
+// Makes the random functions reproducible: the same seed and stream give the
+// same values. Threads evaluating at the same time should use different
+// streams. Returns ERROR_OUT_OF_MEMORY if the generator cannot be created.
+ErrorType calculator_seed_random(Calculator* calc, uint64_t seed, uint64_t stream);
+// Resets the usage counters at the start of an evaluation.
+void calculator_start_budget(Calculator* calc);
+// Charges `cost` operations and polls the clock and cancel token. Returns 0
+// and sets calc->error once a limit is hit or the token is raised.
+int calculator_charge(Calculator* calc, long cost);
 void calculator_toggle_angle_mode(Calculator* calc);
 AngleMode calculator_get_angle_mode(const Calculator* calc);
+void calculator_set_number_mode(Calculator* calc, NumberMode mode);
+NumberMode calculator_get_number_mode(const Calculator* calc);
+// Any other base is ignored.
+void calculator_set_output_base(Calculator* calc, int base);
+int calculator_get_output_base(const Calculator* calc);
+// Operator code for an operator spelled as a word at `p` ("xor", "mod"),
+// with its length in *length, or '\0'.
+char calculator_named_operator(const char* p, size_t* length);
+// Likewise for functions with a multi-letter name ("det", "median").
+char calculator_named_function(const char* p, size_t* length);
+// The word for a code from either table above, or the spelling of a
+// two-character comparison or logical operator ("<=", "&&"), or NULL.
+const char* calculator_operator_name(char op);
+
+CancelToken* cancel_token_new(void);
+void cancel_token_free(CancelToken* token);
+void cancel_token_cancel(CancelToken* token);
+void cancel_token_reset(CancelToken* token);
+int cancel_token_is_cancelled(const CancelToken* token);
 
 const char* calculator_get_display(const Calculator* calc);
+// Matrix result of the last evaluation, or NULL if it produced a scalar.
+// Valid until the next call to calculator_evaluate.
+const Matrix* calculator_get_matrix(const Calculator* calc);
 
 #endif
@@ -0,0 +1,580 @@
+#include "calculator_matrix.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#define ARENA_ALIGNMENT 64
+#define ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)
+
+// Register tile of the GEMM micro-kernel (MR x NR) and the cache blocks the
+// packed operands are cut into: an MC x KC block of A stays in L2 while a
+// KC x NR sliver of B streams through L1.
+#define GEMM_MR 4
+#define GEMM_NR 8
+#define GEMM_MC 128
+#define GEMM_KC 256
+#define GEMM_NC 512
+
+#define LU_BLOCK 64
+#define TRANSPOSE_BLOCK 32
+
+typedef double v2d __attribute__((vector_size(16)));
+typedef double v4d __attribute__((vector_size(32)));
+
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t size;
+    size_t used;
+    char* data;
+} ArenaBlock;
+
+struct MatrixArena {
+    ArenaBlock* blocks;
+    size_t block_size;
+    // GEMM packing buffers; kept across resets because every blocked LU
+    // step reuses them
+    double* packed_a;
+    double* packed_b;
+};
+
+static ArenaBlock* arena_block_new(size_t size) {
+    ArenaBlock* block = (ArenaBlock*)malloc(sizeof(ArenaBlock));
+    if (!block) {
+        return NULL;
+    }
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    block->data = (char*)aligned_alloc(ARENA_ALIGNMENT, size);
+    if (!block->data) {
+        free(block);
+        return NULL;
+    }
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+static void* arena_alloc(MatrixArena* arena, size_t bytes) {
+    bytes = (bytes + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+
+    ArenaBlock* block = arena->blocks;
+    if (!block || block->size - block->used < bytes) {
+        size_t size = bytes > arena->block_size ? bytes : arena->block_size;
+        block = arena_block_new(size);
+        if (!block) {
+            return NULL;
+        }
+        block->next = arena->blocks;
+        arena->blocks = block;
+    }
+
+    void* p = block->data + block->used;
+    block->used += bytes;
+    return p;
+}
+
+void* matrix_arena_alloc(MatrixArena* arena, size_t bytes) {
+    return arena_alloc(arena, bytes);
+}
+
+MatrixArena* matrix_arena_new(size_t block_size) {
+    MatrixArena* arena = (MatrixArena*)malloc(sizeof(MatrixArena));
+    if (arena) {
+        arena->blocks = NULL;
+        arena->block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK_SIZE;
+        arena->packed_a = NULL;
+        arena->packed_b = NULL;
+    }
+    return arena;
+}
+
+void matrix_arena_reset(MatrixArena* arena) {
+    if (!arena || !arena->blocks) {
+        return;
+    }
+    // Keep the largest block so steady-state evaluations never hit malloc
+    ArenaBlock* keep = arena->blocks;
+    for (ArenaBlock* b = arena->blocks->next; b; b = b->next) {
+        if (b->size > keep->size) {
+            keep = b;
+        }
+    }
+    ArenaBlock* b = arena->blocks;
+    while (b) {
+        ArenaBlock* next = b->next;
+        if (b != keep) {
+            free(b->data);
+            free(b);
+        }
+        b = next;
+    }
+    keep->next = NULL;
+    keep->used = 0;
+    arena->blocks = keep;
+}
+
+void matrix_arena_free(MatrixArena* arena) {
+    if (arena) {
+        ArenaBlock* b = arena->blocks;
+        while (b) {
+            ArenaBlock* next = b->next;
+            free(b->data);
+            free(b);
+            b = next;
+        }
+        free(arena->packed_a);
+        free(arena->packed_b);
+        free(arena);
+    }
+}
+
+Matrix* matrix_new(MatrixArena* arena, int rows, int cols) {
+    if (rows <= 0 || cols <= 0) {
+        return NULL;
+    }
+    Matrix* m = (Matrix*)arena_alloc(arena, sizeof(Matrix));
+    if (!m) {
+        return NULL;
+    }
+    m->data = (double*)arena_alloc(arena, (size_t)rows * (size_t)cols * sizeof(double));
+    if (!m->data) {
+        return NULL;
+    }
+    m->rows = rows;
+    m->cols = cols;
+    return m;
+}
+
+Matrix* matrix_copy(MatrixArena* arena, const Matrix* m) {
+    Matrix* copy = matrix_new(arena, m->rows, m->cols);
+    if (copy) {
+        memcpy(copy->data, m->data, (size_t)m->rows * (size_t)m->cols * sizeof(double));
+    }
+    return copy;
+}
+
+// Packs a kc x nc block of B into NR-wide column panels, zero padding the
+// last panel so the micro-kernel never needs an edge case on loads.
+static void pack_b(int kc, int nc, const double* b, int ldb, double* packed) {
+    for (int j0 = 0; j0 < nc; j0 += GEMM_NR) {
+        int nr = nc - j0 < GEMM_NR ? nc - j0 : GEMM_NR;
+        for (int p = 0; p < kc; p++) {
+            const double* src = b + (size_t)p * ldb + j0;
+            int j = 0;
+            for (; j < nr; j++) {
+                packed[j] = src[j];
+            }
+            for (; j < GEMM_NR; j++) {
+                packed[j] = 0.0;
+            }
+            packed += GEMM_NR;
+        }
+    }
+}
+
+// Packs an mc x kc block of A into MR-tall row panels, folding in alpha.
+static void pack_a(int mc, int kc, const double* a, int lda, double alpha, double* packed) {
+    for (int i0 = 0; i0 < mc; i0 += GEMM_MR) {
+        int mr = mc - i0 < GEMM_MR ? mc - i0 : GEMM_MR;
+        for (int p = 0; p < kc; p++) {
+            int i = 0;
+            for (; i < mr; i++) {
+                packed[i] = alpha * a[(size_t)(i0 + i) * lda + p];
+            }
+            for (; i < GEMM_MR; i++) {
+                packed[i] = 0.0;
+            }
+            packed += GEMM_MR;
+        }
+    }
+}
+
+// Micro-kernels compute the MR x NR tile Ap * Bp over kc steps into `tile`.
+// The baseline kernel uses 2-wide vectors, which every x86-64 CPU has, and
+// walks the NR panel in two halves so its accumulators fit the 16 SSE
+// registers. The AVX2 kernel keeps the whole 4x8 tile in eight 4-wide FMA
+// accumulators.
+typedef void (*GemmMicroKernel)(int kc, const double* ap, const double* bp, double tile[GEMM_MR][GEMM_NR]);
+
+static void gemm_micro_kernel_generic(int kc, const double* ap, const double* bp, double tile[GEMM_MR][GEMM_NR]) {
+    for (int half = 0; half < GEMM_NR; half += 4) {
+        v2d c00 = {0}, c01 = {0}, c10 = {0}, c11 = {0};
+        v2d c20 = {0}, c21 = {0}, c30 = {0}, c31 = {0};
+        const double* a = ap;
+        const double* b = bp + half;
+
+        for (int p = 0; p < kc; p++) {
+            v2d b0, b1;
+            memcpy(&b0, b, sizeof(v2d));
+            memcpy(&b1, b + 2, sizeof(v2d));
+            c00 += a[0] * b0; c01 += a[0] * b1;
+            c10 += a[1] * b0; c11 += a[1] * b1;
+            c20 += a[2] * b0; c21 += a[2] * b1;
+            c30 += a[3] * b0; c31 += a[3] * b1;
+            a += GEMM_MR;
+            b += GEMM_NR;
+        }
+
+        memcpy(&tile[0][half], &c00, sizeof(v2d)); memcpy(&tile[0][half + 2], &c01, sizeof(v2d));
+        memcpy(&tile[1][half], &c10, sizeof(v2d)); memcpy(&tile[1][half + 2], &c11, sizeof(v2d));
+        memcpy(&tile[2][half], &c20, sizeof(v2d)); memcpy(&tile[2][half + 2], &c21, sizeof(v2d));
+        memcpy(&tile[3][half], &c30, sizeof(v2d)); memcpy(&tile[3][half + 2], &c31, sizeof(v2d));
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2,fma")))
+static void gemm_micro_kernel_avx2(int kc, const double* ap, const double* bp, double tile[GEMM_MR][GEMM_NR]) {
+    v4d c00 = {0}, c01 = {0}, c10 = {0}, c11 = {0};
+    v4d c20 = {0}, c21 = {0}, c30 = {0}, c31 = {0};
+
+    for (int p = 0; p < kc; p++) {
+        v4d b0, b1;
+        memcpy(&b0, bp, sizeof(v4d));
+        memcpy(&b1, bp + 4, sizeof(v4d));
+        c00 += ap[0] * b0; c01 += ap[0] * b1;
+        c10 += ap[1] * b0; c11 += ap[1] * b1;
+        c20 += ap[2] * b0; c21 += ap[2] * b1;
+        c30 += ap[3] * b0; c31 += ap[3] * b1;
+        ap += GEMM_MR;
+        bp += GEMM_NR;
+    }
+
+    memcpy(&tile[0][0], &c00, sizeof(v4d)); memcpy(&tile[0][4], &c01, sizeof(v4d));
+    memcpy(&tile[1][0], &c10, sizeof(v4d)); memcpy(&tile[1][4], &c11, sizeof(v4d));
+    memcpy(&tile[2][0], &c20, sizeof(v4d)); memcpy(&tile[2][4], &c21, sizeof(v4d));
+    memcpy(&tile[3][0], &c30, sizeof(v4d)); memcpy(&tile[3][4], &c31, sizeof(v4d));
+}
+#endif
+
+static GemmMicroKernel select_micro_kernel(void) {
+    static GemmMicroKernel kernel = NULL;
+    if (!kernel) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            kernel = gemm_micro_kernel_avx2;
+        } else {
+            kernel = gemm_micro_kernel_generic;
+        }
+#else
+        kernel = gemm_micro_kernel_generic;
+#endif
+    }
+    return kernel;
+}
+
+// C (m x n) += alpha * A (m x k) * B (k x n), all row-major with leading
+// dimensions.
+static ErrorType gemm_update(MatrixArena* arena, int m, int n, int k, double alpha,
+                             const double* a, int lda, const double* b, int ldb, double* c, int ldc) {
+    if (m <= 0 || n <= 0 || k <= 0) {
+        return ERROR_NONE;
+    }
+
+    if (!arena->packed_a) {
+        arena->packed_a = (double*)aligned_alloc(ARENA_ALIGNMENT, (size_t)GEMM_MC * GEMM_KC * sizeof(double));
+    }
+    if (!arena->packed_b) {
+        arena->packed_b = (double*)aligned_alloc(ARENA_ALIGNMENT, (size_t)GEMM_KC * (GEMM_NC + GEMM_NR) * sizeof(double));
+    }
+    double* packed_a = arena->packed_a;
+    double* packed_b = arena->packed_b;
+    if (!packed_a || !packed_b) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+    GemmMicroKernel kernel = select_micro_kernel();
+    double tile[GEMM_MR][GEMM_NR];
+
+    for (int jc = 0; jc < n; jc += GEMM_NC) {
+        int nc = n - jc < GEMM_NC ? n - jc : GEMM_NC;
+        for (int pc = 0; pc < k; pc += GEMM_KC) {
+            int kc = k - pc < GEMM_KC ? k - pc : GEMM_KC;
+            pack_b(kc, nc, b + (size_t)pc * ldb + jc, ldb, packed_b);
+
+            for (int ic = 0; ic < m; ic += GEMM_MC) {
+                int mc = m - ic < GEMM_MC ? m - ic : GEMM_MC;
+                pack_a(mc, kc, a + (size_t)ic * lda + pc, lda, alpha, packed_a);
+
+                for (int jr = 0; jr < nc; jr += GEMM_NR) {
+                    int nr = nc - jr < GEMM_NR ? nc - jr : GEMM_NR;
+                    for (int ir = 0; ir < mc; ir += GEMM_MR) {
+                        int mr = mc - ir < GEMM_MR ? mc - ir : GEMM_MR;
+                        double* ct = c + (size_t)(ic + ir) * ldc + jc + jr;
+                        kernel(kc, packed_a + (size_t)ir * kc, packed_b + (size_t)jr * kc, tile);
+                        for (int i = 0; i < mr; i++) {
+                            for (int j = 0; j < nr; j++) {
+                                ct[(size_t)i * ldc + j] += tile[i][j];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return ERROR_NONE;
+}
+
+ErrorType matrix_multiply(MatrixArena* arena, const Matrix* a, const Matrix* b, Matrix** out) {
+    if (a->cols != b->rows) {
+        return ERROR_DIMENSION_MISMATCH;
+    }
+    Matrix* c = matrix_new(arena, a->rows, b->cols);
+    if (!c) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+    memset(c->data, 0, (size_t)c->rows * (size_t)c->cols * sizeof(double));
+
+    ErrorType err = gemm_update(arena, a->rows, b->cols, a->cols, 1.0,
+                                a->data, a->cols, b->data, b->cols, c->data, c->cols);
+    if (err == ERROR_NONE) {
+        *out = c;
+    }
+    return err;
+}
+
+ErrorType matrix_transpose(MatrixArena* arena, const Matrix* m, Matrix** out) {
+    Matrix* t = matrix_new(arena, m->cols, m->rows);
+    if (!t) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+    // Tiled so both the row reads and the column writes stay within a few
+    // cache lines per tile
+    for (int i0 = 0; i0 < m->rows; i0 += TRANSPOSE_BLOCK) {
+        int i1 = i0 + TRANSPOSE_BLOCK < m->rows ? i0 + TRANSPOSE_BLOCK : m->rows;
+        for (int j0 = 0; j0 < m->cols; j0 += TRANSPOSE_BLOCK) {
+            int j1 = j0 + TRANSPOSE_BLOCK < m->cols ? j0 + TRANSPOSE_BLOCK : m->cols;
+            for (int i = i0; i < i1; i++) {
+                for (int j = j0; j < j1; j++) {
+                    t->data[(size_t)j * t->cols + i] = m->data[(size_t)i * m->cols + j];
+                }
+            }
+        }
+    }
+    *out = t;
+    return ERROR_NONE;
+}
+
+static void swap_rows(double* data, int cols, int r1, int r2) {
+    if (r1 == r2) {
+        return;
+    }
+    double* a = data + (size_t)r1 * cols;
+    double* b = data + (size_t)r2 * cols;
+    for (int j = 0; j < cols; j++) {
+        double t = a[j];
+        a[j] = b[j];
+        b[j] = t;
+    }
+}
+
+ErrorType matrix_lu_factor(MatrixArena* arena, Matrix* lu, int* pivots, int* swap_count) {
+    int n = lu->rows;
+    double* a = lu->data;
+    int singular = 0;
+    int swaps = 0;
+
+    if (lu->rows != lu->cols) {
+        return ERROR_DIMENSION_MISMATCH;
+    }
+
+    // A pivot this small relative to the largest entry is rounding noise
+    // left from cancellation, as in the last pivot of [[1,2,3],[4,5,6],[7,8,9]]
+    double largest = 0.0;
+    for (size_t i = 0; i < (size_t)n * n; i++) {
+        largest = fmax(largest, fabs(a[i]));
+    }
+    double tolerance = (double)n * DBL_EPSILON * largest;
+
+    for (int j0 = 0; j0 < n; j0 += LU_BLOCK) {
+        int jend = j0 + LU_BLOCK < n ? j0 + LU_BLOCK : n;
+
+        // Unblocked factorization of the panel a[j0:n, j0:jend]
+        for (int j = j0; j < jend; j++) {
+            int p = j;
+            double best = fabs(a[(size_t)j * n + j]);
+            for (int i = j + 1; i < n; i++) {
+                double v = fabs(a[(size_t)i * n + j]);
+                if (v > best) {
+                    best = v;
+                    p = i;
+                }
+            }
+            pivots[j] = p;
+            if (p != j) {
+                swap_rows(a, n, j, p);
+                swaps++;
+            }
+
+            double pivot = a[(size_t)j * n + j];
+            if (fabs(pivot) <= tolerance) {
+                singular = 1;
+                if (pivot == 0.0) {
+                    continue;
+                }
+            }
+            const double* urow = a + (size_t)j * n;
+            for (int i = j + 1; i < n; i++) {
+                double* row = a + (size_t)i * n;
+                double l = row[j] / pivot;
+                row[j] = l;
+                for (int c = j + 1; c < jend; c++) {
+                    row[c] -= l * urow[c];
+                }
+            }
+        }
+
+        if (jend == n) {
+            break;
+        }
+
+        // U12 = L11^-1 * A12, as whole-row updates so the inner loop is
+        // contiguous
+        for (int j = j0; j < jend; j++) {
+            const double* urow = a + (size_t)j * n;
+            for (int i = j + 1; i < jend; i++) {
+                double* row = a + (size_t)i * n;
+                double l = row[j];
+                for (int c = jend; c < n; c++) {
+                    row[c] -= l * urow[c];
+                }
+            }
+        }
+
+        // A22 -= L21 * U12 through the blocked GEMM kernel
+        ErrorType err = gemm_update(arena, n - jend, n - jend, jend - j0, -1.0,
+                                    a + (size_t)jend * n + j0, n,
+                                    a + (size_t)j0 * n + jend, n,
+                                    a + (size_t)jend * n + jend, n);
+        if (err != ERROR_NONE) {
+            return err;
+        }
+    }
+
+    if (swap_count) {
+        *swap_count = swaps;
+    }
+    return singular ? ERROR_SINGULAR_MATRIX : ERROR_NONE;
+}
+
+ErrorType matrix_determinant(MatrixArena* arena, const Matrix* m, double* out) {
+    if (m->rows != m->cols) {
+        return ERROR_DIMENSION_MISMATCH;
+    }
+    Matrix* lu = matrix_copy(arena, m);
+    int* pivots = (int*)arena_alloc(arena, (size_t)m->rows * sizeof(int));
+    if (!lu || !pivots) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+
+    int swaps = 0;
+    ErrorType err = matrix_lu_factor(arena, lu, pivots, &swaps);
+    // The factors of a singular matrix are complete, and an exactly zero
+    // pivot makes the product zero
+    if (err != ERROR_NONE && err != ERROR_SINGULAR_MATRIX) {
+        return err;
+    }
+
+    double det = (swaps & 1) ? -1.0 : 1.0;
+    for (int i = 0; i < m->rows; i++) {
+        det *= lu->data[(size_t)i * m->cols + i];
+    }
+    // A swap sign times a zero pivot is -0, shown as "-0"
+    *out = det == 0.0 ? 0.0 : det;
+    return ERROR_NONE;
+}
+
+void matrix_lu_solve(const Matrix* lu, const int* pivots, double* x, int k) {
+    int n = lu->rows;
+    const double* a = lu->data;
+
+    for (int i = 0; i < n; i++) {
+        swap_rows(x, k, i, pivots[i]);
+    }
+    for (int i = 0; i < n; i++) {
+        double* xi = x + (size_t)i * k;
+        for (int j = 0; j < i; j++) {
+            double l = a[(size_t)i * n + j];
+            const double* xj = x + (size_t)j * k;
+            for (int c = 0; c < k; c++) {
+                xi[c] -= l * xj[c];
+            }
+        }
+    }
+    for (int i = n - 1; i >= 0; i--) {
+        double* xi = x + (size_t)i * k;
+        for (int j = i + 1; j < n; j++) {
+            double u = a[(size_t)i * n + j];
+            const double* xj = x + (size_t)j * k;
+            for (int c = 0; c < k; c++) {
+                xi[c] -= u * xj[c];
+            }
+        }
+        double inv = 1.0 / a[(size_t)i * n + i];
+        for (int c = 0; c < k; c++) {
+            xi[c] *= inv;
+        }
+    }
+}
+
+static ErrorType factor_copy(MatrixArena* arena, const Matrix* m, Matrix** lu, int** pivots) {
+    if (m->rows != m->cols) {
+        return ERROR_DIMENSION_MISMATCH;
+    }
+    *lu = matrix_copy(arena, m);
+    *pivots = (int*)arena_alloc(arena, (size_t)m->rows * sizeof(int));
+    if (!*lu || !*pivots) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+    return matrix_lu_factor(arena, *lu, *pivots, NULL);
+}
+
+ErrorType matrix_inverse(MatrixArena* arena, const Matrix* m, Matrix** out) {
+    Matrix* lu;
+    int* pivots;
+    ErrorType err = factor_copy(arena, m, &lu, &pivots);
+    if (err != ERROR_NONE) {
+        return err;
+    }
+
+    int n = m->rows;
+    Matrix* inv = matrix_new(arena, n, n);
+    if (!inv) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+    memset(inv->data, 0, (size_t)n * (size_t)n * sizeof(double));
+    for (int i = 0; i < n; i++) {
+        inv->data[(size_t)i * n + i] = 1.0;
+    }
+    matrix_lu_solve(lu, pivots, inv->data, n);
+    *out = inv;
+    return ERROR_NONE;
+}
+
+ErrorType matrix_solve(MatrixArena* arena, const Matrix* a, const Matrix* b, Matrix** out) {
+    int as_vector = b->rows == 1 && b->cols == a->rows && a->rows != 1;
+    int rhs_rows = as_vector ? b->cols : b->rows;
+    int rhs_cols = as_vector ? 1 : b->cols;
+
+    if (rhs_rows != a->rows) {
+        return ERROR_DIMENSION_MISMATCH;
+    }
+
+    Matrix* lu;
+    int* pivots;
+    ErrorType err = factor_copy(arena, a, &lu, &pivots);
+    if (err != ERROR_NONE) {
+        return err;
+    }
+
+    // A 1xN row vector and an Nx1 column share the same memory layout, so
+    // copying the data is enough to treat it as a column
+    Matrix* x = matrix_copy(arena, b);
+    if (!x) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+    matrix_lu_solve(lu, pivots, x->data, rhs_cols);
+    *out = x;
+    return ERROR_NONE;
+}
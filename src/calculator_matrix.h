@@ -0,0 +1,49 @@
+#ifndef CALCULATOR_MATRIX_H
+#define CALCULATOR_MATRIX_H
+
+#include <stddef.h>
+#include "calculator_logic.h"
+
+// Dense row-major matrix. Vectors are stored as 1xN matrices.
+struct Matrix {
+    int rows;
+    int cols;
+    double* data;
+};
+
+// Bump allocator for matrix storage. Every intermediate result of an
+// evaluation comes from the arena and is released at once by
+// matrix_arena_reset, so no per-matrix free is needed.
+MatrixArena* matrix_arena_new(size_t block_size);
+void matrix_arena_reset(MatrixArena* arena);
+void matrix_arena_free(MatrixArena* arena);
+// Raw storage with the same lifetime, for per-evaluation values that are not
+// matrices (the big fractions of rational mode).
+void* matrix_arena_alloc(MatrixArena* arena, size_t bytes);
+
+Matrix* matrix_new(MatrixArena* arena, int rows, int cols);
+Matrix* matrix_copy(MatrixArena* arena, const Matrix* m);
+
+// out = a * b using a cache-blocked, register-tiled kernel.
+ErrorType matrix_multiply(MatrixArena* arena, const Matrix* a, const Matrix* b, Matrix** out);
+ErrorType matrix_transpose(MatrixArena* arena, const Matrix* m, Matrix** out);
+
+// Blocked LU factorization with partial pivoting, in place: on return `lu`
+// holds the unit lower factor below the diagonal and the upper factor on and
+// above it, and row i was swapped with pivots[i]. Returns
+// ERROR_SINGULAR_MATRIX if a pivot is at most n * DBL_EPSILON times the
+// largest magnitude in the matrix; the factors are still complete in that
+// case so the determinant is well defined.
+ErrorType matrix_lu_factor(MatrixArena* arena, Matrix* lu, int* pivots, int* swap_count);
+// Overwrites the n x k row-major right-hand side `x` with the solution of
+// a * x = b, given the factors of `a` from matrix_lu_factor.
+void matrix_lu_solve(const Matrix* lu, const int* pivots, double* x, int k);
+
+ErrorType matrix_determinant(MatrixArena* arena, const Matrix* m, double* out);
+ErrorType matrix_inverse(MatrixArena* arena, const Matrix* m, Matrix** out);
+
+// Solves a * x = b. A 1xN `b` is treated as a column vector and the solution
+// is returned in the same shape.
+ErrorType matrix_solve(MatrixArena* arena, const Matrix* a, const Matrix* b, Matrix** out);
+
+#endif
@@ -0,0 +1,242 @@
+#include "calculator_numtheory.h"
+#include <stddef.h>
+
+typedef unsigned __int128 UInteger;
+
+// Steps of Brent's rho between two gcds; the product of the differences
+// is accumulated in between
+#define RHO_BATCH 128
+
+// Trial divisors. Once they are divided out, anything below the square of
+// the next prime, 101, is prime.
+static const uint8_t small_primes[] = {
+    2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61, 67, 71, 73, 79, 83, 89, 97,
+};
+#define SMALL_PRIME_COUNT (sizeof(small_primes) / sizeof(small_primes[0]))
+#define SMALL_PRIME_SQUARE (101 * 101)
+
+// Miller-Rabin bases that together admit no composite below 2^64
+// (Jim Sinclair's set)
+static const uint64_t witness_bases[] = {2, 325, 9375, 28178, 450775, 9780504, 1795265022};
+
+uint64_t numtheory_gcd(uint64_t a, uint64_t b) {
+    if (!a || !b) {
+        return a | b;
+    }
+    int shift = __builtin_ctzll(a | b);
+    a >>= __builtin_ctzll(a);
+    do {
+        b >>= __builtin_ctzll(b);
+        if (a > b) {
+            uint64_t t = a;
+            a = b;
+            b = t;
+        }
+        b -= a;
+    } while (b);
+    return a << shift;
+}
+
+uint64_t numtheory_mulmod(uint64_t a, uint64_t b, uint64_t m) {
+    return (uint64_t)((UInteger)a * b % m);
+}
+
+// Montgomery form for an odd modulus n: x is held as x * 2^64 mod n
+
+typedef struct {
+    uint64_t n;
+    // n^-1 mod 2^64
+    uint64_t inverse;
+    // 2^64 mod n, which is 1 in Montgomery form, and 2^128 mod n
+    uint64_t one;
+    uint64_t r2;
+} Montgomery;
+
+static void montgomery_init(Montgomery* m, uint64_t n) {
+    // Newton's iteration doubles the correct low bits; n is its own inverse
+    // to 3 bits
+    uint64_t inverse = n;
+    for (int i = 0; i < 5; i++) {
+        inverse *= 2 - n * inverse;
+    }
+    m->n = n;
+    m->inverse = inverse;
+    m->one = -n % n;
+    m->r2 = (uint64_t)((UInteger)m->one * m->one % n);
+}
+
+// t * 2^-64 mod n for t < n * 2^64. The low words of t and q * n agree, so
+// the result is the difference of the high words, taken back into [0, n)
+static inline uint64_t montgomery_reduce(const Montgomery* m, UInteger t) {
+    uint64_t q = (uint64_t)t * m->inverse;
+    uint64_t high = (uint64_t)(((UInteger)q * m->n) >> 64);
+    uint64_t t_high = (uint64_t)(t >> 64);
+    return t_high >= high ? t_high - high : t_high - high + m->n;
+}
+
+static inline uint64_t montgomery_multiply(const Montgomery* m, uint64_t a, uint64_t b) {
+    return montgomery_reduce(m, (UInteger)a * b);
+}
+
+static inline uint64_t montgomery_from(const Montgomery* m, uint64_t x) {
+    return montgomery_multiply(m, x % m->n, m->r2);
+}
+
+static inline uint64_t montgomery_to(const Montgomery* m, uint64_t x) {
+    return montgomery_reduce(m, x);
+}
+
+static uint64_t montgomery_power(const Montgomery* m, uint64_t base, uint64_t exponent) {
+    uint64_t result = m->one;
+    while (exponent) {
+        if (exponent & 1) {
+            result = montgomery_multiply(m, result, base);
+        }
+        base = montgomery_multiply(m, base, base);
+        exponent >>= 1;
+    }
+    return result;
+}
+
+uint64_t numtheory_powmod(uint64_t base, uint64_t exponent, uint64_t m) {
+    if (m == 1) {
+        return 0;
+    }
+    if (m & 1) {
+        Montgomery mont;
+        montgomery_init(&mont, m);
+        return montgomery_to(&mont, montgomery_power(&mont, montgomery_from(&mont, base), exponent));
+    }
+    uint64_t result = 1;
+    base %= m;
+    while (exponent) {
+        if (exponent & 1) {
+            result = numtheory_mulmod(result, base, m);
+        }
+        base = numtheory_mulmod(base, base, m);
+        exponent >>= 1;
+    }
+    return result;
+}
+
+// Miller-Rabin for odd n past the trial divisors
+static int is_strong_probable_prime(uint64_t n) {
+    Montgomery m;
+    montgomery_init(&m, n);
+    uint64_t minus_one = n - m.one;
+    int s = __builtin_ctzll(n - 1);
+    uint64_t d = (n - 1) >> s;
+
+    for (size_t i = 0; i < sizeof(witness_bases) / sizeof(witness_bases[0]); i++) {
+        uint64_t a = witness_bases[i] % n;
+        if (a == 0) {
+            continue;
+        }
+        uint64_t x = montgomery_power(&m, montgomery_from(&m, a), d);
+        if (x == m.one || x == minus_one) {
+            continue;
+        }
+        int r = 1;
+        for (; r < s; r++) {
+            x = montgomery_multiply(&m, x, x);
+            if (x == minus_one) {
+                break;
+            }
+        }
+        if (r == s) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int numtheory_is_prime(uint64_t n) {
+    for (size_t i = 0; i < SMALL_PRIME_COUNT; i++) {
+        if (n % small_primes[i] == 0) {
+            return n == small_primes[i];
+        }
+    }
+    if (n < SMALL_PRIME_SQUARE) {
+        return n > 1;
+    }
+    return is_strong_probable_prime(n);
+}
+
+// A non-trivial factor of the odd composite n, by Brent's variant of
+// Pollard's rho on x -> x^2 + c. Returns n if this c fails.
+static uint64_t pollard_brent(uint64_t n, uint64_t c) {
+    Montgomery m;
+    montgomery_init(&m, n);
+    c = montgomery_from(&m, c);
+    uint64_t x = 0, y = montgomery_from(&m, 2), saved = y, product = m.one, g = 1;
+
+#define RHO_STEP(v) do { \
+        (v) = montgomery_multiply(&m, (v), (v)) + c; \
+        if ((v) < c || (v) >= n) (v) -= n; \
+    } while (0)
+
+    for (uint64_t r = 1; g == 1; r *= 2) {
+        x = y;
+        for (uint64_t i = 0; i < r; i++) {
+            RHO_STEP(y);
+        }
+        for (uint64_t k = 0; k < r && g == 1; k += RHO_BATCH) {
+            saved = y;
+            uint64_t steps = r - k < RHO_BATCH ? r - k : RHO_BATCH;
+            for (uint64_t i = 0; i < steps; i++) {
+                RHO_STEP(y);
+                product = montgomery_multiply(&m, product, x > y ? x - y : y - x);
+            }
+            // Montgomery form only scales by a unit, so the gcd is the same
+            g = numtheory_gcd(product, n);
+        }
+    }
+    if (g == n) {
+        // The batch overshot the collision: step through it one at a time
+        do {
+            RHO_STEP(saved);
+            g = numtheory_gcd(x > saved ? x - saved : saved - x, n);
+        } while (g == 1);
+    }
+#undef RHO_STEP
+    return g;
+}
+
+int numtheory_factor(uint64_t n, uint64_t factors[NUMTHEORY_MAX_FACTORS]) {
+    uint64_t pending[NUMTHEORY_MAX_FACTORS];
+    int count = 0, open = 0;
+
+    for (size_t i = 0; i < SMALL_PRIME_COUNT && n > 1; i++) {
+        while (n % small_primes[i] == 0) {
+            factors[count++] = small_primes[i];
+            n /= small_primes[i];
+        }
+    }
+    if (n > 1) {
+        pending[open++] = n;
+    }
+    // Every factor left has all its prime factors above 97
+    while (open > 0) {
+        n = pending[--open];
+        if (n < SMALL_PRIME_SQUARE || is_strong_probable_prime(n)) {
+            factors[count++] = n;
+            continue;
+        }
+        uint64_t d = n;
+        for (uint64_t c = 1; d == n; c++) {
+            d = pollard_brent(n, c);
+        }
+        pending[open++] = d;
+        pending[open++] = n / d;
+    }
+
+    for (int i = 1; i < count; i++) {
+        uint64_t f = factors[i];
+        int j = i;
+        for (; j > 0 && factors[j - 1] > f; j--) {
+            factors[j] = factors[j - 1];
+        }
+        factors[j] = f;
+    }
+    return count;
+}
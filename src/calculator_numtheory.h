@@ -0,0 +1,26 @@
+#ifndef CALCULATOR_NUMTHEORY_H
+#define CALCULATOR_NUMTHEORY_H
+
+#include <stdint.h>
+
+// Exact number theory on unsigned 64-bit integers. Products modulo an odd
+// modulus use Montgomery multiplication, so no step divides; primality is a
+// deterministic Miller-Rabin test, correct for every 64-bit n, and
+// factorization is trial division by the primes below 100 followed by
+// Pollard's rho with Brent's cycle detection, which splits any 64-bit
+// semiprime in a few milliseconds.
+
+// Enough for the 63 factors of 2^63
+#define NUMTHEORY_MAX_FACTORS 64
+
+// gcd(0, b) is b
+uint64_t numtheory_gcd(uint64_t a, uint64_t b);
+// a * b mod m and base^exponent mod m, for m >= 1; 0^0 is 1
+uint64_t numtheory_mulmod(uint64_t a, uint64_t b, uint64_t m);
+uint64_t numtheory_powmod(uint64_t base, uint64_t exponent, uint64_t m);
+int numtheory_is_prime(uint64_t n);
+// Prime factors of n in ascending order, repeated by multiplicity; returns
+// their count, 0 for n < 2.
+int numtheory_factor(uint64_t n, uint64_t factors[NUMTHEORY_MAX_FACTORS]);
+
+#endif
@@ -0,0 +1,615 @@
+#include "calculator_ode.h"
+#include "calculator_matrix.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+// Dormand-Prince 5(4) tableau
+#define DP_C2 (1.0 / 5.0)
+#define DP_C3 (3.0 / 10.0)
+#define DP_C4 (4.0 / 5.0)
+#define DP_C5 (8.0 / 9.0)
+#define DP_A21 (1.0 / 5.0)
+#define DP_A31 (3.0 / 40.0)
+#define DP_A32 (9.0 / 40.0)
+#define DP_A41 (44.0 / 45.0)
+#define DP_A42 (-56.0 / 15.0)
+#define DP_A43 (32.0 / 9.0)
+#define DP_A51 (19372.0 / 6561.0)
+#define DP_A52 (-25360.0 / 2187.0)
+#define DP_A53 (64448.0 / 6561.0)
+#define DP_A54 (-212.0 / 729.0)
+#define DP_A61 (9017.0 / 3168.0)
+#define DP_A62 (-355.0 / 33.0)
+#define DP_A63 (46732.0 / 5247.0)
+#define DP_A64 (49.0 / 176.0)
+#define DP_A65 (-5103.0 / 18656.0)
+#define DP_A71 (35.0 / 384.0)
+#define DP_A73 (500.0 / 1113.0)
+#define DP_A74 (125.0 / 192.0)
+#define DP_A75 (-2187.0 / 6784.0)
+#define DP_A76 (11.0 / 84.0)
+// Difference between the 5th- and 4th-order weights
+#define DP_E1 (71.0 / 57600.0)
+#define DP_E3 (-71.0 / 16695.0)
+#define DP_E4 (71.0 / 1920.0)
+#define DP_E5 (-17253.0 / 339200.0)
+#define DP_E6 (22.0 / 525.0)
+#define DP_E7 (-1.0 / 40.0)
+// Dense output (Hairer, Norsett and Wanner)
+#define DP_D1 (-12715105075.0 / 11282082432.0)
+#define DP_D3 (87487479700.0 / 32700410799.0)
+#define DP_D4 (-10690763975.0 / 1880347072.0)
+#define DP_D5 (701980252875.0 / 199316789632.0)
+#define DP_D6 (-1453857185.0 / 822651844.0)
+#define DP_D7 (69997945.0 / 29380423.0)
+
+// Rosenbrock 2(3) of Shampine and Reichelt: d = 1 / (2 + sqrt(2)),
+// e32 = 6 + sqrt(2)
+#define ROS_D 0.29289321881345247560
+#define ROS_E32 7.41421356237309504880
+
+struct OdeSystem {
+    const ProgramLibrary* library;
+    size_t dimension;
+    size_t* programs;
+    // t, then the states, then the parameters; each equation reads its
+    // variables from here through `slots`
+    double* values;
+    size_t* slots;
+    size_t* slot_offsets;
+    double* gathered;
+    const char** parameters;
+    unsigned char* parameter_set;
+    size_t parameter_count;
+    // Stage vectors and the dense output of the last step, dimension each
+    double* k[7];
+    double* y_new;
+    double* y_stage;
+    double* dense[5];
+    // Rosenbrock: Jacobian, iteration matrix, df/dt
+    double* jacobian;
+    double* iteration;
+    double* dfdt;
+    int* pivots;
+    MatrixArena* arena;
+};
+
+static size_t find_slot(OdeSystem* system, const char* name, const char* const* states, const char* time) {
+    if (time && strcmp(name, time) == 0) {
+        return 0;
+    }
+    for (size_t j = 0; j < system->dimension; j++) {
+        if (states[j] && strcmp(name, states[j]) == 0) {
+            return 1 + j;
+        }
+    }
+    for (size_t p = 0; p < system->parameter_count; p++) {
+        if (strcmp(name, system->parameters[p]) == 0) {
+            return 1 + system->dimension + p;
+        }
+    }
+    system->parameters[system->parameter_count] = name;
+    return 1 + system->dimension + system->parameter_count++;
+}
+
+OdeSystem* ode_system_new(const ProgramLibrary* library, const size_t* programs, size_t dimension,
+                          const char* const* states, const char* time) {
+    if (dimension == 0) {
+        return NULL;
+    }
+    OdeSystem* system = (OdeSystem*)calloc(1, sizeof(OdeSystem));
+    if (!system) {
+        return NULL;
+    }
+    system->library = library;
+    system->dimension = dimension;
+
+    size_t total_slots = 0, widest = 1;
+    for (size_t i = 0; i < dimension; i++) {
+        size_t count = program_variable_count(library, programs[i]);
+        total_slots += count;
+        widest = count > widest ? count : widest;
+    }
+    size_t n = dimension;
+    system->programs = (size_t*)malloc(n * sizeof(size_t));
+    system->slots = (size_t*)malloc((total_slots + 1) * sizeof(size_t));
+    system->slot_offsets = (size_t*)malloc((n + 1) * sizeof(size_t));
+    system->gathered = (double*)malloc(widest * sizeof(double));
+    system->parameters = (const char**)malloc((total_slots + 1) * sizeof(const char*));
+    system->parameter_set = (unsigned char*)calloc(total_slots + 1, 1);
+    system->values = (double*)calloc(1 + n + total_slots, sizeof(double));
+    double* work = (double*)malloc((17 * n + 2 * n * n) * sizeof(double));
+    system->pivots = (int*)malloc(n * sizeof(int));
+    system->arena = matrix_arena_new(0);
+    if (!system->programs || !system->slots || !system->slot_offsets || !system->gathered ||
+        !system->parameters || !system->parameter_set || !system->values || !work ||
+        !system->pivots || !system->arena) {
+        free(work);
+        ode_system_free(system);
+        return NULL;
+    }
+    for (int s = 0; s < 7; s++) {
+        system->k[s] = work + (size_t)s * n;
+    }
+    system->y_new = work + 7 * n;
+    system->y_stage = work + 8 * n;
+    for (int s = 0; s < 5; s++) {
+        system->dense[s] = work + (size_t)(9 + s) * n;
+    }
+    system->dfdt = work + 14 * n;
+    system->jacobian = work + 17 * n;
+    system->iteration = system->jacobian + n * n;
+
+    memcpy(system->programs, programs, n * sizeof(size_t));
+    size_t slot = 0;
+    for (size_t i = 0; i < n; i++) {
+        system->slot_offsets[i] = slot;
+        size_t count = program_variable_count(library, programs[i]);
+        for (size_t v = 0; v < count; v++) {
+            system->slots[slot++] = find_slot(system, program_variable_name(library, programs[i], v), states, time);
+        }
+    }
+    system->slot_offsets[n] = slot;
+    return system;
+}
+
+void ode_system_free(OdeSystem* system) {
+    if (!system) {
+        return;
+    }
+    // The stage vectors and matrices are one allocation starting at k[0]
+    free(system->k[0]);
+    free(system->programs);
+    free(system->slots);
+    free(system->slot_offsets);
+    free(system->gathered);
+    free(system->parameters);
+    free(system->parameter_set);
+    free(system->values);
+    free(system->pivots);
+    matrix_arena_free(system->arena);
+    free(system);
+}
+
+int ode_system_set_parameter(OdeSystem* system, const char* name, double value) {
+    for (size_t p = 0; p < system->parameter_count; p++) {
+        if (strcmp(name, system->parameters[p]) == 0) {
+            system->values[1 + system->dimension + p] = value;
+            system->parameter_set[p] = 1;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void ode_options_default(OdeOptions* options) {
+    options->method = ODE_DORMAND_PRINCE;
+    options->relative_tolerance = 1e-6;
+    options->absolute_tolerance = 1e-9;
+    options->initial_step = 0.0;
+    options->max_step = 0.0;
+    options->max_steps = 100000;
+}
+
+// f = f(t, y), one compiled program per component
+static ErrorType evaluate(OdeSystem* system, Calculator* calc, double t, const double* y, double* f, OdeStats* stats) {
+    size_t n = system->dimension;
+    system->values[0] = t;
+    memcpy(system->values + 1, y, n * sizeof(double));
+    for (size_t i = 0; i < n; i++) {
+        size_t first = system->slot_offsets[i];
+        size_t count = system->slot_offsets[i + 1] - first;
+        for (size_t v = 0; v < count; v++) {
+            system->gathered[v] = system->values[system->slots[first + v]];
+        }
+        ErrorType err = program_run(system->library, system->programs[i], calc, system->gathered, &f[i]);
+        if (err != ERROR_NONE) {
+            return err;
+        }
+    }
+    stats->evaluations++;
+    return ERROR_NONE;
+}
+
+// Root-mean-square of error[i] / (atol + rtol * max(|y[i]|, |y_new[i]|))
+static double error_norm(const double* error, const double* y, const double* y_new, size_t n,
+                         const OdeOptions* options) {
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        double scale = options->absolute_tolerance +
+                       options->relative_tolerance * fmax(fabs(y[i]), fabs(y_new[i]));
+        double e = error[i] / scale;
+        sum += e * e;
+    }
+    return sqrt(sum / (double)n);
+}
+
+// First step size from the size of f and an estimate of its derivative
+// (Hairer, Norsett and Wanner, II.4); f0 is f(t, y)
+static ErrorType initial_step(OdeSystem* system, Calculator* calc, const OdeOptions* options, int order,
+                              double t, const double* y, const double* f0, double direction, double span,
+                              OdeStats* stats, double* h) {
+    size_t n = system->dimension;
+    double* y1 = system->y_stage;
+    double* f1 = system->k[1];
+    double dny = 0.0, dnf = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        double scale = options->absolute_tolerance + options->relative_tolerance * fabs(y[i]);
+        dny += (y[i] / scale) * (y[i] / scale);
+        dnf += (f0[i] / scale) * (f0[i] / scale);
+    }
+    dny = sqrt(dny / (double)n);
+    dnf = sqrt(dnf / (double)n);
+    double step = (dny <= 1e-5 || dnf <= 1e-5) ? 1e-6 : 0.01 * dny / dnf;
+    step = fmin(step, span);
+
+    for (size_t i = 0; i < n; i++) {
+        y1[i] = y[i] + direction * step * f0[i];
+    }
+    ErrorType err = evaluate(system, calc, t + direction * step, y1, f1, stats);
+    if (err != ERROR_NONE) {
+        return err;
+    }
+    double der2 = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        double scale = options->absolute_tolerance + options->relative_tolerance * fabs(y[i]);
+        double d = (f1[i] - f0[i]) / scale;
+        der2 += d * d;
+    }
+    der2 = sqrt(der2 / (double)n) / step;
+    double der12 = fmax(der2, dnf);
+    double step1 = der12 <= 1e-15 ? fmax(1e-6, step * 1e-3) : pow(0.01 / der12, 1.0 / order);
+    step = fmin(fmin(100.0 * step, step1), span);
+    *h = direction * step;
+    return ERROR_NONE;
+}
+
+// One Dormand-Prince step from (t, y) with k[0] = f(t, y). Leaves the new
+// state in y_new, f(t + h, y_new) in k[6] and the error norm in *error.
+static ErrorType dopri_step(OdeSystem* system, Calculator* calc, const OdeOptions* options,
+                            double t, const double* y, double h, OdeStats* stats, double* error) {
+    size_t n = system->dimension;
+    double** k = system->k;
+    double* s = system->y_stage;
+    ErrorType err;
+
+    for (size_t i = 0; i < n; i++) {
+        s[i] = y[i] + h * DP_A21 * k[0][i];
+    }
+    if ((err = evaluate(system, calc, t + DP_C2 * h, s, k[1], stats)) != ERROR_NONE) {
+        return err;
+    }
+    for (size_t i = 0; i < n; i++) {
+        s[i] = y[i] + h * (DP_A31 * k[0][i] + DP_A32 * k[1][i]);
+    }
+    if ((err = evaluate(system, calc, t + DP_C3 * h, s, k[2], stats)) != ERROR_NONE) {
+        return err;
+    }
+    for (size_t i = 0; i < n; i++) {
+        s[i] = y[i] + h * (DP_A41 * k[0][i] + DP_A42 * k[1][i] + DP_A43 * k[2][i]);
+    }
+    if ((err = evaluate(system, calc, t + DP_C4 * h, s, k[3], stats)) != ERROR_NONE) {
+        return err;
+    }
+    for (size_t i = 0; i < n; i++) {
+        s[i] = y[i] + h * (DP_A51 * k[0][i] + DP_A52 * k[1][i] + DP_A53 * k[2][i] + DP_A54 * k[3][i]);
+    }
+    if ((err = evaluate(system, calc, t + DP_C5 * h, s, k[4], stats)) != ERROR_NONE) {
+        return err;
+    }
+    for (size_t i = 0; i < n; i++) {
+        s[i] = y[i] + h * (DP_A61 * k[0][i] + DP_A62 * k[1][i] + DP_A63 * k[2][i] +
+                           DP_A64 * k[3][i] + DP_A65 * k[4][i]);
+    }
+    if ((err = evaluate(system, calc, t + h, s, k[5], stats)) != ERROR_NONE) {
+        return err;
+    }
+    for (size_t i = 0; i < n; i++) {
+        system->y_new[i] = y[i] + h * (DP_A71 * k[0][i] + DP_A73 * k[2][i] + DP_A74 * k[3][i] +
+                                       DP_A75 * k[4][i] + DP_A76 * k[5][i]);
+    }
+    if ((err = evaluate(system, calc, t + h, system->y_new, k[6], stats)) != ERROR_NONE) {
+        return err;
+    }
+    for (size_t i = 0; i < n; i++) {
+        s[i] = h * (DP_E1 * k[0][i] + DP_E3 * k[2][i] + DP_E4 * k[3][i] +
+                    DP_E5 * k[4][i] + DP_E6 * k[5][i] + DP_E7 * k[6][i]);
+    }
+    *error = error_norm(s, y, system->y_new, n, options);
+    return ERROR_NONE;
+}
+
+static void dopri_prepare_dense(OdeSystem* system, const double* y, double h) {
+    double** k = system->k;
+    double** d = system->dense;
+    for (size_t i = 0; i < system->dimension; i++) {
+        double difference = system->y_new[i] - y[i];
+        double slope = h * k[0][i] - difference;
+        d[0][i] = y[i];
+        d[1][i] = difference;
+        d[2][i] = slope;
+        d[3][i] = difference - h * k[6][i] - slope;
+        d[4][i] = h * (DP_D1 * k[0][i] + DP_D3 * k[2][i] + DP_D4 * k[3][i] +
+                       DP_D5 * k[4][i] + DP_D6 * k[5][i] + DP_D7 * k[6][i]);
+    }
+}
+
+static void dopri_interpolate(const OdeSystem* system, double theta, double* out) {
+    double* const* d = system->dense;
+    double rest = 1.0 - theta;
+    for (size_t i = 0; i < system->dimension; i++) {
+        out[i] = d[0][i] + theta * (d[1][i] + rest * (d[2][i] + theta * (d[3][i] + rest * d[4][i])));
+    }
+}
+
+// Forward-difference Jacobian and df/dt at (t, y), with f0 = f(t, y)
+static ErrorType rosenbrock_jacobian(OdeSystem* system, Calculator* calc, double t, const double* y,
+                                     const double* f0, double h, OdeStats* stats) {
+    size_t n = system->dimension;
+    double* column = system->k[5];
+    double* shifted = system->y_stage;
+    double root = sqrt(DBL_EPSILON);
+    ErrorType err;
+
+    memcpy(shifted, y, n * sizeof(double));
+    for (size_t j = 0; j < n; j++) {
+        double delta = root * fmax(fabs(y[j]), 1e-5);
+        // Make the increment exactly representable
+        volatile double moved = y[j] + delta;
+        delta = moved - y[j];
+        shifted[j] = moved;
+        if ((err = evaluate(system, calc, t, shifted, column, stats)) != ERROR_NONE) {
+            return err;
+        }
+        shifted[j] = y[j];
+        for (size_t i = 0; i < n; i++) {
+            system->jacobian[i * n + j] = (column[i] - f0[i]) / delta;
+        }
+    }
+    double delta = fmin(root * fmax(fabs(t), fabs(h)), fabs(h));
+    delta = copysign(delta, h);
+    if ((err = evaluate(system, calc, t + delta, y, column, stats)) != ERROR_NONE) {
+        return err;
+    }
+    for (size_t i = 0; i < n; i++) {
+        system->dfdt[i] = (column[i] - f0[i]) / delta;
+    }
+    stats->jacobians++;
+    return ERROR_NONE;
+}
+
+// One Rosenbrock step from (t, y) with k[0] = f(t, y) and a current
+// Jacobian. Leaves the new state in y_new, f(t + h, y_new) in k[6], the
+// stages for the dense output in k[1] and k[2] and the error norm in *error.
+// A singular iteration matrix gives an infinite error, so the step shrinks.
+static ErrorType rosenbrock_step(OdeSystem* system, Calculator* calc, const OdeOptions* options,
+                                 double t, const double* y, double h, OdeStats* stats, double* error) {
+    size_t n = system->dimension;
+    double* f0 = system->k[0];
+    double* k1 = system->k[1];
+    double* k2 = system->k[2];
+    double* k3 = system->k[3];
+    double* f1 = system->k[4];
+    double* f2 = system->k[6];
+    double* s = system->y_stage;
+    double hd = h * ROS_D;
+    ErrorType err;
+
+    // W = I - h d J
+    for (size_t i = 0; i < n * n; i++) {
+        system->iteration[i] = -hd * system->jacobian[i];
+    }
+    for (size_t i = 0; i < n; i++) {
+        system->iteration[i * n + i] += 1.0;
+    }
+    Matrix w = {(int)n, (int)n, system->iteration};
+    err = matrix_lu_factor(system->arena, &w, system->pivots, NULL);
+    matrix_arena_reset(system->arena);
+    if (err == ERROR_SINGULAR_MATRIX) {
+        *error = INFINITY;
+        return ERROR_NONE;
+    }
+    if (err != ERROR_NONE) {
+        return err;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        k1[i] = f0[i] + hd * system->dfdt[i];
+    }
+    matrix_lu_solve(&w, system->pivots, k1, 1);
+    for (size_t i = 0; i < n; i++) {
+        s[i] = y[i] + 0.5 * h * k1[i];
+    }
+    if ((err = evaluate(system, calc, t + 0.5 * h, s, f1, stats)) != ERROR_NONE) {
+        return err;
+    }
+    for (size_t i = 0; i < n; i++) {
+        k2[i] = f1[i] - k1[i];
+    }
+    matrix_lu_solve(&w, system->pivots, k2, 1);
+    for (size_t i = 0; i < n; i++) {
+        k2[i] += k1[i];
+        system->y_new[i] = y[i] + h * k2[i];
+    }
+    if ((err = evaluate(system, calc, t + h, system->y_new, f2, stats)) != ERROR_NONE) {
+        return err;
+    }
+    for (size_t i = 0; i < n; i++) {
+        k3[i] = f2[i] - ROS_E32 * (k2[i] - f1[i]) - 2.0 * (k1[i] - f0[i]) + hd * system->dfdt[i];
+    }
+    matrix_lu_solve(&w, system->pivots, k3, 1);
+    for (size_t i = 0; i < n; i++) {
+        s[i] = h / 6.0 * (k1[i] - 2.0 * k2[i] + k3[i]);
+    }
+    *error = error_norm(s, y, system->y_new, n, options);
+    return ERROR_NONE;
+}
+
+static void rosenbrock_prepare_dense(OdeSystem* system, const double* y, double h) {
+    for (size_t i = 0; i < system->dimension; i++) {
+        system->dense[0][i] = y[i];
+        system->dense[1][i] = h * system->k[1][i];
+        system->dense[2][i] = h * system->k[2][i];
+    }
+}
+
+static void rosenbrock_interpolate(const OdeSystem* system, double theta, double* out) {
+    double w1 = theta * (1.0 - theta) / (1.0 - 2.0 * ROS_D);
+    double w2 = theta * (theta - 2.0 * ROS_D) / (1.0 - 2.0 * ROS_D);
+    for (size_t i = 0; i < system->dimension; i++) {
+        out[i] = system->dense[0][i] + w1 * system->dense[1][i] + w2 * system->dense[2][i];
+    }
+}
+
+static int state_finite(const double* y, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (!isfinite(y[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+ErrorType ode_integrate(OdeSystem* system, Calculator* calc, const OdeOptions* options,
+                        double t0, double t1, double* y,
+                        const double* times, size_t count, double* out, OdeStats* stats) {
+    OdeOptions defaults;
+    OdeStats counters = {0, 0, 0, 0, 0};
+    size_t n = system->dimension;
+    if (!options) {
+        ode_options_default(&defaults);
+        options = &defaults;
+    }
+    if (!stats) {
+        stats = &counters;
+    }
+    *stats = counters;
+
+    for (size_t p = 0; p < system->parameter_count; p++) {
+        if (!system->parameter_set[p]) {
+            return ERROR_SYNTAX;
+        }
+    }
+    double direction = t1 < t0 ? -1.0 : 1.0;
+    double span = fabs(t1 - t0);
+    if (!isfinite(span) || !(options->relative_tolerance >= 0.0) || !(options->absolute_tolerance >= 0.0) ||
+        options->relative_tolerance + options->absolute_tolerance <= 0.0) {
+        return ERROR_MATH_DOMAIN;
+    }
+    for (size_t k = 0; k < count; k++) {
+        double previous = k > 0 ? times[k - 1] : t0;
+        if (!(direction * (times[k] - previous) >= 0.0) || !(direction * (t1 - times[k]) >= 0.0)) {
+            return ERROR_MATH_DOMAIN;
+        }
+    }
+
+    int rosenbrock = options->method == ODE_ROSENBROCK;
+    int order = rosenbrock ? 3 : 5;
+    double safety = rosenbrock ? 0.8 : 0.9;
+    double grow = rosenbrock ? 5.0 : 10.0;
+    double max_step = options->max_step > 0.0 ? fmin(options->max_step, span) : span;
+    size_t next = 0;
+    while (next < count && times[next] == t0) {
+        memcpy(out + next * n, y, n * sizeof(double));
+        stats->points = ++next;
+    }
+    if (span == 0.0) {
+        return ERROR_NONE;
+    }
+
+    double* f0 = system->k[0];
+    double t = t0;
+    double h;
+    ErrorType err = evaluate(system, calc, t, y, f0, stats);
+    if (err != ERROR_NONE) {
+        return err;
+    }
+    if (options->initial_step > 0.0) {
+        h = direction * fmin(options->initial_step, max_step);
+    } else {
+        err = initial_step(system, calc, options, order, t, y, f0, direction, max_step, stats, &h);
+        if (err != ERROR_NONE) {
+            return err;
+        }
+    }
+
+    int jacobian_current = 0;
+    int rejected = 0;
+    while (direction * (t1 - t) > 0.0) {
+        if (calc->cancel && cancel_token_is_cancelled(calc->cancel)) {
+            return ERROR_CANCELLED;
+        }
+        if (stats->steps + stats->rejected >= options->max_steps) {
+            return ERROR_BUDGET_EXCEEDED;
+        }
+        if (fabs(h) <= 16.0 * DBL_EPSILON * fmax(fabs(t), DBL_MIN)) {
+            return ERROR_MATH_DOMAIN;
+        }
+        int last = direction * (t + h - t1) >= 0.0;
+        if (last) {
+            h = t1 - t;
+        }
+
+        double error;
+        if (rosenbrock) {
+            if (!jacobian_current) {
+                if ((err = rosenbrock_jacobian(system, calc, t, y, f0, h, stats)) != ERROR_NONE) {
+                    return err;
+                }
+                jacobian_current = 1;
+            }
+            err = rosenbrock_step(system, calc, options, t, y, h, stats, &error);
+        } else {
+            err = dopri_step(system, calc, options, t, y, h, stats, &error);
+        }
+        if (err != ERROR_NONE) {
+            return err;
+        }
+
+        if (!(error <= 1.0)) {
+            stats->rejected++;
+            rejected = 1;
+            double factor = isfinite(error) ? fmax(0.2, safety * pow(error, -1.0 / order)) : 0.2;
+            h *= factor;
+            continue;
+        }
+
+        // Accepted: stream the output times this step passed
+        double t_new = last ? t1 : t + h;
+        if (!state_finite(system->y_new, n)) {
+            return ERROR_OVERFLOW;
+        }
+        if (next < count && direction * (times[next] - t_new) <= 0.0) {
+            if (rosenbrock) {
+                rosenbrock_prepare_dense(system, y, h);
+            } else {
+                dopri_prepare_dense(system, y, h);
+            }
+            while (next < count && direction * (times[next] - t_new) <= 0.0) {
+                if (times[next] == t_new) {
+                    memcpy(out + next * n, system->y_new, n * sizeof(double));
+                } else if (rosenbrock) {
+                    rosenbrock_interpolate(system, (times[next] - t) / h, out + next * n);
+                } else {
+                    dopri_interpolate(system, (times[next] - t) / h, out + next * n);
+                }
+                stats->points = ++next;
+            }
+        }
+        memcpy(y, system->y_new, n * sizeof(double));
+        memcpy(f0, system->k[6], n * sizeof(double));
+        t = t_new;
+        stats->steps++;
+        jacobian_current = 0;
+
+        double factor = error == 0.0 ? grow : fmin(grow, fmax(0.2, safety * pow(error, -1.0 / order)));
+        if (rejected) {
+            factor = fmin(factor, 1.0);
+            rejected = 0;
+        }
+        h = direction * fmin(fabs(h) * factor, max_step);
+    }
+    return ERROR_NONE;
+}
@@ -0,0 +1,81 @@
+#ifndef CALCULATOR_ODE_H
+#define CALCULATOR_ODE_H
+
+#include <stddef.h>
+#include "calculator_logic.h"
+#include "calculator_program.h"
+
+// Initial value problems dy/dt = f(t, y) for small systems whose right-hand
+// sides are programs in a compiled library, so every evaluation runs the
+// bytecode directly. Each program may use the time variable, any of the
+// state variables and named parameters, e.g. `-$k*$y+sin($t)`.
+//
+//   ODE_DORMAND_PRINCE  explicit RK5(4) with FSAL and a 4th-order dense
+//                       output; the default for non-stiff problems
+//   ODE_ROSENBROCK      linearly implicit, L-stable 2(3) pair (the ode23s
+//                       scheme) with a finite-difference Jacobian, for stiff
+//                       problems where the explicit method would need tiny
+//                       steps
+//
+// Both control the step size with the error estimate scaled per component by
+// absolute + relative * |y|, in the root-mean-square norm.
+typedef enum {
+    ODE_DORMAND_PRINCE,
+    ODE_ROSENBROCK
+} OdeMethod;
+
+typedef struct {
+    OdeMethod method;
+    double relative_tolerance;
+    double absolute_tolerance;
+    // Zero picks the first step from the problem and leaves the step size
+    // unbounded.
+    double initial_step;
+    double max_step;
+    // Accepted plus rejected steps before giving up with ERROR_BUDGET_EXCEEDED
+    size_t max_steps;
+} OdeOptions;
+
+typedef struct {
+    size_t steps;
+    size_t rejected;
+    size_t evaluations;
+    size_t jacobians;
+    // Rows written to the output buffer
+    size_t points;
+} OdeStats;
+
+typedef struct OdeSystem OdeSystem;
+
+// Equation i is dy_i/dt = program programs[i] of `library`, for i below
+// `dimension`. A program variable named `time` is t, one named states[j] is
+// y_j, and any other is a parameter to set with ode_system_set_parameter.
+// The library must stay open while the system is in use. Returns NULL if
+// out of memory.
+OdeSystem* ode_system_new(const ProgramLibrary* library, const size_t* programs, size_t dimension,
+                          const char* const* states, const char* time);
+void ode_system_free(OdeSystem* system);
+// Returns 0 if no equation uses `name` as a parameter.
+int ode_system_set_parameter(OdeSystem* system, const char* name, double value);
+
+// Dormand-Prince with relative 1e-6, absolute 1e-9 and 100000 steps.
+void ode_options_default(OdeOptions* options);
+
+// Integrates from t0 to t1 (t1 < t0 runs backwards), starting from `y` and
+// leaving the state at t1 in it. For each of the `count` output times, which
+// must be ordered from t0 towards t1 and lie between them, the interpolated
+// state is written to row k of `out` (count x dimension) as soon as a step
+// passes it, so after a failure the first stats->points rows are still
+// valid. `options` and `stats` may be NULL.
+//
+// Errors from a right-hand side, including ERROR_CANCELLED from the
+// calculator's cancel token, stop the integration. A parameter that was never
+// set gives ERROR_SYNTAX, unordered output times ERROR_MATH_DOMAIN, a step
+// size that falls to rounding level ERROR_MATH_DOMAIN, a state that leaves
+// the finite range ERROR_OVERFLOW and running out of steps
+// ERROR_BUDGET_EXCEEDED.
+ErrorType ode_integrate(OdeSystem* system, Calculator* calc, const OdeOptions* options,
+                        double t0, double t1, double* y,
+                        const double* times, size_t count, double* out, OdeStats* stats);
+
+#endif
@@ -0,0 +1,436 @@
+#define _GNU_SOURCE
+#include "calculator_parallel.h"
+#include "calculator_random.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+
+// Pieces shorter than this are evaluated whole rather than split further
+#define PARALLEL_SPLIT_LENGTH 256
+#define PARALLEL_MAX_THREADS 64
+
+// A piece of the expression. Chain nodes ('+' or '*') own a contiguous run
+// of children; leaves are evaluated by the workers. `sign` is -1 for a term
+// after a binary minus or a piece written as -( ... ). A leaf has no
+// children.
+typedef struct {
+    size_t start;
+    size_t length;
+    size_t first_child;
+    size_t child_count;
+    char kind;
+    double sign;
+} ParallelNode;
+
+typedef struct {
+    ParallelNode* items;
+    size_t count;
+    size_t capacity;
+} NodeList;
+
+typedef struct {
+    const char* expression;
+    const Calculator* settings;
+    double deadline;
+    long operations;
+    const ParallelNode* nodes;
+    const size_t* leaves;
+    size_t first_leaf;
+    size_t end_leaf;
+    double* values;
+    ErrorType* errors;
+} ParallelWorker;
+
+static int node_push(NodeList* list, size_t start, size_t end, double sign) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 64;
+        ParallelNode* items = (ParallelNode*)realloc(list->items, capacity * sizeof(ParallelNode));
+        if (!items) {
+            return 0;
+        }
+        list->items = items;
+        list->capacity = capacity;
+    }
+    ParallelNode* node = &list->items[list->count++];
+    node->start = start;
+    node->length = end - start;
+    node->first_child = 0;
+    node->child_count = 0;
+    node->kind = '\0';
+    node->sign = sign;
+    return 1;
+}
+
+static void trim(const char* s, size_t* start, size_t* end) {
+    while (*start < *end && isspace((unsigned char)s[*start])) {
+        (*start)++;
+    }
+    while (*end > *start && isspace((unsigned char)s[*end - 1])) {
+        (*end)--;
+    }
+}
+
+// True if s[start] is '(' and its match is s[end - 1]
+static int wraps_whole(const char* s, size_t start, size_t end) {
+    int depth = 0;
+    if (end - start < 2 || s[start] != '(' || s[end - 1] != ')') {
+        return 0;
+    }
+    for (size_t i = start; i < end - 1; i++) {
+        depth += s[i] == '(' ? 1 : s[i] == ')' ? -1 : 0;
+        if (depth == 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Characters whose precedence relative to the chain operators is known;
+// anything else at the top level keeps the piece whole
+static int is_splittable_char(char c) {
+    return isalnum((unsigned char)c) || isspace((unsigned char)c) || strchr(".+-*/%^!()", c) != NULL;
+}
+
+// A + or - is binary only after something that ends a value, and a sign after
+// an operator. After a letter it is either an exponent sign inside a numeric
+// literal or ambiguous (constant vs function name).
+static int ends_value(char c) {
+    return isdigit((unsigned char)c) || c == '.' || c == ')' || c == '!';
+}
+
+// True if the word ending at s[prev] starts with a digit, so strtod reads the
+// sign that follows as part of the literal (1e-3, 0x1p+4)
+static int in_numeric_literal(const char* s, size_t start, size_t prev) {
+    size_t i = prev + 1;
+    while (i > start && (isalnum((unsigned char)s[i - 1]) || s[i - 1] == '.')) {
+        i--;
+    }
+    return isdigit((unsigned char)s[i]) || s[i] == '.';
+}
+
+// Counts the top-level separators of `kind` in [start, end), or -1 if the
+// piece cannot be split safely. With `list`, also appends the pieces.
+static int scan_chain(const char* s, size_t start, size_t end, char kind, NodeList* list) {
+    int depth = 0, count = 0;
+    size_t piece = start, prev = end, length;
+    double sign = 1.0;
+
+    for (size_t i = start; i < end; i++) {
+        char c = s[i];
+        int separator;
+        if (!is_splittable_char(c)) {
+            return -1;
+        }
+        if (isspace((unsigned char)c)) {
+            continue;
+        }
+        // xor binds looser than + and mod as tight as *, so neither chain
+        // can be split around them
+        if (isalpha((unsigned char)c) && (i == start || !isalnum((unsigned char)s[i - 1])) &&
+            calculator_named_operator(s + i, &length) != '\0') {
+            return -1;
+        }
+        if (kind == '+') {
+            separator = depth == 0 && (c == '+' || c == '-') && prev != end;
+            if (separator && !ends_value(s[prev])) {
+                if (isalpha((unsigned char)s[prev]) && !in_numeric_literal(s, start, prev)) {
+                    return -1;
+                }
+                separator = 0;
+            }
+        } else if (kind == '*') {
+            separator = c == '*';
+        } else {
+            separator = c == '/' || c == '%';
+        }
+
+        if (c == '(') {
+            depth++;
+        } else if (c == ')') {
+            depth--;
+        } else if (depth == 0 && separator) {
+            if (list) {
+                size_t a = piece, b = i;
+                trim(s, &a, &b);
+                if (!node_push(list, a, b, sign)) {
+                    return -1;
+                }
+            }
+            sign = c == '-' ? -1.0 : 1.0;
+            piece = i + 1;
+            count++;
+        }
+        prev = i;
+    }
+    if (list) {
+        size_t a = piece, b = end;
+        trim(s, &a, &b);
+        if (!node_push(list, a, b, sign)) {
+            return -1;
+        }
+    }
+    return count;
+}
+
+// Turns list->items[index] into a chain node if it is long enough and has a
+// top-level chain; otherwise it stays a leaf. Returns 0 on allocation failure.
+static int split_node(NodeList* list, const char* s, size_t index) {
+    ParallelNode* node = &list->items[index];
+    size_t start = node->start, end = node->start + node->length;
+    double sign = node->sign;
+    char kind = '\0';
+
+    if (node->length < PARALLEL_SPLIT_LENGTH) {
+        return 1;
+    }
+    for (;;) {
+        if (wraps_whole(s, start, end)) {
+            start++;
+            end--;
+        } else if ((s[start] == '-' || s[start] == '+') && start + 1 < end) {
+            size_t inner = start + 1, inner_end = end;
+            trim(s, &inner, &inner_end);
+            if (!wraps_whole(s, inner, inner_end)) {
+                break;
+            }
+            sign = s[start] == '-' ? -sign : sign;
+            start = inner;
+        } else {
+            break;
+        }
+        trim(s, &start, &end);
+    }
+    node->start = start;
+    node->length = end - start;
+    node->sign = sign;
+
+    if (scan_chain(s, start, end, '+', NULL) > 0) {
+        kind = '+';
+    } else if (scan_chain(s, start, end, '*', NULL) > 0 && scan_chain(s, start, end, '/', NULL) == 0) {
+        kind = '*';
+    } else {
+        return 1;
+    }
+
+    size_t first = list->count;
+    if (scan_chain(s, start, end, kind, list) < 0) {
+        return 0;
+    }
+    node = &list->items[index];
+    node->kind = kind;
+    node->first_child = first;
+    node->child_count = list->count - first;
+    return 1;
+}
+
+static double reduce_pairwise(const double* values, size_t count, char kind) {
+    if (count == 1) {
+        return values[0];
+    }
+    size_t half = count / 2;
+    double a = reduce_pairwise(values, half, kind);
+    double b = reduce_pairwise(values + half, count - half, kind);
+    return kind == '+' ? a + b : a * b;
+}
+
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Each piece gets what is left of the caller's operation and time budget
+static int limit_piece(ParallelWorker* worker, Calculator* calc) {
+    const EvaluationBudget* budget = &worker->settings->budget;
+    if (budget->max_operations > 0) {
+        calc->budget.max_operations = budget->max_operations - worker->operations;
+        if (calc->budget.max_operations <= 0) {
+            return 0;
+        }
+    }
+    if (worker->deadline > 0.0) {
+        calc->budget.max_seconds = worker->deadline - monotonic_seconds();
+        if (calc->budget.max_seconds <= 0.0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void* parallel_worker(void* arg) {
+    ParallelWorker* worker = (ParallelWorker*)arg;
+    Calculator* calc = calculator_new();
+    size_t capacity = 0;
+    char* buffer = NULL;
+
+    for (size_t k = worker->first_leaf; k < worker->end_leaf; k++) {
+        size_t index = worker->leaves[k];
+        const ParallelNode* node = &worker->nodes[index];
+        if (node->length + 1 > capacity) {
+            capacity = node->length + 1;
+            free(buffer);
+            buffer = (char*)malloc(capacity);
+        }
+        if (!calc || !buffer) {
+            worker->errors[index] = ERROR_OUT_OF_MEMORY;
+            continue;
+        }
+        memcpy(buffer, worker->expression + node->start, node->length);
+        buffer[node->length] = '\0';
+
+        double value = 0.0;
+        calc->angle_mode = worker->settings->angle_mode;
+        calc->budget.max_depth = worker->settings->budget.max_depth;
+        calc->cancel = worker->settings->cancel;
+        if (worker->settings->random &&
+            calculator_seed_random(calc, random_get_seed(worker->settings->random),
+                                   random_substream(random_get_stream(worker->settings->random), (uint64_t)index)) != ERROR_NONE) {
+            worker->errors[index] = ERROR_OUT_OF_MEMORY;
+            continue;
+        }
+        if (!limit_piece(worker, calc)) {
+            worker->errors[index] = ERROR_BUDGET_EXCEEDED;
+            continue;
+        }
+        worker->errors[index] = calculator_evaluate_value(calc, buffer, &value);
+        worker->values[index] = node->sign * value;
+        worker->operations += calc->operations;
+    }
+
+    free(buffer);
+    calculator_free(calc);
+    return NULL;
+}
+
+// Nesting depth is checked on the whole expression, since splitting strips
+// the outer parentheses from the pieces
+static int exceeds_depth(const char* s, int max_depth) {
+    int depth = 0;
+    for (; *s; s++) {
+        if (*s == '(' || *s == '[') {
+            if (++depth > max_depth) {
+                return 1;
+            }
+        } else if (*s == ')' || *s == ']') {
+            depth--;
+        }
+    }
+    return 0;
+}
+
+ErrorType parallel_evaluate(const Calculator* settings, const char* expression, int threads, double* value) {
+    NodeList list = {NULL, 0, 0};
+    size_t start = 0, end = strlen(expression);
+    ErrorType result = ERROR_OUT_OF_MEMORY;
+    size_t* leaves = NULL;
+    double* values = NULL;
+    ErrorType* errors = NULL;
+    size_t leaf_count = 0;
+    size_t leaf_bytes = 0;
+
+    double deadline = settings->budget.max_seconds > 0.0 ? monotonic_seconds() + settings->budget.max_seconds : 0.0;
+
+    if (settings->budget.max_depth > 0 && exceeds_depth(expression, settings->budget.max_depth)) {
+        return ERROR_BUDGET_EXCEEDED;
+    }
+    trim(expression, &start, &end);
+    if (!node_push(&list, start, end, 1.0)) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+    // Children are appended behind their parent, so one pass visits them all
+    for (size_t i = 0; i < list.count; i++) {
+        if (!split_node(&list, expression, i)) {
+            goto done;
+        }
+    }
+
+    leaves = (size_t*)malloc(list.count * sizeof(size_t));
+    values = (double*)malloc(list.count * sizeof(double));
+    errors = (ErrorType*)calloc(list.count, sizeof(ErrorType));
+    if (!leaves || !values || !errors) {
+        goto done;
+    }
+    for (size_t i = 0; i < list.count; i++) {
+        if (list.items[i].child_count == 0) {
+            leaves[leaf_count++] = i;
+            leaf_bytes += list.items[i].length + 1;
+        }
+    }
+
+    if (threads <= 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (int)online : 1;
+    }
+    if (threads > PARALLEL_MAX_THREADS) {
+        threads = PARALLEL_MAX_THREADS;
+    }
+    if ((size_t)threads > leaf_count) {
+        threads = (int)leaf_count;
+    }
+
+    // Contiguous runs of leaves with about the same number of bytes each
+    ParallelWorker workers[PARALLEL_MAX_THREADS];
+    pthread_t handles[PARALLEL_MAX_THREADS];
+    int started[PARALLEL_MAX_THREADS] = {0};
+    size_t bytes = 0;
+    size_t leaf = 0;
+    for (int t = 0; t < threads; t++) {
+        workers[t] = (ParallelWorker){expression, settings, deadline, 0, list.items, leaves, leaf, leaf, values, errors};
+        size_t target = leaf_bytes * (size_t)(t + 1) / (size_t)threads;
+        while (leaf < leaf_count && (bytes < target || t == threads - 1)) {
+            bytes += list.items[leaves[leaf++]].length + 1;
+        }
+        workers[t].end_leaf = leaf;
+    }
+    for (int t = 1; t < threads; t++) {
+        started[t] = pthread_create(&handles[t], NULL, parallel_worker, &workers[t]) == 0;
+        if (!started[t]) {
+            parallel_worker(&workers[t]);
+        }
+    }
+    if (threads > 0) {
+        parallel_worker(&workers[0]);
+    }
+    for (int t = 1; t < threads; t++) {
+        if (started[t]) {
+            pthread_join(handles[t], NULL);
+        }
+    }
+
+    result = ERROR_NONE;
+    size_t error_start = 0;
+    for (size_t k = 0; k < leaf_count; k++) {
+        const ParallelNode* node = &list.items[leaves[k]];
+        if (errors[leaves[k]] != ERROR_NONE && (result == ERROR_NONE || node->start < error_start)) {
+            result = errors[leaves[k]];
+            error_start = node->start;
+        }
+    }
+    long operations = 0;
+    for (int t = 0; t < threads; t++) {
+        operations += workers[t].operations;
+    }
+    if (result == ERROR_NONE && settings->budget.max_operations > 0 && operations > settings->budget.max_operations) {
+        result = ERROR_BUDGET_EXCEEDED;
+    }
+    if (result == ERROR_NONE) {
+        // Parents precede their children, so a reverse pass reduces bottom-up
+        for (size_t i = list.count; i-- > 0;) {
+            const ParallelNode* node = &list.items[i];
+            if (node->child_count > 0) {
+                values[i] = node->sign * reduce_pairwise(values + node->first_child, node->child_count, node->kind);
+            }
+        }
+        *value = values[0];
+    }
+
+done:
+    free(list.items);
+    free(leaves);
+    free(values);
+    free(errors);
+    return result;
+}
@@ -0,0 +1,24 @@
+#ifndef CALCULATOR_PARALLEL_H
+#define CALCULATOR_PARALLEL_H
+
+#include "calculator_logic.h"
+
+// calculator_evaluate hands real-valued expressions at least this long to
+// parallel_evaluate.
+#define PARALLEL_MIN_LENGTH (64 * 1024)
+
+// Evaluates one long expression on several threads. A flat top-level chain
+// of binary + and - is cut into terms, and a chain of * into factors when no
+// / or % shares it; long parenthesized pieces are cut the same way,
+// recursively. The pieces are parsed and evaluated independently and then
+// combined by pairwise reduction in a fixed order, so the result is the same
+// for every thread count (though it may differ in the last bits from strict
+// left-to-right evaluation). `threads` <= 0 uses one thread per online CPU.
+// The angle mode, budget and cancel token are taken from `settings`; the
+// operation budget covers all pieces together. On failure the error of the
+// leftmost failing piece is returned. If `settings` has a random generator,
+// each piece draws from its own substream of it, so a seeded evaluation
+// also gives the same result for every thread count.
+ErrorType parallel_evaluate(const Calculator* settings, const char* expression, int threads, double* value);
+
+#endif
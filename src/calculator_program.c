@@ -0,0 +1,1048 @@
+#define _GNU_SOURCE
+#include "calculator_program.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <math.h>
+
+#define PROGRAM_MAGIC "MEPROG"
+#define PROGRAM_MAX_NAME_LENGTH 4096
+#define POLYNOMIAL_MAX_DEGREE 32
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t program_count;
+    uint32_t constant_count;
+    uint32_t slot_count;
+    uint32_t code_size;
+    uint32_t names_size;
+    uint64_t directory_offset;
+    uint64_t constants_offset;
+    uint64_t slots_offset;
+    uint64_t code_offset;
+    uint64_t names_offset;
+} ProgramFileHeader;
+
+typedef struct {
+    uint32_t name_offset;
+    uint32_t name_length;
+    uint32_t code_offset;
+    uint32_t code_length;
+    uint32_t slot_base;
+    uint32_t slot_count;
+} ProgramEntry;
+
+typedef struct {
+    uint32_t name_offset;
+    uint32_t name_length;
+} ProgramSlot;
+
+typedef struct {
+    char* data;
+    size_t size;
+    size_t capacity;
+} Buffer;
+
+// Everything recorded so far, for all programs; the marks let a failed
+// compile be rolled back
+struct ProgramRecorder {
+    Buffer code;
+    Buffer constants;
+    Buffer slots;
+    Buffer names;
+    size_t slot_base;
+    int failed;
+};
+
+struct ProgramWriter {
+    ProgramRecorder recorder;
+    Buffer entries;
+    Calculator* calc;
+    int rewrite;
+};
+
+// What the rewrite pass knows about the value a subtree leaves on the stack.
+// A polynomial is a sum of monomials with distinct powers of one variable,
+// or a constant when `variable` is -1; coefficients are finite and the
+// nonzero ones are exactly the terms written in the expression.
+typedef struct {
+    size_t start;
+    int polynomial;
+    int32_t variable;
+    int degree;
+    int terms;
+    double coefficients[POLYNOMIAL_MAX_DEGREE + 1];
+} RewriteValue;
+
+typedef enum {
+    REWRITE_HORNER,
+    REWRITE_POWI,
+    REWRITE_RECIPROCAL
+} RewriteKind;
+
+// A conditional the rewrite pass is inside: its code starts at `start`, the
+// second branch at `other` and both join at `join`, which is 0 until the
+// jump ending the first branch is reached
+typedef struct {
+    size_t start;
+    size_t other;
+    size_t join;
+    int depth;
+} RewriteBranch;
+
+// A jump re-emitted at `branch` whose target was `target` in the old code
+typedef struct {
+    size_t branch;
+    size_t target;
+} RewriteJump;
+
+// Replaces the code in [start, end) of the program being rewritten
+typedef struct {
+    size_t start;
+    size_t end;
+    RewriteKind kind;
+    int32_t exponent;
+    double constant;
+    RewriteValue polynomial;
+} RewriteEdit;
+
+struct ProgramLibrary {
+    char* map;
+    size_t size;
+    // Set when `map` is a heap copy from program_writer_load
+    int heap;
+    const ProgramFileHeader* header;
+    const ProgramEntry* entries;
+    const double* constants;
+    const ProgramSlot* slots;
+    const uint8_t* code;
+    const char* names;
+};
+
+static int buffer_append(Buffer* buffer, const void* data, size_t size) {
+    if (buffer->size + size > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+        while (capacity < buffer->size + size) {
+            capacity *= 2;
+        }
+        char* grown = (char*)realloc(buffer->data, capacity);
+        if (!grown) {
+            return 0;
+        }
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    return 1;
+}
+
+static uint32_t read_operand(const uint8_t* code) {
+    uint32_t operand;
+    memcpy(&operand, code, sizeof(operand));
+    return operand;
+}
+
+static void recorder_emit(ProgramRecorder* recorder, uint8_t op, uint32_t operand) {
+    if (!buffer_append(&recorder->code, &op, 1) || !buffer_append(&recorder->code, &operand, sizeof(operand))) {
+        recorder->failed = 1;
+    }
+}
+
+// Appends a NUL-terminated name and returns its offset in the names section
+static uint32_t recorder_add_name(ProgramRecorder* recorder, const char* name, size_t length) {
+    uint32_t offset = (uint32_t)recorder->names.size;
+    if (!buffer_append(&recorder->names, name, length) || !buffer_append(&recorder->names, "", 1)) {
+        recorder->failed = 1;
+    }
+    return offset;
+}
+
+void program_recorder_constant(ProgramRecorder* recorder, double value) {
+    uint32_t index = (uint32_t)(recorder->constants.size / sizeof(double));
+    if (!buffer_append(&recorder->constants, &value, sizeof(value))) {
+        recorder->failed = 1;
+        return;
+    }
+    recorder_emit(recorder, PROGRAM_OP_CONST, index);
+}
+
+void program_recorder_variable(ProgramRecorder* recorder, const char* name, size_t length) {
+    const ProgramSlot* slots = (const ProgramSlot*)recorder->slots.data;
+    size_t count = recorder->slots.size / sizeof(ProgramSlot);
+    size_t slot = recorder->slot_base;
+
+    while (slot < count && (slots[slot].name_length != length ||
+                            memcmp(recorder->names.data + slots[slot].name_offset, name, length) != 0)) {
+        slot++;
+    }
+    if (slot == count) {
+        ProgramSlot entry = {recorder_add_name(recorder, name, length), (uint32_t)length};
+        if (length > PROGRAM_MAX_NAME_LENGTH || !buffer_append(&recorder->slots, &entry, sizeof(entry))) {
+            recorder->failed = 1;
+            return;
+        }
+    }
+    recorder_emit(recorder, PROGRAM_OP_LOAD, (uint32_t)(slot - recorder->slot_base));
+}
+
+void program_recorder_operator(ProgramRecorder* recorder, char op) {
+    if (!buffer_append(&recorder->code, &op, 1)) {
+        recorder->failed = 1;
+    }
+}
+
+size_t program_recorder_branch(ProgramRecorder* recorder, uint8_t op) {
+    size_t branch = recorder->code.size;
+    recorder_emit(recorder, op, 0);
+    return branch;
+}
+
+static void recorder_set_target(ProgramRecorder* recorder, size_t branch, size_t target) {
+    uint32_t offset = (uint32_t)(target - (branch + 1 + sizeof(uint32_t)));
+    // A jump whose emission failed is not there to patch
+    if (branch + 1 + sizeof(uint32_t) <= recorder->code.size) {
+        memcpy(recorder->code.data + branch + 1, &offset, sizeof(offset));
+    }
+}
+
+void program_recorder_patch(ProgramRecorder* recorder, size_t branch) {
+    recorder_set_target(recorder, branch, recorder->code.size);
+}
+
+// Strength reduction on a freshly compiled program. One pass over the
+// postfix code tracks which subtrees are constants or polynomials and
+// records edits; a second pass re-emits the code with the edits applied.
+static int value_is_constant(const RewriteValue* value) {
+    return value->polynomial && value->variable < 0;
+}
+
+static void value_set_constant(RewriteValue* value, double constant) {
+    value->variable = -1;
+    value->degree = 0;
+    value->terms = 1;
+    value->coefficients[0] = constant;
+    // Zero terms would be dropped by Horner form, changing 0*inf and -0
+    value->polynomial = isfinite(constant) && constant != 0.0;
+}
+
+static void value_count_terms(RewriteValue* value) {
+    value->terms = 0;
+    value->degree = 0;
+    for (int k = 0; k <= POLYNOMIAL_MAX_DEGREE; k++) {
+        if (value->coefficients[k] != 0.0) {
+            value->terms++;
+            value->degree = k;
+        }
+    }
+}
+
+static int value_is_horner_candidate(const RewriteValue* value) {
+    return value->polynomial && value->variable >= 0 && value->degree >= 2 && value->terms >= 2;
+}
+
+// Folds `a op b` into `a` where the result is still a constant or a
+// polynomial; constants fold with the same operation the interpreter would
+// perform, so folding never changes a result.
+static void value_combine(RewriteValue* a, const RewriteValue* b, char op) {
+    if (!a->polynomial || !b->polynomial || (a->variable >= 0 && b->variable >= 0 && a->variable != b->variable)) {
+        a->polynomial = 0;
+        return;
+    }
+    if (value_is_constant(a) && value_is_constant(b) && op != '^') {
+        double x = a->coefficients[0], y = b->coefficients[0];
+        switch (op) {
+            case '+': value_set_constant(a, x + y); return;
+            case '-': value_set_constant(a, x - y); return;
+            case '*': value_set_constant(a, x * y); return;
+            case '/': value_set_constant(a, y != 0.0 ? x / y : NAN); return;
+            default: a->polynomial = 0; return;
+        }
+    }
+    int variable = a->variable >= 0 ? a->variable : b->variable;
+    double product[POLYNOMIAL_MAX_DEGREE + 1] = {0};
+
+    switch (op) {
+        case '+': case '-':
+            for (int k = 0; k <= POLYNOMIAL_MAX_DEGREE; k++) {
+                if (a->coefficients[k] != 0.0 && b->coefficients[k] != 0.0) {
+                    a->polynomial = 0;
+                    return;
+                }
+                if (b->coefficients[k] != 0.0) {
+                    a->coefficients[k] = op == '+' ? b->coefficients[k] : -b->coefficients[k];
+                }
+            }
+            break;
+        case '*':
+            // Only monomial times monomial, so no sum is ever distributed
+            if (a->terms != 1 || b->terms != 1 || a->degree + b->degree > POLYNOMIAL_MAX_DEGREE) {
+                a->polynomial = 0;
+                return;
+            }
+            product[a->degree + b->degree] = a->coefficients[a->degree] * b->coefficients[b->degree];
+            if (!isfinite(product[a->degree + b->degree]) || product[a->degree + b->degree] == 0.0) {
+                a->polynomial = 0;
+                return;
+            }
+            memcpy(a->coefficients, product, sizeof(product));
+            break;
+        case '^': {
+            // x^j raised to a positive integer constant
+            double exponent = b->coefficients[0];
+            if (!value_is_constant(b) || a->variable < 0 || a->terms != 1 || a->coefficients[a->degree] != 1.0 ||
+                exponent != floor(exponent) || exponent < 1.0 || exponent > PROGRAM_POWI_MAX ||
+                exponent * a->degree > POLYNOMIAL_MAX_DEGREE) {
+                a->polynomial = 0;
+                return;
+            }
+            product[a->degree * (int)exponent] = 1.0;
+            memcpy(a->coefficients, product, sizeof(product));
+            break;
+        }
+        default:
+            a->polynomial = 0;
+            return;
+    }
+    a->variable = variable;
+    value_count_terms(a);
+}
+
+static int rewrite_add_edit(Buffer* edits, const RewriteEdit* edit) {
+    return buffer_append(edits, edit, sizeof(*edit));
+}
+
+static int rewrite_add_horner(Buffer* edits, const RewriteValue* value, size_t end) {
+    if (!value_is_horner_candidate(value)) {
+        return 1;
+    }
+    RewriteEdit edit = {.start = value->start, .end = end, .kind = REWRITE_HORNER, .polynomial = *value};
+    return rewrite_add_edit(edits, &edit);
+}
+
+// Outer edits first; an edit starting inside one already applied is skipped
+static int compare_edits(const void* a, const void* b) {
+    const RewriteEdit* x = (const RewriteEdit*)a;
+    const RewriteEdit* y = (const RewriteEdit*)b;
+    if (x->start != y->start) {
+        return x->start < y->start ? -1 : 1;
+    }
+    return x->end > y->end ? -1 : x->end < y->end;
+}
+
+// x^n with one rounding per multiply, unlike pow
+static double powi(double x, int32_t n) {
+    uint32_t k = n < 0 ? -(uint32_t)n : (uint32_t)n;
+    double result = 1.0;
+    while (k > 0) {
+        if (k & 1) {
+            result *= x;
+        }
+        k >>= 1;
+        if (k > 0) {
+            x *= x;
+        }
+    }
+    return n < 0 ? 1.0 / result : result;
+}
+
+static int is_jump(uint8_t op) {
+    return op == PROGRAM_OP_JUMP_IF_FALSE || op == PROGRAM_OP_JUMP;
+}
+
+static size_t instruction_size(uint8_t op) {
+    return op == PROGRAM_OP_CONST || op == PROGRAM_OP_LOAD || op == PROGRAM_OP_POWI || is_jump(op)
+               ? 1 + sizeof(uint32_t) : 1;
+}
+
+// Target of the jump at `pc`
+static size_t jump_target(const uint8_t* code, size_t pc) {
+    return pc + 1 + sizeof(uint32_t) + read_operand(code + pc + 1);
+}
+
+// Each branch of a conditional is scanned like a separate subtree; the
+// joined value is no polynomial.
+static int rewrite_scan(const uint8_t* code, size_t length, const double* constants, size_t base, Buffer* edits) {
+    RewriteValue stack[MAX_STACK_SIZE];
+    RewriteBranch branches[MAX_STACK_SIZE];
+    int depth = 0, open = 0;
+    size_t end = 0;
+
+    for (size_t pc = 0;; pc = end) {
+        while (open > 0 && branches[open - 1].join == pc) {
+            RewriteBranch* branch = &branches[--open];
+            if (depth != branch->depth + 1 || !rewrite_add_horner(edits, &stack[depth - 1], pc)) {
+                return 0;
+            }
+            stack[depth - 1].start = branch->start;
+            stack[depth - 1].polynomial = 0;
+        }
+        if (pc >= length) {
+            break;
+        }
+        uint8_t op = code[pc];
+        end = pc + instruction_size(op);
+        if (op == PROGRAM_OP_JUMP_IF_FALSE) {
+            if (depth < 1 || open == MAX_STACK_SIZE || !rewrite_add_horner(edits, &stack[depth - 1], pc)) {
+                return 0;
+            }
+            RewriteBranch* branch = &branches[open++];
+            branch->start = stack[--depth].start;
+            branch->other = jump_target(code, pc);
+            branch->join = 0;
+            branch->depth = depth;
+            continue;
+        }
+        if (op == PROGRAM_OP_JUMP) {
+            // Only the shape the compiler emits: the first branch ends with
+            // a jump over the second
+            RewriteBranch* branch = open > 0 ? &branches[open - 1] : NULL;
+            if (!branch || branch->join != 0 || branch->other != end || depth != branch->depth + 1 ||
+                !rewrite_add_horner(edits, &stack[depth - 1], pc)) {
+                return 0;
+            }
+            branch->join = jump_target(code, pc);
+            depth--;
+            continue;
+        }
+        if (op == PROGRAM_OP_CONST || op == PROGRAM_OP_LOAD) {
+            if (depth == MAX_STACK_SIZE) {
+                return 0;
+            }
+            RewriteValue* value = &stack[depth++];
+            memset(value, 0, sizeof(*value));
+            value->start = pc;
+            if (op == PROGRAM_OP_CONST) {
+                value_set_constant(value, constants[read_operand(code + pc + 1) - base]);
+            } else {
+                value->polynomial = 1;
+                value->variable = (int32_t)read_operand(code + pc + 1);
+                value->coefficients[1] = 1.0;
+                value_count_terms(value);
+            }
+            continue;
+        }
+        int arity = calculator_operator_arity((char)op);
+        if (arity < 0 || depth < arity) {
+            return 0;
+        }
+        if (arity == 0) {
+            // rand() and randn()
+            if (depth == MAX_STACK_SIZE) {
+                return 0;
+            }
+            stack[depth].start = pc;
+            stack[depth++].polynomial = 0;
+            continue;
+        }
+        RewriteValue* a = &stack[depth - arity];
+        if (arity == 1) {
+            if (op == 'N' && a->polynomial) {
+                for (int k = 0; k <= POLYNOMIAL_MAX_DEGREE; k++) {
+                    a->coefficients[k] = -a->coefficients[k];
+                }
+            } else if (!rewrite_add_horner(edits, a, pc)) {
+                return 0;
+            } else {
+                a->polynomial = 0;
+            }
+            continue;
+        }
+        if (arity == 3) {
+            // powmod(b, e, m): each operand is rewritten on its own
+            if (!rewrite_add_horner(edits, a, a[1].start) || !rewrite_add_horner(edits, &a[1], a[2].start) ||
+                !rewrite_add_horner(edits, &a[2], pc)) {
+                return 0;
+            }
+            a->polynomial = 0;
+            depth -= 2;
+            continue;
+        }
+
+        RewriteValue* b = &stack[depth - 1];
+        double constant = b->coefficients[0];
+        RewriteEdit edit = {.start = b->start, .end = end};
+        if (op == '^' && value_is_constant(b) && constant == floor(constant) && fabs(constant) <= PROGRAM_POWI_MAX) {
+            edit.kind = REWRITE_POWI;
+            edit.exponent = (int32_t)constant;
+            if (!rewrite_add_edit(edits, &edit)) {
+                return 0;
+            }
+        } else if (op == '/' && value_is_constant(b)) {
+            // Exact only when c is a power of two whose reciprocal is a double
+            int exponent;
+            if (fabs(frexp(constant, &exponent)) == 0.5 && isfinite(1.0 / constant)) {
+                edit.kind = REWRITE_RECIPROCAL;
+                edit.constant = 1.0 / constant;
+                if (!rewrite_add_edit(edits, &edit)) {
+                    return 0;
+                }
+            }
+        }
+
+        RewriteValue left = *a;
+        value_combine(a, b, (char)op);
+        if (!a->polynomial && (!rewrite_add_horner(edits, &left, b->start) || !rewrite_add_horner(edits, b, pc))) {
+            return 0;
+        }
+        depth--;
+    }
+    if (depth != 1 || open != 0 || !rewrite_add_horner(edits, &stack[0], length)) {
+        return 0;
+    }
+    if (edits->size > 0) {
+        qsort(edits->data, edits->size / sizeof(RewriteEdit), sizeof(RewriteEdit), compare_edits);
+    }
+    return 1;
+}
+
+// x^power, in factors of at most PROGRAM_POWI_MAX
+static void emit_power(ProgramRecorder* recorder, int32_t variable, int power) {
+    for (int factors = 0; power > 0; factors++) {
+        int factor = power < PROGRAM_POWI_MAX ? power : PROGRAM_POWI_MAX;
+        recorder_emit(recorder, PROGRAM_OP_LOAD, (uint32_t)variable);
+        if (factor > 1) {
+            recorder_emit(recorder, PROGRAM_OP_POWI, (uint32_t)factor);
+        }
+        if (factors > 0) {
+            program_recorder_operator(recorder, '*');
+        }
+        power -= factor;
+    }
+}
+
+// c_n x^n + ... + c_0 as (((c_n x + c_n-1) x + ...) x + c_0, skipping zero
+// coefficients by multiplying with a power of x instead
+static void emit_horner(ProgramRecorder* recorder, const RewriteValue* polynomial) {
+    const double* c = polynomial->coefficients;
+    int k = polynomial->degree, folded = 0;
+
+    if (c[k] == 1.0) {
+        emit_power(recorder, polynomial->variable, 1);
+        folded = 1;
+    } else {
+        program_recorder_constant(recorder, c[k]);
+    }
+    while (k > 0) {
+        int next = k - 1;
+        while (next > 0 && c[next] == 0.0) {
+            next--;
+        }
+        if (k - next - folded > 0) {
+            emit_power(recorder, polynomial->variable, k - next - folded);
+            program_recorder_operator(recorder, '*');
+        }
+        folded = 0;
+        if (c[next] != 0.0) {
+            program_recorder_constant(recorder, c[next]);
+            program_recorder_operator(recorder, '+');
+        }
+        k = next;
+    }
+}
+
+// Rewrites the program recorded since the marks in place
+static int program_rewrite(ProgramRecorder* recorder, size_t code_mark, size_t constants_mark) {
+    size_t length = recorder->code.size - code_mark;
+    size_t constants_size = recorder->constants.size - constants_mark;
+    uint8_t* code = (uint8_t*)malloc(length);
+    // The program's own constants are the ones after the mark
+    size_t base = constants_mark / sizeof(double);
+    double* constants = (double*)malloc(constants_size + sizeof(double));
+    // New position of each old instruction, for the jump targets
+    size_t* moved = (size_t*)malloc((length + 1) * sizeof(size_t));
+    Buffer edits = {0};
+    Buffer jumps = {0};
+    int ok = code && constants && moved;
+
+    if (ok) {
+        memcpy(code, recorder->code.data + code_mark, length);
+        if (constants_size > 0) {
+            memcpy(constants, recorder->constants.data + constants_mark, constants_size);
+        }
+    }
+    // A program the scan cannot follow is kept as compiled
+    if (ok && rewrite_scan(code, length, constants, base, &edits) && edits.size > 0) {
+        const RewriteEdit* edit = (const RewriteEdit*)edits.data;
+        const RewriteEdit* last = edit + edits.size / sizeof(RewriteEdit);
+        recorder->code.size = code_mark;
+        recorder->constants.size = constants_mark;
+
+        for (size_t pc = 0; pc < length;) {
+            moved[pc] = recorder->code.size;
+            while (edit < last && edit->start < pc) {
+                edit++;
+            }
+            if (edit < last && edit->start == pc) {
+                if (edit->kind == REWRITE_HORNER) {
+                    emit_horner(recorder, &edit->polynomial);
+                } else if (edit->kind == REWRITE_POWI) {
+                    recorder_emit(recorder, PROGRAM_OP_POWI, (uint32_t)edit->exponent);
+                } else {
+                    program_recorder_constant(recorder, edit->constant);
+                    program_recorder_operator(recorder, '*');
+                }
+                pc = edit->end;
+                continue;
+            }
+            uint8_t op = code[pc];
+            if (op == PROGRAM_OP_CONST) {
+                program_recorder_constant(recorder, constants[read_operand(code + pc + 1) - base]);
+            } else if (op == PROGRAM_OP_LOAD) {
+                recorder_emit(recorder, op, read_operand(code + pc + 1));
+            } else if (is_jump(op)) {
+                RewriteJump jump = {program_recorder_branch(recorder, op), jump_target(code, pc)};
+                if (!buffer_append(&jumps, &jump, sizeof(jump))) {
+                    ok = 0;
+                }
+            } else {
+                program_recorder_operator(recorder, (char)op);
+            }
+            pc += instruction_size(op);
+        }
+        moved[length] = recorder->code.size;
+        // Edits never span a branch, so every target is an instruction kept
+        const RewriteJump* jump = (const RewriteJump*)jumps.data;
+        for (size_t i = 0; i < jumps.size / sizeof(RewriteJump); i++) {
+            recorder_set_target(recorder, jump[i].branch, moved[jump[i].target]);
+        }
+    }
+    free(code);
+    free(constants);
+    free(moved);
+    free(edits.data);
+    free(jumps.data);
+    return ok;
+}
+
+ProgramWriter* program_writer_new(void) {
+    ProgramWriter* writer = (ProgramWriter*)calloc(1, sizeof(ProgramWriter));
+    if (writer) {
+        writer->calc = calculator_new();
+        if (!writer->calc) {
+            free(writer);
+            return NULL;
+        }
+        writer->rewrite = 1;
+    }
+    return writer;
+}
+
+void program_writer_free(ProgramWriter* writer) {
+    if (writer) {
+        free(writer->recorder.code.data);
+        free(writer->recorder.constants.data);
+        free(writer->recorder.slots.data);
+        free(writer->recorder.names.data);
+        free(writer->entries.data);
+        calculator_free(writer->calc);
+        free(writer);
+    }
+}
+
+void program_writer_set_rewrite(ProgramWriter* writer, int enabled) {
+    writer->rewrite = enabled;
+}
+
+ErrorType program_writer_add(ProgramWriter* writer, const char* name, const char* expression) {
+    ProgramRecorder* recorder = &writer->recorder;
+    size_t code_mark = recorder->code.size;
+    size_t constants_mark = recorder->constants.size;
+    size_t slots_mark = recorder->slots.size;
+    size_t names_mark = recorder->names.size;
+    size_t name_length = strlen(name);
+
+    if (name_length == 0 || name_length > PROGRAM_MAX_NAME_LENGTH) {
+        return ERROR_SYNTAX;
+    }
+    recorder->slot_base = slots_mark / sizeof(ProgramSlot);
+    recorder->failed = 0;
+    ErrorType error = calculator_compile(writer->calc, expression, recorder);
+    if (error == ERROR_NONE && !recorder->failed && writer->rewrite &&
+        !program_rewrite(recorder, code_mark, constants_mark)) {
+        recorder->failed = 1;
+    }
+
+    ProgramEntry entry;
+    entry.name_offset = recorder_add_name(recorder, name, name_length);
+    entry.name_length = (uint32_t)name_length;
+    entry.code_offset = (uint32_t)code_mark;
+    entry.code_length = (uint32_t)(recorder->code.size - code_mark);
+    entry.slot_base = (uint32_t)recorder->slot_base;
+    entry.slot_count = (uint32_t)((recorder->slots.size - slots_mark) / sizeof(ProgramSlot));
+
+    if (error == ERROR_NONE && (recorder->failed || recorder->code.size > UINT32_MAX ||
+                                recorder->constants.size / sizeof(double) > UINT32_MAX ||
+                                recorder->names.size > UINT32_MAX ||
+                                !buffer_append(&writer->entries, &entry, sizeof(entry)))) {
+        error = ERROR_OUT_OF_MEMORY;
+    }
+    if (error != ERROR_NONE) {
+        recorder->code.size = code_mark;
+        recorder->constants.size = constants_mark;
+        recorder->slots.size = slots_mark;
+        recorder->names.size = names_mark;
+    }
+    return error;
+}
+
+static int compare_entries(const void* a, const void* b, void* names) {
+    return strcmp((const char*)names + ((const ProgramEntry*)a)->name_offset,
+                  (const char*)names + ((const ProgramEntry*)b)->name_offset);
+}
+
+static size_t align_up(size_t offset, size_t alignment) {
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+static int write_section(FILE* file, size_t* written, size_t offset, const void* data, size_t size) {
+    static const char padding[8] = {0};
+    if (offset - *written > sizeof(padding) || fwrite(padding, 1, offset - *written, file) != offset - *written) {
+        return 0;
+    }
+    if (size > 0 && fwrite(data, 1, size, file) != size) {
+        return 0;
+    }
+    *written = offset + size;
+    return 1;
+}
+
+static int write_library(ProgramWriter* writer, FILE* file) {
+    ProgramRecorder* recorder = &writer->recorder;
+    ProgramEntry* entries = (ProgramEntry*)writer->entries.data;
+    size_t count = writer->entries.size / sizeof(ProgramEntry);
+
+    // Sorted so the loader can look programs up by binary search
+    if (count > 0) {
+        qsort_r(entries, count, sizeof(ProgramEntry), compare_entries, recorder->names.data);
+    }
+    for (size_t i = 1; i < count; i++) {
+        if (compare_entries(&entries[i - 1], &entries[i], recorder->names.data) == 0) {
+            return 0;
+        }
+    }
+
+    ProgramFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PROGRAM_MAGIC, sizeof(PROGRAM_MAGIC));
+    header.version = PROGRAM_FORMAT_VERSION;
+    header.program_count = (uint32_t)count;
+    header.constant_count = (uint32_t)(recorder->constants.size / sizeof(double));
+    header.slot_count = (uint32_t)(recorder->slots.size / sizeof(ProgramSlot));
+    header.code_size = (uint32_t)recorder->code.size;
+    header.names_size = (uint32_t)recorder->names.size;
+    header.directory_offset = sizeof(header);
+    header.constants_offset = align_up(header.directory_offset + writer->entries.size, sizeof(double));
+    header.slots_offset = header.constants_offset + recorder->constants.size;
+    header.code_offset = header.slots_offset + recorder->slots.size;
+    header.names_offset = header.code_offset + recorder->code.size;
+
+    size_t written = 0;
+    return write_section(file, &written, 0, &header, sizeof(header)) &&
+           write_section(file, &written, header.directory_offset, entries, writer->entries.size) &&
+           write_section(file, &written, header.constants_offset, recorder->constants.data, recorder->constants.size) &&
+           write_section(file, &written, header.slots_offset, recorder->slots.data, recorder->slots.size) &&
+           write_section(file, &written, header.code_offset, recorder->code.data, recorder->code.size) &&
+           write_section(file, &written, header.names_offset, recorder->names.data, recorder->names.size);
+}
+
+int program_writer_save(ProgramWriter* writer, const char* path) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return 0;
+    }
+    int ok = write_library(writer, file);
+    return fclose(file) == 0 && ok;
+}
+
+// True if [offset, offset + count * size) lies inside a file of `file_size` bytes
+static int section_fits(uint64_t offset, uint64_t count, uint64_t size, size_t file_size) {
+    return offset <= file_size && count <= (file_size - offset) / size;
+}
+
+static int name_valid(const ProgramLibrary* library, uint32_t offset, uint32_t length) {
+    uint32_t names_size = library->header->names_size;
+    return offset < names_size && length < names_size - offset &&
+           library->names[offset + length] == '\0' && memchr(library->names + offset, '\0', length) == NULL;
+}
+
+// Simulates the stack of one program: every operand index must be in range,
+// every byte a known code, and the program must leave exactly one value
+// without going past the evaluator's stack depth. Jumps go forward to an
+// instruction boundary, every path must reach it with the same depth, and
+// no code may be unreachable. `landing` has one zeroed entry per code byte
+// and one for the end, and receives the depth + 1 at each jump target.
+static int verify_code(const ProgramLibrary* library, const ProgramEntry* entry, int* landing) {
+    const uint8_t* code = library->code + entry->code_offset;
+    uint32_t length = entry->code_length;
+    int depth = 0, reachable = 1;
+
+    for (uint32_t pc = 0;;) {
+        if (landing[pc] > 0) {
+            if (reachable && depth != landing[pc] - 1) {
+                return 0;
+            }
+            depth = landing[pc] - 1;
+            reachable = 1;
+        }
+        if (pc == length) {
+            break;
+        }
+        if (!reachable) {
+            return 0;
+        }
+        uint8_t op = code[pc];
+        size_t size = instruction_size(op);
+        if (length - pc < size) {
+            return 0;
+        }
+        for (size_t k = 1; k < size; k++) {
+            if (landing[pc + k] > 0) {
+                return 0;
+            }
+        }
+        if (is_jump(op)) {
+            size_t target = jump_target(code, pc);
+            if (op == PROGRAM_OP_JUMP_IF_FALSE && --depth < 0) {
+                return 0;
+            }
+            if (target > length || (landing[target] > 0 && landing[target] != depth + 1)) {
+                return 0;
+            }
+            landing[target] = depth + 1;
+            reachable = op == PROGRAM_OP_JUMP_IF_FALSE;
+        } else if (op == PROGRAM_OP_CONST || op == PROGRAM_OP_LOAD) {
+            uint32_t operand = read_operand(code + pc + 1);
+            if (operand >= (op == PROGRAM_OP_CONST ? library->header->constant_count : entry->slot_count)) {
+                return 0;
+            }
+            if (++depth > MAX_STACK_SIZE) {
+                return 0;
+            }
+        } else if (op == PROGRAM_OP_POWI) {
+            int32_t exponent = (int32_t)read_operand(code + pc + 1);
+            if (depth < 1 || exponent < -PROGRAM_POWI_MAX || exponent > PROGRAM_POWI_MAX) {
+                return 0;
+            }
+        } else {
+            int arity = calculator_operator_arity((char)op);
+            if (arity < 0 || depth < arity) {
+                return 0;
+            }
+            depth -= arity - 1;
+            if (depth > MAX_STACK_SIZE) {
+                return 0;
+            }
+        }
+        pc += (uint32_t)size;
+    }
+    return depth == 1;
+}
+
+static int verify_program(const ProgramLibrary* library, const ProgramEntry* entry) {
+    int* landing = (int*)calloc((size_t)entry->code_length + 1, sizeof(int));
+    int ok = landing && verify_code(library, entry, landing);
+    free(landing);
+    return ok;
+}
+
+static int library_validate(ProgramLibrary* library) {
+    const ProgramFileHeader* header = library->header;
+    size_t size = library->size;
+
+    if (size < sizeof(ProgramFileHeader) || memcmp(header->magic, PROGRAM_MAGIC, sizeof(PROGRAM_MAGIC)) != 0 ||
+        header->version != PROGRAM_FORMAT_VERSION) {
+        return 0;
+    }
+    if (!section_fits(header->directory_offset, header->program_count, sizeof(ProgramEntry), size) ||
+        !section_fits(header->constants_offset, header->constant_count, sizeof(double), size) ||
+        !section_fits(header->slots_offset, header->slot_count, sizeof(ProgramSlot), size) ||
+        !section_fits(header->code_offset, header->code_size, 1, size) ||
+        !section_fits(header->names_offset, header->names_size, 1, size) ||
+        header->directory_offset % sizeof(uint32_t) != 0 || header->constants_offset % sizeof(double) != 0 ||
+        header->slots_offset % sizeof(uint32_t) != 0) {
+        return 0;
+    }
+
+    library->entries = (const ProgramEntry*)(library->map + header->directory_offset);
+    library->constants = (const double*)(library->map + header->constants_offset);
+    library->slots = (const ProgramSlot*)(library->map + header->slots_offset);
+    library->code = (const uint8_t*)(library->map + header->code_offset);
+    library->names = library->map + header->names_offset;
+
+    for (uint32_t i = 0; i < header->slot_count; i++) {
+        if (!name_valid(library, library->slots[i].name_offset, library->slots[i].name_length)) {
+            return 0;
+        }
+    }
+    for (uint32_t i = 0; i < header->program_count; i++) {
+        const ProgramEntry* entry = &library->entries[i];
+        if (!name_valid(library, entry->name_offset, entry->name_length) ||
+            entry->code_offset > header->code_size || entry->code_length > header->code_size - entry->code_offset ||
+            entry->slot_base > header->slot_count || entry->slot_count > header->slot_count - entry->slot_base) {
+            return 0;
+        }
+        if (i > 0 && strcmp(library->names + library->entries[i - 1].name_offset,
+                            library->names + entry->name_offset) >= 0) {
+            return 0;
+        }
+        if (!verify_program(library, entry)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+ProgramLibrary* program_library_open(const char* path) {
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    ProgramLibrary* library = (ProgramLibrary*)calloc(1, sizeof(ProgramLibrary));
+    if (!library || fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(ProgramFileHeader)) {
+        free(library);
+        close(fd);
+        return NULL;
+    }
+
+    library->size = (size_t)st.st_size;
+    void* map = mmap(NULL, library->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        free(library);
+        return NULL;
+    }
+    library->map = (char*)map;
+    library->header = (const ProgramFileHeader*)map;
+
+    if (!library_validate(library)) {
+        program_library_close(library);
+        return NULL;
+    }
+    return library;
+}
+
+ProgramLibrary* program_writer_load(ProgramWriter* writer) {
+    char* data = NULL;
+    size_t size = 0;
+    FILE* file = open_memstream(&data, &size);
+    if (!file) {
+        return NULL;
+    }
+    int ok = write_library(writer, file);
+    if (fclose(file) != 0 || !ok) {
+        free(data);
+        return NULL;
+    }
+    ProgramLibrary* library = (ProgramLibrary*)calloc(1, sizeof(ProgramLibrary));
+    if (!library) {
+        free(data);
+        return NULL;
+    }
+    library->map = data;
+    library->size = size;
+    library->heap = 1;
+    library->header = (const ProgramFileHeader*)data;
+    if (size < sizeof(ProgramFileHeader) || !library_validate(library)) {
+        program_library_close(library);
+        return NULL;
+    }
+    return library;
+}
+
+void program_library_close(ProgramLibrary* library) {
+    if (library) {
+        if (library->heap) {
+            free(library->map);
+        } else {
+            munmap(library->map, library->size);
+        }
+        free(library);
+    }
+}
+
+size_t program_library_count(const ProgramLibrary* library) {
+    return library->header->program_count;
+}
+
+long program_library_find(const ProgramLibrary* library, const char* name) {
+    size_t low = 0, high = library->header->program_count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        int order = strcmp(library->names + library->entries[mid].name_offset, name);
+        if (order == 0) {
+            return (long)mid;
+        }
+        if (order < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return -1;
+}
+
+const char* program_name(const ProgramLibrary* library, size_t index) {
+    return library->names + library->entries[index].name_offset;
+}
+
+size_t program_variable_count(const ProgramLibrary* library, size_t index) {
+    return library->entries[index].slot_count;
+}
+
+const char* program_variable_name(const ProgramLibrary* library, size_t index, size_t slot) {
+    return library->names + library->slots[library->entries[index].slot_base + slot].name_offset;
+}
+
+ErrorType program_run(const ProgramLibrary* library, size_t index, Calculator* calc,
+                      const double* variables, double* value) {
+    const ProgramEntry* entry = &library->entries[index];
+    const uint8_t* code = library->code + entry->code_offset;
+    const uint8_t* end = code + entry->code_length;
+
+    calc->numbers.top = -1;
+    calc->error = ERROR_NONE;
+    calc->matrix_count = 0;
+    calc->matrix_result = NULL;
+    calc->conditional_count = 0;
+    calc->skipping = 0;
+    calculator_start_budget(calc);
+
+    // Verified at open: operands are in range, jumps land on instructions and
+    // the stack cannot overflow
+    while (code < end) {
+        uint8_t op = *code;
+        if (op == PROGRAM_OP_CONST) {
+            ns_push(&calc->numbers, library->constants[read_operand(code + 1)]);
+            code += 1 + sizeof(uint32_t);
+        } else if (op == PROGRAM_OP_LOAD) {
+            ns_push(&calc->numbers, variables[read_operand(code + 1)]);
+            code += 1 + sizeof(uint32_t);
+        } else if (op == PROGRAM_OP_POWI) {
+            if (calculator_charge(calc, 1)) {
+                double* top = &calc->numbers.items[calc->numbers.top];
+                *top = powi(*top, (int32_t)read_operand(code + 1));
+            }
+            code += 1 + sizeof(uint32_t);
+        } else if (op == PROGRAM_OP_JUMP_IF_FALSE) {
+            int taken = calc->numbers.items[calc->numbers.top--] == 0.0;
+            code += 1 + sizeof(uint32_t) + (taken ? read_operand(code + 1) : 0);
+        } else if (op == PROGRAM_OP_JUMP) {
+            code += 1 + sizeof(uint32_t) + read_operand(code + 1);
+        } else {
+            apply_operator(calc, (char)op);
+            code++;
+        }
+    }
+    if (calc->error != ERROR_NONE) {
+        return calc->error;
+    }
+    *value = calc->numbers.items[0];
+    return ERROR_NONE;
+}
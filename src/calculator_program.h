@@ -0,0 +1,100 @@
+#ifndef CALCULATOR_PROGRAM_H
+#define CALCULATOR_PROGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "calculator_logic.h"
+
+// Precompiled expressions. A program is the postfix form the evaluator
+// produces while parsing: constants, variable loads and the same single-char
+// operator codes apply_operator takes. Variables are written `$name` and are
+// numbered per program in order of first use.
+//
+// A library file holds many named programs:
+//
+//   header      magic "MEPROG", format version, section offsets and sizes
+//   directory   one ProgramEntry per program, sorted by name
+//   constants   double constant pool, 8-byte aligned
+//   slots       variable slot table: the name of each program's variables
+//   code        bytecode; PROGRAM_OP_CONST and PROGRAM_OP_LOAD are followed
+//               by a 32-bit index, PROGRAM_OP_POWI by a signed 32-bit
+//               exponent, the jumps by a 32-bit forward offset, every other
+//               byte is an operator code
+//   names       NUL-terminated program and variable names
+//
+// Files are little-endian; on other hosts the version check fails.
+#define PROGRAM_FORMAT_VERSION 3
+#define PROGRAM_OP_CONST 0x01
+#define PROGRAM_OP_LOAD 0x02
+// Raises the top of the stack to an integer power of at most
+// PROGRAM_POWI_MAX in magnitude by repeated squaring
+#define PROGRAM_OP_POWI 0x03
+#define PROGRAM_POWI_MAX 16
+// Conditionals and && || skip the code of the branch not taken. The target
+// is the end of the jump instruction plus its offset; JUMP_IF_FALSE pops the
+// condition and jumps if it is zero.
+#define PROGRAM_OP_JUMP_IF_FALSE 0x04
+#define PROGRAM_OP_JUMP 0x05
+
+// Collects compiled programs and writes them out as a library file.
+typedef struct ProgramWriter ProgramWriter;
+
+ProgramWriter* program_writer_new(void);
+void program_writer_free(ProgramWriter* writer);
+// Compiles `expression` and adds it under `name`. Matrices, complex numbers
+// and the matrix functions cannot be compiled and give ERROR_SYNTAX.
+ErrorType program_writer_add(ProgramWriter* writer, const char* name, const char* expression);
+// Strength reduction of the programs added afterwards; on by default.
+//   - `a^n` with a constant integer |n| <= PROGRAM_POWI_MAX becomes
+//     PROGRAM_OP_POWI. n = 2 matches pow exactly; otherwise every multiply
+//     rounds, so the result can be up to about |n| ulp from pow, and for
+//     n < 0 an overflowing a^|n| gives 0 where pow may give a subnormal.
+//   - A sum of monomials in one variable of degree 2 to 32, such as
+//     `3$x^4+2$x^3-$x+7`, is evaluated in Horner form. The terms are added
+//     in a different order, so the result can differ by a few ulp of the
+//     largest term, and an intermediate can overflow where the original
+//     did not or the other way round.
+//   - `a/c` with c a power of two becomes `a*(1/c)`, which is exact.
+void program_writer_set_rewrite(ProgramWriter* writer, int enabled);
+// Returns 0 on I/O failure or if two programs share a name.
+int program_writer_save(ProgramWriter* writer, const char* path);
+
+// A library file mapped read-only. Opening validates every section and
+// verifies each program's bytecode (operand indices, operator codes, stack
+// depth), so a truncated, corrupt or hostile file is rejected up front and
+// programs then run straight from the mapping without further checks.
+typedef struct ProgramLibrary ProgramLibrary;
+
+// Returns NULL if the file is missing or fails validation.
+ProgramLibrary* program_library_open(const char* path);
+// The library program_writer_save would write, built in memory instead, for
+// programs compiled at run time. It does not refer to the writer, which can
+// be freed or keep adding programs. Returns NULL if out of memory or if two
+// programs share a name.
+ProgramLibrary* program_writer_load(ProgramWriter* writer);
+void program_library_close(ProgramLibrary* library);
+
+size_t program_library_count(const ProgramLibrary* library);
+// Binary search over the sorted directory; returns -1 if there is no such program.
+long program_library_find(const ProgramLibrary* library, const char* name);
+// Names point into the mapping and stay valid until the library is closed.
+const char* program_name(const ProgramLibrary* library, size_t index);
+size_t program_variable_count(const ProgramLibrary* library, size_t index);
+const char* program_variable_name(const ProgramLibrary* library, size_t index, size_t slot);
+
+// Runs program `index` with `variables[slot]` as the value of each variable,
+// using the angle mode of `calc`, which must be in real mode.
+ErrorType program_run(const ProgramLibrary* library, size_t index, Calculator* calc,
+                      const double* variables, double* value);
+
+// Hooks the evaluator calls while compiling; see calculator_compile.
+void program_recorder_constant(ProgramRecorder* recorder, double value);
+void program_recorder_variable(ProgramRecorder* recorder, const char* name, size_t length);
+void program_recorder_operator(ProgramRecorder* recorder, char op);
+// Emits a jump whose target is set later by program_recorder_patch, and
+// returns its position.
+size_t program_recorder_branch(ProgramRecorder* recorder, uint8_t op);
+// Points the jump at `branch` to the end of the code recorded so far.
+void program_recorder_patch(ProgramRecorder* recorder, size_t branch);
+
+#endif
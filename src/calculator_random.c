@@ -0,0 +1,372 @@
+#define _GNU_SOURCE
+#include "calculator_random.h"
+#include "calculator_vecmath.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+// Values generated per refill of the one-at-a-time blocks
+#define RANDOM_BLOCK 256
+// Poisson means below this use inversion, larger ones PTRS rejection
+#define RANDOM_POISSON_INVERSION_LIMIT 10.0
+#define RANDOM_GOLDEN_GAMMA 0x9e3779b97f4a7c15ULL
+// Bits of 1.0; OR-ing 52 random mantissa bits in gives [1, 2)
+#define RANDOM_ONE_BITS 0x3ff0000000000000ULL
+
+typedef struct {
+    double values[RANDOM_BLOCK];
+    size_t next;
+} RandomBlock;
+
+struct RandomGenerator {
+    // state[word][lane]: lane-major so each word loads as one vector
+    uint64_t state[4][RANDOM_LANES];
+    uint64_t seed;
+    uint64_t stream;
+    RandomBlock uniforms;
+    RandomBlock normals;
+    RandomBlock exponentials;
+};
+
+typedef void (*RandomKernel)(uint64_t state[4][RANDOM_LANES], double* out, size_t steps);
+
+static pthread_once_t random_once = PTHREAD_ONCE_INIT;
+static RandomIsa random_best = RANDOM_ISA_SCALAR;
+static RandomIsa random_active = RANDOM_ISA_SCALAR;
+static atomic_ulong random_clock_calls;
+
+static uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+// SplitMix64 finalizer: a bijection that spreads every input bit
+static uint64_t mix64(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static uint64_t xoshiro_next(uint64_t s[4]) {
+    uint64_t result = rotl(s[0] + s[3], 23) + s[0];
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+}
+
+// Advances `s` by 2^128 steps
+static void xoshiro_jump(uint64_t s[4]) {
+    static const uint64_t jump[4] = {0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+                                     0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL};
+    uint64_t t[4] = {0, 0, 0, 0};
+    for (int i = 0; i < 4; i++) {
+        for (int b = 0; b < 64; b++) {
+            if (jump[i] & (1ULL << b)) {
+                t[0] ^= s[0];
+                t[1] ^= s[1];
+                t[2] ^= s[2];
+                t[3] ^= s[3];
+            }
+            xoshiro_next(s);
+        }
+    }
+    memcpy(s, t, sizeof(t));
+}
+
+static double uniform_from_bits(uint64_t bits) {
+    uint64_t one = (bits >> 12) | RANDOM_ONE_BITS;
+    double value;
+    memcpy(&value, &one, sizeof(value));
+    return value - 1.0;
+}
+
+// Reference kernel: RANDOM_LANES uniforms per step, lane by lane
+static void random_kernel_scalar(uint64_t state[4][RANDOM_LANES], double* out, size_t steps) {
+    for (size_t i = 0; i < steps; i++) {
+        for (int lane = 0; lane < RANDOM_LANES; lane++) {
+            uint64_t s[4] = {state[0][lane], state[1][lane], state[2][lane], state[3][lane]};
+            out[i * RANDOM_LANES + lane] = uniform_from_bits(xoshiro_next(s));
+            for (int word = 0; word < 4; word++) {
+                state[word][lane] = s[word];
+            }
+        }
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+typedef uint64_t v2du __attribute__((vector_size(16)));
+typedef uint64_t v4du __attribute__((vector_size(32)));
+typedef double v2d __attribute__((vector_size(16)));
+typedef double v4d __attribute__((vector_size(32)));
+
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#define RANDOM_WIDTH 2
+#define RW v2du
+#define RD v2d
+#define RK(name) name##_sse2
+#include "calculator_random_kernels.h"
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#define RANDOM_WIDTH 4
+#define RW v4du
+#define RD v4d
+#define RK(name) name##_avx2
+#include "calculator_random_kernels.h"
+#pragma GCC pop_options
+#endif
+
+static void random_init(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        random_best = RANDOM_ISA_AVX2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        random_best = RANDOM_ISA_SSE2;
+    }
+#endif
+    random_active = random_best;
+}
+
+RandomIsa random_best_isa(void) {
+    pthread_once(&random_once, random_init);
+    return random_best;
+}
+
+RandomIsa random_get_isa(void) {
+    pthread_once(&random_once, random_init);
+    return random_active;
+}
+
+int random_set_isa(RandomIsa isa) {
+    pthread_once(&random_once, random_init);
+    if (isa > random_best) {
+        return 0;
+    }
+    random_active = isa;
+    return 1;
+}
+
+const char* random_isa_name(RandomIsa isa) {
+    switch (isa) {
+        case RANDOM_ISA_SCALAR: return "scalar";
+        case RANDOM_ISA_SSE2: return "sse2";
+        case RANDOM_ISA_AVX2: return "avx2";
+    }
+    return "unknown";
+}
+
+static RandomKernel random_kernel(void) {
+    switch (random_get_isa()) {
+#if defined(__x86_64__) || defined(__i386__)
+        case RANDOM_ISA_AVX2: return random_kernel_avx2;
+        case RANDOM_ISA_SSE2: return random_kernel_sse2;
+#endif
+        default: return random_kernel_scalar;
+    }
+}
+
+void random_seed(RandomGenerator* generator, uint64_t seed, uint64_t stream) {
+    uint64_t x = seed ^ mix64(stream + RANDOM_GOLDEN_GAMMA);
+    uint64_t s[4];
+    for (int word = 0; word < 4; word++) {
+        x += RANDOM_GOLDEN_GAMMA;
+        s[word] = mix64(x);
+    }
+    // All-zero is the one state xoshiro never leaves
+    if ((s[0] | s[1] | s[2] | s[3]) == 0) {
+        s[0] = RANDOM_GOLDEN_GAMMA;
+    }
+    for (int lane = 0; lane < RANDOM_LANES; lane++) {
+        if (lane > 0) {
+            xoshiro_jump(s);
+        }
+        for (int word = 0; word < 4; word++) {
+            generator->state[word][lane] = s[word];
+        }
+    }
+    generator->seed = seed;
+    generator->stream = stream;
+    generator->uniforms.next = RANDOM_BLOCK;
+    generator->normals.next = RANDOM_BLOCK;
+    generator->exponentials.next = RANDOM_BLOCK;
+}
+
+RandomGenerator* random_generator_new(uint64_t seed, uint64_t stream) {
+    RandomGenerator* generator = (RandomGenerator*)malloc(sizeof(RandomGenerator));
+    if (generator) {
+        random_seed(generator, seed, stream);
+    }
+    return generator;
+}
+
+void random_generator_free(RandomGenerator* generator) {
+    free(generator);
+}
+
+uint64_t random_get_seed(const RandomGenerator* generator) {
+    return generator->seed;
+}
+
+uint64_t random_get_stream(const RandomGenerator* generator) {
+    return generator->stream;
+}
+
+uint64_t random_clock_seed(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t calls = atomic_fetch_add(&random_clock_calls, 1);
+    return mix64((uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec) ^
+           mix64(((uint64_t)getpid() << 32) + calls);
+}
+
+uint64_t random_substream(uint64_t stream, uint64_t index) {
+    return mix64(stream ^ mix64(index + RANDOM_GOLDEN_GAMMA));
+}
+
+void random_fill_uniform(RandomGenerator* generator, double* out, size_t count) {
+    RandomKernel kernel = random_kernel();
+    size_t steps = count / RANDOM_LANES;
+    kernel(generator->state, out, steps);
+    if (count % RANDOM_LANES != 0) {
+        double tail[RANDOM_LANES];
+        kernel(generator->state, tail, 1);
+        memcpy(out + steps * RANDOM_LANES, tail, (count % RANDOM_LANES) * sizeof(double));
+    }
+}
+
+// Box-Muller in blocks: half of each block of uniforms gives the radii
+// sqrt(-2 ln(1 - u)) and half the angles 2 pi u, and every pair gives two
+// normals r cos(theta) and r sin(theta)
+void random_fill_normal(RandomGenerator* generator, double* out, size_t count) {
+    double radius[RANDOM_BLOCK / 2], angle[RANDOM_BLOCK / 2], sine[RANDOM_BLOCK / 2];
+
+    while (count > 0) {
+        size_t pairs = count < RANDOM_BLOCK ? (count + 1) / 2 : RANDOM_BLOCK / 2;
+        random_fill_uniform(generator, radius, pairs);
+        random_fill_uniform(generator, angle, pairs);
+        for (size_t i = 0; i < pairs; i++) {
+            // 1 - u is exact and never 0
+            radius[i] = 1.0 - radius[i];
+            angle[i] *= 2.0 * M_PI;
+        }
+        vecmath_apply(VECMATH_LOG, RAD, radius, radius, pairs);
+        vecmath_apply(VECMATH_SIN, RAD, angle, sine, pairs);
+        vecmath_apply(VECMATH_COS, RAD, angle, angle, pairs);
+        size_t produced = pairs * 2 < count ? pairs * 2 : count;
+        for (size_t i = 0; i < pairs; i++) {
+            double r = sqrt(-2.0 * radius[i]);
+            out[i] = r * angle[i];
+            if (pairs + i < produced) {
+                out[pairs + i] = r * sine[i];
+            }
+        }
+        out += produced;
+        count -= produced;
+    }
+}
+
+void random_fill_exponential(RandomGenerator* generator, double* out, size_t count) {
+    while (count > 0) {
+        size_t n = count < RANDOM_BLOCK ? count : RANDOM_BLOCK;
+        random_fill_uniform(generator, out, n);
+        for (size_t i = 0; i < n; i++) {
+            out[i] = 1.0 - out[i];
+        }
+        vecmath_apply(VECMATH_LOG, RAD, out, out, n);
+        for (size_t i = 0; i < n; i++) {
+            out[i] = -out[i] + 0.0;
+        }
+        out += n;
+        count -= n;
+    }
+}
+
+static double block_next(RandomGenerator* generator, RandomBlock* block,
+                         void (*fill)(RandomGenerator*, double*, size_t)) {
+    if (block->next == RANDOM_BLOCK) {
+        fill(generator, block->values, RANDOM_BLOCK);
+        block->next = 0;
+    }
+    return block->values[block->next++];
+}
+
+double random_uniform(RandomGenerator* generator) {
+    return block_next(generator, &generator->uniforms, random_fill_uniform);
+}
+
+double random_normal(RandomGenerator* generator) {
+    return block_next(generator, &generator->normals, random_fill_normal);
+}
+
+double random_exponential(RandomGenerator* generator) {
+    return block_next(generator, &generator->exponentials, random_fill_exponential);
+}
+
+// Small means: walk the cumulative distribution from 0 until it passes a
+// uniform. The walk stops where the remaining mass underflows.
+static double poisson_inversion(RandomGenerator* generator, double lambda) {
+    double u = random_uniform(generator);
+    double p = exp(-lambda), cumulative = p;
+    double k = 0.0;
+    while (u >= cumulative && p > 0.0) {
+        k += 1.0;
+        p *= lambda / k;
+        cumulative += p;
+    }
+    return k;
+}
+
+// Large means: Hormann's transformed rejection with squeeze (PTRS)
+static double poisson_ptrs(RandomGenerator* generator, double lambda) {
+    double slam = sqrt(lambda), loglam = log(lambda);
+    double b = 0.931 + 2.53 * slam;
+    double a = -0.059 + 0.02483 * b;
+    double invalpha = 1.1239 + 1.1328 / (b - 3.4);
+    double vr = 0.9277 - 3.6224 / (b - 2.0);
+    int sign;
+
+    for (;;) {
+        double u = random_uniform(generator) - 0.5;
+        double v = random_uniform(generator);
+        double us = 0.5 - fabs(u);
+        double k = floor((2.0 * a / us + b) * u + lambda + 0.43);
+        if (us >= 0.07 && v <= vr) {
+            return k;
+        }
+        if (k < 0.0 || (us < 0.013 && v > us)) {
+            continue;
+        }
+        if (log(v) + log(invalpha) - log(a / (us * us) + b) <= -lambda + k * loglam - lgamma_r(k + 1.0, &sign)) {
+            return k;
+        }
+    }
+}
+
+double random_poisson(RandomGenerator* generator, double lambda) {
+    if (lambda == 0.0) {
+        return 0.0;
+    }
+    return lambda < RANDOM_POISSON_INVERSION_LIMIT ? poisson_inversion(generator, lambda)
+                                                   : poisson_ptrs(generator, lambda);
+}
+
+ErrorType random_fill_poisson(RandomGenerator* generator, double lambda, double* out, size_t count) {
+    if (!(lambda >= 0.0 && lambda <= RANDOM_POISSON_MAX)) {
+        return ERROR_MATH_DOMAIN;
+    }
+    for (size_t i = 0; i < count; i++) {
+        out[i] = random_poisson(generator, lambda);
+    }
+    return ERROR_NONE;
+}
@@ -0,0 +1,61 @@
+#ifndef CALCULATOR_RANDOM_H
+#define CALCULATOR_RANDOM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "calculator_logic.h"
+
+// Pseudo-random numbers for Monte Carlo work. The generator is xoshiro256++
+// run as RANDOM_LANES interleaved lanes, so one step of the state fills a
+// whole vector: 8 lanes are two AVX2 or four SSE2 registers. The lanes are
+// 2^128 steps apart in one sequence and never overlap.
+//
+// A (seed, stream) pair selects the sequence. Streams are hashed into the
+// starting state, so each thread or piece of work can take its own stream
+// number and get an independent sequence from the same seed. The same seed,
+// stream and calls always give the same numbers; uniform values are also
+// bit-identical on every instruction set, while the other distributions go
+// through calculator_vecmath and can differ in the last bits between them.
+#define RANDOM_LANES 8
+
+typedef enum {
+    RANDOM_ISA_SCALAR,
+    RANDOM_ISA_SSE2,
+    RANDOM_ISA_AVX2
+} RandomIsa;
+
+RandomGenerator* random_generator_new(uint64_t seed, uint64_t stream);
+void random_generator_free(RandomGenerator* generator);
+// Restarts the generator on another sequence.
+void random_seed(RandomGenerator* generator, uint64_t seed, uint64_t stream);
+uint64_t random_get_seed(const RandomGenerator* generator);
+uint64_t random_get_stream(const RandomGenerator* generator);
+// A seed that differs between runs and between calls.
+uint64_t random_clock_seed(void);
+// Stream number for part `index` of a job running on `stream`.
+uint64_t random_substream(uint64_t stream, uint64_t index);
+
+// Bulk generation. Uniform values are multiples of 2^-52 in [0, 1); normal
+// values are standard normal (Box-Muller); exponential values have rate 1.
+void random_fill_uniform(RandomGenerator* generator, double* out, size_t count);
+void random_fill_normal(RandomGenerator* generator, double* out, size_t count);
+void random_fill_exponential(RandomGenerator* generator, double* out, size_t count);
+// Returns ERROR_MATH_DOMAIN unless 0 <= lambda <= RANDOM_POISSON_MAX.
+#define RANDOM_POISSON_MAX 0x1p52
+ErrorType random_fill_poisson(RandomGenerator* generator, double lambda, double* out, size_t count);
+
+// One value at a time, taken from blocks generated in bulk.
+double random_uniform(RandomGenerator* generator);
+double random_normal(RandomGenerator* generator);
+double random_exponential(RandomGenerator* generator);
+// lambda must be in range as for random_fill_poisson.
+double random_poisson(RandomGenerator* generator, double lambda);
+
+RandomIsa random_best_isa(void);
+RandomIsa random_get_isa(void);
+// Selects the generator kernel, mainly for tests and benchmarks. Returns 0
+// and keeps the current one if the CPU does not support `isa`.
+int random_set_isa(RandomIsa isa);
+const char* random_isa_name(RandomIsa isa);
+
+#endif
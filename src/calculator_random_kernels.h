@@ -0,0 +1,44 @@
+// Kernel template for calculator_random.c, included once per instruction
+// set with that set enabled through `#pragma GCC target`. The includer
+// defines:
+//   RANDOM_WIDTH          lanes per vector
+//   RW, RD                uint64_t and double vector types of that width
+//   RK(name)              appends the instruction set to a kernel name
+//
+// The generator lanes are split into RANDOM_LANES / RANDOM_WIDTH vectors
+// that each step advances side by side.
+#define RANDOM_PARTS (RANDOM_LANES / RANDOM_WIDTH)
+
+static void RK(random_kernel)(uint64_t state[4][RANDOM_LANES], double* out, size_t steps) {
+    RW s0[RANDOM_PARTS], s1[RANDOM_PARTS], s2[RANDOM_PARTS], s3[RANDOM_PARTS];
+    memcpy(s0, state[0], sizeof(s0));
+    memcpy(s1, state[1], sizeof(s1));
+    memcpy(s2, state[2], sizeof(s2));
+    memcpy(s3, state[3], sizeof(s3));
+    for (size_t i = 0; i < steps; i++) {
+#pragma GCC unroll 4
+        for (int part = 0; part < RANDOM_PARTS; part++) {
+            RW sum = s0[part] + s3[part];
+            RW result = ((sum << 23) | (sum >> 41)) + s0[part];
+            RW t = s1[part] << 17;
+            s2[part] ^= s0[part];
+            s3[part] ^= s1[part];
+            s1[part] ^= s2[part];
+            s0[part] ^= s3[part];
+            s2[part] ^= t;
+            s3[part] = (s3[part] << 45) | (s3[part] >> 19);
+            RD u = (RD)((result >> 12) | RANDOM_ONE_BITS) - 1.0;
+            memcpy(out + i * RANDOM_LANES + part * RANDOM_WIDTH, &u, sizeof(u));
+        }
+    }
+    memcpy(state[0], s0, sizeof(s0));
+    memcpy(state[1], s1, sizeof(s1));
+    memcpy(state[2], s2, sizeof(s2));
+    memcpy(state[3], s3, sizeof(s3));
+}
+
+#undef RANDOM_PARTS
+#undef RANDOM_WIDTH
+#undef RW
+#undef RD
+#undef RK
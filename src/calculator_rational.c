@@ -0,0 +1,897 @@
+#include "calculator_rational.h"
+#include "calculator_integer.h"
+#include "calculator_matrix.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef unsigned __int128 UInteger;
+
+#define INTEGER_MIN ((Integer)((UInteger)1 << 127))
+#define RATIONAL_MAX_LIMBS (RATIONAL_MAX_BITS / 64)
+// Working precision: the product of two values at the limit, plus a carry
+#define NATURAL_LIMBS (2 * RATIONAL_MAX_LIMBS + 1)
+// 10^19, the largest power of ten in a limb
+#define LIMB_TEN_POWER 10000000000000000000ULL
+#define LIMB_TEN_DIGITS 19
+// Factorials past this are over RATIONAL_MAX_BITS
+#define RATIONAL_MAX_FACTORIAL 600
+
+// Numerator then denominator limbs, least significant first
+struct BigRational {
+    int negative;
+    int num_count;
+    int den_count;
+    uint64_t limbs[];
+};
+
+// Arbitrary-precision magnitude with a fixed capacity; `count` limbs are
+// in use and the top one is non-zero
+typedef struct {
+    int count;
+    uint64_t limbs[NATURAL_LIMBS];
+} Natural;
+
+// A fraction in working precision
+typedef struct {
+    int negative;
+    Natural num;
+    Natural den;
+} Wide;
+
+// Binary GCD
+
+static int ctz128(UInteger x) {
+    uint64_t low = (uint64_t)x;
+    return low ? __builtin_ctzll(low) : 64 + __builtin_ctzll((uint64_t)(x >> 64));
+}
+
+static uint64_t gcd64(uint64_t a, uint64_t b) {
+    if (!a || !b) {
+        return a | b;
+    }
+    int shift = __builtin_ctzll(a | b);
+    a >>= __builtin_ctzll(a);
+    do {
+        b >>= __builtin_ctzll(b);
+        if (a > b) {
+            uint64_t t = a;
+            a = b;
+            b = t;
+        }
+        b -= a;
+    } while (b);
+    return a << shift;
+}
+
+static UInteger gcd128(UInteger a, UInteger b) {
+    if (!a || !b) {
+        return a | b;
+    }
+    int shift = ctz128(a | b);
+    a >>= ctz128(a);
+    do {
+        b >>= ctz128(b);
+        if (!((a | b) >> 64)) {
+            return (UInteger)gcd64((uint64_t)a, (uint64_t)b) << shift;
+        }
+        if (a > b) {
+            UInteger t = a;
+            a = b;
+            b = t;
+        }
+        b -= a;
+    } while (b);
+    return a << shift;
+}
+
+static UInteger magnitude(Integer x) {
+    return x < 0 ? -(UInteger)x : (UInteger)x;
+}
+
+static int fits64(Integer x) {
+    return x >= INT64_MIN && x <= INT64_MAX;
+}
+
+// 128-bit fractions
+
+// Reduces num/den (den > 0) into *out; 0 if the numerator is -2^127, which
+// has no positive counterpart
+static int small_make(Integer num, Integer den, Rational* out) {
+    UInteger g = gcd128(magnitude(num), (UInteger)den);
+    if (g > 1) {
+        num /= (Integer)g;
+        den /= (Integer)g;
+    }
+    if (num == INTEGER_MIN) {
+        return 0;
+    }
+    out->num = num;
+    out->den = den;
+    out->big = NULL;
+    return 1;
+}
+
+static int small_add(const Rational* a, const Rational* b, int subtract, Rational* out) {
+    Integer bn = subtract ? -b->num : b->num;
+    if (fits64(a->num) && fits64(a->den) && fits64(bn) && fits64(b->den)) {
+        // Each product is below 2^126, so neither they nor their sum overflow
+        return small_make(a->num * b->den + bn * a->den, a->den * b->den, out);
+    }
+    Integer g = (Integer)gcd128((UInteger)a->den, (UInteger)b->den);
+    Integer x, y, num, den;
+    if (__builtin_mul_overflow(a->num, b->den / g, &x) || __builtin_mul_overflow(bn, a->den / g, &y) ||
+        __builtin_add_overflow(x, y, &num) || __builtin_mul_overflow(a->den, b->den / g, &den)) {
+        return 0;
+    }
+    return small_make(num, den, out);
+}
+
+static int small_multiply(const Rational* a, const Rational* b, Rational* out) {
+    if (fits64(a->num) && fits64(a->den) && fits64(b->num) && fits64(b->den)) {
+        return small_make(a->num * b->num, a->den * b->den, out);
+    }
+    // Cancelling across first keeps the products in lowest terms
+    Integer g1 = (Integer)gcd128(magnitude(a->num), (UInteger)b->den);
+    Integer g2 = (Integer)gcd128(magnitude(b->num), (UInteger)a->den);
+    Integer num, den;
+    if (g1 == 0 || g2 == 0 || __builtin_mul_overflow(a->num / g1, b->num / g2, &num) ||
+        __builtin_mul_overflow(a->den / g2, b->den / g1, &den) || num == INTEGER_MIN) {
+        return 0;
+    }
+    out->num = num;
+    out->den = den;
+    out->big = NULL;
+    return 1;
+}
+
+// Naturals
+
+static void natural_trim(Natural* n) {
+    while (n->count > 0 && n->limbs[n->count - 1] == 0) {
+        n->count--;
+    }
+}
+
+// Copies only the limbs in use; a Natural is too large to assign whole
+static void natural_copy(Natural* out, const Natural* n) {
+    out->count = n->count;
+    memcpy(out->limbs, n->limbs, (size_t)n->count * sizeof(uint64_t));
+}
+
+static void natural_set(Natural* n, UInteger value) {
+    n->limbs[0] = (uint64_t)value;
+    n->limbs[1] = (uint64_t)(value >> 64);
+    n->count = 2;
+    natural_trim(n);
+}
+
+static int natural_bits(const Natural* n) {
+    return n->count ? n->count * 64 - __builtin_clzll(n->limbs[n->count - 1]) : 0;
+}
+
+static int natural_compare(const Natural* a, const Natural* b) {
+    if (a->count != b->count) {
+        return a->count < b->count ? -1 : 1;
+    }
+    for (int i = a->count - 1; i >= 0; i--) {
+        if (a->limbs[i] != b->limbs[i]) {
+            return a->limbs[i] < b->limbs[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+// out may be a or b
+static void natural_add(Natural* out, const Natural* a, const Natural* b) {
+    int count = a->count > b->count ? a->count : b->count;
+    uint64_t carry = 0;
+    for (int i = 0; i < count; i++) {
+        UInteger sum = (UInteger)(i < a->count ? a->limbs[i] : 0) + (i < b->count ? b->limbs[i] : 0) + carry;
+        out->limbs[i] = (uint64_t)sum;
+        carry = (uint64_t)(sum >> 64);
+    }
+    out->limbs[count] = carry;
+    out->count = count + 1;
+    natural_trim(out);
+}
+
+// a >= b; out may be a or b
+static void natural_subtract(Natural* out, const Natural* a, const Natural* b) {
+    uint64_t borrow = 0;
+    for (int i = 0; i < a->count; i++) {
+        uint64_t x = a->limbs[i], y = i < b->count ? b->limbs[i] : 0;
+        out->limbs[i] = x - y - borrow;
+        borrow = (x < y) || (x - y < borrow);
+    }
+    out->count = a->count;
+    natural_trim(out);
+}
+
+// out must not be a or b
+static void natural_multiply(Natural* out, const Natural* a, const Natural* b) {
+    out->count = a->count + b->count;
+    memset(out->limbs, 0, (size_t)out->count * sizeof(uint64_t));
+    for (int i = 0; i < a->count; i++) {
+        uint64_t carry = 0;
+        for (int j = 0; j < b->count; j++) {
+            UInteger t = (UInteger)a->limbs[i] * b->limbs[j] + out->limbs[i + j] + carry;
+            out->limbs[i + j] = (uint64_t)t;
+            carry = (uint64_t)(t >> 64);
+        }
+        out->limbs[i + b->count] = carry;
+    }
+    natural_trim(out);
+}
+
+// n = n * factor + addend; 0 if it no longer fits
+static int natural_multiply_add(Natural* n, uint64_t factor, uint64_t addend) {
+    uint64_t carry = addend;
+    for (int i = 0; i < n->count; i++) {
+        UInteger t = (UInteger)n->limbs[i] * factor + carry;
+        n->limbs[i] = (uint64_t)t;
+        carry = (uint64_t)(t >> 64);
+    }
+    if (carry) {
+        if (n->count == NATURAL_LIMBS) {
+            return 0;
+        }
+        n->limbs[n->count++] = carry;
+    }
+    return 1;
+}
+
+// Divides in place and returns the remainder
+static uint64_t natural_divide_limb(Natural* n, uint64_t divisor) {
+    UInteger remainder = 0;
+    for (int i = n->count - 1; i >= 0; i--) {
+        UInteger t = remainder << 64 | n->limbs[i];
+        n->limbs[i] = (uint64_t)(t / divisor);
+        remainder = t % divisor;
+    }
+    natural_trim(n);
+    return (uint64_t)remainder;
+}
+
+static void natural_shift_right(Natural* n, int bits) {
+    int limbs = bits / 64, shift = bits % 64;
+    if (limbs >= n->count) {
+        n->count = 0;
+        return;
+    }
+    for (int i = 0; i < n->count - limbs; i++) {
+        uint64_t high = i + limbs + 1 < n->count ? n->limbs[i + limbs + 1] : 0;
+        n->limbs[i] = shift ? n->limbs[i + limbs] >> shift | high << (64 - shift) : n->limbs[i + limbs];
+    }
+    n->count -= limbs;
+    natural_trim(n);
+}
+
+// The caller makes sure the result fits
+static void natural_shift_left(Natural* n, int bits) {
+    int limbs = bits / 64, shift = bits % 64;
+    if (n->count == 0) {
+        return;
+    }
+    n->limbs[n->count + limbs] = 0;
+    for (int i = n->count - 1; i >= 0; i--) {
+        uint64_t x = n->limbs[i];
+        if (shift) {
+            n->limbs[i + limbs + 1] |= x >> (64 - shift);
+        }
+        n->limbs[i + limbs] = x << shift;
+    }
+    for (int i = 0; i < limbs; i++) {
+        n->limbs[i] = 0;
+    }
+    n->count += limbs + 1;
+    natural_trim(n);
+}
+
+static int natural_ctz(const Natural* n) {
+    for (int i = 0; i < n->count; i++) {
+        if (n->limbs[i]) {
+            return i * 64 + __builtin_ctzll(n->limbs[i]);
+        }
+    }
+    return 0;
+}
+
+static void natural_gcd(Natural* out, const Natural* a, const Natural* b) {
+    if (a->count == 0 || b->count == 0) {
+        natural_copy(out, a->count ? a : b);
+        return;
+    }
+    Natural u, v;
+    Natural *x = &u, *y = &v;
+    natural_copy(x, a);
+    natural_copy(y, b);
+    int xz = natural_ctz(x), yz = natural_ctz(y);
+    int shift = xz < yz ? xz : yz;
+    natural_shift_right(x, xz);
+    do {
+        natural_shift_right(y, natural_ctz(y));
+        if (x->count <= 2 && y->count <= 2) {
+            UInteger g = gcd128((UInteger)x->limbs[0] | (x->count > 1 ? (UInteger)x->limbs[1] << 64 : 0),
+                                (UInteger)y->limbs[0] | (y->count > 1 ? (UInteger)y->limbs[1] << 64 : 0));
+            natural_set(out, g);
+            natural_shift_left(out, shift);
+            return;
+        }
+        if (natural_compare(x, y) > 0) {
+            Natural* t = x;
+            x = y;
+            y = t;
+        }
+        natural_subtract(y, y, x);
+    } while (y->count);
+    natural_copy(out, x);
+    natural_shift_left(out, shift);
+}
+
+// Quotient of a division known to be exact, one limb per step from the
+// bottom: with the divisor made odd, each quotient limb is the remainder's
+// lowest limb times the divisor's inverse mod 2^64
+static void natural_divide_exact(Natural* quotient, const Natural* a, const Natural* b) {
+    Natural r, d;
+    int zeros = natural_ctz(b);
+    natural_copy(&r, a);
+    natural_copy(&d, b);
+    natural_shift_right(&r, zeros);
+    natural_shift_right(&d, zeros);
+    // Newton's iteration doubles the correct low bits from 3
+    uint64_t inverse = d.limbs[0];
+    for (int i = 0; i < 5; i++) {
+        inverse *= 2 - d.limbs[0] * inverse;
+    }
+    int count = r.count - d.count + 1;
+    if (count <= 0) {
+        quotient->count = 0;
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        uint64_t q = r.limbs[i] * inverse, carry = 0;
+        quotient->limbs[i] = q;
+        for (int j = 0; j < d.count; j++) {
+            UInteger product = (UInteger)q * d.limbs[j] + carry;
+            uint64_t low = (uint64_t)product, x = r.limbs[i + j];
+            r.limbs[i + j] = x - low;
+            carry = (uint64_t)(product >> 64) + (x < low);
+        }
+        for (int k = i + d.count; carry && k < r.count; k++) {
+            uint64_t x = r.limbs[k];
+            r.limbs[k] = x - carry;
+            carry = x < carry;
+        }
+    }
+    quotient->count = count;
+    natural_trim(quotient);
+}
+
+// Top bits as a double, scaled by 2^-*exponent
+static double natural_to_double(const Natural* n, int* exponent) {
+    int bits = natural_bits(n);
+    *exponent = bits > 128 ? bits - 128 : 0;
+    Natural top;
+    natural_copy(&top, n);
+    natural_shift_right(&top, *exponent);
+    return (double)((top.count > 1 ? (UInteger)top.limbs[1] << 64 : 0) | (top.count ? top.limbs[0] : 0));
+}
+
+// Wide fractions
+
+static void wide_from_rational(Wide* w, const Rational* r) {
+    if (r->big) {
+        const BigRational* big = r->big;
+        w->negative = big->negative;
+        w->num.count = big->num_count;
+        w->den.count = big->den_count;
+        memcpy(w->num.limbs, big->limbs, (size_t)big->num_count * sizeof(uint64_t));
+        memcpy(w->den.limbs, big->limbs + big->num_count, (size_t)big->den_count * sizeof(uint64_t));
+    } else {
+        w->negative = r->num < 0;
+        natural_set(&w->num, magnitude(r->num));
+        natural_set(&w->den, (UInteger)r->den);
+    }
+}
+
+static void wide_reduce(Wide* w) {
+    Natural g, t;
+    natural_gcd(&g, &w->num, &w->den);
+    if (g.count > 1 || (g.count == 1 && g.limbs[0] != 1)) {
+        natural_divide_exact(&t, &w->num, &g);
+        natural_copy(&w->num, &t);
+        natural_divide_exact(&t, &w->den, &g);
+        natural_copy(&w->den, &t);
+    }
+    if (w->num.count == 0) {
+        w->negative = 0;
+    }
+}
+
+// A reduced wide fraction as a 128-bit one if it fits, else as a
+// BigRational in the arena
+static ErrorType wide_to_rational(MatrixArena* arena, const Wide* w, Rational* out) {
+    int num_bits = natural_bits(&w->num), den_bits = natural_bits(&w->den);
+    if (num_bits > RATIONAL_MAX_BITS || den_bits > RATIONAL_MAX_BITS) {
+        return ERROR_OVERFLOW;
+    }
+    if (num_bits < 128 && den_bits < 128) {
+        UInteger num = w->num.count ? w->num.limbs[0] : 0, den = w->den.limbs[0];
+        if (w->num.count > 1) {
+            num |= (UInteger)w->num.limbs[1] << 64;
+        }
+        if (w->den.count > 1) {
+            den |= (UInteger)w->den.limbs[1] << 64;
+        }
+        out->num = w->negative ? -(Integer)num : (Integer)num;
+        out->den = (Integer)den;
+        out->big = NULL;
+        return ERROR_NONE;
+    }
+    size_t limbs = (size_t)(w->num.count + w->den.count);
+    BigRational* big = arena ? (BigRational*)matrix_arena_alloc(arena, sizeof(BigRational) + limbs * sizeof(uint64_t)) : NULL;
+    if (!big) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+    big->negative = w->negative;
+    big->num_count = w->num.count;
+    big->den_count = w->den.count;
+    memcpy(big->limbs, w->num.limbs, (size_t)w->num.count * sizeof(uint64_t));
+    memcpy(big->limbs + w->num.count, w->den.limbs, (size_t)w->den.count * sizeof(uint64_t));
+    out->num = 0;
+    out->den = 0;
+    out->big = big;
+    return ERROR_NONE;
+}
+
+// Signed sum of two products of magnitudes: (sx x) + (sy y)
+static void wide_signed_add(Natural* out, int* negative, const Natural* x, int x_negative,
+                            const Natural* y, int y_negative) {
+    if (x_negative == y_negative) {
+        natural_add(out, x, y);
+        *negative = x_negative;
+    } else if (natural_compare(x, y) >= 0) {
+        natural_subtract(out, x, y);
+        *negative = x_negative;
+    } else {
+        natural_subtract(out, y, x);
+        *negative = y_negative;
+    }
+}
+
+// Operands at most RATIONAL_MAX_BITS wide, so the products always fit
+static void wide_add(Wide* out, const Wide* a, const Wide* b, int subtract) {
+    Natural x, y;
+    natural_multiply(&x, &a->num, &b->den);
+    natural_multiply(&y, &b->num, &a->den);
+    wide_signed_add(&out->num, &out->negative, &x, a->negative, &y, b->negative != subtract);
+    natural_multiply(&out->den, &a->den, &b->den);
+    wide_reduce(out);
+}
+
+// `reduce` may be 0 when no factor can cancel, as between powers of one
+// fraction in lowest terms
+static void wide_multiply(Wide* out, const Wide* a, const Wide* b, int reduce) {
+    natural_multiply(&out->num, &a->num, &b->num);
+    natural_multiply(&out->den, &a->den, &b->den);
+    out->negative = a->negative != b->negative;
+    if (reduce) {
+        wide_reduce(out);
+    }
+}
+
+// Public operations
+
+Rational rational_from_integer(Integer value) {
+    Rational r = {value, 1, NULL};
+    return r;
+}
+
+int rational_is_exact(const Rational* value) {
+    return value->big != NULL || value->den > 0;
+}
+
+int rational_to_integer(const Rational* value, Integer* integer) {
+    if (value->big || value->den != 1) {
+        return 0;
+    }
+    *integer = value->num;
+    return 1;
+}
+
+int rational_is_zero(const Rational* value) {
+    // A big value is never zero: zero always fits in 128 bits
+    return !value->big && value->num == 0;
+}
+
+double rational_to_double(const Rational* value) {
+    if (!value->big) {
+        return (double)value->num / (double)value->den;
+    }
+    Wide w;
+    int num_exponent, den_exponent;
+    wide_from_rational(&w, value);
+    double num = natural_to_double(&w.num, &num_exponent);
+    double den = natural_to_double(&w.den, &den_exponent);
+    double result = ldexp(num / den, num_exponent - den_exponent);
+    return w.negative ? -result : result;
+}
+
+static ErrorType add(MatrixArena* arena, const Rational* a, const Rational* b, int subtract, Rational* out) {
+    if (!a->big && !b->big && small_add(a, b, subtract, out)) {
+        return ERROR_NONE;
+    }
+    Wide x, y, result;
+    wide_from_rational(&x, a);
+    wide_from_rational(&y, b);
+    wide_add(&result, &x, &y, subtract);
+    return wide_to_rational(arena, &result, out);
+}
+
+static ErrorType multiply(MatrixArena* arena, const Rational* a, const Rational* b, int reduce, Rational* out) {
+    if (!a->big && !b->big && small_multiply(a, b, out)) {
+        return ERROR_NONE;
+    }
+    Wide x, y, result;
+    wide_from_rational(&x, a);
+    wide_from_rational(&y, b);
+    wide_multiply(&result, &x, &y, reduce);
+    return wide_to_rational(arena, &result, out);
+}
+
+static ErrorType reciprocal(MatrixArena* arena, const Rational* a, Rational* out) {
+    if (rational_is_zero(a)) {
+        return ERROR_MATH_DIV_ZERO;
+    }
+    if (!a->big) {
+        Integer num = a->num < 0 ? -a->den : a->den;
+        out->den = a->num < 0 ? -a->num : a->num;
+        out->num = num;
+        out->big = NULL;
+        return ERROR_NONE;
+    }
+    // Swapping the parts keeps both as wide as before, so it stays big
+    const BigRational* big = a->big;
+    size_t limbs = (size_t)(big->num_count + big->den_count);
+    BigRational* flipped = arena ? (BigRational*)matrix_arena_alloc(arena, sizeof(BigRational) + limbs * sizeof(uint64_t)) : NULL;
+    if (!flipped) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+    flipped->negative = big->negative;
+    flipped->num_count = big->den_count;
+    flipped->den_count = big->num_count;
+    memcpy(flipped->limbs, big->limbs + big->num_count, (size_t)big->den_count * sizeof(uint64_t));
+    memcpy(flipped->limbs + big->den_count, big->limbs, (size_t)big->num_count * sizeof(uint64_t));
+    out->num = 0;
+    out->den = 0;
+    out->big = flipped;
+    return ERROR_NONE;
+}
+
+static ErrorType power(MatrixArena* arena, const Rational* base, Integer exponent, Rational* out) {
+    Rational result = rational_from_integer(1), square = *base;
+    ErrorType err = ERROR_NONE;
+    UInteger n = magnitude(exponent);
+
+    if (rational_is_zero(base)) {
+        if (exponent < 0) {
+            return ERROR_MATH_DIV_ZERO;
+        }
+        *out = rational_from_integer(exponent == 0);
+        return ERROR_NONE;
+    }
+    if (!base->big && base->den == 1 && (base->num == 1 || base->num == -1)) {
+        *out = rational_from_integer(base->num == -1 && (n & 1) ? -1 : 1);
+        return ERROR_NONE;
+    }
+    // Any other base at least doubles the size of one part per doubling of n
+    if (n > RATIONAL_MAX_BITS) {
+        return ERROR_OVERFLOW;
+    }
+    // Powers of a fraction in lowest terms are in lowest terms, so the
+    // products skip the GCD
+    while (err == ERROR_NONE) {
+        if (n & 1) {
+            err = multiply(arena, &result, &square, 0, &result);
+        }
+        n >>= 1;
+        if (!n || err != ERROR_NONE) {
+            break;
+        }
+        err = multiply(arena, &square, &square, 0, &square);
+    }
+    if (err == ERROR_NONE && exponent < 0) {
+        err = reciprocal(arena, &result, &result);
+    }
+    if (err == ERROR_NONE) {
+        *out = result;
+    }
+    return err;
+}
+
+ErrorType rational_apply_binary(MatrixArena* arena, char op, const Rational* a, const Rational* b, Rational* out) {
+    Rational inverse;
+    Integer exponent;
+    ErrorType err;
+
+    switch (op) {
+        case '+': return add(arena, a, b, 0, out);
+        case '-': return add(arena, a, b, 1, out);
+        case '*': return multiply(arena, a, b, 1, out);
+        case '/':
+            err = reciprocal(arena, b, &inverse);
+            return err != ERROR_NONE ? err : multiply(arena, a, &inverse, 1, out);
+        case '^':
+            if (!rational_to_integer(b, &exponent)) {
+                return ERROR_SYNTAX;
+            }
+            return power(arena, a, exponent, out);
+        default:
+            return ERROR_SYNTAX;
+    }
+}
+
+ErrorType rational_apply_unary(MatrixArena* arena, char op, const Rational* a, Rational* out) {
+    Integer n;
+    Wide w;
+
+    switch (op) {
+        case 'N':
+            if (!a->big) {
+                *out = *a;
+                out->num = -a->num;
+                return ERROR_NONE;
+            }
+            wide_from_rational(&w, a);
+            w.negative = !w.negative;
+            return wide_to_rational(arena, &w, out);
+        case 'R':
+            return reciprocal(arena, a, out);
+        case '!': {
+            if (!rational_to_integer(a, &n) || n < 0) {
+                return ERROR_MATH_DOMAIN;
+            }
+            if (n > RATIONAL_MAX_FACTORIAL) {
+                return ERROR_OVERFLOW;
+            }
+            Rational result = rational_from_integer(1);
+            for (Integer i = 2; i <= n; i++) {
+                Rational factor = rational_from_integer(i);
+                ErrorType err = multiply(arena, &result, &factor, 0, &result);
+                if (err != ERROR_NONE) {
+                    return err;
+                }
+            }
+            *out = result;
+            return ERROR_NONE;
+        }
+        default:
+            return ERROR_SYNTAX;
+    }
+}
+
+int rational_compare(const Rational* a, const Rational* b) {
+    if (!a->big && !b->big) {
+        Integer x, y;
+        if (!__builtin_mul_overflow(a->num, b->den, &x) && !__builtin_mul_overflow(b->num, a->den, &y)) {
+            return (x > y) - (x < y);
+        }
+    }
+    Wide p, q;
+    Natural x, y;
+    wide_from_rational(&p, a);
+    wide_from_rational(&q, b);
+    int sign_p = p.num.count == 0 ? 0 : p.negative ? -1 : 1;
+    int sign_q = q.num.count == 0 ? 0 : q.negative ? -1 : 1;
+    if (sign_p != sign_q) {
+        return sign_p < sign_q ? -1 : 1;
+    }
+    natural_multiply(&x, &p.num, &q.den);
+    natural_multiply(&y, &q.num, &p.den);
+    return natural_compare(&x, &y) * sign_p;
+}
+
+static int is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+ErrorType rational_parse(MatrixArena* arena, const char* text, const char** end, Rational* value) {
+    const char* p = text;
+    int negative = 0;
+    *end = text;
+
+    if (*p == '+' || *p == '-') {
+        negative = *p++ == '-';
+    }
+    if (integer_has_base_prefix(text)) {
+        Integer integer;
+        ErrorType err = integer_parse(128, 0, text, end, &integer);
+        if (err == ERROR_NONE) {
+            *value = rational_from_integer(integer);
+        }
+        return err;
+    }
+    if (!is_digit(*p) && !(*p == '.' && is_digit(p[1]))) {
+        return ERROR_NONE;
+    }
+
+    Wide w;
+    long scale = 0;
+    int overflow = 0;
+    w.negative = negative;
+    w.num.count = 0;
+    for (; is_digit(*p); p++) {
+        overflow |= !natural_multiply_add(&w.num, 10, (uint64_t)(*p - '0'));
+    }
+    if (*p == '.') {
+        for (p++; is_digit(*p); p++) {
+            overflow |= !natural_multiply_add(&w.num, 10, (uint64_t)(*p - '0'));
+            scale--;
+        }
+    }
+    if ((*p == 'e' || *p == 'E') && (is_digit(p[1]) || ((p[1] == '+' || p[1] == '-') && is_digit(p[2])))) {
+        int exponent_negative = p[1] == '-';
+        long exponent = 0;
+        for (p += 1 + (p[1] == '+' || p[1] == '-'); is_digit(*p); p++) {
+            if (exponent < 100000) {
+                exponent = exponent * 10 + (*p - '0');
+            }
+        }
+        scale += exponent_negative ? -exponent : exponent;
+    }
+    *end = p;
+    natural_trim(&w.num);
+
+    // 10^1234 is past RATIONAL_MAX_BITS
+    if (overflow || scale > 1234 || scale < -1234) {
+        return ERROR_OVERFLOW;
+    }
+    natural_set(&w.den, 1);
+    for (long i = 0; i < (scale < 0 ? -scale : scale) && !overflow; i++) {
+        overflow = !natural_multiply_add(scale < 0 ? &w.den : &w.num, 10, 0);
+    }
+    if (overflow) {
+        return ERROR_OVERFLOW;
+    }
+    wide_reduce(&w);
+    return wide_to_rational(arena, &w, value);
+}
+
+// Decimal digits of a magnitude; 0 if they do not fit
+static size_t natural_format(const Natural* n, char* buffer, size_t size) {
+    Natural t = *n;
+    size_t length = 0;
+    do {
+        uint64_t chunk = natural_divide_limb(&t, LIMB_TEN_POWER);
+        for (int i = 0; i < LIMB_TEN_DIGITS && (t.count || chunk); i++) {
+            if (length + 1 >= size) {
+                return 0;
+            }
+            buffer[length++] = (char)('0' + chunk % 10);
+            chunk /= 10;
+        }
+    } while (t.count);
+    if (length == 0) {
+        if (size < 2) {
+            return 0;
+        }
+        buffer[length++] = '0';
+    }
+    for (size_t i = 0; i < length / 2; i++) {
+        char c = buffer[i];
+        buffer[i] = buffer[length - 1 - i];
+        buffer[length - 1 - i] = c;
+    }
+    buffer[length] = '\0';
+    return length;
+}
+
+// Multiplies by 10^k; 0 if the result no longer fits
+static int natural_scale_ten(Natural* n, int k) {
+    uint64_t power = 1;
+    for (; k >= LIMB_TEN_DIGITS; k -= LIMB_TEN_DIGITS) {
+        if (!natural_multiply_add(n, LIMB_TEN_POWER, 0)) {
+            return 0;
+        }
+    }
+    while (k-- > 0) {
+        power *= 10;
+    }
+    return natural_multiply_add(n, power, 0);
+}
+
+// floor(a / b) for a quotient below 2^48, by shifting and subtracting; the
+// remainder is left in *a. b must have a limb to spare for the shifts.
+static uint64_t natural_divide_small(Natural* a, const Natural* b) {
+    uint64_t quotient = 0;
+    Natural t;
+    for (int bit = 47; bit >= 0; bit--) {
+        natural_copy(&t, b);
+        natural_shift_left(&t, bit);
+        if (natural_compare(&t, a) <= 0) {
+            natural_subtract(a, a, &t);
+            quotient |= (uint64_t)1 << bit;
+        }
+    }
+    return quotient;
+}
+
+size_t rational_format(const Rational* value, char* buffer, size_t size) {
+    Wide w;
+    size_t length = 0, part;
+
+    if (size < 2) {
+        return 0;
+    }
+    wide_from_rational(&w, value);
+    if (w.negative) {
+        buffer[length++] = '-';
+    }
+    if (!(part = natural_format(&w.num, buffer + length, size - length))) {
+        return 0;
+    }
+    length += part;
+    if (w.den.count == 1 && w.den.limbs[0] == 1) {
+        return length;
+    }
+    if (length + 2 >= size) {
+        return 0;
+    }
+    buffer[length++] = '/';
+    if (!(part = natural_format(&w.den, buffer + length, size - length))) {
+        return 0;
+    }
+    return length + part;
+}
+
+size_t rational_format_scientific(const Rational* value, char* buffer, size_t size) {
+    // Eleven significant digits
+    const uint64_t low = 10000000000ULL, high = 10 * low;
+    Wide w;
+    Natural a, b;
+    uint64_t quotient = 0;
+    int written;
+
+    wide_from_rational(&w, value);
+    if (w.num.count == 0) {
+        written = snprintf(buffer, size, "0");
+        return written > 0 && (size_t)written < size ? (size_t)written : 0;
+    }
+    // The bit lengths put the decimal exponent within one of this guess;
+    // the quotient then says which way it is off
+    int exponent = (int)floor((natural_bits(&w.num) - natural_bits(&w.den)) * 0.30102999566398120);
+    for (int attempt = 0; attempt < 3; attempt++) {
+        natural_copy(&a, &w.num);
+        natural_copy(&b, &w.den);
+        int scale = 10 - exponent;
+        if (!natural_scale_ten(scale > 0 ? &a : &b, scale > 0 ? scale : -scale) || b.count + 1 >= NATURAL_LIMBS) {
+            return 0;
+        }
+        quotient = natural_divide_small(&a, &b);
+        if (quotient < low) {
+            exponent--;
+        } else if (quotient >= high) {
+            exponent++;
+        } else {
+            break;
+        }
+    }
+    if (quotient < low || quotient >= high) {
+        return 0;
+    }
+
+    // Round half to even on the remainder, as printf does
+    natural_shift_left(&a, 1);
+    int half = natural_compare(&a, &b);
+    if (half > 0 || (half == 0 && (quotient & 1))) {
+        if (++quotient == high) {
+            quotient = low;
+            exponent++;
+        }
+    }
+    written = snprintf(buffer, size, "%s%llu.%010llue%c%02d", w.negative ? "-" : "",
+                       (unsigned long long)(quotient / low), (unsigned long long)(quotient % low),
+                       exponent < 0 ? '-' : '+', exponent < 0 ? -exponent : exponent);
+    return written > 0 && (size_t)written < size ? (size_t)written : 0;
+}
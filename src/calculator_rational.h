@@ -0,0 +1,48 @@
+#ifndef CALCULATOR_RATIONAL_H
+#define CALCULATOR_RATIONAL_H
+
+#include <stddef.h>
+#include "calculator_logic.h"
+
+// Exact fractions for NUMBER_MODE_RATIONAL. A Rational is kept in lowest
+// terms with a positive denominator, reduced with binary GCD.
+//
+// Operands whose numerator and denominator fit in 64 bits take a path whose
+// 128-bit intermediates cannot overflow; wider 128-bit operands use checked
+// arithmetic. A result that does not fit in 128 bits is computed again on
+// arbitrary-precision integers of up to RATIONAL_MAX_BITS, stored as a
+// BigRational in the evaluation's arena, and moves back to 128 bits as soon
+// as it is small enough. Past RATIONAL_MAX_BITS the functions below give
+// ERROR_OVERFLOW and the evaluator carries on with a double.
+#define RATIONAL_MAX_BITS 4096
+
+// Rational from an integer
+Rational rational_from_integer(Integer value);
+// True for a fraction held exactly, 128-bit or big
+int rational_is_exact(const Rational* value);
+// Sets *value and returns 1 if the fraction is a 128-bit integer.
+int rational_to_integer(const Rational* value, Integer* integer);
+int rational_is_zero(const Rational* value);
+double rational_to_double(const Rational* value);
+
+// Reads [sign] digits [. digits] [e [sign] digits] exactly, so 0.1 is 1/10,
+// and sets *end past it; *end == text if there is no number.
+ErrorType rational_parse(MatrixArena* arena, const char* text, const char** end, Rational* value);
+// "n" for an integer, otherwise "n/d". Returns 0, and writes nothing
+// useful, if the digits do not fit in `size`.
+size_t rational_format(const Rational* value, char* buffer, size_t size);
+// The exact value rounded to ten digits after the point, in the "%.10e"
+// form real mode uses for large doubles, for fractions too long to show
+// whole. Returns 0 if it does not fit in `size`.
+size_t rational_format_scientific(const Rational* value, char* buffer, size_t size);
+
+// `+ - * /` and `^` with an integer exponent. Other codes, and non-integer
+// exponents, have no exact result and give ERROR_SYNTAX.
+ErrorType rational_apply_binary(MatrixArena* arena, char op, const Rational* a, const Rational* b, Rational* out);
+// Negation ('N'), reciprocal ('R') and factorial ('!') of a non-negative
+// integer; other codes give ERROR_SYNTAX.
+ErrorType rational_apply_unary(MatrixArena* arena, char op, const Rational* a, Rational* out);
+// -1, 0 or 1
+int rational_compare(const Rational* a, const Rational* b);
+
+#endif
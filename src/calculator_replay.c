@@ -0,0 +1,219 @@
+#include "calculator_replay.h"
+#include "calculator_stats.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+// Upper bound on `loop`, so a typo cannot keep a benchmark running for days
+#define REPLAY_MAX_LOOPS 100000
+#define REPLAY_MAX_WAIT_MS 60000
+
+struct ReplayStats {
+    StatsSummary* series[REPLAY_SERIES_COUNT];
+};
+
+static const char* const key_names[] = {"Return", "BackSpace"};
+
+static const char* const series_names[REPLAY_SERIES_COUNT] = {
+    "button handler", "key handler", "input to frame", "frame",
+};
+
+static int append_event(ReplayScript* script, size_t* capacity, ReplayEventKind kind, const char* text,
+                        size_t length, int wait_ms) {
+    if (script->count == *capacity) {
+        size_t grown = *capacity ? *capacity * 2 : 64;
+        ReplayEvent* events = realloc(script->events, grown * sizeof(ReplayEvent));
+        if (!events) {
+            return 0;
+        }
+        script->events = events;
+        *capacity = grown;
+    }
+    ReplayEvent* event = &script->events[script->count++];
+    event->kind = kind;
+    memcpy(event->text, text, length);
+    event->text[length] = '\0';
+    event->wait_ms = wait_ms;
+    return 1;
+}
+
+// A whole number in [1, max] filling `text`, or 0
+static int parse_count(const char* text, size_t length, int max) {
+    long value = 0;
+    if (length == 0) {
+        return 0;
+    }
+    for (size_t i = 0; i < length; i++) {
+        if (!isdigit((unsigned char)text[i]) || (value = value * 10 + (text[i] - '0')) > max) {
+            return 0;
+        }
+    }
+    return (int)value;
+}
+
+// One line, without its newline; returns 0 if it is malformed
+static int parse_line(ReplayScript* script, size_t* capacity, const char* line, size_t length, int* looped) {
+    while (length > 0 && isspace((unsigned char)*line)) {
+        line++;
+        length--;
+    }
+    while (length > 0 && isspace((unsigned char)line[length - 1])) {
+        length--;
+    }
+    if (length == 0 || *line == '#') {
+        return 1;
+    }
+
+    size_t word = 0;
+    while (word < length && !isspace((unsigned char)line[word])) {
+        word++;
+    }
+    // The argument starts after one separating space, so typed text keeps
+    // any others
+    const char* argument = line + word + (word < length);
+    size_t argument_length = length - word - (word < length);
+
+    if (word == 6 && strncmp(line, "button", 6) == 0) {
+        if (argument_length == 0 || argument_length >= REPLAY_MAX_TEXT) {
+            return 0;
+        }
+        return append_event(script, capacity, REPLAY_BUTTON, argument, argument_length, 0);
+    }
+    if (word == 4 && strncmp(line, "type", 4) == 0) {
+        if (argument_length == 0) {
+            return 0;
+        }
+        // One event per UTF-8 character: a lead byte and its continuation bytes
+        for (size_t i = 0; i < argument_length;) {
+            size_t n = 1;
+            while (i + n < argument_length && ((unsigned char)argument[i + n] & 0xC0) == 0x80) {
+                n++;
+            }
+            if (n >= REPLAY_MAX_TEXT || !append_event(script, capacity, REPLAY_KEY, argument + i, n, 0)) {
+                return 0;
+            }
+            i += n;
+        }
+        return 1;
+    }
+    if (word == 3 && strncmp(line, "key", 3) == 0) {
+        for (size_t k = 0; k < sizeof(key_names) / sizeof(key_names[0]); k++) {
+            if (strlen(key_names[k]) == argument_length && strncmp(argument, key_names[k], argument_length) == 0) {
+                return append_event(script, capacity, REPLAY_KEY, argument, argument_length, 0);
+            }
+        }
+        return 0;
+    }
+    if (word == 4 && strncmp(line, "wait", 4) == 0) {
+        int ms = parse_count(argument, argument_length, REPLAY_MAX_WAIT_MS);
+        return ms > 0 && append_event(script, capacity, REPLAY_WAIT, "", 0, ms);
+    }
+    if (word == 4 && strncmp(line, "loop", 4) == 0 && !*looped) {
+        *looped = 1;
+        script->loops = parse_count(argument, argument_length, REPLAY_MAX_LOOPS);
+        return script->loops > 0;
+    }
+    return 0;
+}
+
+ReplayScript* replay_script_parse(const char* text, size_t* error_line) {
+    ReplayScript* script = calloc(1, sizeof(ReplayScript));
+    size_t capacity = 0, line_number = 0;
+    int looped = 0;
+
+    *error_line = 0;
+    if (!script) {
+        return NULL;
+    }
+    script->loops = 1;
+    while (*text) {
+        const char* newline = strchr(text, '\n');
+        size_t length = newline ? (size_t)(newline - text) : strlen(text);
+        line_number++;
+        if (!parse_line(script, &capacity, text, length, &looped)) {
+            *error_line = line_number;
+            replay_script_free(script);
+            return NULL;
+        }
+        text += length + (newline != NULL);
+    }
+    return script;
+}
+
+ReplayScript* replay_script_load(const char* path, size_t* error_line) {
+    FILE* file = fopen(path, "rb");
+    char* text = NULL;
+    long size;
+
+    *error_line = 0;
+    if (!file) {
+        return NULL;
+    }
+    if (fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) >= 0 && fseek(file, 0, SEEK_SET) == 0 &&
+        (text = malloc((size_t)size + 1)) != NULL) {
+        size_t read = fread(text, 1, (size_t)size, file);
+        text[read] = '\0';
+    }
+    fclose(file);
+    if (!text) {
+        return NULL;
+    }
+    ReplayScript* script = replay_script_parse(text, error_line);
+    free(text);
+    return script;
+}
+
+void replay_script_free(ReplayScript* script) {
+    if (script) {
+        free(script->events);
+        free(script);
+    }
+}
+
+ReplayStats* replay_stats_new(void) {
+    ReplayStats* stats = calloc(1, sizeof(ReplayStats));
+    if (!stats) {
+        return NULL;
+    }
+    for (int s = 0; s < REPLAY_SERIES_COUNT; s++) {
+        if (!(stats->series[s] = stats_summary_new())) {
+            replay_stats_free(stats);
+            return NULL;
+        }
+    }
+    return stats;
+}
+
+void replay_stats_free(ReplayStats* stats) {
+    if (stats) {
+        for (int s = 0; s < REPLAY_SERIES_COUNT; s++) {
+            stats_summary_free(stats->series[s]);
+        }
+        free(stats);
+    }
+}
+
+void replay_stats_add(ReplayStats* stats, ReplaySeries series, double ms) {
+    stats_summary_add(stats->series[series], ms);
+}
+
+size_t replay_stats_count(const ReplayStats* stats, ReplaySeries series) {
+    return stats_count(stats->series[series]);
+}
+
+void replay_stats_print(ReplayStats* stats, FILE* out) {
+    fprintf(out, "%-16s%8s%10s%10s%10s%10s%10s\n", "ms", "count", "mean", "p50", "p95", "p99", "max");
+    for (int s = 0; s < REPLAY_SERIES_COUNT; s++) {
+        StatsSummary* summary = stats->series[s];
+        double mean = 0.0, p50 = 0.0, p95 = 0.0, p99 = 0.0, max = 0.0;
+        if (stats_count(summary) > 0) {
+            stats_mean(summary, &mean);
+            stats_quantile(summary, 0.5, &p50);
+            stats_quantile(summary, 0.95, &p95);
+            stats_quantile(summary, 0.99, &p99);
+            stats_max(summary, &max);
+        }
+        fprintf(out, "%-16s%8zu%10.3f%10.3f%10.3f%10.3f%10.3f\n", series_names[s], stats_count(summary), mean, p50,
+                p95, p99, max);
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef CALCULATOR_REPLAY_H
+#define CALCULATOR_REPLAY_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// Recorded UI interactions for the GTK latency harness, and the summary of
+// what replaying them cost. Nothing here touches GTK, so scripts can be
+// checked and reports built without a display.
+//
+// A script has one event per line; blank lines and '#' comments are
+// skipped:
+//
+//   button 7         click the keypad button labelled "7"
+//   type sin(30)     one key event per character, typed into the entry
+//   key Return       a named key: Return or BackSpace
+//   wait 250         stay idle for 250 ms
+//   loop 20          play the whole script 20 times (once, anywhere)
+
+// Longest button label or typed character, in bytes, plus a terminator
+#define REPLAY_MAX_TEXT 16
+
+typedef enum {
+    REPLAY_BUTTON,
+    REPLAY_KEY,
+    REPLAY_WAIT
+} ReplayEventKind;
+
+typedef struct {
+    ReplayEventKind kind;
+    // The button label, the UTF-8 character typed or the key name
+    char text[REPLAY_MAX_TEXT];
+    int wait_ms;
+} ReplayEvent;
+
+typedef struct {
+    ReplayEvent* events;
+    size_t count;
+    int loops;
+} ReplayScript;
+
+// Parses `text`; on a malformed line returns NULL and sets *error_line to
+// its 1-based number (0 when out of memory).
+ReplayScript* replay_script_parse(const char* text, size_t* error_line);
+ReplayScript* replay_script_load(const char* path, size_t* error_line);
+void replay_script_free(ReplayScript* script);
+
+// Measurements, in milliseconds, kept as streaming summaries
+typedef enum {
+    // Time spent in the handlers of one event
+    REPLAY_SERIES_BUTTON,
+    REPLAY_SERIES_KEY,
+    // From dispatching an event to the end of the frame that shows it
+    REPLAY_SERIES_INPUT_TO_FRAME,
+    // From the start of layout to the end of painting, for every frame
+    REPLAY_SERIES_FRAME,
+    REPLAY_SERIES_COUNT
+} ReplaySeries;
+
+typedef struct ReplayStats ReplayStats;
+
+ReplayStats* replay_stats_new(void);
+void replay_stats_free(ReplayStats* stats);
+void replay_stats_add(ReplayStats* stats, ReplaySeries series, double ms);
+size_t replay_stats_count(const ReplayStats* stats, ReplaySeries series);
+// Count, mean, median, 95th and 99th percentile and maximum of each series
+void replay_stats_print(ReplayStats* stats, FILE* out);
+
+#endif
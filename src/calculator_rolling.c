@@ -0,0 +1,319 @@
+#include "calculator_rolling.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Sample numbers, oldest first, whose samples are each smaller (or larger)
+// than every later one in the window; the front is the extreme. A ring of
+// the window's length, which bounds its size.
+typedef struct {
+    uint64_t* numbers;
+    size_t head;
+    size_t size;
+} Deque;
+
+struct RollingWindow {
+    size_t length;
+    // Sample k is at samples[k % length]
+    double* samples;
+    uint64_t pushed;
+    size_t count;
+    size_t nonfinite;
+    // Sums of (x - shift) and (x - shift)^2 over the finite samples, each
+    // with its compensation term
+    double shift;
+    double sum, sum_error;
+    double squares, squares_error;
+    size_t until_rebuild;
+    Deque min, max;
+    double alpha;
+    double ewma;
+    int has_ewma;
+};
+
+struct RollingBinding {
+    const ProgramLibrary* library;
+    size_t index;
+    size_t slot_count;
+    // Per slot, the window feeding it or NULL, and which aggregate
+    const RollingWindow** windows;
+    unsigned char* aggregates;
+    // Bound slots in the order they were bound
+    size_t* bound;
+    size_t bound_count;
+};
+
+// Variable name suffixes, indexed by RollingAggregate
+static const char* const aggregate_suffixes[ROLLING_AGGREGATE_COUNT] = {
+    "", "_count", "_sum", "_mean", "_var", "_sd", "_min", "_max", "_ewma",
+};
+
+static inline void neumaier_add(double* sum, double* error, double x) {
+    double t = *sum + x;
+    if (fabs(*sum) >= fabs(x)) {
+        *error += (*sum - t) + x;
+    } else {
+        *error += (x - t) + *sum;
+    }
+    *sum = t;
+}
+
+static inline double window_sample(const RollingWindow* window, uint64_t number) {
+    return window->samples[number % window->length];
+}
+
+static inline uint64_t deque_at(const Deque* deque, size_t length, size_t i) {
+    return deque->numbers[(deque->head + i) % length];
+}
+
+// Appends `number`, first dropping the entries it dominates: those not below
+// it for the minimum (`sign` 1), not above it for the maximum (`sign` -1)
+static inline void deque_push(RollingWindow* window, Deque* deque, uint64_t number, double sign) {
+    double x = sign * window_sample(window, number);
+    while (deque->size > 0 && sign * window_sample(window, deque_at(deque, window->length, deque->size - 1)) >= x) {
+        deque->size--;
+    }
+    deque->numbers[(deque->head + deque->size) % window->length] = number;
+    deque->size++;
+}
+
+static inline void deque_expire(Deque* deque, size_t length, uint64_t number) {
+    if (deque->size > 0 && deque->numbers[deque->head] == number) {
+        deque->head = (deque->head + 1) % length;
+        deque->size--;
+    }
+}
+
+// Recomputes the sums from the buffer about their current mean, which also
+// moves the shift to where the data is now
+static void rebuild_sums(RollingWindow* window) {
+    uint64_t first = window->pushed - window->count;
+    size_t finite = 0;
+    double mean = 0.0;
+    for (uint64_t k = first; k < window->pushed; k++) {
+        double x = window_sample(window, k);
+        if (isfinite(x)) {
+            finite++;
+            mean += (x - mean) / (double)finite;
+        }
+    }
+    window->shift = mean;
+    window->sum = window->sum_error = 0.0;
+    window->squares = window->squares_error = 0.0;
+    for (uint64_t k = first; k < window->pushed; k++) {
+        double x = window_sample(window, k);
+        if (isfinite(x)) {
+            double d = x - mean;
+            neumaier_add(&window->sum, &window->sum_error, d);
+            neumaier_add(&window->squares, &window->squares_error, d * d);
+        }
+    }
+    window->until_rebuild = window->length;
+}
+
+RollingWindow* rolling_window_new(size_t length, double alpha) {
+    if (length == 0 || !(alpha > 0.0 && alpha <= 1.0)) {
+        return NULL;
+    }
+    RollingWindow* window = (RollingWindow*)calloc(1, sizeof(RollingWindow));
+    if (!window) {
+        return NULL;
+    }
+    window->length = length;
+    window->alpha = alpha;
+    window->samples = (double*)malloc(length * sizeof(double));
+    window->min.numbers = (uint64_t*)malloc(length * sizeof(uint64_t));
+    window->max.numbers = (uint64_t*)malloc(length * sizeof(uint64_t));
+    if (!window->samples || !window->min.numbers || !window->max.numbers) {
+        rolling_window_free(window);
+        return NULL;
+    }
+    rolling_window_clear(window);
+    return window;
+}
+
+void rolling_window_free(RollingWindow* window) {
+    if (window) {
+        free(window->samples);
+        free(window->min.numbers);
+        free(window->max.numbers);
+        free(window);
+    }
+}
+
+void rolling_window_clear(RollingWindow* window) {
+    window->pushed = 0;
+    window->count = 0;
+    window->nonfinite = 0;
+    window->shift = 0.0;
+    window->sum = window->sum_error = 0.0;
+    window->squares = window->squares_error = 0.0;
+    window->until_rebuild = window->length;
+    window->min.head = window->min.size = 0;
+    window->max.head = window->max.size = 0;
+    window->ewma = 0.0;
+    window->has_ewma = 0;
+}
+
+void rolling_window_push(RollingWindow* window, double sample) {
+    uint64_t number = window->pushed;
+
+    if (window->count == window->length) {
+        uint64_t expired = number - window->length;
+        double old = window_sample(window, expired);
+        if (isfinite(old)) {
+            double d = old - window->shift;
+            neumaier_add(&window->sum, &window->sum_error, -d);
+            neumaier_add(&window->squares, &window->squares_error, -d * d);
+        } else {
+            window->nonfinite--;
+        }
+        deque_expire(&window->min, window->length, expired);
+        deque_expire(&window->max, window->length, expired);
+    } else {
+        window->count++;
+    }
+
+    window->samples[number % window->length] = sample;
+    window->pushed++;
+    if (isfinite(sample)) {
+        if (window->count == 1) {
+            // Start the shift at the data so the first window is well
+            // conditioned too
+            window->shift = sample;
+        }
+        double d = sample - window->shift;
+        neumaier_add(&window->sum, &window->sum_error, d);
+        neumaier_add(&window->squares, &window->squares_error, d * d);
+        deque_push(window, &window->min, number, 1.0);
+        deque_push(window, &window->max, number, -1.0);
+        window->ewma = window->has_ewma ? window->ewma + window->alpha * (sample - window->ewma) : sample;
+        window->has_ewma = 1;
+    } else {
+        window->nonfinite++;
+    }
+
+    if (--window->until_rebuild == 0) {
+        rebuild_sums(window);
+    }
+}
+
+size_t rolling_window_count(const RollingWindow* window) {
+    return window->count;
+}
+
+ErrorType rolling_window_get(const RollingWindow* window, RollingAggregate aggregate, double* out) {
+    size_t n = window->count;
+
+    if (aggregate == ROLLING_COUNT) {
+        *out = (double)n;
+        return ERROR_NONE;
+    }
+    if (aggregate == ROLLING_EWMA) {
+        if (!window->has_ewma) {
+            return ERROR_MATH_DOMAIN;
+        }
+        *out = window->ewma;
+        return ERROR_NONE;
+    }
+    if (n == 0) {
+        return ERROR_MATH_DOMAIN;
+    }
+    if (aggregate == ROLLING_LAST) {
+        *out = window_sample(window, window->pushed - 1);
+        return ERROR_NONE;
+    }
+    if (window->nonfinite > 0) {
+        return ERROR_MATH_DOMAIN;
+    }
+
+    double sum = window->sum + window->sum_error;
+    switch (aggregate) {
+        case ROLLING_SUM:
+            *out = window->shift * (double)n + sum;
+            return ERROR_NONE;
+        case ROLLING_MEAN:
+            *out = window->shift + sum / (double)n;
+            return ERROR_NONE;
+        case ROLLING_VARIANCE:
+        case ROLLING_STDDEV: {
+            if (n < 2) {
+                return ERROR_MATH_DOMAIN;
+            }
+            double variance = (window->squares + window->squares_error - sum * sum / (double)n) / (double)(n - 1);
+            // The update can leave a constant window a few ulp below zero
+            variance = variance > 0.0 ? variance : 0.0;
+            *out = aggregate == ROLLING_VARIANCE ? variance : sqrt(variance);
+            return ERROR_NONE;
+        }
+        case ROLLING_MIN:
+            *out = window_sample(window, window->min.numbers[window->min.head]);
+            return ERROR_NONE;
+        case ROLLING_MAX:
+            *out = window_sample(window, window->max.numbers[window->max.head]);
+            return ERROR_NONE;
+        default:
+            return ERROR_SYNTAX;
+    }
+}
+
+RollingBinding* rolling_binding_new(const ProgramLibrary* library, size_t index) {
+    RollingBinding* binding = (RollingBinding*)calloc(1, sizeof(RollingBinding));
+    if (!binding) {
+        return NULL;
+    }
+    binding->library = library;
+    binding->index = index;
+    binding->slot_count = program_variable_count(library, index);
+    binding->windows = (const RollingWindow**)calloc(binding->slot_count + 1, sizeof(RollingWindow*));
+    binding->aggregates = (unsigned char*)calloc(binding->slot_count + 1, 1);
+    binding->bound = (size_t*)malloc((binding->slot_count + 1) * sizeof(size_t));
+    if (!binding->windows || !binding->aggregates || !binding->bound) {
+        rolling_binding_free(binding);
+        return NULL;
+    }
+    return binding;
+}
+
+void rolling_binding_free(RollingBinding* binding) {
+    if (binding) {
+        free(binding->windows);
+        free(binding->aggregates);
+        free(binding->bound);
+        free(binding);
+    }
+}
+
+size_t rolling_binding_add(RollingBinding* binding, const char* name, const RollingWindow* window) {
+    size_t name_length = strlen(name), added = 0;
+
+    for (size_t slot = 0; slot < binding->slot_count; slot++) {
+        const char* variable = program_variable_name(binding->library, binding->index, slot);
+        if (binding->windows[slot] || strncmp(variable, name, name_length) != 0) {
+            continue;
+        }
+        for (int a = 0; a < ROLLING_AGGREGATE_COUNT; a++) {
+            if (strcmp(variable + name_length, aggregate_suffixes[a]) == 0) {
+                binding->windows[slot] = window;
+                binding->aggregates[slot] = (unsigned char)a;
+                binding->bound[binding->bound_count++] = slot;
+                added++;
+                break;
+            }
+        }
+    }
+    return added;
+}
+
+ErrorType rolling_binding_update(const RollingBinding* binding, double* variables) {
+    for (size_t i = 0; i < binding->bound_count; i++) {
+        size_t slot = binding->bound[i];
+        ErrorType error = rolling_window_get(binding->windows[slot], (RollingAggregate)binding->aggregates[slot],
+                                             &variables[slot]);
+        if (error != ERROR_NONE) {
+            return error;
+        }
+    }
+    return ERROR_NONE;
+}
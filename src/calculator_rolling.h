@@ -0,0 +1,75 @@
+#ifndef CALCULATOR_ROLLING_H
+#define CALCULATOR_ROLLING_H
+
+#include <stddef.h>
+#include "calculator_logic.h"
+#include "calculator_program.h"
+
+// Moving aggregates over the last `length` samples of a stream, for live
+// signals that are fed one sample per tick. A push costs O(1) amortized:
+// the sum and sum of squares are kept about a shift near the data with
+// compensated (Neumaier) updates and rebuilt exactly from the buffer once
+// per `length` pushes, so rounding drift cannot build up; the minimum and
+// maximum come from monotonic deques. An exponentially weighted moving
+// average over the whole stream runs alongside.
+//
+// A sample that is a NaN or an infinity stays out of the sums and deques;
+// while one is in the window every aggregate but the newest sample and the
+// count gives ERROR_MATH_DOMAIN, as the statistics functions do. The EWMA
+// skips such samples.
+typedef enum {
+    ROLLING_LAST,
+    ROLLING_COUNT,
+    ROLLING_SUM,
+    ROLLING_MEAN,
+    // Sample variance (n - 1 denominator); needs two samples
+    ROLLING_VARIANCE,
+    ROLLING_STDDEV,
+    ROLLING_MIN,
+    ROLLING_MAX,
+    ROLLING_EWMA,
+    ROLLING_AGGREGATE_COUNT
+} RollingAggregate;
+
+typedef struct RollingWindow RollingWindow;
+
+// `alpha` in (0, 1] is the weight of each new sample in the EWMA. Returns
+// NULL for a zero length, an alpha out of range or if out of memory.
+RollingWindow* rolling_window_new(size_t length, double alpha);
+void rolling_window_free(RollingWindow* window);
+void rolling_window_push(RollingWindow* window, double sample);
+// Forgets every sample, including the EWMA's history.
+void rolling_window_clear(RollingWindow* window);
+// Samples in the window, at most its length
+size_t rolling_window_count(const RollingWindow* window);
+// An empty window gives ERROR_MATH_DOMAIN for everything but the count.
+ErrorType rolling_window_get(const RollingWindow* window, RollingAggregate aggregate, double* out);
+
+// Feeds windows to a compiled program. Binding a window as `temp` gives the
+// program's variables with these names its aggregates:
+//
+//   $temp        newest sample         $temp_var    variance
+//   $temp_count  samples in window     $temp_sd     standard deviation
+//   $temp_sum    sum                   $temp_min    minimum
+//   $temp_mean   mean                  $temp_max    maximum
+//   $temp_ewma   EWMA
+//
+// The slots are resolved once, so a tick is a push per window, an update
+// and program_run, e.g. `($temp-$temp_mean)/$temp_sd` for a rolling z-score.
+typedef struct RollingBinding RollingBinding;
+
+// The library must stay open while the binding is in use. Returns NULL if
+// out of memory.
+RollingBinding* rolling_binding_new(const ProgramLibrary* library, size_t index);
+void rolling_binding_free(RollingBinding* binding);
+// Returns how many variables of the program now read `window`, 0 if none
+// does. A variable already bound to another window keeps it. The window
+// must outlive the binding.
+size_t rolling_binding_add(RollingBinding* binding, const char* name, const RollingWindow* window);
+// Writes each bound variable's current value into `variables[slot]`,
+// leaving the other slots alone; `variables` holds program_variable_count
+// entries, as for program_run. Stops at the first aggregate that cannot be
+// computed and returns its error.
+ErrorType rolling_binding_update(const RollingBinding* binding, double* variables);
+
+#endif
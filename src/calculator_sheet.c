@@ -0,0 +1,538 @@
+#define _GNU_SOURCE
+#include "calculator_sheet.h"
+#include "calculator_program.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define SHEET_MAX_THREADS 64
+// Most ready cells a worker takes at once, so the lock is taken per batch
+// rather than per cell
+#define SHEET_MAX_BATCH 32
+
+typedef struct {
+    char* name;
+    // Compiled definition, or NULL for an input cell or an empty one
+    ProgramLibrary* program;
+    // Cell of each program variable, by slot
+    size_t* inputs;
+    size_t input_count;
+    // Cells with this one among their inputs
+    size_t* dependents;
+    size_t dependent_count;
+    size_t dependent_capacity;
+    double constant;
+    double value;
+    ErrorType error;
+    int defined;
+    int dirty;
+    // Graph searches: visited and looked-for marks compared with the sheet's
+    // epoch, so no pass has to clear them
+    unsigned long visited;
+    unsigned long target;
+    // Recalculation: dirty inputs not yet done, and the chain length so far
+    size_t pending;
+    size_t level;
+} SheetCell;
+
+struct Sheet {
+    SheetCell* cells;
+    size_t count;
+    size_t capacity;
+    // Open addressing by name: cell index + 1, or 0 for a free bucket
+    size_t* buckets;
+    size_t bucket_count;
+    size_t widest;
+    unsigned long epoch;
+    // Scratch for the graph searches
+    size_t* stack;
+    // Cells with `dirty` set, so a recalculation never visits the others
+    size_t* dirty;
+    size_t dirty_count;
+};
+
+// Shared by the workers of one recalculation. `ready` holds cells in the
+// order they became ready; [head, tail) have not been taken yet.
+typedef struct {
+    Sheet* sheet;
+    const Calculator* settings;
+    size_t* ready;
+    size_t head;
+    size_t tail;
+    size_t done;
+    size_t total;
+    size_t depth;
+    int threads;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} SheetRun;
+
+static size_t hash_name(const char* name) {
+    // FNV-1a
+    size_t hash = 14695981039346656037ULL;
+    for (; *name; name++) {
+        hash = (hash ^ (unsigned char)*name) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int name_valid(const char* name) {
+    if (!*name) {
+        return 0;
+    }
+    for (; *name; name++) {
+        char c = *name;
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_')) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static long find_cell(const Sheet* sheet, const char* name) {
+    if (sheet->bucket_count == 0) {
+        return -1;
+    }
+    size_t mask = sheet->bucket_count - 1;
+    for (size_t b = hash_name(name) & mask; sheet->buckets[b]; b = (b + 1) & mask) {
+        if (strcmp(sheet->cells[sheet->buckets[b] - 1].name, name) == 0) {
+            return (long)(sheet->buckets[b] - 1);
+        }
+    }
+    return -1;
+}
+
+// Keeps the table at most half full
+static int grow_buckets(Sheet* sheet) {
+    size_t count = sheet->bucket_count ? sheet->bucket_count * 2 : 64;
+    size_t* buckets = (size_t*)calloc(count, sizeof(size_t));
+    if (!buckets) {
+        return 0;
+    }
+    for (size_t i = 0; i < sheet->count; i++) {
+        size_t b = hash_name(sheet->cells[i].name) & (count - 1);
+        while (buckets[b]) {
+            b = (b + 1) & (count - 1);
+        }
+        buckets[b] = i + 1;
+    }
+    free(sheet->buckets);
+    sheet->buckets = buckets;
+    sheet->bucket_count = count;
+    return 1;
+}
+
+// Index of `name`, created empty if it is new, or -1 if out of memory
+static long intern_cell(Sheet* sheet, const char* name) {
+    long found = find_cell(sheet, name);
+    if (found >= 0) {
+        return found;
+    }
+    if (sheet->count == sheet->capacity) {
+        size_t capacity = sheet->capacity ? sheet->capacity * 2 : 32;
+        SheetCell* cells = (SheetCell*)realloc(sheet->cells, capacity * sizeof(SheetCell));
+        size_t* stack = (size_t*)realloc(sheet->stack, capacity * sizeof(size_t));
+        if (cells) {
+            sheet->cells = cells;
+        }
+        if (stack) {
+            sheet->stack = stack;
+        }
+        size_t* dirty = (size_t*)realloc(sheet->dirty, capacity * sizeof(size_t));
+        if (dirty) {
+            sheet->dirty = dirty;
+        }
+        if (!cells || !stack || !dirty) {
+            return -1;
+        }
+        sheet->capacity = capacity;
+    }
+    if (2 * (sheet->count + 1) > sheet->bucket_count && !grow_buckets(sheet)) {
+        return -1;
+    }
+    SheetCell* cell = &sheet->cells[sheet->count];
+    memset(cell, 0, sizeof(*cell));
+    cell->name = strdup(name);
+    if (!cell->name) {
+        return -1;
+    }
+    cell->error = ERROR_SYNTAX;
+    size_t mask = sheet->bucket_count - 1;
+    size_t b = hash_name(name) & mask;
+    while (sheet->buckets[b]) {
+        b = (b + 1) & mask;
+    }
+    sheet->buckets[b] = sheet->count + 1;
+    return (long)sheet->count++;
+}
+
+static int add_dependent(SheetCell* cell, size_t dependent) {
+    if (cell->dependent_count == cell->dependent_capacity) {
+        size_t capacity = cell->dependent_capacity ? cell->dependent_capacity * 2 : 4;
+        size_t* dependents = (size_t*)realloc(cell->dependents, capacity * sizeof(size_t));
+        if (!dependents) {
+            return 0;
+        }
+        cell->dependents = dependents;
+        cell->dependent_capacity = capacity;
+    }
+    cell->dependents[cell->dependent_count++] = dependent;
+    return 1;
+}
+
+static void remove_dependent(SheetCell* cell, size_t dependent) {
+    for (size_t i = 0; i < cell->dependent_count; i++) {
+        if (cell->dependents[i] == dependent) {
+            cell->dependents[i] = cell->dependents[--cell->dependent_count];
+            return;
+        }
+    }
+}
+
+// True if any of `inputs` is `index` or downstream of it, so depending on
+// them would close a cycle
+static int closes_cycle(Sheet* sheet, size_t index, const size_t* inputs, size_t input_count) {
+    unsigned long epoch = ++sheet->epoch;
+    for (size_t i = 0; i < input_count; i++) {
+        sheet->cells[inputs[i]].target = epoch;
+    }
+    size_t top = 0;
+    sheet->stack[top++] = index;
+    sheet->cells[index].visited = epoch;
+    while (top > 0) {
+        SheetCell* cell = &sheet->cells[sheet->stack[--top]];
+        if (cell->target == epoch) {
+            return 1;
+        }
+        for (size_t d = 0; d < cell->dependent_count; d++) {
+            SheetCell* next = &sheet->cells[cell->dependents[d]];
+            if (next->visited != epoch) {
+                next->visited = epoch;
+                sheet->stack[top++] = cell->dependents[d];
+            }
+        }
+    }
+    return 0;
+}
+
+// Each cell is pushed at most once, so the stack never holds more than
+// every cell
+static void mark_dirty(Sheet* sheet, size_t index) {
+    size_t top = 0;
+    if (sheet->cells[index].dirty) {
+        return;
+    }
+    sheet->cells[index].dirty = 1;
+    sheet->dirty[sheet->dirty_count++] = index;
+    sheet->stack[top++] = index;
+    while (top > 0) {
+        const SheetCell* cell = &sheet->cells[sheet->stack[--top]];
+        for (size_t d = 0; d < cell->dependent_count; d++) {
+            SheetCell* next = &sheet->cells[cell->dependents[d]];
+            if (!next->dirty) {
+                next->dirty = 1;
+                sheet->dirty[sheet->dirty_count++] = cell->dependents[d];
+                sheet->stack[top++] = cell->dependents[d];
+            }
+        }
+    }
+}
+
+// Replaces the definition of cell `index` with `program` (NULL for an input
+// holding `constant`) reading from `inputs`, which the cell takes over
+static ErrorType define_cell(Sheet* sheet, size_t index, ProgramLibrary* program, size_t* inputs,
+                             size_t input_count, double constant) {
+    if (closes_cycle(sheet, index, inputs, input_count)) {
+        program_library_close(program);
+        free(inputs);
+        return ERROR_CIRCULAR_REFERENCE;
+    }
+    for (size_t i = 0; i < input_count; i++) {
+        if (!add_dependent(&sheet->cells[inputs[i]], index)) {
+            for (size_t j = 0; j < i; j++) {
+                remove_dependent(&sheet->cells[inputs[j]], index);
+            }
+            program_library_close(program);
+            free(inputs);
+            return ERROR_OUT_OF_MEMORY;
+        }
+    }
+    SheetCell* cell = &sheet->cells[index];
+    for (size_t i = 0; i < cell->input_count; i++) {
+        remove_dependent(&sheet->cells[cell->inputs[i]], index);
+    }
+    program_library_close(cell->program);
+    free(cell->inputs);
+    cell->program = program;
+    cell->inputs = inputs;
+    cell->input_count = input_count;
+    cell->constant = constant;
+    cell->defined = 1;
+    if (input_count > sheet->widest) {
+        sheet->widest = input_count;
+    }
+    mark_dirty(sheet, index);
+    return ERROR_NONE;
+}
+
+Sheet* sheet_new(void) {
+    return (Sheet*)calloc(1, sizeof(Sheet));
+}
+
+void sheet_free(Sheet* sheet) {
+    if (!sheet) {
+        return;
+    }
+    for (size_t i = 0; i < sheet->count; i++) {
+        free(sheet->cells[i].name);
+        program_library_close(sheet->cells[i].program);
+        free(sheet->cells[i].inputs);
+        free(sheet->cells[i].dependents);
+    }
+    free(sheet->cells);
+    free(sheet->buckets);
+    free(sheet->stack);
+    free(sheet->dirty);
+    free(sheet);
+}
+
+ErrorType sheet_set(Sheet* sheet, const char* name, const char* expression) {
+    if (!name_valid(name)) {
+        return ERROR_SYNTAX;
+    }
+    ProgramWriter* writer = program_writer_new();
+    if (!writer) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+    ErrorType error = program_writer_add(writer, name, expression);
+    ProgramLibrary* program = error == ERROR_NONE ? program_writer_load(writer) : NULL;
+    program_writer_free(writer);
+    if (error != ERROR_NONE) {
+        return error;
+    }
+    if (!program) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+
+    size_t input_count = program_variable_count(program, 0);
+    size_t* inputs = (size_t*)malloc((input_count + 1) * sizeof(size_t));
+    long index = inputs ? intern_cell(sheet, name) : -1;
+    for (size_t i = 0; index >= 0 && i < input_count; i++) {
+        long input = intern_cell(sheet, program_variable_name(program, 0, i));
+        if (input < 0) {
+            index = -1;
+        } else {
+            inputs[i] = (size_t)input;
+        }
+    }
+    if (index < 0) {
+        program_library_close(program);
+        free(inputs);
+        return ERROR_OUT_OF_MEMORY;
+    }
+    return define_cell(sheet, (size_t)index, program, inputs, input_count, 0.0);
+}
+
+ErrorType sheet_set_value(Sheet* sheet, const char* name, double value) {
+    if (!name_valid(name)) {
+        return ERROR_SYNTAX;
+    }
+    long index = intern_cell(sheet, name);
+    if (index < 0) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+    return define_cell(sheet, (size_t)index, NULL, NULL, 0, value);
+}
+
+// Value of one cell whose inputs are all up to date. An input's error
+// becomes the cell's own without running it.
+static void evaluate_cell(Sheet* sheet, SheetCell* cell, Calculator* calc, double* gathered) {
+    if (!cell->defined) {
+        cell->error = ERROR_SYNTAX;
+        return;
+    }
+    if (!cell->program) {
+        cell->value = cell->constant;
+        cell->error = ERROR_NONE;
+        return;
+    }
+    for (size_t i = 0; i < cell->input_count; i++) {
+        const SheetCell* input = &sheet->cells[cell->inputs[i]];
+        if (input->error != ERROR_NONE) {
+            cell->error = input->error;
+            return;
+        }
+        gathered[i] = input->value;
+    }
+    double value = 0.0;
+    cell->error = program_run(cell->program, 0, calc, gathered, &value);
+    if (cell->error == ERROR_NONE) {
+        cell->value = value;
+    }
+}
+
+// Finished cells release their dependents; the lock is held
+static void complete_cells(SheetRun* run, const size_t* batch, size_t count) {
+    Sheet* sheet = run->sheet;
+    for (size_t k = 0; k < count; k++) {
+        const SheetCell* cell = &sheet->cells[batch[k]];
+        if (cell->level > run->depth) {
+            run->depth = cell->level;
+        }
+        for (size_t d = 0; d < cell->dependent_count; d++) {
+            SheetCell* next = &sheet->cells[cell->dependents[d]];
+            if (next->level < cell->level + 1) {
+                next->level = cell->level + 1;
+            }
+            if (--next->pending == 0) {
+                run->ready[run->tail++] = cell->dependents[d];
+            }
+        }
+    }
+    run->done += count;
+}
+
+static void* sheet_worker(void* arg) {
+    SheetRun* run = (SheetRun*)arg;
+    Sheet* sheet = run->sheet;
+    Calculator* calc = calculator_new();
+    double* gathered = (double*)malloc((sheet->widest + 1) * sizeof(double));
+    size_t batch[SHEET_MAX_BATCH];
+
+    if (calc && run->settings) {
+        calc->angle_mode = run->settings->angle_mode;
+        calc->budget = run->settings->budget;
+        calc->cancel = run->settings->cancel;
+    }
+    pthread_mutex_lock(&run->lock);
+    for (;;) {
+        while (run->head == run->tail && run->done < run->total) {
+            pthread_cond_wait(&run->wake, &run->lock);
+        }
+        if (run->done == run->total) {
+            break;
+        }
+        // An even share of what is ready, so one worker does not take a
+        // whole level while the others wait
+        size_t count = (run->tail - run->head) / (size_t)run->threads;
+        count = count < 1 ? 1 : count > SHEET_MAX_BATCH ? SHEET_MAX_BATCH : count;
+        memcpy(batch, run->ready + run->head, count * sizeof(size_t));
+        run->head += count;
+        pthread_mutex_unlock(&run->lock);
+
+        for (size_t k = 0; k < count; k++) {
+            SheetCell* cell = &sheet->cells[batch[k]];
+            if (calc && gathered) {
+                evaluate_cell(sheet, cell, calc, gathered);
+            } else {
+                cell->error = ERROR_OUT_OF_MEMORY;
+            }
+        }
+
+        pthread_mutex_lock(&run->lock);
+        size_t ready = run->tail;
+        complete_cells(run, batch, count);
+        if (run->tail > ready + 1 || run->done == run->total) {
+            pthread_cond_broadcast(&run->wake);
+        } else if (run->tail > ready) {
+            pthread_cond_signal(&run->wake);
+        }
+    }
+    pthread_mutex_unlock(&run->lock);
+    free(gathered);
+    calculator_free(calc);
+    return NULL;
+}
+
+ErrorType sheet_recalculate(Sheet* sheet, const Calculator* settings, int threads, SheetStats* stats) {
+    SheetRun run;
+    memset(&run, 0, sizeof(run));
+    run.sheet = sheet;
+    run.settings = settings;
+    run.total = sheet->dirty_count;
+    if (stats) {
+        memset(stats, 0, sizeof(*stats));
+    }
+    if (run.total == 0) {
+        return ERROR_NONE;
+    }
+    run.ready = (size_t*)malloc(run.total * sizeof(size_t));
+    if (!run.ready) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+
+    // A dirty cell waits for its dirty inputs; the others are up to date
+    for (size_t i = 0; i < sheet->dirty_count; i++) {
+        SheetCell* cell = &sheet->cells[sheet->dirty[i]];
+        cell->pending = 0;
+        cell->level = 1;
+        for (size_t k = 0; k < cell->input_count; k++) {
+            cell->pending += sheet->cells[cell->inputs[k]].dirty;
+        }
+        if (cell->pending == 0) {
+            run.ready[run.tail++] = sheet->dirty[i];
+        }
+    }
+
+    if (threads <= 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (int)online : 1;
+    }
+    if (threads > SHEET_MAX_THREADS) {
+        threads = SHEET_MAX_THREADS;
+    }
+    if (run.total < SHEET_PARALLEL_MIN_CELLS) {
+        threads = 1;
+    }
+    run.threads = threads;
+    pthread_mutex_init(&run.lock, NULL);
+    pthread_cond_init(&run.wake, NULL);
+
+    pthread_t handles[SHEET_MAX_THREADS];
+    int started[SHEET_MAX_THREADS] = {0};
+    for (int t = 1; t < threads; t++) {
+        started[t] = pthread_create(&handles[t], NULL, sheet_worker, &run) == 0;
+    }
+    sheet_worker(&run);
+    for (int t = 1; t < threads; t++) {
+        if (started[t]) {
+            pthread_join(handles[t], NULL);
+        }
+    }
+    pthread_cond_destroy(&run.wake);
+    pthread_mutex_destroy(&run.lock);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < sheet->dirty_count; i++) {
+        SheetCell* cell = &sheet->cells[sheet->dirty[i]];
+        cell->dirty = cell->error == ERROR_CANCELLED;
+        if (cell->dirty) {
+            sheet->dirty[kept++] = sheet->dirty[i];
+        }
+    }
+    sheet->dirty_count = kept;
+    if (stats) {
+        stats->recomputed = run.total;
+        stats->depth = run.depth;
+        stats->threads = threads;
+    }
+    free(run.ready);
+    return ERROR_NONE;
+}
+
+ErrorType sheet_get(const Sheet* sheet, const char* name, double* value) {
+    long index = find_cell(sheet, name);
+    if (index < 0) {
+        return ERROR_SYNTAX;
+    }
+    const SheetCell* cell = &sheet->cells[index];
+    if (cell->error == ERROR_NONE) {
+        *value = cell->value;
+    }
+    return cell->error;
+}
+
+size_t sheet_cell_count(const Sheet* sheet) {
+    return sheet->count;
+}
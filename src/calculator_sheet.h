@@ -0,0 +1,57 @@
+#ifndef CALCULATOR_SHEET_H
+#define CALCULATOR_SHEET_H
+
+#include <stddef.h>
+#include "calculator_logic.h"
+
+// A workspace of named cells, each a compiled expression that may refer to
+// other cells as `$name`, e.g. `$price*(1+$tax)`. The references form a
+// dependency graph that is kept acyclic: a definition that would make a cell
+// depend on itself is refused.
+//
+// Changing a cell marks it and everything downstream of it dirty, and
+// sheet_recalculate runs only the dirty cells, each after all of its inputs.
+// Cells whose inputs are done are handed to the worker threads as they
+// become ready, so independent branches of the graph run in parallel while
+// a chain runs in order.
+typedef struct Sheet Sheet;
+
+// Fewer dirty cells than this are recalculated on the calling thread.
+#define SHEET_PARALLEL_MIN_CELLS 256
+
+typedef struct {
+    // Cells evaluated by the last sheet_recalculate
+    size_t recomputed;
+    // Longest chain of dirty cells, each depending on the one before
+    size_t depth;
+    int threads;
+} SheetStats;
+
+Sheet* sheet_new(void);
+void sheet_free(Sheet* sheet);
+
+// Defines or redefines cell `name` (letters, digits and `_`). A reference to
+// a cell that has no definition yet creates it empty; reading it gives
+// ERROR_SYNTAX until it is defined. An expression that does not compile
+// gives ERROR_SYNTAX, and one that would close a cycle
+// ERROR_CIRCULAR_REFERENCE; either way the cell keeps its old definition.
+ErrorType sheet_set(Sheet* sheet, const char* name, const char* expression);
+// Defines an input cell holding `value`, without compiling anything.
+ErrorType sheet_set_value(Sheet* sheet, const char* name, double value);
+
+// Evaluates the dirty cells with the angle mode, budget and cancel token of
+// `settings`, which may be NULL for the defaults; the budget applies to each
+// cell. `threads` <= 0 uses one thread per online CPU. A cell that fails
+// holds its error, and so does every cell that depends on it. Cells stopped
+// by the cancel token stay dirty for the next call. Returns
+// ERROR_OUT_OF_MEMORY if the work could not be set up, else ERROR_NONE;
+// `stats` may be NULL.
+ErrorType sheet_recalculate(Sheet* sheet, const Calculator* settings, int threads, SheetStats* stats);
+
+// The value of `name` as of the last recalculation, or its error. A name
+// that was never mentioned gives ERROR_SYNTAX.
+ErrorType sheet_get(const Sheet* sheet, const char* name, double* value);
+// Cells defined or referenced so far
+size_t sheet_cell_count(const Sheet* sheet);
+
+#endif
@@ -0,0 +1,429 @@
+#include "calculator_stats.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Centroids left after a compression; the k1 scale function allows at most
+// about STATS_COMPRESSION of them
+#define DIGEST_CENTROIDS 512
+// Incoming points collected between compressions
+#define DIGEST_BUFFER 4096
+// Lines read between two polls of the cancel token
+#define STATS_CANCEL_INTERVAL 65536
+// Longest number accepted on one line of a column file
+#define STATS_MAX_LINE 64
+
+typedef struct {
+    double mean;
+    double weight;
+} Centroid;
+
+struct StatsSummary {
+    // Welford state
+    size_t count;
+    double mean;
+    double m2;
+    double min;
+    double max;
+    // Set once a NaN or infinity was added
+    int invalid;
+    // Merging t-digest: compressed centroids sorted by mean, plus unsorted
+    // points and centroids waiting for the next compression. The buffer has
+    // room for the centroids too, which are merged into it when compressing.
+    Centroid centroids[DIGEST_CENTROIDS];
+    size_t centroid_count;
+    Centroid buffer[DIGEST_BUFFER + DIGEST_CENTROIDS];
+    size_t buffer_count;
+};
+
+StatsSummary* stats_summary_new(void) {
+    StatsSummary* summary = (StatsSummary*)malloc(sizeof(StatsSummary));
+    if (summary) {
+        summary->count = 0;
+        summary->mean = 0.0;
+        summary->m2 = 0.0;
+        summary->min = INFINITY;
+        summary->max = -INFINITY;
+        summary->invalid = 0;
+        summary->centroid_count = 0;
+        summary->buffer_count = 0;
+    }
+    return summary;
+}
+
+void stats_summary_free(StatsSummary* summary) {
+    free(summary);
+}
+
+// Sorts by mean: quicksort with median-of-three pivots down to short runs,
+// then insertion sort. Inlined comparisons are several times faster than qsort.
+static void sort_centroids(Centroid* c, size_t n) {
+    while (n > 16) {
+        size_t mid = n / 2, last = n - 1;
+        if (c[mid].mean < c[0].mean) { Centroid t = c[mid]; c[mid] = c[0]; c[0] = t; }
+        if (c[last].mean < c[0].mean) { Centroid t = c[last]; c[last] = c[0]; c[0] = t; }
+        if (c[last].mean < c[mid].mean) { Centroid t = c[last]; c[last] = c[mid]; c[mid] = t; }
+        double pivot = c[mid].mean;
+        size_t i = 0, j = last;
+        for (;;) {
+            while (c[i].mean < pivot) i++;
+            while (c[j].mean > pivot) j--;
+            if (i >= j) break;
+            Centroid t = c[i]; c[i] = c[j]; c[j] = t;
+            i++;
+            j--;
+        }
+        // Recurse into the smaller side, loop on the larger
+        if (j + 1 < n - j - 1) {
+            sort_centroids(c, j + 1);
+            c += j + 1;
+            n -= j + 1;
+        } else {
+            sort_centroids(c + j + 1, n - j - 1);
+            n = j + 1;
+        }
+    }
+    for (size_t i = 1; i < n; i++) {
+        Centroid t = c[i];
+        size_t j = i;
+        while (j > 0 && c[j - 1].mean > t.mean) {
+            c[j] = c[j - 1];
+            j--;
+        }
+        c[j] = t;
+    }
+}
+
+// k1 scale function and its inverse: a centroid may span one unit of k,
+// which keeps centroids small near q = 0 and q = 1
+static double scale_k(double q) {
+    return STATS_COMPRESSION / (2.0 * M_PI) * asin(2.0 * q - 1.0);
+}
+
+static double scale_q(double k) {
+    if (k >= STATS_COMPRESSION / 4.0) {
+        return 1.0;
+    }
+    return (sin(k * 2.0 * M_PI / STATS_COMPRESSION) + 1.0) / 2.0;
+}
+
+static void compress(StatsSummary* s) {
+    if (s->buffer_count == 0) {
+        return;
+    }
+    // Sort the new points, then merge the sorted centroids in from the back
+    sort_centroids(s->buffer, s->buffer_count);
+    size_t n = s->buffer_count + s->centroid_count;
+    size_t i = s->buffer_count, j = s->centroid_count, k = n;
+    while (j > 0) {
+        if (i > 0 && s->buffer[i - 1].mean > s->centroids[j - 1].mean) {
+            s->buffer[--k] = s->buffer[--i];
+        } else {
+            s->buffer[--k] = s->centroids[--j];
+        }
+    }
+
+    double total = 0.0;
+    for (i = 0; i < n; i++) {
+        total += s->buffer[i].weight;
+    }
+
+    size_t out = 0;
+    double before = 0.0;
+    double q_limit = scale_q(scale_k(0.0) + 1.0);
+    Centroid current = s->buffer[0];
+    for (i = 1; i < n; i++) {
+        const Centroid* next = &s->buffer[i];
+        if ((before + current.weight + next->weight) / total <= q_limit) {
+            current.weight += next->weight;
+            current.mean += (next->mean - current.mean) * next->weight / current.weight;
+        } else {
+            s->centroids[out++] = current;
+            before += current.weight;
+            q_limit = scale_q(scale_k(before / total) + 1.0);
+            current = *next;
+        }
+    }
+    s->centroids[out++] = current;
+    s->centroid_count = out;
+    s->buffer_count = 0;
+}
+
+static void buffer_centroid(StatsSummary* s, double mean, double weight) {
+    if (s->buffer_count == DIGEST_BUFFER) {
+        compress(s);
+    }
+    s->buffer[s->buffer_count++] = (Centroid){mean, weight};
+}
+
+void stats_summary_add(StatsSummary* s, double value) {
+    if (!isfinite(value)) {
+        s->invalid = 1;
+        return;
+    }
+    s->count++;
+    double delta = value - s->mean;
+    s->mean += delta / (double)s->count;
+    s->m2 += delta * (value - s->mean);
+    if (value < s->min) {
+        s->min = value;
+    }
+    if (value > s->max) {
+        s->max = value;
+    }
+    buffer_centroid(s, value, 1.0);
+}
+
+void stats_summary_merge(StatsSummary* into, const StatsSummary* from) {
+    into->invalid |= from->invalid;
+    if (from->count == 0) {
+        return;
+    }
+    double n = (double)(into->count + from->count);
+    double delta = from->mean - into->mean;
+    into->m2 += from->m2 + delta * delta * (double)into->count * (double)from->count / n;
+    into->mean += delta * (double)from->count / n;
+    into->count += from->count;
+    into->min = fmin(into->min, from->min);
+    into->max = fmax(into->max, from->max);
+
+    for (size_t i = 0; i < from->centroid_count; i++) {
+        buffer_centroid(into, from->centroids[i].mean, from->centroids[i].weight);
+    }
+    for (size_t i = 0; i < from->buffer_count; i++) {
+        buffer_centroid(into, from->buffer[i].mean, from->buffer[i].weight);
+    }
+}
+
+typedef struct {
+    const char* start;
+    const char* end;
+    const CancelToken* cancel;
+    StatsSummary* summary;
+    ErrorType error;
+} StatsWorker;
+
+static void* stats_worker(void* arg) {
+    StatsWorker* w = (StatsWorker*)arg;
+    const char* p = w->start;
+    long lines = 0;
+
+    while (p < w->end) {
+        const char* line_end = memchr(p, '\n', (size_t)(w->end - p));
+        if (!line_end) {
+            line_end = w->end;
+        }
+        if (++lines % STATS_CANCEL_INTERVAL == 0 && w->cancel && cancel_token_is_cancelled(w->cancel)) {
+            w->error = ERROR_CANCELLED;
+            return NULL;
+        }
+
+        const char* a = p;
+        const char* b = line_end;
+        while (a < b && (*a == ' ' || *a == '\t')) {
+            a++;
+        }
+        while (b > a && (b[-1] == ' ' || b[-1] == '\t' || b[-1] == '\r')) {
+            b--;
+        }
+        p = line_end + 1;
+        if (a == b || *a == '#') {
+            continue;
+        }
+
+        // The mapping is not NUL-terminated, so strtod reads a copy
+        char text[STATS_MAX_LINE];
+        char* parsed;
+        size_t length = (size_t)(b - a);
+        if (length >= sizeof(text)) {
+            w->error = ERROR_SYNTAX;
+            return NULL;
+        }
+        memcpy(text, a, length);
+        text[length] = '\0';
+        double value = strtod(text, &parsed);
+        if (parsed != text + length) {
+            w->error = ERROR_SYNTAX;
+            return NULL;
+        }
+        stats_summary_add(w->summary, value);
+    }
+    return NULL;
+}
+
+ErrorType stats_summary_add_file(StatsSummary* summary, const char* path, int threads, const CancelToken* cancel) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0) {
+        return ERROR_FILE;
+    }
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return ERROR_FILE;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return ERROR_NONE;
+    }
+    size_t size = (size_t)st.st_size;
+    const char* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return ERROR_FILE;
+    }
+    madvise((void*)data, size, MADV_SEQUENTIAL);
+
+    if (threads <= 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (int)online : 1;
+    }
+    if (threads > STATS_MAX_THREADS) {
+        threads = STATS_MAX_THREADS;
+    }
+    // Partitions of at least 64 KiB, each starting at a line
+    if ((size_t)threads > size / 65536 + 1) {
+        threads = (int)(size / 65536 + 1);
+    }
+
+    StatsWorker workers[STATS_MAX_THREADS];
+    pthread_t handles[STATS_MAX_THREADS];
+    int started[STATS_MAX_THREADS] = {0};
+    const char* end = data + size;
+    const char* start = data;
+    ErrorType result = ERROR_NONE;
+    for (int t = 0; t < threads; t++) {
+        const char* cut = t == threads - 1 ? end : data + size * (size_t)(t + 1) / (size_t)threads;
+        if (cut < start) {
+            cut = start;
+        }
+        const char* newline = cut < end ? memchr(cut, '\n', (size_t)(end - cut)) : NULL;
+        if (t < threads - 1) {
+            cut = newline ? newline + 1 : end;
+        }
+        workers[t] = (StatsWorker){start, cut, cancel, t == 0 ? summary : stats_summary_new(), ERROR_NONE};
+        if (!workers[t].summary) {
+            result = ERROR_OUT_OF_MEMORY;
+            threads = t;
+            break;
+        }
+        start = cut;
+    }
+    if (result == ERROR_NONE) {
+        for (int t = 1; t < threads; t++) {
+            started[t] = pthread_create(&handles[t], NULL, stats_worker, &workers[t]) == 0;
+            if (!started[t]) {
+                stats_worker(&workers[t]);
+            }
+        }
+        stats_worker(&workers[0]);
+        for (int t = 1; t < threads; t++) {
+            if (started[t]) {
+                pthread_join(handles[t], NULL);
+            }
+        }
+    }
+
+    // Merged in file order; the first failing partition decides the error
+    for (int t = 0; t < threads; t++) {
+        if (result == ERROR_NONE) {
+            result = workers[t].error;
+        }
+        if (t > 0) {
+            if (result == ERROR_NONE) {
+                stats_summary_merge(summary, workers[t].summary);
+            }
+            stats_summary_free(workers[t].summary);
+        }
+    }
+    munmap((void*)data, size);
+    return result;
+}
+
+size_t stats_count(const StatsSummary* summary) {
+    return summary->count;
+}
+
+static ErrorType check(const StatsSummary* s, size_t needed) {
+    return s->invalid || s->count < needed ? ERROR_MATH_DOMAIN : ERROR_NONE;
+}
+
+ErrorType stats_mean(const StatsSummary* summary, double* out) {
+    ErrorType err = check(summary, 1);
+    if (err == ERROR_NONE) {
+        *out = summary->mean;
+    }
+    return err;
+}
+
+ErrorType stats_variance(const StatsSummary* summary, double* out) {
+    ErrorType err = check(summary, 2);
+    if (err == ERROR_NONE) {
+        *out = summary->m2 / (double)(summary->count - 1);
+    }
+    return err;
+}
+
+ErrorType stats_stddev(const StatsSummary* summary, double* out) {
+    ErrorType err = stats_variance(summary, out);
+    if (err == ERROR_NONE) {
+        *out = sqrt(*out);
+    }
+    return err;
+}
+
+ErrorType stats_min(const StatsSummary* summary, double* out) {
+    ErrorType err = check(summary, 1);
+    if (err == ERROR_NONE) {
+        *out = summary->min;
+    }
+    return err;
+}
+
+ErrorType stats_max(const StatsSummary* summary, double* out) {
+    ErrorType err = check(summary, 1);
+    if (err == ERROR_NONE) {
+        *out = summary->max;
+    }
+    return err;
+}
+
+ErrorType stats_quantile(StatsSummary* summary, double q, double* out) {
+    ErrorType err = check(summary, 1);
+    if (err != ERROR_NONE) {
+        return err;
+    }
+    if (!(q >= 0.0 && q <= 1.0)) {
+        return ERROR_MATH_DOMAIN;
+    }
+    compress(summary);
+
+    // Each centroid sits at its mid rank, the minimum and maximum at the
+    // first and last rank; interpolate between neighbours around q*(n-1)
+    double rank = q * (double)(summary->count - 1);
+    double prev_rank = 0.0, prev_value = summary->min, before = 0.0;
+    for (size_t i = 0; i < summary->centroid_count; i++) {
+        const Centroid* c = &summary->centroids[i];
+        double mid = before + (c->weight - 1.0) / 2.0;
+        if (rank <= mid) {
+            *out = mid == prev_rank ? c->mean
+                                    : prev_value + (rank - prev_rank) / (mid - prev_rank) * (c->mean - prev_value);
+            return ERROR_NONE;
+        }
+        prev_rank = mid;
+        prev_value = c->mean;
+        before += c->weight;
+    }
+    double last = (double)(summary->count - 1);
+    *out = last == prev_rank ? summary->max
+                             : prev_value + (rank - prev_rank) / (last - prev_rank) * (summary->max - prev_value);
+    return ERROR_NONE;
+}
@@ -0,0 +1,54 @@
+#ifndef CALCULATOR_STATS_H
+#define CALCULATOR_STATS_H
+
+#include <stddef.h>
+#include "calculator_logic.h"
+
+// Single-pass summaries of a data set in bounded memory: count, mean and
+// variance by Welford's update (merged with Chan's formula), exact minimum
+// and maximum, and a merging t-digest for quantiles. Summaries of separate
+// partitions merge into the summary of their union, which is how column
+// files are read in parallel.
+//
+// The digest keeps every point while the data set is small (up to about a
+// hundred values), so quantiles of short lists are exact; beyond that the
+// error is a small fraction of a percentile, smallest in the tails.
+#define STATS_COMPRESSION 200.0
+
+// Upper bound on the worker threads used to read one file
+#define STATS_MAX_THREADS 64
+
+typedef struct StatsSummary StatsSummary;
+
+StatsSummary* stats_summary_new(void);
+void stats_summary_free(StatsSummary* summary);
+void stats_summary_add(StatsSummary* summary, double value);
+// Folds `from` into `into`; `from` is left unchanged.
+void stats_summary_merge(StatsSummary* into, const StatsSummary* from);
+
+// Streams a numeric column file, one value per line, into `summary`. Blank
+// lines and lines starting with '#' are skipped; any other line that is not
+// a number gives ERROR_SYNTAX. The file is memory-mapped and cut into
+// partitions at line breaks, which `threads` workers summarize in parallel
+// (<= 0 uses one per online CPU); the partitions are merged in file order,
+// so the last bits of the moments and the digest's centroids can differ
+// between thread counts. Raising `cancel` stops the pass with
+// ERROR_CANCELLED. A file that cannot be opened or mapped, or is not a
+// regular file, gives ERROR_FILE.
+ErrorType stats_summary_add_file(StatsSummary* summary, const char* path, int threads, const CancelToken* cancel);
+
+size_t stats_count(const StatsSummary* summary);
+// All of these give ERROR_MATH_DOMAIN for an empty data set or one that
+// contains a NaN or an infinity. The variance
+// is the sample variance (n - 1 denominator) and needs two values.
+ErrorType stats_mean(const StatsSummary* summary, double* out);
+ErrorType stats_variance(const StatsSummary* summary, double* out);
+ErrorType stats_stddev(const StatsSummary* summary, double* out);
+ErrorType stats_min(const StatsSummary* summary, double* out);
+ErrorType stats_max(const StatsSummary* summary, double* out);
+// `q` in [0, 1]. Interpolates linearly between order statistics, like the
+// default quantile of R and NumPy, taking each centroid at its mid rank.
+// Compresses pending points first, hence the non-const summary.
+ErrorType stats_quantile(StatsSummary* summary, double q, double* out);
+
+#endif
@@ -0,0 +1,229 @@
+#include "calculator_trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define TRACE_MAGIC "METRACE"
+#define TRACE_FORMAT_VERSION 1
+// Length of the busy wait that calibrates the cycle counter
+#define TRACE_CALIBRATION_SECONDS 0.01
+
+struct TraceBuffer {
+    TraceEvent* events;
+    size_t mask;
+    // Events recorded since the last clear; the next one goes to
+    // events[written & mask]
+    uint64_t written;
+    // Carried over by trace_import_binary
+    uint64_t dropped_before;
+};
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t event_size;
+    uint64_t count;
+    uint64_t dropped;
+    double ticks_per_second;
+} TraceFileHeader;
+
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static double ticks_per_second;
+
+TraceBuffer* trace_buffer_new(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity && size < ((size_t)1 << 40)) {
+        size <<= 1;
+    }
+    TraceBuffer* buffer = (TraceBuffer*)malloc(sizeof(TraceBuffer));
+    if (!buffer) {
+        return NULL;
+    }
+    buffer->events = (TraceEvent*)malloc(size * sizeof(TraceEvent));
+    if (!buffer->events) {
+        free(buffer);
+        return NULL;
+    }
+    buffer->mask = size - 1;
+    buffer->written = 0;
+    buffer->dropped_before = 0;
+    return buffer;
+}
+
+void trace_buffer_free(TraceBuffer* buffer) {
+    if (buffer) {
+        free(buffer->events);
+        free(buffer);
+    }
+}
+
+void trace_buffer_clear(TraceBuffer* buffer) {
+    buffer->written = 0;
+    buffer->dropped_before = 0;
+}
+
+size_t trace_buffer_capacity(const TraceBuffer* buffer) {
+    return buffer->mask + 1;
+}
+
+size_t trace_buffer_count(const TraceBuffer* buffer) {
+    return buffer->written <= buffer->mask ? (size_t)buffer->written : buffer->mask + 1;
+}
+
+uint64_t trace_buffer_dropped(const TraceBuffer* buffer) {
+    return buffer->dropped_before + (buffer->written - trace_buffer_count(buffer));
+}
+
+const TraceEvent* trace_buffer_event(const TraceBuffer* buffer, size_t index) {
+    uint64_t first = buffer->written - trace_buffer_count(buffer);
+    return &buffer->events[(first + index) & buffer->mask];
+}
+
+TraceEvent* trace_buffer_next(TraceBuffer* buffer) {
+    return &buffer->events[buffer->written++ & buffer->mask];
+}
+
+static uint64_t monotonic_nanoseconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t trace_timestamp(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return monotonic_nanoseconds();
+#endif
+}
+
+static void trace_calibrate(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    uint64_t clock_start = monotonic_nanoseconds();
+    uint64_t ticks_start = trace_timestamp();
+    uint64_t clock_end;
+    do {
+        clock_end = monotonic_nanoseconds();
+    } while (clock_end - clock_start < (uint64_t)(TRACE_CALIBRATION_SECONDS * 1e9));
+    uint64_t ticks_end = trace_timestamp();
+    ticks_per_second = (double)(ticks_end - ticks_start) * 1e9 / (double)(clock_end - clock_start);
+#else
+    ticks_per_second = 1e9;
+#endif
+}
+
+double trace_ticks_per_second(void) {
+    pthread_once(&trace_once, trace_calibrate);
+    return ticks_per_second;
+}
+
+// JSON has no NaN or infinity, so those are written as strings
+static void write_json_number(FILE* file, double value) {
+    if (isnan(value)) {
+        fputs("\"nan\"", file);
+    } else if (isinf(value)) {
+        fputs(value > 0 ? "\"inf\"" : "\"-inf\"", file);
+    } else {
+        fprintf(file, "%.17g", value);
+    }
+}
+
+static void write_json_name(FILE* file, char op) {
+    const char* name = calculator_operator_name(op);
+    fputc('"', file);
+    if (name) {
+        fputs(name, file);
+    } else if (op == '"' || op == '\\') {
+        fprintf(file, "\\%c", op);
+    } else if ((unsigned char)op < 0x20 || (unsigned char)op >= 0x7f) {
+        fprintf(file, "\\u%04x", (unsigned char)op);
+    } else {
+        fputc(op, file);
+    }
+    fputc('"', file);
+}
+
+int trace_export_chrome(const TraceBuffer* buffer, const char* path) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        return 0;
+    }
+    size_t count = trace_buffer_count(buffer);
+    double microseconds = 1e6 / trace_ticks_per_second();
+    uint64_t origin = count > 0 ? trace_buffer_event(buffer, 0)->start : 0;
+
+    fputs("{\"traceEvents\":[", file);
+    for (size_t i = 0; i < count; i++) {
+        const TraceEvent* event = trace_buffer_event(buffer, i);
+        fputs(i > 0 ? ",\n{\"name\":" : "\n{\"name\":", file);
+        write_json_name(file, event->op);
+        fprintf(file, ",\"cat\":\"operator\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,\"args\":{",
+                (double)(event->start - origin) * microseconds, (double)(event->end - event->start) * microseconds);
+        for (int k = 0; k < event->arity && k < 2; k++) {
+            fprintf(file, "\"operand%d\":", k);
+            write_json_number(file, event->operands[k]);
+            fputc(',', file);
+        }
+        fputs("\"result\":", file);
+        write_json_number(file, event->result);
+        fprintf(file, ",\"numbers\":%d,\"operators\":%d,\"error\":%d}}",
+                event->number_depth, event->operator_depth, event->error);
+    }
+    fprintf(file, "\n],\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped\":%llu}}\n",
+            (unsigned long long)trace_buffer_dropped(buffer));
+    return fclose(file) == 0;
+}
+
+int trace_export_binary(const TraceBuffer* buffer, const char* path) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return 0;
+    }
+    TraceFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    header.version = TRACE_FORMAT_VERSION;
+    header.event_size = sizeof(TraceEvent);
+    header.count = trace_buffer_count(buffer);
+    header.dropped = trace_buffer_dropped(buffer);
+    header.ticks_per_second = trace_ticks_per_second();
+
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    // The ring holds the events in at most two runs
+    size_t first = (size_t)((buffer->written - header.count) & buffer->mask);
+    size_t run = header.count < buffer->mask + 1 - first ? header.count : buffer->mask + 1 - first;
+    ok = ok && fwrite(buffer->events + first, sizeof(TraceEvent), run, file) == run;
+    ok = ok && fwrite(buffer->events, sizeof(TraceEvent), header.count - run, file) == header.count - run;
+    return fclose(file) == 0 && ok;
+}
+
+TraceBuffer* trace_import_binary(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    TraceFileHeader header;
+    TraceBuffer* buffer = NULL;
+    if (fread(&header, sizeof(header), 1, file) == 1 &&
+        memcmp(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) == 0 &&
+        header.version == TRACE_FORMAT_VERSION && header.event_size == sizeof(TraceEvent) &&
+        header.count <= ((uint64_t)1 << 40)) {
+        buffer = trace_buffer_new((size_t)header.count);
+    }
+    if (buffer && fread(buffer->events, sizeof(TraceEvent), (size_t)header.count, file) == header.count &&
+        fgetc(file) == EOF) {
+        buffer->written = header.count;
+        buffer->dropped_before = header.dropped;
+    } else {
+        trace_buffer_free(buffer);
+        buffer = NULL;
+    }
+    fclose(file);
+    return buffer;
+}
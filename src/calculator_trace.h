@@ -0,0 +1,74 @@
+#ifndef CALCULATOR_TRACE_H
+#define CALCULATOR_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "calculator_logic.h"
+
+// Opt-in record of every operator an evaluation applies. Attach a buffer
+// with calculator_set_trace; while none is attached apply_operator pays one
+// predictable branch, and building with -DCALCULATOR_NO_TRACE removes even
+// that. Recording stores a fixed-size event in a preallocated ring, so it
+// neither allocates nor formats; once the ring is full the oldest events are
+// overwritten. Exporting to Chrome trace JSON (chrome://tracing, Perfetto) or
+// to a compact binary file is done afterwards.
+//
+// Operands and the result are the stack entries as doubles: integers and
+// decimals are converted, complex values give their real part, and matrices
+// and data sets give NaN. Integer-only expressions run on the integer fast
+// path first, so when that pass falls back to doubles both passes appear in
+// the trace. Each calculator records into its own buffer; parallel
+// evaluation does not trace its workers.
+
+typedef struct {
+    // Cycle counter before and after the step; see trace_ticks_per_second
+    uint64_t start;
+    uint64_t end;
+    // operands[0] is the left operand of a binary operator or the argument of
+    // a function; unused ones are NaN
+    double operands[2];
+    double result;
+    char op;
+    uint8_t arity;
+    // calc->error after the step
+    uint8_t error;
+    uint8_t reserved;
+    // Number and operator stack depths before the step
+    int16_t number_depth;
+    int16_t operator_depth;
+} TraceEvent;
+
+typedef struct TraceBuffer TraceBuffer;
+
+// Capacity is rounded up to a power of two. Returns NULL if out of memory.
+TraceBuffer* trace_buffer_new(size_t capacity);
+void trace_buffer_free(TraceBuffer* buffer);
+void trace_buffer_clear(TraceBuffer* buffer);
+size_t trace_buffer_capacity(const TraceBuffer* buffer);
+// Events held, at most the capacity
+size_t trace_buffer_count(const TraceBuffer* buffer);
+// Events overwritten since the last clear
+uint64_t trace_buffer_dropped(const TraceBuffer* buffer);
+// Oldest first; `index` must be below trace_buffer_count.
+const TraceEvent* trace_buffer_event(const TraceBuffer* buffer, size_t index);
+// Slot for the next event, overwriting the oldest when full
+TraceEvent* trace_buffer_next(TraceBuffer* buffer);
+
+// The time stamp counter on x86, nanoseconds elsewhere.
+uint64_t trace_timestamp(void);
+// Measured once against the monotonic clock.
+double trace_ticks_per_second(void);
+
+// Chrome trace event format: one complete ("X") event per step named after
+// the operator, with operands, result, depths and error as arguments and
+// times in microseconds from the first event. Returns 0 on I/O failure.
+int trace_export_chrome(const TraceBuffer* buffer, const char* path);
+// Header (magic "METRACE", version, event size, count, dropped, ticks per
+// second) followed by the raw events, oldest first, in host byte order.
+// Returns 0 on I/O failure.
+int trace_export_binary(const TraceBuffer* buffer, const char* path);
+// Reads a binary export back into a new buffer sized to hold it, with the
+// same dropped count. Returns NULL if the file is missing or malformed.
+TraceBuffer* trace_import_binary(const char* path);
+
+#endif
@@ -0,0 +1,322 @@
+#include "calculator_vecmath.h"
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+#ifndef M_2_PI
+#define M_2_PI 0.63661977236758134308
+#endif
+#ifndef M_SQRT2
+#define M_SQRT2 1.41421356237309504880
+#endif
+
+#define VECMATH_SIGN_MASK ((int64_t)0x8000000000000000ULL)
+#define VECMATH_MANTISSA_MASK ((int64_t)0x000fffffffffffffLL)
+#define VECMATH_ONE_BITS ((int64_t)0x3ff0000000000000LL)
+#define VECMATH_LOW_WORD_MASK ((int64_t)0xffffffff00000000ULL)
+#define VECMATH_ROUND_SHIFT 0x1.8p52
+#define VECMATH_SPLITTER 134217729.0
+
+// Fast-path limits; lanes past them go to libm
+#define VECMATH_EXP_LIMIT 708.0
+#define VECMATH_TRIG_RAD_LIMIT 1e5
+#define VECMATH_TRIG_DEG_LIMIT 0x1p45
+#define VECMATH_POW_Y_LIMIT 0x1p900
+
+#define VECMATH_LOG2E 1.44269504088896338700
+#define VECMATH_LN2_HI 6.93147180369123816490e-01
+#define VECMATH_LN2_LO 1.90821492927058770002e-10
+#define VECMATH_LOG10_2_HI 3.01029995663611771306e-01
+#define VECMATH_LOG10_2_LO 3.69423907715893078616e-13
+#define VECMATH_INV_LN10 4.34294481903251816668e-01
+#define VECMATH_DEG_TO_RAD (M_PI / 180.0)
+#define VECMATH_RAD_TO_DEG (180.0 / M_PI)
+
+// pi/2 in three pieces; the first two have 33 significant bits so their
+// products with a quotient below 2^20 are exact
+#define VECMATH_PIO2_1 1.57079632673412561417e+00
+#define VECMATH_PIO2_2 6.07710050630396597660e-11
+#define VECMATH_PIO2_3 2.02226624879595063154e-21
+#define VECMATH_PIO2_HI 1.57079632679489655800e+00
+#define VECMATH_PIO2_LO 6.12323399573676603587e-17
+#define VECMATH_PIO4_HI 7.85398163397448278999e-01
+
+// Polynomial coefficients from fdlibm (k_sin.c, k_cos.c, e_log.c, e_asin.c)
+#define VECMATH_S1 -1.66666666666666324348e-01
+#define VECMATH_S2 8.33333333332248946124e-03
+#define VECMATH_S3 -1.98412698298579493134e-04
+#define VECMATH_S4 2.75573137070700676789e-06
+#define VECMATH_S5 -2.50507602534068634195e-08
+#define VECMATH_S6 1.58969099521155010221e-10
+#define VECMATH_C1 4.16666666666666019037e-02
+#define VECMATH_C2 -1.38888888888741095749e-03
+#define VECMATH_C3 2.48015872894767294178e-05
+#define VECMATH_C4 -2.75573143513906633035e-07
+#define VECMATH_C5 2.08757232129817482790e-09
+#define VECMATH_C6 -1.13596475577881948265e-11
+#define VECMATH_LG1 6.666666666666735130e-01
+#define VECMATH_LG2 3.999999999940941908e-01
+#define VECMATH_LG3 2.857142874366239149e-01
+#define VECMATH_LG4 2.222219843214978396e-01
+#define VECMATH_LG5 1.818357216161805012e-01
+#define VECMATH_LG6 1.531383769920937332e-01
+#define VECMATH_LG7 1.479819860511658591e-01
+#define VECMATH_PS0 1.66666666666666657415e-01
+#define VECMATH_PS1 -3.25565818622400915405e-01
+#define VECMATH_PS2 2.01212532134862925881e-01
+#define VECMATH_PS3 -4.00555345006794114027e-02
+#define VECMATH_PS4 7.91534994289814532176e-04
+#define VECMATH_PS5 3.47933107596021167570e-05
+#define VECMATH_QS1 -2.40339491173441421878e+00
+#define VECMATH_QS2 2.02094576023350569471e+00
+#define VECMATH_QS3 -6.88283971605453293030e-01
+#define VECMATH_QS4 7.70381505559019352791e-02
+
+#define VECMATH_LOG_TABLE_BITS 7
+#define VECMATH_LOG_TABLE_SIZE (1 << VECMATH_LOG_TABLE_BITS)
+
+// Taylor series of e^r, highest order first; |r| <= ln(2)/2 keeps the
+// truncation error below 2^-57
+static const double vecmath_exp_coeffs[] = {
+    1.0 / 6227020800.0, 1.0 / 479001600.0, 1.0 / 39916800.0, 1.0 / 3628800.0,
+    1.0 / 362880.0, 1.0 / 40320.0, 1.0 / 5040.0, 1.0 / 720.0, 1.0 / 120.0,
+    1.0 / 24.0, 1.0 / 6.0, 0.5, 1.0, 1.0
+};
+
+// Entry i covers mantissas in [1 + i/128, 1 + (i+1)/128): invc is about the
+// reciprocal of the interval midpoint and logc_hi + logc_lo = -log(invc)
+typedef struct {
+    double invc;
+    double logc_hi;
+    double logc_lo;
+} VecmathLogEntry;
+
+static VecmathLogEntry vecmath_log_table[VECMATH_LOG_TABLE_SIZE];
+
+static pthread_once_t vecmath_once = PTHREAD_ONCE_INIT;
+static VecmathIsa vecmath_best = VECMATH_ISA_SCALAR;
+static VecmathIsa vecmath_active = VECMATH_ISA_SCALAR;
+
+// sin/cos/tan of an angle in degrees: remquo reduces modulo 90 exactly
+static double scalar_trig_degrees(VecmathFunction function, double x) {
+    int quotient;
+    double r = remquo(x, 90.0, &quotient);
+    double rad = r * VECMATH_DEG_TO_RAD;
+    double s = sin(rad), c = cos(rad);
+    int q = quotient & 3;
+
+    switch (function) {
+        case VECMATH_SIN: return (q == 0 ? s : q == 1 ? c : q == 2 ? -s : -c) + 0.0;
+        case VECMATH_COS: return (q == 0 ? c : q == 1 ? -s : q == 2 ? -c : s) + 0.0;
+        default:
+            if (q & 1) {
+                return r == 0.0 ? NAN : -c / s + 0.0;
+            }
+            return s / c + 0.0;
+    }
+}
+
+double vecmath_scalar(VecmathFunction function, AngleMode angle_mode, double x) {
+    int degrees = angle_mode == DEG;
+
+    switch (function) {
+        case VECMATH_SIN:
+            return degrees ? scalar_trig_degrees(function, x) : sin(x);
+        case VECMATH_COS:
+            return degrees ? scalar_trig_degrees(function, x) : cos(x);
+        case VECMATH_TAN:
+            return degrees ? scalar_trig_degrees(function, x) : tan(x);
+        case VECMATH_ASIN:
+            if (degrees && fabs(x) == 1.0) {
+                return copysign(90.0, x);
+            }
+            return degrees ? asin(x) * VECMATH_RAD_TO_DEG : asin(x);
+        case VECMATH_EXP: return exp(x);
+        case VECMATH_LOG: return log(x);
+        case VECMATH_LOG10: return log10(x);
+    }
+    return NAN;
+}
+
+static void scalar_apply(VecmathFunction function, AngleMode angle_mode, const double* in, double* out, size_t count) {
+    for (size_t k = 0; k < count; k++) {
+        out[k] = vecmath_scalar(function, angle_mode, in[k]);
+    }
+}
+
+static void scalar_pow(const double* x, const double* y, double* out, size_t count) {
+    for (size_t k = 0; k < count; k++) {
+        out[k] = pow(x[k], y[k]);
+    }
+}
+
+static double scalar_predicate(VecmathPredicate predicate, double x, double y) {
+    switch (predicate) {
+        case VECMATH_LESS: return x < y;
+        case VECMATH_LESS_EQUAL: return x <= y;
+        case VECMATH_EQUAL: return x == y;
+        case VECMATH_NOT_EQUAL: return x != y;
+        case VECMATH_AND: return x != 0.0 && y != 0.0;
+        case VECMATH_OR: return x != 0.0 || y != 0.0;
+    }
+    return NAN;
+}
+
+static void scalar_compare(VecmathPredicate predicate, const double* x, const double* y, double* out, size_t count) {
+    for (size_t k = 0; k < count; k++) {
+        out[k] = scalar_predicate(predicate, x[k], y[k]);
+    }
+}
+
+static void scalar_select(const double* condition, const double* a, const double* b, double* out, size_t count) {
+    for (size_t k = 0; k < count; k++) {
+        out[k] = condition[k] != 0.0 ? a[k] : b[k];
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+typedef double v2d __attribute__((vector_size(16)));
+typedef double v4d __attribute__((vector_size(32)));
+typedef double v8d __attribute__((vector_size(64)));
+typedef int64_t v2di __attribute__((vector_size(16)));
+typedef int64_t v4di __attribute__((vector_size(32)));
+typedef int64_t v8di __attribute__((vector_size(64)));
+
+// The SSE2 kernels compute product errors with Dekker's split, which
+// breaks if the compiler fuses its multiply-adds when building with -march
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#pragma GCC optimize("fp-contract=off")
+#define VM_WIDTH 2
+#define VD v2d
+#define VI v2di
+#define VM(name) vecmath_##name##_sse2
+#define VM_SQRT(v) ((v2d)_mm_sqrt_pd((__m128d)(v)))
+#include "calculator_vecmath_kernels.h"
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#define VM_WIDTH 4
+#define VD v4d
+#define VI v4di
+#define VM(name) vecmath_##name##_avx2
+#define VM_SQRT(v) ((v4d)_mm256_sqrt_pd((__m256d)(v)))
+#define VM_FMSUB(a, b, c) ((v4d)_mm256_fmsub_pd((__m256d)(a), (__m256d)(b), (__m256d)(c)))
+#include "calculator_vecmath_kernels.h"
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx2,fma")
+#define VM_WIDTH 8
+#define VD v8d
+#define VI v8di
+#define VM(name) vecmath_##name##_avx512
+#define VM_SQRT(v) ((v8d)_mm512_sqrt_pd((__m512d)(v)))
+#define VM_FMSUB(a, b, c) ((v8d)_mm512_fmsub_pd((__m512d)(a), (__m512d)(b), (__m512d)(c)))
+#include "calculator_vecmath_kernels.h"
+#pragma GCC pop_options
+#endif
+
+static void vecmath_init(void) {
+    for (int i = 0; i < VECMATH_LOG_TABLE_SIZE; i++) {
+        double invc = 1.0 / (1.0 + (i + 0.5) / VECMATH_LOG_TABLE_SIZE);
+        long double logc = -logl((long double)invc);
+        vecmath_log_table[i].invc = invc;
+        vecmath_log_table[i].logc_hi = (double)logc;
+        vecmath_log_table[i].logc_lo = (double)(logc - (long double)vecmath_log_table[i].logc_hi);
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        vecmath_best = VECMATH_ISA_AVX512;
+    } else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        vecmath_best = VECMATH_ISA_AVX2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        vecmath_best = VECMATH_ISA_SSE2;
+    }
+#endif
+    vecmath_active = vecmath_best;
+}
+
+VecmathIsa vecmath_best_isa(void) {
+    pthread_once(&vecmath_once, vecmath_init);
+    return vecmath_best;
+}
+
+VecmathIsa vecmath_get_isa(void) {
+    pthread_once(&vecmath_once, vecmath_init);
+    return vecmath_active;
+}
+
+int vecmath_set_isa(VecmathIsa isa) {
+    pthread_once(&vecmath_once, vecmath_init);
+    if (isa > vecmath_best) {
+        return 0;
+    }
+    vecmath_active = isa;
+    return 1;
+}
+
+const char* vecmath_isa_name(VecmathIsa isa) {
+    switch (isa) {
+        case VECMATH_ISA_SCALAR: return "scalar";
+        case VECMATH_ISA_SSE2: return "sse2";
+        case VECMATH_ISA_AVX2: return "avx2";
+        case VECMATH_ISA_AVX512: return "avx512";
+    }
+    return "unknown";
+}
+
+void vecmath_apply(VecmathFunction function, AngleMode angle_mode, const double* in, double* out, size_t count) {
+    switch (vecmath_get_isa()) {
+#if defined(__x86_64__) || defined(__i386__)
+        case VECMATH_ISA_AVX512: vecmath_apply_avx512(function, angle_mode, in, out, count); return;
+        case VECMATH_ISA_AVX2: vecmath_apply_avx2(function, angle_mode, in, out, count); return;
+        case VECMATH_ISA_SSE2: vecmath_apply_sse2(function, angle_mode, in, out, count); return;
+#endif
+        default: scalar_apply(function, angle_mode, in, out, count); return;
+    }
+}
+
+void vecmath_pow(const double* x, const double* y, double* out, size_t count) {
+    switch (vecmath_get_isa()) {
+#if defined(__x86_64__) || defined(__i386__)
+        case VECMATH_ISA_AVX512: vecmath_pow_apply_avx512(x, y, out, count); return;
+        case VECMATH_ISA_AVX2: vecmath_pow_apply_avx2(x, y, out, count); return;
+        case VECMATH_ISA_SSE2: vecmath_pow_apply_sse2(x, y, out, count); return;
+#endif
+        default: scalar_pow(x, y, out, count); return;
+    }
+}
+
+void vecmath_compare(VecmathPredicate predicate, const double* x, const double* y, double* out, size_t count) {
+    switch (vecmath_get_isa()) {
+#if defined(__x86_64__) || defined(__i386__)
+        case VECMATH_ISA_AVX512: vecmath_compare_apply_avx512(predicate, x, y, out, count); return;
+        case VECMATH_ISA_AVX2: vecmath_compare_apply_avx2(predicate, x, y, out, count); return;
+        case VECMATH_ISA_SSE2: vecmath_compare_apply_sse2(predicate, x, y, out, count); return;
+#endif
+        default: scalar_compare(predicate, x, y, out, count); return;
+    }
+}
+
+void vecmath_select(const double* condition, const double* a, const double* b, double* out, size_t count) {
+    switch (vecmath_get_isa()) {
+#if defined(__x86_64__) || defined(__i386__)
+        case VECMATH_ISA_AVX512: vecmath_select_apply_avx512(condition, a, b, out, count); return;
+        case VECMATH_ISA_AVX2: vecmath_select_apply_avx2(condition, a, b, out, count); return;
+        case VECMATH_ISA_SSE2: vecmath_select_apply_sse2(condition, a, b, out, count); return;
+#endif
+        default: scalar_select(condition, a, b, out, count); return;
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef CALCULATOR_VECMATH_H
+#define CALCULATOR_VECMATH_H
+
+#include <stddef.h>
+#include "calculator_logic.h"
+
+// Vectorized elementary functions over arrays of doubles. There is a kernel
+// set for SSE2, AVX2 (with FMA) and AVX-512; the best one the CPU supports is
+// picked from cpuid on first use. Lanes the vector kernels do not cover
+// (special values, arguments past the fast range reduction, results near
+// overflow) are recomputed with libm, so every element is within a few ulp
+// of the libm result.
+typedef enum {
+    VECMATH_ISA_SCALAR,
+    VECMATH_ISA_SSE2,
+    VECMATH_ISA_AVX2,
+    VECMATH_ISA_AVX512
+} VecmathIsa;
+
+typedef enum {
+    VECMATH_SIN,
+    VECMATH_COS,
+    VECMATH_TAN,
+    VECMATH_ASIN,
+    VECMATH_EXP,
+    VECMATH_LOG,
+    VECMATH_LOG10
+} VecmathFunction;
+
+// Element-wise tests for the comparison and logical operators; greater-than
+// is less-than with the operands swapped
+typedef enum {
+    VECMATH_LESS,
+    VECMATH_LESS_EQUAL,
+    VECMATH_EQUAL,
+    VECMATH_NOT_EQUAL,
+    VECMATH_AND,
+    VECMATH_OR
+} VecmathPredicate;
+
+VecmathIsa vecmath_best_isa(void);
+VecmathIsa vecmath_get_isa(void);
+// Selects a kernel set, mainly for tests and benchmarks. Returns 0 and keeps
+// the current one if the CPU does not support `isa`.
+int vecmath_set_isa(VecmathIsa isa);
+const char* vecmath_isa_name(VecmathIsa isa);
+
+// out may alias in. Angles (the input of sin/cos/tan, the output of asin)
+// are in `angle_mode` units. In degrees the argument is reduced modulo 90
+// exactly before it is converted, so sin(180) and cos(90) are exactly 0 and
+// asin(1) is exactly 90.
+void vecmath_apply(VecmathFunction function, AngleMode angle_mode, const double* in, double* out, size_t count);
+void vecmath_pow(const double* x, const double* y, double* out, size_t count);
+
+// 1.0 where the predicate holds and 0.0 elsewhere. NaN is unordered and,
+// being nonzero, true for VECMATH_AND and VECMATH_OR. out may alias x or y.
+void vecmath_compare(VecmathPredicate predicate, const double* x, const double* y, double* out, size_t count);
+// out[k] = condition[k] != 0 ? a[k] : b[k], as a masked blend. out may alias
+// any input.
+void vecmath_select(const double* condition, const double* a, const double* b, double* out, size_t count);
+
+// Scalar reference with the same degree handling, used for fallback lanes.
+double vecmath_scalar(VecmathFunction function, AngleMode angle_mode, double x);
+
+#endif
@@ -0,0 +1,411 @@
+// Kernel template for calculator_vecmath.c, included once per instruction
+// set with that set enabled through `#pragma GCC target`. The includer
+// defines:
+//   VM_WIDTH              lanes per vector
+//   VD, VI                double and int64_t vector types of that width
+//   VM(name)              appends the instruction set to a kernel name
+//   VM_SQRT(v)            lane-wise square root
+//   VM_FMSUB(a, b, c)     fused a * b - c, if the instruction set has FMA
+//
+// Every kernel returns its result and sets `special` to all-ones in lanes it
+// does not handle; the driver recomputes those with vecmath_scalar.
+
+static inline VD VM(splat)(double v) {
+    VD zero = {0};
+    return zero + v;
+}
+
+static inline VD VM(select)(VI mask, VD a, VD b) {
+    return (VD)(((VI)a & mask) | ((VI)b & ~mask));
+}
+
+static inline VD VM(fabs)(VD x) {
+    return (VD)((VI)x & ~VECMATH_SIGN_MASK);
+}
+
+// Round to nearest through the 1.5 * 2^52 shift; `n` gets the integer value
+static inline VD VM(round)(VD x, VI* n) {
+    VD t = x + VECMATH_ROUND_SHIFT;
+    *n = (VI)t - (VI)VM(splat)(VECMATH_ROUND_SHIFT);
+    return t - VECMATH_ROUND_SHIFT;
+}
+
+static inline VD VM(int_to_double)(VI n) {
+    return (VD)(n + (VI)VM(splat)(VECMATH_ROUND_SHIFT)) - VECMATH_ROUND_SHIFT;
+}
+
+// Exact error of the product p = fl(a * b)
+static inline VD VM(product_error)(VD a, VD b, VD p) {
+#ifdef VM_FMSUB
+    return VM_FMSUB(a, b, p);
+#else
+    VD ca = a * VECMATH_SPLITTER;
+    VD cb = b * VECMATH_SPLITTER;
+    VD ah = ca - (ca - a), al = a - ah;
+    VD bh = cb - (cb - b), bl = b - bh;
+    return ((ah * bh - p) + ah * bl + al * bh) + al * bl;
+#endif
+}
+
+// Exact error of the sum s = fl(a + b)
+static inline VD VM(sum_error)(VD a, VD b, VD s) {
+    VD bb = s - a;
+    return (a - (s - bb)) + (b - bb);
+}
+
+// e^(x + xl) for |x| < VECMATH_EXP_LIMIT, where xl is a small correction
+static inline VD VM(exp_core)(VD x, VD xl) {
+    VI n;
+    VD nd = VM(round)(x * VECMATH_LOG2E, &n);
+    VD r = (x - nd * VECMATH_LN2_HI) - nd * VECMATH_LN2_LO + xl;
+
+    VD p = VM(splat)(vecmath_exp_coeffs[0]);
+    for (size_t i = 1; i < sizeof(vecmath_exp_coeffs) / sizeof(vecmath_exp_coeffs[0]); i++) {
+        p = p * r + vecmath_exp_coeffs[i];
+    }
+    return p * (VD)((n + 1023) << 52);
+}
+
+static inline VD VM(exp)(VD x, VI* special) {
+    *special = ~(VI)(VM(fabs)(x) < VECMATH_EXP_LIMIT);
+    return VM(exp_core)(VM(select)(*special, VM(splat)(0.0), x), VM(splat)(0.0));
+}
+
+// x = 2^k * (1 + f) with 1 + f in [sqrt(2)/2, sqrt(2)); x must be normal
+static inline void VM(log_split)(VD x, VD* k, VD* f) {
+    VI bits = (VI)x;
+    VI e = (bits >> 52) - 1023;
+    VD m = (VD)((bits & VECMATH_MANTISSA_MASK) | VECMATH_ONE_BITS);
+    VI high = (VI)(m > M_SQRT2);
+
+    *k = VM(int_to_double)(e - high);
+    *f = VM(select)(high, m * 0.5, m) - 1.0;
+}
+
+// log(1 + f) - f, as in fdlibm: s * (hfsq + R(s^2)) - hfsq
+static inline VD VM(log1p_tail)(VD f) {
+    VD s = f / (2.0 + f);
+    VD z = s * s;
+    VD w = z * z;
+    VD t1 = w * (VECMATH_LG2 + w * (VECMATH_LG4 + w * VECMATH_LG6));
+    VD t2 = z * (VECMATH_LG1 + w * (VECMATH_LG3 + w * (VECMATH_LG5 + w * VECMATH_LG7)));
+    VD hfsq = 0.5 * f * f;
+    return s * (hfsq + t1 + t2) - hfsq;
+}
+
+static inline VD VM(log_any)(VD x, int base10, VI* special) {
+    *special = ~((VI)(x >= DBL_MIN) & (VI)(x < INFINITY));
+    VD k, f;
+    VM(log_split)(VM(select)(*special, VM(splat)(1.0), x), &k, &f);
+    VD tail = VM(log1p_tail)(f);
+    if (base10) {
+        return k * VECMATH_LOG10_2_HI + (k * VECMATH_LOG10_2_LO + (f + tail) * VECMATH_INV_LN10);
+    }
+    return k * VECMATH_LN2_HI + (f + (tail + k * VECMATH_LN2_LO));
+}
+
+// Reduces x to r in about [-pi/4, pi/4] and the quadrant q. A degree
+// argument is reduced by 90, which is exact, and only r is converted.
+static inline VD VM(trig_reduce)(VD x, int degrees, VI* q, VI* special) {
+    VD n;
+    if (degrees) {
+        *special = ~(VI)(VM(fabs)(x) < VECMATH_TRIG_DEG_LIMIT);
+        n = VM(round)(x * (1.0 / 90.0), q);
+        return (x - n * 90.0) * VECMATH_DEG_TO_RAD;
+    }
+    *special = ~(VI)(VM(fabs)(x) < VECMATH_TRIG_RAD_LIMIT);
+    n = VM(round)(x * M_2_PI, q);
+    return ((x - n * VECMATH_PIO2_1) - n * VECMATH_PIO2_2) - n * VECMATH_PIO2_3;
+}
+
+static inline VD VM(sin_poly)(VD r) {
+    VD z = r * r;
+    VD p = VECMATH_S2 + z * (VECMATH_S3 + z * (VECMATH_S4 + z * (VECMATH_S5 + z * VECMATH_S6)));
+    return r + z * r * (VECMATH_S1 + z * p);
+}
+
+static inline VD VM(cos_poly)(VD r) {
+    VD z = r * r;
+    VD p = z * (VECMATH_C1 + z * (VECMATH_C2 + z * (VECMATH_C3 + z * (VECMATH_C4 + z * (VECMATH_C5 + z * VECMATH_C6)))));
+    VD hz = 0.5 * z;
+    VD w = 1.0 - hz;
+    return w + (((1.0 - w) - hz) + z * p);
+}
+
+static inline VD VM(sin_cos)(VD x, int degrees, int cosine, VI* special) {
+    VI q;
+    VD r = VM(trig_reduce)(x, degrees, &q, special);
+    VD s = VM(sin_poly)(r);
+    VD c = VM(cos_poly)(r);
+    VI odd = -(q & 1);
+    VD result;
+
+    if (cosine) {
+        result = VM(select)(odd, s, c);
+        result = (VD)((VI)result ^ (((q + 1) & 2) << 62));
+    } else {
+        result = VM(select)(odd, c, s);
+        result = (VD)((VI)result ^ ((q & 2) << 62));
+    }
+    // Exact zeros at multiples of 90 degrees come out unsigned
+    return degrees ? result + 0.0 : result;
+}
+
+static inline VD VM(tan)(VD x, int degrees, VI* special) {
+    VI q;
+    VD r = VM(trig_reduce)(x, degrees, &q, special);
+    VD s = VM(sin_poly)(r);
+    VD c = VM(cos_poly)(r);
+    VI odd = -(q & 1);
+    VD result = VM(select)(odd, -c, s) / VM(select)(odd, s, c);
+
+    if (degrees) {
+        // tan(90 + 180k) is a pole rather than a huge finite value
+        result = VM(select)(odd & (VI)(r == 0.0), VM(splat)(NAN), result + 0.0);
+    }
+    return result;
+}
+
+// fdlibm's asin: a rational approximation on |x| < 0.5 and
+// asin(x) = pi/2 - 2 asin(sqrt((1 - x) / 2)) above it. In degrees the pi/2
+// becomes an exact 90.
+static inline VD VM(asin)(VD x, int degrees, VI* special) {
+    VD ax = VM(fabs)(x);
+    *special = ~(VI)(ax <= 1.0);
+    ax = VM(select)(*special, VM(splat)(0.0), ax);
+
+    VI small = (VI)(ax < 0.5);
+    VD t = VM(select)(small, ax * ax, 0.5 * (1.0 - ax));
+    VD p = t * (VECMATH_PS0 + t * (VECMATH_PS1 + t * (VECMATH_PS2 + t * (VECMATH_PS3 + t * (VECMATH_PS4 + t * VECMATH_PS5)))));
+    VD q = 1.0 + t * (VECMATH_QS1 + t * (VECMATH_QS2 + t * (VECMATH_QS3 + t * VECMATH_QS4)));
+    VD w = p / q;
+    VD s = VM_SQRT(t);
+
+    // 0.5 <= |x| < 0.975: split s so that t - sh^2 is exact
+    VD sh = (VD)((VI)s & VECMATH_LOW_WORD_MASK);
+    VD c = (t - sh * sh) / (s + sh);
+    VD middle = VECMATH_PIO4_HI - ((2.0 * s * w - (VECMATH_PIO2_LO - 2.0 * c)) - (VECMATH_PIO4_HI - 2.0 * sh));
+    VD near_one;
+    VD result = ax + ax * w;
+
+    if (degrees) {
+        near_one = 90.0 - 2.0 * (s + s * w) * VECMATH_RAD_TO_DEG;
+        result = result * VECMATH_RAD_TO_DEG;
+        middle = middle * VECMATH_RAD_TO_DEG;
+    } else {
+        near_one = VECMATH_PIO2_HI - (2.0 * (s + s * w) - VECMATH_PIO2_LO);
+    }
+    result = VM(select)(small, result, VM(select)((VI)(ax < 0.975), middle, near_one));
+    return (VD)((VI)result | ((VI)x & VECMATH_SIGN_MASK));
+}
+
+// log(x) as hi + lo to about 2^-64 absolute: x = 2^k * m with m in [1, 2),
+// m = c * (1 + r) with c from a 128-entry table, and log(1 + r) by series.
+static inline void VM(log_double_double)(VD x, VD* hi, VD* lo) {
+    VI bits = (VI)x;
+    VI index = (bits >> (52 - VECMATH_LOG_TABLE_BITS)) & (VECMATH_LOG_TABLE_SIZE - 1);
+    VD k = VM(int_to_double)((bits >> 52) - 1023);
+    VD m = (VD)((bits & VECMATH_MANTISSA_MASK) | VECMATH_ONE_BITS);
+
+    int64_t lanes[VM_WIDTH];
+    double invc_lanes[VM_WIDTH], logc_hi_lanes[VM_WIDTH], logc_lo_lanes[VM_WIDTH];
+    memcpy(lanes, &index, sizeof(lanes));
+    for (int l = 0; l < VM_WIDTH; l++) {
+        const VecmathLogEntry* entry = &vecmath_log_table[lanes[l]];
+        invc_lanes[l] = entry->invc;
+        logc_hi_lanes[l] = entry->logc_hi;
+        logc_lo_lanes[l] = entry->logc_lo;
+    }
+    VD invc, logc_hi, logc_lo;
+    memcpy(&invc, invc_lanes, sizeof(invc));
+    memcpy(&logc_hi, logc_hi_lanes, sizeof(logc_hi));
+    memcpy(&logc_lo, logc_lo_lanes, sizeof(logc_lo));
+
+    // m * invc = 1 + r + r_lo exactly, with |r| <= 2^-8
+    VD prod = m * invc;
+    VD r_lo = VM(product_error)(m, invc, prod);
+    VD r = prod - 1.0;
+    VD series = r * r * (-0.5 + r * (1.0 / 3.0 + r * (-0.25 + r * (0.2 + r * (-1.0 / 6.0 + r * (1.0 / 7.0))))));
+    VD tail = r_lo - r * r_lo + series;
+
+    VD a = k * VECMATH_LN2_HI;
+    VD s1 = a + logc_hi;
+    VD e1 = VM(sum_error)(a, logc_hi, s1);
+    VD s2 = s1 + r;
+    VD e2 = VM(sum_error)(s1, r, s2);
+    VD l = e1 + e2 + logc_lo + k * VECMATH_LN2_LO + tail;
+
+    *hi = s2 + l;
+    *lo = (s2 - *hi) + l;
+}
+
+// pow for positive normal x, as exp(y * log(x)) with log in double-double
+static inline VD VM(pow)(VD x, VD y, VI* special) {
+    *special = ~((VI)(x >= DBL_MIN) & (VI)(x < INFINITY) & (VI)(VM(fabs)(y) < VECMATH_POW_Y_LIMIT));
+    x = VM(select)(*special, VM(splat)(1.0), x);
+    y = VM(select)(*special, VM(splat)(0.0), y);
+
+    VD lh, ll;
+    VM(log_double_double)(x, &lh, &ll);
+    VD ph = y * lh;
+    VD pl = VM(product_error)(y, lh, ph) + y * ll;
+
+    *special |= ~(VI)(VM(fabs)(ph) < VECMATH_EXP_LIMIT);
+    ph = VM(select)(*special, VM(splat)(0.0), ph);
+    pl = VM(select)(*special, VM(splat)(0.0), pl);
+    return VM(exp_core)(ph, pl);
+}
+
+static inline __attribute__((always_inline)) VD VM(dispatch)(VecmathFunction function, int degrees, VD x, VI* special) {
+    switch (function) {
+        case VECMATH_SIN: return VM(sin_cos)(x, degrees, 0, special);
+        case VECMATH_COS: return VM(sin_cos)(x, degrees, 1, special);
+        case VECMATH_TAN: return VM(tan)(x, degrees, special);
+        case VECMATH_ASIN: return VM(asin)(x, degrees, special);
+        case VECMATH_EXP: return VM(exp)(x, special);
+        case VECMATH_LOG: return VM(log_any)(x, 0, special);
+        case VECMATH_LOG10: return VM(log_any)(x, 1, special);
+    }
+    return x;
+}
+
+// Handles up to VM_WIDTH elements; a short tail is padded with ones.
+static inline __attribute__((always_inline)) void VM(block)(VecmathFunction function, AngleMode angle_mode,
+                                                            const double* in, const double* in2,
+                                                            double* out, size_t n) {
+    double x_lanes[VM_WIDTH], y_lanes[VM_WIDTH], r_lanes[VM_WIDTH];
+    int64_t special_lanes[VM_WIDTH];
+    int64_t any_special = 0;
+    VD x, y = VM(splat)(1.0), r;
+    VI special = {0};
+
+    if (n == VM_WIDTH) {
+        memcpy(&x, in, sizeof(x));
+        if (in2) {
+            memcpy(&y, in2, sizeof(y));
+        }
+    } else {
+        for (int l = 0; l < VM_WIDTH; l++) {
+            x_lanes[l] = (size_t)l < n ? in[l] : 1.0;
+            y_lanes[l] = in2 && (size_t)l < n ? in2[l] : 1.0;
+        }
+        memcpy(&x, x_lanes, sizeof(x));
+        memcpy(&y, y_lanes, sizeof(y));
+    }
+
+    r = in2 ? VM(pow)(x, y, &special) : VM(dispatch)(function, angle_mode == DEG, x, &special);
+
+    memcpy(special_lanes, &special, sizeof(special));
+    for (int l = 0; l < VM_WIDTH; l++) {
+        any_special |= special_lanes[l];
+    }
+    if (n == VM_WIDTH && !any_special) {
+        memcpy(out, &r, sizeof(r));
+        return;
+    }
+
+    memcpy(x_lanes, &x, sizeof(x));
+    memcpy(y_lanes, &y, sizeof(y));
+    memcpy(r_lanes, &r, sizeof(r));
+    for (size_t l = 0; l < n; l++) {
+        if (special_lanes[l]) {
+            r_lanes[l] = in2 ? pow(x_lanes[l], y_lanes[l]) : vecmath_scalar(function, angle_mode, x_lanes[l]);
+        }
+        out[l] = r_lanes[l];
+    }
+}
+
+static void VM(apply)(VecmathFunction function, AngleMode angle_mode, const double* in, double* out, size_t count) {
+    size_t k = 0;
+
+    // Separate loops per function so each gets its kernel inlined
+    switch (function) {
+#define VM_LOOP(f) \
+        case f: \
+            for (; k + VM_WIDTH <= count; k += VM_WIDTH) { \
+                VM(block)(f, angle_mode, in + k, NULL, out + k, VM_WIDTH); \
+            } \
+            break;
+        VM_LOOP(VECMATH_SIN)
+        VM_LOOP(VECMATH_COS)
+        VM_LOOP(VECMATH_TAN)
+        VM_LOOP(VECMATH_ASIN)
+        VM_LOOP(VECMATH_EXP)
+        VM_LOOP(VECMATH_LOG)
+        VM_LOOP(VECMATH_LOG10)
+#undef VM_LOOP
+    }
+    if (k < count) {
+        VM(block)(function, angle_mode, in + k, NULL, out + k, count - k);
+    }
+}
+
+static void VM(pow_apply)(const double* x, const double* y, double* out, size_t count) {
+    size_t k = 0;
+    for (; k + VM_WIDTH <= count; k += VM_WIDTH) {
+        VM(block)(VECMATH_EXP, RAD, x + k, y + k, out + k, VM_WIDTH);
+    }
+    if (k < count) {
+        VM(block)(VECMATH_EXP, RAD, x + k, y + k, out + k, count - k);
+    }
+}
+
+// Comparison results as 1.0 or 0.0; branch-free, so the tail is the only
+// scalar code
+static inline __attribute__((always_inline)) VD VM(predicate)(VecmathPredicate predicate, VD x, VD y) {
+    VI mask;
+    switch (predicate) {
+        case VECMATH_LESS: mask = (VI)(x < y); break;
+        case VECMATH_LESS_EQUAL: mask = (VI)(x <= y); break;
+        case VECMATH_EQUAL: mask = (VI)(x == y); break;
+        case VECMATH_NOT_EQUAL: mask = (VI)(x != y); break;
+        case VECMATH_AND: mask = (VI)(x != 0.0) & (VI)(y != 0.0); break;
+        default: mask = (VI)(x != 0.0) | (VI)(y != 0.0); break;
+    }
+    return VM(select)(mask, VM(splat)(1.0), VM(splat)(0.0));
+}
+
+static void VM(compare_apply)(VecmathPredicate predicate, const double* x, const double* y, double* out, size_t count) {
+    size_t k = 0;
+
+    switch (predicate) {
+#define VM_LOOP(p) \
+        case p: \
+            for (; k + VM_WIDTH <= count; k += VM_WIDTH) { \
+                VD a, b, r; \
+                memcpy(&a, x + k, sizeof(a)); \
+                memcpy(&b, y + k, sizeof(b)); \
+                r = VM(predicate)(p, a, b); \
+                memcpy(out + k, &r, sizeof(r)); \
+            } \
+            break;
+        VM_LOOP(VECMATH_LESS)
+        VM_LOOP(VECMATH_LESS_EQUAL)
+        VM_LOOP(VECMATH_EQUAL)
+        VM_LOOP(VECMATH_NOT_EQUAL)
+        VM_LOOP(VECMATH_AND)
+        VM_LOOP(VECMATH_OR)
+#undef VM_LOOP
+    }
+    scalar_compare(predicate, x + k, y + k, out + k, count - k);
+}
+
+static void VM(select_apply)(const double* condition, const double* a, const double* b, double* out, size_t count) {
+    size_t k = 0;
+    for (; k + VM_WIDTH <= count; k += VM_WIDTH) {
+        VD c, x, y, r;
+        memcpy(&c, condition + k, sizeof(c));
+        memcpy(&x, a + k, sizeof(x));
+        memcpy(&y, b + k, sizeof(y));
+        r = VM(select)((VI)(c != 0.0), x, y);
+        memcpy(out + k, &r, sizeof(r));
+    }
+    scalar_select(condition + k, a + k, b + k, out + k, count - k);
+}
+
+#undef VM_WIDTH
+#undef VD
+#undef VI
+#undef VM
+#undef VM_SQRT
+#undef VM_FMSUB
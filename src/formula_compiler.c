@@ -0,0 +1,85 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "calculator_program.h"
+
+// Compiles a formula library from text into a program file that
+// program_library_open can map. Each input line is `name = expression`;
+// blank lines and lines starting with '#' are skipped. --no-rewrite keeps
+// every `^` a call to pow; see program_writer_set_rewrite.
+static char* trim(char* s) {
+    while (isspace((unsigned char)*s)) {
+        s++;
+    }
+    char* end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) {
+        *--end = '\0';
+    }
+    return s;
+}
+
+int main(int argc, char** argv) {
+    int rewrite = 1;
+    if (argc == 4 && strcmp(argv[1], "--no-rewrite") == 0) {
+        rewrite = 0;
+        argv++;
+        argc--;
+    }
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s [--no-rewrite] <formulas.txt> <library.mep>\n", argv[0]);
+        return 2;
+    }
+    FILE* input = fopen(argv[1], "r");
+    if (!input) {
+        perror(argv[1]);
+        return 1;
+    }
+    ProgramWriter* writer = program_writer_new();
+    if (!writer) {
+        fclose(input);
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    program_writer_set_rewrite(writer, rewrite);
+
+    char* line = NULL;
+    size_t capacity = 0;
+    long line_number = 0, compiled = 0, failures = 0;
+    while (getline(&line, &capacity, input) != -1) {
+        line_number++;
+        char* text = trim(line);
+        if (*text == '\0' || *text == '#') {
+            continue;
+        }
+        char* equals = strchr(text, '=');
+        if (!equals) {
+            fprintf(stderr, "%s:%ld: expected `name = expression`\n", argv[1], line_number);
+            failures++;
+            continue;
+        }
+        *equals = '\0';
+        char* name = trim(text);
+        ErrorType error = program_writer_add(writer, name, trim(equals + 1));
+        if (error != ERROR_NONE) {
+            fprintf(stderr, "%s:%ld: cannot compile `%s` (error %d)\n", argv[1], line_number, name, (int)error);
+            failures++;
+        } else {
+            compiled++;
+        }
+    }
+    free(line);
+    fclose(input);
+
+    if (failures == 0 && !program_writer_save(writer, argv[2])) {
+        fprintf(stderr, "%s: write failed or duplicate formula names\n", argv[2]);
+        failures++;
+    }
+    program_writer_free(writer);
+    if (failures > 0) {
+        return 1;
+    }
+    printf("%ld formulas compiled to %s\n", compiled, argv[2]);
+    return 0;
+}
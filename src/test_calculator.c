@@ -5,8 +5,34 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <float.h>
 #include <stdlib.h>
 #include "calculator_logic.h"
+#include "calculator_complex.h"
+#include "calculator_matrix.h"
+#include "calculator_history.h"
+#include "calculator_vecmath.h"
+#include "calculator_parallel.h"
+#include "calculator_program.h"
+#include "calculator_decimal.h"
+#include "calculator_integer.h"
+#include "calculator_stats.h"
+#include "calculator_lexer.h"
+#include "calculator_random.h"
+#include "calculator_ode.h"
+#include "calculator_trace.h"
+#include "calculator_fixed.h"
+#include "calculator_cache.h"
+#include "calculator_rational.h"
+#include "calculator_sheet.h"
+#include "calculator_special.h"
+#include "calculator_numtheory.h"
+#include "calculator_replay.h"
+#include "calculator_rolling.h"
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <fcntl.h>
 
 #define TOLERANCE 1e-9
 
@@ -29,6 +55,15 @@ void test_expression_float(const char* expression, double expected) {
     calculator_free(calc);
 }
 
+// Names a fixture no other call or concurrent run uses:
+// "<directory>test_<stem>_<pid>_<n><extension>". Files go under "/tmp/";
+// a directory of "/" gives a shared memory object name.
+static void make_temp_name(char* name, size_t size, const char* directory, const char* stem,
+                           const char* extension) {
+    static int counter = 0;
+    snprintf(name, size, "%stest_%s_%ld_%d%s", directory, stem, (long)getpid(), counter++, extension);
+}
+
 // Basic Arithmetic Tests
 void test_addition(void) {
     test_expression("5+3", "8");
@@ -375,83 +410,3169 @@ void test_zero_operations(void) {
     test_expression_float("s0+c0+t0", 1.0);
 }
 
-// Unity Setup and Runner
-void setUp(void) {
-    // Called before each test
+// Complex Mode Tests
+void test_complex_expression(const char* expression, const char* expected) {
+    Calculator* calc = calculator_new();
+    calculator_set_number_mode(calc, NUMBER_MODE_COMPLEX);
+    calculator_evaluate(calc, expression);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(expected, calculator_get_display(calc), expression);
+    calculator_free(calc);
 }
 
-void tearDown(void) {
-    // Called after each test
+void test_complex_mode_toggle(void) {
+    Calculator* calc = calculator_new();
+    TEST_ASSERT_EQUAL(NUMBER_MODE_REAL, calculator_get_number_mode(calc));
+    calculator_set_number_mode(calc, NUMBER_MODE_COMPLEX);
+    TEST_ASSERT_EQUAL(NUMBER_MODE_COMPLEX, calculator_get_number_mode(calc));
+    calculator_free(calc);
 }
 
-int main(void) {
-    UNITY_BEGIN();
-    
-    // Basic Arithmetic
-    RUN_TEST(test_addition);
-    RUN_TEST(test_subtraction);
-    RUN_TEST(test_multiplication);
-    RUN_TEST(test_division);
-    RUN_TEST(test_division_by_zero);
-    
-    // Precedence and Parentheses
-    RUN_TEST(test_operator_precedence);
-    RUN_TEST(test_parentheses_simple);
-    RUN_TEST(test_nested_parentheses);
-    RUN_TEST(test_complex_expressions);
-    
-    // Trigonometry (Degrees)
-    RUN_TEST(test_sine_deg);
-    RUN_TEST(test_cosine_deg);
-    RUN_TEST(test_tangent_deg);
-    
-    // Trigonometry (Radians)
-    RUN_TEST(test_sine_rad);
-    RUN_TEST(test_cosine_rad);
-    RUN_TEST(test_tangent_rad);
-    
-    // Inverse Trigonometry
-    RUN_TEST(test_arcsine);
-    RUN_TEST(test_arccosine);
-    RUN_TEST(test_arctangent);
-    
-    // Logarithms and Exponents
-    RUN_TEST(test_natural_logarithm);
-    RUN_TEST(test_common_logarithm);
-    RUN_TEST(test_exponential);
-    RUN_TEST(test_power_operator);
-    
-    // Other Functions
-    RUN_TEST(test_factorial);
-    RUN_TEST(test_reciprocal);
-    RUN_TEST(test_negation);
-    RUN_TEST(test_modulo);
-    RUN_TEST(test_square_root);
-    
-    // Constants
-    RUN_TEST(test_pi_constant);
-    RUN_TEST(test_e_constant);
-    
-    // Error Handling
-    RUN_TEST(test_domain_errors);
-    RUN_TEST(test_syntax_errors);
-    RUN_TEST(test_mismatched_parentheses);
-    RUN_TEST(test_stack_overflow);
-    
-    // Calculator State
-    RUN_TEST(test_calculator_clear);
-    RUN_TEST(test_angle_mode_toggle);
-    
-    // Combined Operations
-    RUN_TEST(test_combined_functions);
-    RUN_TEST(test_functions_with_parentheses);
-    RUN_TEST(test_chained_operations);
-    
-    // Edge Cases
-    RUN_TEST(test_very_small_numbers);
-    RUN_TEST(test_very_large_numbers);
-    RUN_TEST(test_negative_number_operations);
-    RUN_TEST(test_zero_operations);
+void test_complex_arithmetic(void) {
+    test_complex_expression("i*i", "-1");
+    test_complex_expression("2i", "2i");
+    test_complex_expression("(1+2i)*(3-i)", "5+5i");
+    test_complex_expression("(1+2i)/(3-4i)", "-0.2+0.4i");
+    test_complex_expression("(1+i)^2", "2i");
+    test_complex_expression("i^(-1)", "-i");
+    test_complex_expression("2+3*4", "14");
+    test_complex_expression("1/(i-i)", "Math Error: Division by zero");
+    // |b|^2 would overflow or underflow
+    test_complex_expression("(1e200+1e200i)/(1e200+1e200i)", "1");
+    test_complex_expression("1/(1e-200i)", "-1.0000000000e+200i");
+    test_complex_expression("(1e200+1e200i)^(-1)", "5.0000000000e-201-5.0000000000e-201i");
+}
+
+void test_complex_domain_extensions(void) {
+    test_complex_expression("q(-4)", "2i");
+    test_complex_expression("q(-1)", "i");
+    test_complex_expression("l(-1)", "3.141592654i");
+    test_complex_expression("E(i*p)", "-1");
+    test_complex_expression("l0", "Math Error: Domain error (e.g., sqrt(-1))");
+    test_complex_expression("!i", "Math Error: Domain error (e.g., sqrt(-1))");
+}
+
+void test_complex_inverse_trig_principal_branch(void) {
+    Calculator* calc = calculator_new();
+    calculator_set_number_mode(calc, NUMBER_MODE_COMPLEX);
+    calculator_toggle_angle_mode(calc);
+
+    calculator_evaluate(calc, "S2");
+    TEST_ASSERT_EQUAL_STRING("1.570796327+1.316957897i", calculator_get_display(calc));
+    calculator_evaluate(calc, "C2");
+    TEST_ASSERT_EQUAL_STRING("-1.316957897i", calculator_get_display(calc));
+    calculator_evaluate(calc, "T(2i)");
+    TEST_ASSERT_EQUAL_STRING("1.570796327+0.5493061443i", calculator_get_display(calc));
+
+    calculator_free(calc);
+}
+
+void test_complex_batch_kernels(void) {
+    ComplexBatch* a = complex_batch_new(3);
+    ComplexBatch* b = complex_batch_new(3);
+    ComplexBatch* out = complex_batch_new(3);
+    TEST_ASSERT_NOT_NULL(a);
+    TEST_ASSERT_NOT_NULL(b);
+    TEST_ASSERT_NOT_NULL(out);
+
+    double ar[] = {1, 0, 2}, ai[] = {2, 1, 0};
+    double br[] = {3, 0, 0}, bi[] = {-1, 1, 0};
+    for (int k = 0; k < 3; k++) {
+        a->re[k] = ar[k]; a->im[k] = ai[k];
+        b->re[k] = br[k]; b->im[k] = bi[k];
+    }
+
+    TEST_ASSERT_EQUAL(ERROR_NONE, complex_batch_binary('*', a, b, out));
+    TEST_ASSERT_DOUBLE_WITHIN(TOLERANCE, 5.0, out->re[0]);
+    TEST_ASSERT_DOUBLE_WITHIN(TOLERANCE, 5.0, out->im[0]);
+    TEST_ASSERT_DOUBLE_WITHIN(TOLERANCE, -1.0, out->re[1]);
+    TEST_ASSERT_DOUBLE_WITHIN(TOLERANCE, 0.0, out->im[1]);
+
+    TEST_ASSERT_EQUAL(ERROR_MATH_DIV_ZERO, complex_batch_binary('/', a, b, out));
+    TEST_ASSERT_DOUBLE_WITHIN(TOLERANCE, 1.0, out->re[1]);
+    TEST_ASSERT_TRUE(isnan(out->re[2]));
+
+    TEST_ASSERT_EQUAL(ERROR_NONE, complex_batch_unary('q', RAD, b, out));
+    TEST_ASSERT_DOUBLE_WITHIN(TOLERANCE, sqrt(0.5), out->re[1]);
+    TEST_ASSERT_DOUBLE_WITHIN(TOLERANCE, sqrt(0.5), out->im[1]);
+
+    // Smith's division in every lane: |b|^2 would overflow, then underflow
+    a->re[0] = a->im[0] = b->re[0] = b->im[0] = 1e200;
+    a->re[1] = 1.0;
+    a->im[1] = 0.0;
+    b->im[1] = 1e-200;
+    TEST_ASSERT_EQUAL(ERROR_MATH_DIV_ZERO, complex_batch_binary('/', a, b, out));
+    TEST_ASSERT_EQUAL_DOUBLE(1.0, out->re[0]);
+    TEST_ASSERT_EQUAL_DOUBLE(0.0, out->im[0]);
+    TEST_ASSERT_EQUAL_DOUBLE(0.0, out->re[1]);
+    TEST_ASSERT_EQUAL_DOUBLE(-1e200, out->im[1]);
+
+    complex_batch_free(a);
+    complex_batch_free(b);
+    complex_batch_free(out);
+}
+
+// Matrix Tests
+void test_matrix_literals(void) {
+    test_expression("[1,2,3]", "[1, 2, 3]");
+    test_expression("[[1,2],[3,4]]", "[[1, 2], [3, 4]]");
+    test_expression("[-1, 2*3, q16]", "[-1, 6, 4]");
+    test_expression("[[1,2],3]", "Math Error: Dimension mismatch");
+    test_expression("[[1,2],[3]]", "Math Error: Dimension mismatch");
+    test_expression("[1,2", "Syntax Error: Mismatched parentheses");
+    test_expression("(1,2]", "Syntax Error: Mismatched parentheses");
+}
+
+void test_matrix_elementwise(void) {
+    test_expression("[1,2]+[3,4]", "[4, 6]");
+    test_expression("[1,2]*[3,4]", "[3, 8]");
+    test_expression("2[1,2]", "[2, 4]");
+    test_expression("[2,4]/2", "[1, 2]");
+    test_expression("q[4,9]", "[2, 3]");
+    test_expression("[1,2]/[1,0]", "Math Error: Division by zero");
+    test_expression("[1,2]+[1,2,3]", "Math Error: Dimension mismatch");
+}
+
+void test_matrix_functions(void) {
+    test_expression("[[1,2],[3,4]]@[[5,6],[7,8]]", "[[19, 22], [43, 50]]");
+    test_expression("[1,2]@[[1],[1]]", "[3]");
+    test_expression("[1,2]@[1,2]", "Math Error: Dimension mismatch");
+    test_expression("det[[1,2],[3,4]]", "-2");
+    test_expression("det([[2,0,0],[0,3,0],[0,0,4]])+1", "25");
+    test_expression("inv([[4,7],[2,6]])", "[[0.6, -0.7], [-0.2, 0.4]]");
+    test_expression("inv([[1,2],[2,4]])", "Math Error: Singular matrix");
+    // Singular in exact arithmetic; elimination leaves a last pivot of
+    // rounding noise rather than zero
+    test_expression("inv([[1,2,3],[4,5,6],[7,8,9]])", "Math Error: Singular matrix");
+    test_expression("solve([[1,2,3],[4,5,6],[7,8,9]],[1,2,3])", "Math Error: Singular matrix");
+    test_expression("inv([[1e-20,0],[0,1e-20]])", "[[1.0000000000e+20, 0], [0, 1.0000000000e+20]]");
+    test_expression("transpose([[1,2],[3,4]])", "[[1, 3], [2, 4]]");
+    test_expression("solve([[2,1],[1,3]],[3,5])", "[0.8, 1.4]");
+    test_expression("det5", "5");
+}
+
+void test_matrix_result_accessor(void) {
+    Calculator* calc = calculator_new();
+    calculator_evaluate(calc, "[[1,2],[3,4]]*2");
+    const Matrix* m = calculator_get_matrix(calc);
+    TEST_ASSERT_NOT_NULL(m);
+    TEST_ASSERT_EQUAL(2, m->rows);
+    TEST_ASSERT_EQUAL(2, m->cols);
+    TEST_ASSERT_DOUBLE_WITHIN(TOLERANCE, 8.0, m->data[3]);
+
+    calculator_evaluate(calc, "1+1");
+    TEST_ASSERT_NULL(calculator_get_matrix(calc));
+    calculator_free(calc);
+}
+
+void test_matrix_blocked_kernels(void) {
+    // Sizes straddle the register tile and cache block edges
+    const int m = 131, k = 300, n = 77;
+    MatrixArena* arena = matrix_arena_new(0);
+    Matrix* a = matrix_new(arena, m, k);
+    Matrix* b = matrix_new(arena, k, n);
+    Matrix* c = NULL;
+    unsigned int seed = 12345;
+    for (int i = 0; i < m * k; i++) {
+        seed = seed * 1103515245u + 12345u;
+        a->data[i] = (double)(seed >> 16 & 0x7fff) / 32768.0 - 0.5;
+    }
+    for (int i = 0; i < k * n; i++) {
+        seed = seed * 1103515245u + 12345u;
+        b->data[i] = (double)(seed >> 16 & 0x7fff) / 32768.0 - 0.5;
+    }
+
+    TEST_ASSERT_EQUAL(ERROR_NONE, matrix_multiply(arena, a, b, &c));
+    for (int i = 0; i < m; i += 13) {
+        for (int j = 0; j < n; j += 7) {
+            double expected = 0.0;
+            for (int p = 0; p < k; p++) {
+                expected += a->data[i * k + p] * b->data[p * n + j];
+            }
+            TEST_ASSERT_DOUBLE_WITHIN(1e-10, expected, c->data[i * n + j]);
+        }
+    }
+
+    // Diagonally dominant system large enough to take several LU blocks
+    const int size = 150;
+    Matrix* s = matrix_new(arena, size, size);
+    Matrix* rhs = matrix_new(arena, 1, size);
+    Matrix* x = NULL;
+    for (int i = 0; i < size; i++) {
+        for (int j = 0; j < size; j++) {
+            s->data[i * size + j] = i == j ? size : 1.0 / (1 + i + j);
+        }
+        rhs->data[i] = i;
+    }
+    TEST_ASSERT_EQUAL(ERROR_NONE, matrix_solve(arena, s, rhs, &x));
+    for (int i = 0; i < size; i++) {
+        double residual = -rhs->data[i];
+        for (int j = 0; j < size; j++) {
+            residual += s->data[i * size + j] * x->data[j];
+        }
+        TEST_ASSERT_DOUBLE_WITHIN(1e-9, 0.0, residual);
+    }
+
+    matrix_arena_free(arena);
+}
+
+// History Tests
+static void remove_history_files(const char* path) {
+    char index_path[256];
+    snprintf(index_path, sizeof(index_path), "%s.idx", path);
+    unlink(path);
+    unlink(index_path);
+}
+
+void test_history_append_and_reopen(void) {
+    char path[128];
+    make_temp_name(path, sizeof(path), "/tmp/", "history", ".log");
+    remove_history_files(path);
+
+    History* history = history_open(path);
+    TEST_ASSERT_NOT_NULL(history);
+    TEST_ASSERT_EQUAL(0, history_count(history));
+    TEST_ASSERT_TRUE(history_append(history, "2+3", "5", DEG, 1700000000));
+    TEST_ASSERT_TRUE(history_append(history, "s(p/2)", "1", RAD, 1700000001));
+    history_close(history);
+
+    history = history_open(path);
+    TEST_ASSERT_NOT_NULL(history);
+    TEST_ASSERT_EQUAL(2, history_count(history));
+    HistoryEntry entry;
+    TEST_ASSERT_TRUE(history_get(history, 1, &entry));
+    TEST_ASSERT_EQUAL_STRING("s(p/2)", entry.expression);
+    TEST_ASSERT_EQUAL_STRING("1", entry.result);
+    TEST_ASSERT_EQUAL(RAD, entry.angle_mode);
+    TEST_ASSERT_EQUAL(1700000001, entry.timestamp);
+    TEST_ASSERT_FALSE(history_get(history, 2, &entry));
+    history_close(history);
+
+    remove_history_files(path);
+}
+
+void test_history_growth_and_search(void) {
+    char path[128];
+    char expression[64];
+    size_t matches[16];
+    make_temp_name(path, sizeof(path), "/tmp/", "history", ".log");
+    remove_history_files(path);
+
+    // Enough entries to force several remaps of both files
+    History* history = history_open(path);
+    TEST_ASSERT_NOT_NULL(history);
+    for (int i = 0; i < 5000; i++) {
+        snprintf(expression, sizeof(expression), "%d*%d+%d", i, i, i % 7);
+        TEST_ASSERT_TRUE(history_append(history, expression, "0", DEG, i));
+    }
+    TEST_ASSERT_EQUAL(5000, history_count(history));
+
+    size_t n = history_search(history, "4999*", HISTORY_MATCH_PREFIX, matches, 16);
+    TEST_ASSERT_EQUAL(1, n);
+    TEST_ASSERT_EQUAL(4999, matches[0]);
+
+    n = history_search(history, "999*", HISTORY_MATCH_SUBSTRING, matches, 16);
+    TEST_ASSERT_EQUAL(5, n);
+    // Newest first
+    TEST_ASSERT_EQUAL(4999, matches[0]);
+    TEST_ASSERT_EQUAL(999, matches[4]);
+
+    TEST_ASSERT_EQUAL(3, history_search(history, "", HISTORY_MATCH_SUBSTRING, matches, 3));
+    history_close(history);
+
+    remove_history_files(path);
+}
+
+void test_history_rebuilds_lost_index(void) {
+    char path[128];
+    char index_path[160];
+    make_temp_name(path, sizeof(path), "/tmp/", "history", ".log");
+    remove_history_files(path);
+    snprintf(index_path, sizeof(index_path), "%s.idx", path);
+
+    History* history = history_open(path);
+    TEST_ASSERT_NOT_NULL(history);
+    history_append(history, "1+1", "2", DEG, 1);
+    history_append(history, "2+2", "4", DEG, 2);
+    history_append(history, "3+3", "6", DEG, 3);
+    history_close(history);
+
+    unlink(index_path);
+    history = history_open(path);
+    TEST_ASSERT_NOT_NULL(history);
+    TEST_ASSERT_EQUAL(3, history_count(history));
+    HistoryEntry entry;
+    TEST_ASSERT_TRUE(history_get(history, 2, &entry));
+    TEST_ASSERT_EQUAL_STRING("3+3", entry.expression);
+    history_close(history);
+
+    remove_history_files(path);
+}
+
+void test_history_rejects_damaged_records(void) {
+    char path[128];
+    char index_path[160];
+    make_temp_name(path, sizeof(path), "/tmp/", "history", ".log");
+    remove_history_files(path);
+    snprintf(index_path, sizeof(index_path), "%s.idx", path);
+
+    History* history = history_open(path);
+    TEST_ASSERT_NOT_NULL(history);
+    history_append(history, "1+1", "2", DEG, 1);
+    history_append(history, "2+2", "4", DEG, 2);
+    history_append(history, "3+3", "6", DEG, 3);
+    history_close(history);
+
+    // An index offset near the top of the address space must not wrap past
+    // the bounds check. Entries start after the 64-byte file header.
+    uint64_t wild = UINT64_MAX - 7;
+    int fd = open(index_path, O_WRONLY);
+    TEST_ASSERT_TRUE(fd >= 0);
+    TEST_ASSERT_EQUAL(sizeof(wild), pwrite(fd, &wild, sizeof(wild), 64 + sizeof(uint64_t)));
+    close(fd);
+
+    history = history_open(path);
+    TEST_ASSERT_NOT_NULL(history);
+    HistoryEntry entry;
+    TEST_ASSERT_FALSE(history_get(history, 1, &entry));
+    TEST_ASSERT_TRUE(history_get(history, 2, &entry));
+    history_close(history);
+
+    // Records are 32 bytes here, so the last one's expression ends at
+    // 64 + 2 * 32 + 24 + 3; without its NUL the record is torn
+    fd = open(path, O_WRONLY);
+    TEST_ASSERT_TRUE(fd >= 0);
+    TEST_ASSERT_EQUAL(1, pwrite(fd, "x", 1, 64 + 2 * 32 + 24 + 3));
+    close(fd);
+    unlink(index_path);
+
+    history = history_open(path);
+    TEST_ASSERT_NOT_NULL(history);
+    TEST_ASSERT_EQUAL(2, history_count(history));
+    TEST_ASSERT_TRUE(history_get(history, 1, &entry));
+    TEST_ASSERT_EQUAL_STRING("2+2", entry.expression);
+    TEST_ASSERT_EQUAL_STRING("4", entry.result);
+    history_close(history);
+
+    remove_history_files(path);
+}
+
+// Matches of a query by brute force, newest first
+static size_t scan_history(History* history, const char* query, HistoryMatch match, size_t* indices,
+                           size_t max_results) {
+    size_t found = 0, length = strlen(query);
+    HistoryEntry entry;
+    for (size_t i = history_count(history); i > 0 && found < max_results; i--) {
+        TEST_ASSERT_TRUE(history_get(history, i - 1, &entry));
+        const char* at = strstr(entry.expression, query);
+        if (match == HISTORY_MATCH_PREFIX ? strncmp(entry.expression, query, length) == 0 : at != NULL) {
+            indices[found++] = i - 1;
+        }
+    }
+    return found;
+}
+
+void test_history_search_index(void) {
+    static const char* const queries[] = {"s(3", "+1)", "1*1", "2^2", "(1+", "q(", "77", "3)*", "zzz", "1"};
+    char path[128];
+    char expression[64];
+    size_t expected[64], got[64];
+    make_temp_name(path, sizeof(path), "/tmp/", "history", ".log");
+    remove_history_files(path);
+
+    History* history = history_open(path);
+    TEST_ASSERT_NOT_NULL(history);
+    unsigned int seed = 7;
+    for (int round = 0; round < 2; round++) {
+        // The second round is appended after the index exists
+        for (int i = 0; i < 3000; i++) {
+            seed = seed * 1103515245u + 12345u;
+            int a = (int)(seed >> 16) % 100, b = (int)(seed >> 8) % 13;
+            snprintf(expression, sizeof(expression), (seed >> 4) % 3 == 0 ? "s(%d)*(1+%d)" : "%d^2+q(%d)*111",
+                     a, b);
+            TEST_ASSERT_TRUE(history_append(history, expression, "0", DEG, i));
+        }
+        for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+            for (int match = HISTORY_MATCH_PREFIX; match <= HISTORY_MATCH_SUBSTRING; match++) {
+                size_t n = scan_history(history, queries[q], (HistoryMatch)match, expected, 64);
+                TEST_ASSERT_EQUAL(n, history_search(history, queries[q], (HistoryMatch)match, got, 64));
+                TEST_ASSERT_EQUAL_MEMORY(expected, got, n * sizeof(size_t));
+            }
+        }
+    }
+    history_close(history);
+
+    remove_history_files(path);
+}
+
+// Distance in units in the last place; NaNs and infinities must match exactly
+static double ulp_distance(double got, double expected) {
+    if (isnan(expected) || isnan(got)) {
+        return isnan(expected) && isnan(got) ? 0.0 : INFINITY;
+    }
+    if (got == expected) {
+        return 0.0;
+    }
+    if (!isfinite(expected) || !isfinite(got)) {
+        return INFINITY;
+    }
+    return fabs(got - expected) / fabs(nextafter(expected, INFINITY) - expected);
+}
+
+#define VECMATH_TEST_COUNT 4099
+#define VECMATH_MAX_ULP 4.0
+
+void test_vecmath_accuracy_vs_libm(void) {
+    static const double specials[] = {0.0, -0.0, NAN, INFINITY, -INFINITY, 1e6, -1e7, 1.5, -2.0, 800.0, -800.0, 1e-310};
+    double* x = malloc(VECMATH_TEST_COUNT * sizeof(double));
+    double* y = malloc(VECMATH_TEST_COUNT * sizeof(double));
+    double* out = malloc(VECMATH_TEST_COUNT * sizeof(double));
+    unsigned int seed = 777;
+    char message[128];
+
+    for (int isa = VECMATH_ISA_SCALAR; isa <= (int)vecmath_best_isa(); isa++) {
+        TEST_ASSERT_TRUE(vecmath_set_isa((VecmathIsa)isa));
+        for (int f = VECMATH_SIN; f <= VECMATH_LOG10; f++) {
+            for (int i = 0; i < VECMATH_TEST_COUNT; i++) {
+                seed = seed * 1103515245u + 12345u;
+                double u = (double)(seed >> 8 & 0xffffff) / 16777216.0;
+                if (i < (int)(sizeof(specials) / sizeof(specials[0]))) {
+                    x[i] = specials[i];
+                } else if (f == VECMATH_ASIN) {
+                    x[i] = 2.0 * u - 1.0;
+                } else if (f == VECMATH_EXP) {
+                    x[i] = (u - 0.5) * 1400.0;
+                } else if (f >= VECMATH_LOG) {
+                    x[i] = exp((u - 0.5) * 1400.0);
+                } else {
+                    x[i] = (u - 0.5) * 2e4;
+                }
+            }
+            vecmath_apply((VecmathFunction)f, RAD, x, out, VECMATH_TEST_COUNT);
+            for (int i = 0; i < VECMATH_TEST_COUNT; i++) {
+                double expected = f == VECMATH_SIN ? sin(x[i]) : f == VECMATH_COS ? cos(x[i]) :
+                                  f == VECMATH_TAN ? tan(x[i]) : f == VECMATH_ASIN ? asin(x[i]) :
+                                  f == VECMATH_EXP ? exp(x[i]) : f == VECMATH_LOG ? log(x[i]) : log10(x[i]);
+                snprintf(message, sizeof(message), "%s function %d at %.17g", vecmath_isa_name((VecmathIsa)isa), f, x[i]);
+                TEST_ASSERT_TRUE_MESSAGE(ulp_distance(out[i], expected) <= VECMATH_MAX_ULP, message);
+            }
+        }
+
+        for (int i = 0; i < VECMATH_TEST_COUNT; i++) {
+            seed = seed * 1103515245u + 12345u;
+            double u = (double)(seed >> 8 & 0xffffff) / 16777216.0;
+            seed = seed * 1103515245u + 12345u;
+            double v = (double)(seed >> 8 & 0xffffff) / 16777216.0;
+            x[i] = exp((u - 0.5) * 40.0);
+            y[i] = (v - 0.5) * 60.0;
+        }
+        // Cases only libm handles: negative bases, zero, overflow
+        x[0] = -2.0; y[0] = 3.0;
+        x[1] = 0.0; y[1] = -1.0;
+        x[2] = 10.0; y[2] = 400.0;
+        x[3] = 2.0; y[3] = -1080.0;
+        vecmath_pow(x, y, out, VECMATH_TEST_COUNT);
+        for (int i = 0; i < VECMATH_TEST_COUNT; i++) {
+            snprintf(message, sizeof(message), "%s pow(%.17g, %.17g)", vecmath_isa_name((VecmathIsa)isa), x[i], y[i]);
+            TEST_ASSERT_TRUE_MESSAGE(ulp_distance(out[i], pow(x[i], y[i])) <= VECMATH_MAX_ULP, message);
+        }
+    }
+    vecmath_set_isa(vecmath_best_isa());
+    free(x);
+    free(y);
+    free(out);
+}
+
+void test_vecmath_degree_variants(void) {
+    double angles[] = {0, 30, 45, 60, 90, 180, 270, -90, 360, 3600 + 30};
+    double arcs[] = {1, -1, 0.5, 0};
+    double out[10];
+    const long double pi = 3.14159265358979323846264338327950288L;
+
+    for (int isa = VECMATH_ISA_SCALAR; isa <= (int)vecmath_best_isa(); isa++) {
+        vecmath_set_isa((VecmathIsa)isa);
+        vecmath_apply(VECMATH_SIN, DEG, angles, out, 10);
+        TEST_ASSERT_EQUAL_DOUBLE(0.5, out[1]);
+        TEST_ASSERT_TRUE(out[5] == 0.0 && !signbit(out[5]));
+        TEST_ASSERT_EQUAL_DOUBLE(-1.0, out[6]);
+        TEST_ASSERT_EQUAL_DOUBLE(0.5, out[9]);
+        vecmath_apply(VECMATH_COS, DEG, angles, out, 10);
+        TEST_ASSERT_TRUE(out[4] == 0.0 && !signbit(out[4]));
+        TEST_ASSERT_EQUAL_DOUBLE(-1.0, out[5]);
+        TEST_ASSERT_EQUAL_DOUBLE(1.0, out[8]);
+        vecmath_apply(VECMATH_TAN, DEG, angles, out, 10);
+        TEST_ASSERT_EQUAL_DOUBLE(1.0, out[2]);
+        TEST_ASSERT_TRUE(isnan(out[4]));
+        TEST_ASSERT_TRUE(isnan(out[7]));
+        vecmath_apply(VECMATH_ASIN, DEG, arcs, out, 4);
+        TEST_ASSERT_EQUAL_DOUBLE(90.0, out[0]);
+        TEST_ASSERT_EQUAL_DOUBLE(-90.0, out[1]);
+        TEST_ASSERT_TRUE(ulp_distance(out[2], 30.0) <= 1.0);
+
+        // Against a long double reference reduced the same exact way
+        double x[257], got[257];
+        for (int i = 0; i < 257; i++) {
+            x[i] = -5000.0 + 39.0137 * i;
+        }
+        vecmath_apply(VECMATH_SIN, DEG, x, got, 257);
+        for (int i = 0; i < 257; i++) {
+            int quotient;
+            long double r = remquol((long double)x[i], 90.0L, &quotient) * pi / 180.0L;
+            int q = quotient & 3;
+            long double expected = q == 0 ? sinl(r) : q == 1 ? cosl(r) : q == 2 ? -sinl(r) : -cosl(r);
+            TEST_ASSERT_TRUE(ulp_distance(got[i], (double)expected) <= VECMATH_MAX_ULP);
+        }
+    }
+    vecmath_set_isa(vecmath_best_isa());
+}
+
+void test_matrix_elementwise_vectorized(void) {
+    test_expression("s[0,90,180,270,30]", "[0, 1, 0, -1, 0.5]");
+    test_expression("c[0,90,180]", "[1, 0, -1]");
+    test_expression("S[1,-1,0]", "[90, -90, 0]");
+    test_expression("L[1,10,1000]", "[0, 1, 3]");
+    test_expression("[1,2,3]^2", "[1, 4, 9]");
+    test_expression("2^[1,2,10]", "[2, 4, 1024]");
+    test_expression("[4,9]^[0.5,2]", "[2, 81]");
+    test_expression("l[1,0]", "Math Error: Domain error (e.g., sqrt(-1))");
+    // A NaN from arguments in range is a domain error, as for scalars
+    test_expression("S([[2]])", "Math Error: Domain error (e.g., sqrt(-1))");
+    test_expression("[[-8]]^[[0.5]]", "Math Error: Domain error (e.g., sqrt(-1))");
+    test_expression("[[-8]]^0.5", "Math Error: Domain error (e.g., sqrt(-1))");
+    // Scalars and matrices reduce degrees the same way
+    test_expression("s(180)", "0");
+    test_expression("s([[180]])", "[0]");
+    test_expression("t(90)", "Math Error: Domain error (e.g., sqrt(-1))");
+    test_expression("t([[90]])", "Math Error: Domain error (e.g., sqrt(-1))");
+}
+
+// Builds "<first><sep><term><sep><term>..." of at least PARALLEL_MIN_LENGTH bytes
+static char* build_chain(const char* first, const char* sep, const char* term, int* count) {
+    size_t step = strlen(sep) + strlen(term);
+    int terms = (int)(PARALLEL_MIN_LENGTH / step) + 1;
+    char* expr = malloc(strlen(first) + (size_t)terms * step + 1);
+    TEST_ASSERT_NOT_NULL(expr);
+    char* p = expr + sprintf(expr, "%s", first);
+    for (int i = 0; i < terms; i++) {
+        p += sprintf(p, "%s%s", sep, term);
+    }
+    *count = terms;
+    return expr;
+}
+
+void test_parallel_large_sum(void) {
+    int terms;
+    char expected[64];
+    char* expr = build_chain("0", "+", "3", &terms);
+    sprintf(expected, "%d", 3 * terms);
+    test_expression(expr, expected);
+    free(expr);
+
+    expr = build_chain("1000000", "-", "1", &terms);
+    sprintf(expected, "%d", 1000000 - terms);
+    test_expression(expr, expected);
+    free(expr);
+
+    // Exponent signs and functions stay inside their terms
+    expr = build_chain("1", "+", "2e-1*5", &terms);
+    sprintf(expected, "%d", 1 + terms);
+    test_expression(expr, expected);
+    free(expr);
+
+    expr = build_chain("0", "+", "s30", &terms);
+    sprintf(expected, "%g", 0.5 * terms);
+    test_expression(expr, expected);
+    free(expr);
+}
+
+void test_parallel_nested_and_errors(void) {
+    int terms;
+    char* sum = build_chain("2", "+", "2", &terms);
+    char* expr = malloc(2 * strlen(sum) + 16);
+    char expected[64];
+    TEST_ASSERT_NOT_NULL(expr);
+
+    sprintf(expr, "3*(%s)-(%s)", sum, sum);
+    sprintf(expected, "%d", 2 * 2 * (terms + 1));
+    test_expression(expr, expected);
+
+    sprintf(expr, "-(%s)", sum);
+    sprintf(expected, "%d", -2 * (terms + 1));
+    test_expression(expr, expected);
+
+    // "...+2/0+2+..." in the middle of the chain
+    size_t mid = strlen(sum) / 2 | 1;
+    sum[mid] = '/';
+    sum[mid + 1] = '0';
+    sprintf(expr, "1+%s", sum);
+    test_expression(expr, "Math Error: Division by zero");
+
+    free(expr);
+    free(sum);
+}
+
+void test_parallel_thread_count_independent(void) {
+    int terms;
+    char* expr = build_chain("0.1", "+", "0.1", &terms);
+    Calculator* calc = calculator_new();
+    double one = 0.0, four = 0.0;
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, parallel_evaluate(calc, expr, 1, &one));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, parallel_evaluate(calc, expr, 4, &four));
+    TEST_ASSERT_EQUAL_MEMORY(&one, &four, sizeof(double));
+    TEST_ASSERT_DOUBLE_WITHIN(1e-9, 0.1 * (terms + 1), one);
+    calculator_free(calc);
+    free(expr);
+}
+
+static void write_program_library(const char* path) {
+    ProgramWriter* writer = program_writer_new();
+    TEST_ASSERT_NOT_NULL(writer);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, program_writer_add(writer, "hypot", "q($a^2+$b^2)"));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, program_writer_add(writer, "area", "p$r^2"));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, program_writer_add(writer, "constant", "2+3*4-10/4"));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, program_writer_add(writer, "wave", "$amp*s($x)+$x!"));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, program_writer_add(writer, "inverse", "1/$x"));
+    // Only real scalar programs can be compiled
+    TEST_ASSERT_EQUAL_INT(ERROR_SYNTAX, program_writer_add(writer, "bad", "1+"));
+    TEST_ASSERT_EQUAL_INT(ERROR_SYNTAX, program_writer_add(writer, "bad", "[1,2]*$x"));
+    TEST_ASSERT_EQUAL_INT(ERROR_SYNTAX, program_writer_add(writer, "bad", "det($x)"));
+    TEST_ASSERT_EQUAL_INT(ERROR_SYNTAX, program_writer_add(writer, "bad", "$+1"));
+    TEST_ASSERT_TRUE(program_writer_save(writer, path));
+    program_writer_free(writer);
+}
+
+void test_program_compile_and_run(void) {
+    char path[64];
+    make_temp_name(path, sizeof(path), "/tmp/", "programs", ".mep");
+    write_program_library(path);
+
+    ProgramLibrary* library = program_library_open(path);
+    TEST_ASSERT_NOT_NULL(library);
+    TEST_ASSERT_EQUAL(5, program_library_count(library));
+    TEST_ASSERT_EQUAL(-1, program_library_find(library, "bad"));
+
+    Calculator* calc = calculator_new();
+    double value = 0.0;
+    long hypot = program_library_find(library, "hypot");
+    TEST_ASSERT_TRUE(hypot >= 0);
+    TEST_ASSERT_EQUAL_STRING("hypot", program_name(library, (size_t)hypot));
+    TEST_ASSERT_EQUAL(2, program_variable_count(library, (size_t)hypot));
+    TEST_ASSERT_EQUAL_STRING("a", program_variable_name(library, (size_t)hypot, 0));
+    TEST_ASSERT_EQUAL_STRING("b", program_variable_name(library, (size_t)hypot, 1));
+    double sides[] = {3.0, 4.0};
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, program_run(library, (size_t)hypot, calc, sides, &value));
+    TEST_ASSERT_DOUBLE_WITHIN(TOLERANCE, 5.0, value);
+
+    double radius = 2.0;
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, program_run(library, (size_t)program_library_find(library, "area"), calc, &radius, &value));
+    TEST_ASSERT_DOUBLE_WITHIN(TOLERANCE, 4.0 * M_PI, value);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, program_run(library, (size_t)program_library_find(library, "constant"), calc, NULL, &value));
+    TEST_ASSERT_DOUBLE_WITHIN(TOLERANCE, 11.5, value);
+
+    // A variable used twice shares one slot; the angle mode comes from calc
+    long wave = program_library_find(library, "wave");
+    TEST_ASSERT_EQUAL(2, program_variable_count(library, (size_t)wave));
+    double wave_inputs[] = {2.0, 3.0};
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, program_run(library, (size_t)wave, calc, wave_inputs, &value));
+    TEST_ASSERT_DOUBLE_WITHIN(TOLERANCE, 2.0 * sin(3.0 * M_PI / 180.0) + 6.0, value);
+    calculator_toggle_angle_mode(calc);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, program_run(library, (size_t)wave, calc, wave_inputs, &value));
+    TEST_ASSERT_DOUBLE_WITHIN(TOLERANCE, 2.0 * sin(3.0) + 6.0, value);
+
+    double zero = 0.0;
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DIV_ZERO, program_run(library, (size_t)program_library_find(library, "inverse"), calc, &zero, &value));
+
+    calculator_free(calc);
+    program_library_close(library);
+
+    // Program names must be unique
+    ProgramWriter* writer = program_writer_new();
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, program_writer_add(writer, "twice", "1"));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, program_writer_add(writer, "twice", "2"));
+    TEST_ASSERT_FALSE(program_writer_save(writer, path));
+    program_writer_free(writer);
+    unlink(path);
+}
+
+void test_program_rejects_corrupt_files(void) {
+    char path[64];
+    make_temp_name(path, sizeof(path), "/tmp/", "programs", ".mep");
+    write_program_library(path);
+
+    FILE* file = fopen(path, "rb");
+    TEST_ASSERT_NOT_NULL(file);
+    unsigned char original[4096];
+    size_t size = fread(original, 1, sizeof(original), file);
+    fclose(file);
+    TEST_ASSERT_TRUE(size > 0 && size < sizeof(original));
+
+    Calculator* calc = calculator_new();
+    double variables[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    for (size_t length = 0; length < size; length++) {
+        file = fopen(path, "wb");
+        fwrite(original, 1, length, file);
+        fclose(file);
+        TEST_ASSERT_NULL(program_library_open(path));
+    }
+    // Every single-byte corruption is either rejected or still runs safely
+    for (size_t offset = 0; offset < size; offset++) {
+        for (int bits = 1; bits < 256; bits <<= 1) {
+            original[offset] ^= (unsigned char)bits;
+            file = fopen(path, "wb");
+            fwrite(original, 1, size, file);
+            fclose(file);
+            original[offset] ^= (unsigned char)bits;
+
+            ProgramLibrary* library = program_library_open(path);
+            if (library) {
+                double value;
+                for (size_t i = 0; i < program_library_count(library); i++) {
+                    TEST_ASSERT_TRUE(program_variable_count(library, i) <= 8);
+                    program_run(library, i, calc, variables, &value);
+                    program_library_find(library, program_name(library, i));
+                }
+                program_library_close(library);
+            }
+        }
+    }
+    calculator_free(calc);
+    unlink(path);
+}
+
+// Runs `expression` at `x` compiled with and without strength reduction and
+// returns both results
+static void run_rewritten_and_plain(const char* expression, double x, double results[2]) {
+    char path[64];
+    make_temp_name(path, sizeof(path), "/tmp/", "programs", ".mep");
+    Calculator* calc = calculator_new();
+    for (int rewrite = 1; rewrite >= 0; rewrite--) {
+        ProgramWriter* writer = program_writer_new();
+        program_writer_set_rewrite(writer, rewrite);
+        TEST_ASSERT_EQUAL_INT(ERROR_NONE, program_writer_add(writer, "f", expression));
+        TEST_ASSERT_TRUE(program_writer_save(writer, path));
+        program_writer_free(writer);
+        ProgramLibrary* library = program_library_open(path);
+        TEST_ASSERT_NOT_NULL(library);
+        TEST_ASSERT_EQUAL_INT(ERROR_NONE, program_run(library, 0, calc, &x, &results[1 - rewrite]));
+        program_library_close(library);
+    }
+    calculator_free(calc);
+    unlink(path);
+}
+
+void test_program_strength_reduction(void) {
+    double results[2];
+    char expression[32];
+
+    // Integer powers: x^2 is exact, higher powers stay within |n| ulp of pow
+    for (int n = -PROGRAM_POWI_MAX; n <= PROGRAM_POWI_MAX; n++) {
+        snprintf(expression, sizeof(expression), "$x^%d", n);
+        for (double x = -3.7; x < 4.0; x += 0.37) {
+            run_rewritten_and_plain(expression, x, results);
+            if (n == 2 || n == 1 || n == 0) {
+                TEST_ASSERT_EQUAL_DOUBLE(results[1], results[0]);
+                TEST_ASSERT_TRUE(memcmp(&results[0], &results[1], sizeof(double)) == 0);
+            } else {
+                TEST_ASSERT_DOUBLE_WITHIN(fabs(results[1]) * (abs(n) + 1) * DBL_EPSILON, results[1], results[0]);
+            }
+        }
+    }
+    run_rewritten_and_plain("$x^-3", -0.0, results);
+    TEST_ASSERT_TRUE(isinf(results[0]) && results[0] < 0 && results[0] == results[1]);
+    // An overflowing power gives 0 where pow still returns a subnormal
+    run_rewritten_and_plain("$x^-5", 1e62, results);
+    TEST_ASSERT_TRUE(results[0] == 0.0 && results[1] > 0.0);
+    // Non-integer and large exponents still call pow
+    run_rewritten_and_plain("$x^2.5+$x^17", 1.1, results);
+    TEST_ASSERT_TRUE(memcmp(&results[0], &results[1], sizeof(double)) == 0);
+
+    // Horner form: no pow calls, same value up to rounding of the terms
+    const char* polynomials[] = {"3$x^4+2$x^3-$x+7", "$x^2-2$x+1", "$x-$x^5", "0.5*$x^3-$x^2*4+$x*$x^6"};
+    for (size_t i = 0; i < sizeof(polynomials) / sizeof(polynomials[0]); i++) {
+        for (double x = -2.5; x < 2.5; x += 0.125) {
+            run_rewritten_and_plain(polynomials[i], x, results);
+            TEST_ASSERT_DOUBLE_WITHIN(1e-12 * (1.0 + pow(fabs(x), 7)), results[1], results[0]);
+        }
+    }
+    for (double x = -2.5; x < 2.5; x += 0.1) {
+        run_rewritten_and_plain("3$x^4+2$x^3-$x+7", x, results);
+        double horner = ((3.0 * x + 2.0) * (x * x) + -1.0) * x + 7.0;
+        TEST_ASSERT_TRUE(memcmp(&horner, &results[0], sizeof(double)) == 0);
+    }
+    // A sum is never distributed or regrouped, so these stay as written
+    run_rewritten_and_plain("3*($x^2+$x)", 0.1, results);
+    TEST_ASSERT_TRUE(memcmp(&results[0], &results[1], sizeof(double)) == 0);
+    run_rewritten_and_plain("$x^2+$x+$x", 0.1, results);
+    TEST_ASSERT_TRUE(memcmp(&results[0], &results[1], sizeof(double)) == 0);
+
+    // Division by a power of two is a multiplication with the same result
+    for (double x = -1e300; fabs(x) > 1e-300; x *= -1.7e-3) {
+        run_rewritten_and_plain("$x/8+$x/0.25+$x/3", x, results);
+        TEST_ASSERT_TRUE(memcmp(&results[0], &results[1], sizeof(double)) == 0);
+    }
+    run_rewritten_and_plain("$x/4", 4.9e-324, results);
+    TEST_ASSERT_TRUE(memcmp(&results[0], &results[1], sizeof(double)) == 0);
+}
+
+static void test_expression_with_budget(const char* expression, const EvaluationBudget* budget, const char* expected) {
+    Calculator* calc = calculator_new();
+    calculator_set_budget(calc, budget);
+    calculator_evaluate(calc, expression);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(expected, calculator_get_display(calc), expression);
+    calculator_free(calc);
+}
+
+// "[[1,0,...],[0,1,...],...]" for an n x n identity
+static char* identity_literal(int n) {
+    char* text = malloc((size_t)n * (size_t)(2 * n + 3) + 3);
+    char* p = text;
+    *p++ = '[';
+    for (int i = 0; i < n; i++) {
+        *p++ = '[';
+        for (int j = 0; j < n; j++) {
+            p += sprintf(p, j ? ",%d" : "%d", i == j);
+        }
+        *p++ = ']';
+        if (i < n - 1) {
+            *p++ = ',';
+        }
+    }
+    strcpy(p, "]");
+    return text;
+}
+
+void test_budget_limits(void) {
+    EvaluationBudget operations = {20, 0, 0.0};
+    test_expression_with_budget("1+2*3", &operations, "7");
+    test_expression_with_budget("1+1+1+1+1+1+1+1+1+1+1+1", &operations, "Error: Evaluation budget exceeded");
+
+    EvaluationBudget depth = {0, 3, 0.0};
+    test_expression_with_budget("((2+(3)))*2", &depth, "10");
+    test_expression_with_budget("(((2+(3))))*2", &depth, "Error: Evaluation budget exceeded");
+
+    // Matrix operators are charged for their arithmetic, not per call
+    char* identity = identity_literal(20);
+    char* expr = malloc(strlen(identity) + 16);
+    sprintf(expr, "det(inv(%s))", identity);
+    EvaluationBudget small = {5000, 0, 0.0};
+    EvaluationBudget large = {50000, 0, 0.0};
+    test_expression_with_budget(expr, &small, "Error: Evaluation budget exceeded");
+    test_expression_with_budget(expr, &large, "1");
+
+    EvaluationBudget instant = {0, 0, 1e-9};
+    test_expression_with_budget(expr, &instant, "Error: Evaluation budget exceeded");
+    free(expr);
+    free(identity);
+
+    // Pieces of a parallel evaluation share one budget
+    int terms;
+    char* sum = build_chain("0", "+", "1", &terms);
+    EvaluationBudget tight = {(long)terms, 0, 0.0};
+    EvaluationBudget ample = {(long)terms * 4, 2, 10.0};
+    test_expression_with_budget(sum, &tight, "Error: Evaluation budget exceeded");
+    char expected[32];
+    sprintf(expected, "%d", terms);
+    test_expression_with_budget(sum, &ample, expected);
+    free(sum);
+}
+
+void test_cancel_token(void) {
+    Calculator* calc = calculator_new();
+    CancelToken* token = cancel_token_new();
+    calculator_set_cancel_token(calc, token);
+
+    calculator_evaluate(calc, "2+3");
+    TEST_ASSERT_EQUAL_STRING("5", calculator_get_display(calc));
+    cancel_token_cancel(token);
+    TEST_ASSERT_TRUE(cancel_token_is_cancelled(token));
+    calculator_evaluate(calc, "2+3");
+    TEST_ASSERT_EQUAL_STRING("Error: Evaluation cancelled", calculator_get_display(calc));
+
+    int terms;
+    char* sum = build_chain("0", "+", "1", &terms);
+    double value;
+    TEST_ASSERT_EQUAL_INT(ERROR_CANCELLED, parallel_evaluate(calc, sum, 2, &value));
+    free(sum);
+
+    cancel_token_reset(token);
+    calculator_evaluate(calc, "2+3");
+    TEST_ASSERT_EQUAL_STRING("5", calculator_get_display(calc));
+
+    calculator_set_cancel_token(calc, NULL);
+    cancel_token_free(token);
+    calculator_free(calc);
+}
+
+// Decimal Mode Tests
+void test_decimal_expression(NumberMode mode, const char* expression, const char* expected) {
+    Calculator* calc = calculator_new();
+    calculator_set_number_mode(calc, mode);
+    calculator_evaluate(calc, expression);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(expected, calculator_get_display(calc), expression);
+    calculator_free(calc);
+}
+
+void test_decimal_exact_arithmetic(void) {
+    // Decimal fractions are exact, so the binary representation error is gone
+    test_decimal_expression(NUMBER_MODE_DECIMAL64, "0.1+0.2-0.3", "0");
+    test_decimal_expression(NUMBER_MODE_DECIMAL128, "0.1+0.2", "0.3");
+    test_decimal_expression(NUMBER_MODE_DECIMAL64, "1.10*3", "3.3");
+    test_decimal_expression(NUMBER_MODE_DECIMAL64, "19.99*100", "1999");
+    test_decimal_expression(NUMBER_MODE_DECIMAL64, "7.5%2", "1.5");
+    test_decimal_expression(NUMBER_MODE_DECIMAL64, "2^10-1", "1023");
+    test_decimal_expression(NUMBER_MODE_DECIMAL64, "2^-2", "0.25");
+    test_decimal_expression(NUMBER_MODE_DECIMAL64, "N(3-5)", "2");
+    test_decimal_expression(NUMBER_MODE_DECIMAL128, "25!", "15511210043330985984000000");
+    test_decimal_expression(NUMBER_MODE_DECIMAL128, "1/3",
+                            "0.3333333333333333333333333333333333");
+    test_decimal_expression(NUMBER_MODE_DECIMAL64, "1/3", "0.3333333333333333");
+    test_decimal_expression(NUMBER_MODE_DECIMAL64, "2/3", "0.6666666666666667");
+    test_decimal_expression(NUMBER_MODE_DECIMAL128, "p", "3.141592653589793238462643383279503");
+}
+
+void test_decimal_rounding_and_errors(void) {
+    // Round-half-even at the 16th digit
+    test_decimal_expression(NUMBER_MODE_DECIMAL64, "1000000000000000.5+0", "1000000000000000");
+    test_decimal_expression(NUMBER_MODE_DECIMAL64, "1000000000000001.5+0", "1000000000000002");
+    test_decimal_expression(NUMBER_MODE_DECIMAL64, "1/0", "Math Error: Division by zero");
+    test_decimal_expression(NUMBER_MODE_DECIMAL64, "5%0", "Math Error: Division by zero");
+    test_decimal_expression(NUMBER_MODE_DECIMAL64, "0^-1", "Math Error: Division by zero");
+    test_decimal_expression(NUMBER_MODE_DECIMAL64, "q(-4)", "Math Error: Domain error (e.g., sqrt(-1))");
+    test_decimal_expression(NUMBER_MODE_DECIMAL64, "(1.5)!", "Math Error: Domain error (e.g., sqrt(-1))");
+    test_decimal_expression(NUMBER_MODE_DECIMAL64, "10^400", "Error: Overflow");
+    test_decimal_expression(NUMBER_MODE_DECIMAL64, "[1,2]", "Syntax Error: Invalid expression");
+    // Functions without a decimal kernel go through double
+    test_decimal_expression(NUMBER_MODE_DECIMAL64, "q16", "4");
+    test_decimal_expression(NUMBER_MODE_DECIMAL64, "l(e)", "1");
+
+    Calculator* calc = calculator_new();
+    double value = 0.0;
+    calculator_set_number_mode(calc, NUMBER_MODE_DECIMAL128);
+    TEST_ASSERT_EQUAL(ERROR_NONE, calculator_evaluate_value(calc, "1.25*4", &value));
+    TEST_ASSERT_EQUAL_DOUBLE(5.0, value);
+    calculator_free(calc);
+}
+
+void test_decimal_encoding_round_trip(void) {
+    const char* inputs[] = { "0.1", "-123.456", "1e-390", "9999999999999999", "1.5e300" };
+    char text[64];
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+        const char* end;
+        Decimal d = decimal_parse(DECIMAL_128, inputs[i], &end);
+        TEST_ASSERT_EQUAL_INT('\0', *end);
+        decimal_format(DECIMAL_128, d, text, sizeof(text));
+        Decimal again = decimal_parse(DECIMAL_128, text, &end);
+        TEST_ASSERT_EQUAL_UINT64(d.low, again.low);
+        TEST_ASSERT_EQUAL_UINT64(d.high, again.high);
+    }
+    // 17 digits do not fit decimal64 and round half-even
+    const char* end;
+    Decimal d = decimal_parse(DECIMAL_64, "12345678901234565", &end);
+    decimal_format(DECIMAL_64, d, text, sizeof(text));
+    TEST_ASSERT_EQUAL_STRING("1.234567890123456e+16", text);
+}
+
+// Integer Mode Tests
+void test_integer_expression(NumberMode mode, int base, const char* expression, const char* expected) {
+    Calculator* calc = calculator_new();
+    calculator_set_number_mode(calc, mode);
+    calculator_set_output_base(calc, base);
+    calculator_evaluate(calc, expression);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(expected, calculator_get_display(calc), expression);
+    calculator_free(calc);
+}
+
+void test_integer_fast_path_is_exact(void) {
+    Calculator* calc = calculator_new();
+    double value = 0.0;
+
+    // 2^60 + 1 is not a double; only the integer path keeps the 1
+    TEST_ASSERT_EQUAL(ERROR_NONE, calculator_evaluate_value(calc, "2^60+1-2^60", &value));
+    TEST_ASSERT_EQUAL_DOUBLE(1.0, value);
+    TEST_ASSERT_EQUAL(ERROR_NONE, calculator_evaluate_value(calc, "9007199254740993-9007199254740992", &value));
+    TEST_ASSERT_EQUAL_DOUBLE(1.0, value);
+    TEST_ASSERT_EQUAL(NUMBER_MODE_REAL, calculator_get_number_mode(calc));
+    // and the display shows every digit
+    test_expression("2^62+1", "4611686018427387905");
+    test_expression("9007199254740993", "9007199254740993");
+    test_expression("10^10", "10000000000");
+
+    // Integers have no -0; a zero keeps the double path's sign, and its
+    // value when rounding left the doubles nonzero or out of range
+    test_expression("-0", "-0");
+    test_expression("0*-1", "-0");
+    test_expression("3-3", "0");
+    test_expression("(9007199254740993-9007199254740992)-1", "0");
+    test_expression("(2^62+(2^62-1))&0", "0");
+
+    // Anything the integers cannot represent falls back to double
+    test_expression("7/2", "3.5");
+    test_expression("2^-1", "0.5");
+    test_expression("2^64", "1.8446744074e+19");
+    test_expression("21!", "5.1090942172e+19");
+    test_expression("1/0", "Math Error: Division by zero");
+    test_expression("0x10+0b101+0o17", "36");
+    test_expression("6 xor 3", "5");
+    test_expression("1<<4|1", "17");
+    test_expression("17 mod 5", "2");
+    // Bitwise operators bind looser than arithmetic
+    test_expression("1 xor 2+3", "4");
+    test_expression("2.5&1", "Math Error: Domain error (e.g., sqrt(-1))");
+    calculator_free(calc);
+}
+
+void test_integer_modes(void) {
+    test_integer_expression(NUMBER_MODE_INT64, 10, "9223372036854775807", "9223372036854775807");
+    test_integer_expression(NUMBER_MODE_INT64, 10, "9223372036854775807+1", "Error: Overflow");
+    test_integer_expression(NUMBER_MODE_INT64, 10, "-9223372036854775808", "-9223372036854775808");
+    test_integer_expression(NUMBER_MODE_INT64, 10, "N(-9223372036854775807-1)", "Error: Overflow");
+    test_integer_expression(NUMBER_MODE_INT64, 10, "-7/2", "-3");
+    test_integer_expression(NUMBER_MODE_INT64, 10, "-7 mod 2", "-1");
+    test_integer_expression(NUMBER_MODE_INT64, 10, "20!", "2432902008176640000");
+    test_integer_expression(NUMBER_MODE_INT64, 10, "21!", "Error: Overflow");
+    test_integer_expression(NUMBER_MODE_INT64, 10, "1<<62", "4611686018427387904");
+    test_integer_expression(NUMBER_MODE_INT64, 10, "1<<63", "Error: Overflow");
+    test_integer_expression(NUMBER_MODE_INT64, 10, "1<<64", "Math Error: Domain error (e.g., sqrt(-1))");
+    test_integer_expression(NUMBER_MODE_INT64, 10, "-16>>2", "-4");
+    test_integer_expression(NUMBER_MODE_INT64, 10, "5/0", "Math Error: Division by zero");
+    test_integer_expression(NUMBER_MODE_INT64, 10, "s30", "Math Error: Domain error (e.g., sqrt(-1))");
+    test_integer_expression(NUMBER_MODE_INT64, 10, "1.5", "Syntax Error: Invalid expression");
+    test_integer_expression(NUMBER_MODE_INT64, 10, "2p", "Syntax Error: Invalid expression");
+    // Prefixed literals may spell the full bit pattern
+    test_integer_expression(NUMBER_MODE_INT64, 10, "0xffffffffffffffff", "-1");
+    test_integer_expression(NUMBER_MODE_INT64, 16, "255", "0xff");
+    test_integer_expression(NUMBER_MODE_INT64, 16, "-1", "0xffffffffffffffff");
+    test_integer_expression(NUMBER_MODE_INT64, 8, "0b111000", "0o70");
+    test_integer_expression(NUMBER_MODE_INT64, 2, "0xa xor 0x3", "0b1001");
+    test_integer_expression(NUMBER_MODE_INT128, 10, "2^100+1", "1267650600228229401496703205377");
+    test_integer_expression(NUMBER_MODE_INT128, 10, "33!", "8683317618811886495518194401280000000");
+    test_integer_expression(NUMBER_MODE_INT128, 10, "34!", "Error: Overflow");
+    test_integer_expression(NUMBER_MODE_INT128, 16, "1<<100", "0x10000000000000000000000000");
+
+    Calculator* calc = calculator_new();
+    calculator_set_output_base(calc, 7);
+    TEST_ASSERT_EQUAL(10, calculator_get_output_base(calc));
+    calculator_free(calc);
+}
+
+void test_integer_literals_and_formatting(void) {
+    const char* end;
+    Integer value = 0;
+    char text[160];
+
+    TEST_ASSERT_EQUAL(ERROR_NONE, integer_parse(64, 0, "0x7fffffffffffffff)", &end, &value));
+    TEST_ASSERT_EQUAL_INT(')', *end);
+    TEST_ASSERT_TRUE(value == INT64_MAX);
+    TEST_ASSERT_EQUAL(ERROR_OVERFLOW, integer_parse(64, 0, "0x8000000000000000", &end, &value));
+    TEST_ASSERT_EQUAL(ERROR_NONE, integer_parse(64, 1, "0x8000000000000000", &end, &value));
+    TEST_ASSERT_TRUE(value == INT64_MIN);
+    TEST_ASSERT_EQUAL(ERROR_OVERFLOW, integer_parse(128, 0, "170141183460469231731687303715884105728", &end, &value));
+    integer_parse(64, 0, "0b2", &end, &value);
+    TEST_ASSERT_EQUAL_INT('b', *end);
+
+    integer_format(128, 2, -1, text, sizeof(text));
+    TEST_ASSERT_EQUAL_size_t(130, strlen(text));
+    integer_format(64, 10, INT64_MIN, text, sizeof(text));
+    TEST_ASSERT_EQUAL_STRING("-9223372036854775808", text);
+}
+
+// Statistics Tests
+void test_stats_of_lists(void) {
+    test_expression("mean([1,2,3,4])", "2.5");
+    test_expression("median([3,1,2,10])", "2.5");
+    test_expression("percentile([1,2,3,4,5],90)", "4.6");
+    test_expression("var([2,4,4,4,5,5,7,9])", "4.571428571");
+    test_expression("stddev([2,4,4,4,5,5,7,9])", "2.138089935");
+    test_expression("min([[1,2],[3,0]])+max([4,-8])", "4");
+    test_expression("mean(5)", "5");
+    // The sample variance needs two values
+    test_expression("var(5)", "Math Error: Domain error (e.g., sqrt(-1))");
+    test_expression("percentile([1,2],101)", "Math Error: Domain error (e.g., sqrt(-1))");
+}
+
+void test_stats_column_file(void) {
+    char path[128];
+    // Room for the longest expression below, which names the file twice
+    char expression[2 * sizeof(path) + 32];
+    make_temp_name(path, sizeof(path), "/tmp/", "column", ".txt");
+
+    FILE* file = fopen(path, "w");
+    TEST_ASSERT_NOT_NULL(file);
+    fprintf(file, "# header\n");
+    for (int i = 1; i <= 100000; i++) {
+        fprintf(file, i % 1000 == 0 ? " %d \r\n\n" : "%d\n", i);
+    }
+    fclose(file);
+
+    Calculator* calc = calculator_new();
+    double value = 0.0;
+    snprintf(expression, sizeof(expression), "mean(\"%s\")", path);
+    TEST_ASSERT_EQUAL(ERROR_NONE, calculator_evaluate_value(calc, expression, &value));
+    TEST_ASSERT_DOUBLE_WITHIN(1e-6, 50000.5, value);
+    snprintf(expression, sizeof(expression), "max(\"%s\")-min(\"%s\")", path, path);
+    TEST_ASSERT_EQUAL(ERROR_NONE, calculator_evaluate_value(calc, expression, &value));
+    TEST_ASSERT_EQUAL_DOUBLE(99999.0, value);
+    snprintf(expression, sizeof(expression), "var(\"%s\")", path);
+    TEST_ASSERT_EQUAL(ERROR_NONE, calculator_evaluate_value(calc, expression, &value));
+    TEST_ASSERT_DOUBLE_WITHIN(1e-3, 100000.0 * 100001.0 / 12.0, value);
+    // Quantiles are approximate, closest in the tails
+    snprintf(expression, sizeof(expression), "median(\"%s\")", path);
+    TEST_ASSERT_EQUAL(ERROR_NONE, calculator_evaluate_value(calc, expression, &value));
+    TEST_ASSERT_DOUBLE_WITHIN(100.0, 50000.5, value);
+    snprintf(expression, sizeof(expression), "percentile(\"%s\",99.9)", path);
+    TEST_ASSERT_EQUAL(ERROR_NONE, calculator_evaluate_value(calc, expression, &value));
+    TEST_ASSERT_DOUBLE_WITHIN(10.0, 99900.1, value);
+
+    // Paths are only read in real mode
+    calculator_set_number_mode(calc, NUMBER_MODE_COMPLEX);
+    snprintf(expression, sizeof(expression), "mean(\"%s\")", path);
+    calculator_evaluate(calc, expression);
+    TEST_ASSERT_EQUAL_STRING("Syntax Error: Invalid expression", calculator_get_display(calc));
+    calculator_free(calc);
+
+    file = fopen(path, "a");
+    TEST_ASSERT_NOT_NULL(file);
+    fprintf(file, "12x\n");
+    fclose(file);
+    test_expression(expression, "Syntax Error: Invalid expression");
+    unlink(path);
+    test_expression(expression, "Error: Cannot read file");
+    test_expression("mean(\"/tmp\")", "Error: Cannot read file");
+}
+
+void test_stats_merge_matches_single_pass(void) {
+    char path[128];
+    make_temp_name(path, sizeof(path), "/tmp/", "column", ".txt");
+
+    FILE* file = fopen(path, "w");
+    TEST_ASSERT_NOT_NULL(file);
+    StatsSummary* single = stats_summary_new();
+    StatsSummary* left = stats_summary_new();
+    StatsSummary* right = stats_summary_new();
+    unsigned int seed = 12345;
+    for (int i = 0; i < 200000; i++) {
+        seed = seed * 1103515245u + 12345u;
+        double x = (double)(seed >> 8) / 65536.0;
+        fprintf(file, "%.17g\n", x);
+        stats_summary_add(single, x);
+        stats_summary_add(i < 70000 ? left : right, x);
+    }
+    fclose(file);
+    stats_summary_merge(left, right);
+
+    double a, b;
+    TEST_ASSERT_EQUAL(200000, stats_count(left));
+    stats_mean(single, &a);
+    stats_mean(left, &b);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-9 * fabs(a), a, b);
+    stats_variance(single, &a);
+    stats_variance(left, &b);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-9 * a, a, b);
+    stats_quantile(single, 0.5, &a);
+    stats_quantile(left, 0.5, &b);
+    TEST_ASSERT_DOUBLE_WITHIN(0.005 * a, a, b);
+
+    // Any number of workers summarizes the file like one pass does
+    for (int threads = 1; threads <= 8; threads *= 2) {
+        StatsSummary* parallel = stats_summary_new();
+        TEST_ASSERT_EQUAL(ERROR_NONE, stats_summary_add_file(parallel, path, threads, NULL));
+        TEST_ASSERT_EQUAL(200000, stats_count(parallel));
+        stats_min(single, &a);
+        stats_min(parallel, &b);
+        TEST_ASSERT_EQUAL_DOUBLE(a, b);
+        stats_variance(single, &a);
+        stats_variance(parallel, &b);
+        TEST_ASSERT_DOUBLE_WITHIN(1e-9 * a, a, b);
+        stats_quantile(single, 0.99, &a);
+        stats_quantile(parallel, 0.99, &b);
+        TEST_ASSERT_DOUBLE_WITHIN(0.002 * a, a, b);
+        stats_summary_free(parallel);
+    }
+
+    CancelToken* cancel = cancel_token_new();
+    cancel_token_cancel(cancel);
+    StatsSummary* cancelled = stats_summary_new();
+    TEST_ASSERT_EQUAL(ERROR_CANCELLED, stats_summary_add_file(cancelled, path, 2, cancel));
+    stats_summary_free(cancelled);
+    cancel_token_free(cancel);
+
+    StatsSummary* unread = stats_summary_new();
+    TEST_ASSERT_EQUAL(ERROR_FILE, stats_summary_add_file(unread, "/tmp", 2, NULL));
+    TEST_ASSERT_EQUAL(0, stats_count(unread));
+    stats_summary_free(unread);
+
+    stats_summary_free(single);
+    stats_summary_free(left);
+    stats_summary_free(right);
+    unlink(path);
+}
+
+// Lexer Tests
+void test_lexer_token_array(void) {
+    LexTokens* tokens = lex_tokens_new();
+    const char* expression = "  12.5*sin(x) xor 0x1f<<2 \"f\"";
+    static const struct { LexKind kind; char op; uint32_t offset; uint16_t length; } expected[] = {
+        { LEX_NUMBER, '\0', 2, 4 },
+        { LEX_OPERATOR, '*', 6, 1 },
+        { LEX_FUNCTION, 's', 7, 3 },
+        { LEX_PUNCTUATION, '(', 10, 1 },
+        { LEX_FUNCTION, 'x', 11, 1 },
+        { LEX_PUNCTUATION, ')', 12, 1 },
+        { LEX_OPERATOR, OP_XOR, 14, 3 },
+        { LEX_NUMBER, '\0', 18, 4 },
+        { LEX_OPERATOR, OP_SHIFT_LEFT, 22, 2 },
+        { LEX_NUMBER, '\0', 24, 1 },
+        { LEX_STRING, '"', 26, 3 },
+    };
+    TEST_ASSERT_NOT_NULL(tokens);
+    TEST_ASSERT_EQUAL(ERROR_NONE, lexer_tokenize(tokens, expression, NUMBER_MODE_REAL));
+    TEST_ASSERT_EQUAL_size_t(sizeof(expected) / sizeof(expected[0]), tokens->count);
+    for (size_t i = 0; i < tokens->count; i++) {
+        TEST_ASSERT_EQUAL_INT(expected[i].kind, tokens->items[i].kind);
+        TEST_ASSERT_EQUAL_INT(expected[i].op, tokens->items[i].op);
+        TEST_ASSERT_EQUAL_UINT32(expected[i].offset, tokens->items[i].offset);
+        TEST_ASSERT_EQUAL_UINT32(expected[i].length, tokens->items[i].length);
+    }
+    TEST_ASSERT_EQUAL_DOUBLE(12.5, tokens->items[0].value);
+    TEST_ASSERT_EQUAL_DOUBLE(31.0, tokens->items[7].value);
+
+    // A sign after an operator belongs to the number; after a value it does not
+    TEST_ASSERT_EQUAL(ERROR_NONE, lexer_tokenize(tokens, "2*-3-4", NUMBER_MODE_REAL));
+    TEST_ASSERT_EQUAL_size_t(5, tokens->count);
+    TEST_ASSERT_EQUAL_DOUBLE(-3.0, tokens->items[2].value);
+    TEST_ASSERT_EQUAL_INT('-', tokens->items[3].op);
+
+    // Errors end the array where they occur
+    TEST_ASSERT_EQUAL(ERROR_NONE, lexer_tokenize(tokens, "1+2.3.4+5", NUMBER_MODE_REAL));
+    TEST_ASSERT_EQUAL_size_t(4, tokens->count);
+    TEST_ASSERT_EQUAL_INT(LEX_ERROR, tokens->items[3].kind);
+    TEST_ASSERT_EQUAL_INT(ERROR_SYNTAX, tokens->items[3].op);
+    TEST_ASSERT_EQUAL_UINT32(5, tokens->items[3].offset);
+    TEST_ASSERT_EQUAL(ERROR_NONE, lexer_tokenize(tokens, "1+\"open", NUMBER_MODE_REAL));
+    TEST_ASSERT_EQUAL_INT(LEX_ERROR, tokens->items[tokens->count - 1].kind);
+
+    // The imaginary unit only exists in complex mode
+    TEST_ASSERT_EQUAL(ERROR_NONE, lexer_tokenize(tokens, "2i", NUMBER_MODE_COMPLEX));
+    TEST_ASSERT_EQUAL_INT(LEX_CONSTANT, tokens->items[1].kind);
+    TEST_ASSERT_EQUAL(ERROR_NONE, lexer_tokenize(tokens, "2i", NUMBER_MODE_REAL));
+    TEST_ASSERT_EQUAL_INT(LEX_FUNCTION, tokens->items[1].kind);
+    lex_tokens_free(tokens);
+}
+
+void test_lexer_isas_agree(void) {
+    static const char* pieces[] = {
+        " ", "                                        ", "\t\n", "1", "3.25", "1234567890123456789012345678901234567890",
+        "0.000000000000000000000000000001", "1e-7", "+", "-", "*", "(", ")", "s", "mean", "p", "2.", ".5", "mod",
+    };
+    char expression[2048];
+    LexTokens* scalar = lex_tokens_new();
+    LexTokens* vector = lex_tokens_new();
+    LexerIsa best = lexer_best_isa();
+    srand(37);
+
+    for (int round = 0; round < 500; round++) {
+        size_t used = 0;
+        for (int i = 0; i < 30; i++) {
+            const char* piece = pieces[rand() % (sizeof(pieces) / sizeof(pieces[0]))];
+            size_t length = strlen(piece);
+            if (used + length >= sizeof(expression)) {
+                break;
+            }
+            memcpy(expression + used, piece, length);
+            used += length;
+        }
+        expression[used] = '\0';
+
+        lexer_set_isa(LEXER_ISA_SCALAR);
+        TEST_ASSERT_EQUAL(ERROR_NONE, lexer_tokenize(scalar, expression, NUMBER_MODE_REAL));
+        for (LexerIsa isa = LEXER_ISA_SSE2; isa <= best; isa++) {
+            TEST_ASSERT_TRUE(lexer_set_isa(isa));
+            TEST_ASSERT_EQUAL(ERROR_NONE, lexer_tokenize(vector, expression, NUMBER_MODE_REAL));
+            TEST_ASSERT_EQUAL_size_t(scalar->count, vector->count);
+            TEST_ASSERT_EQUAL_MEMORY(scalar->items, vector->items, scalar->count * sizeof(LexToken));
+        }
+    }
+    lexer_set_isa(best);
+    lex_tokens_free(scalar);
+    lex_tokens_free(vector);
+}
+
+void test_lexer_numbers_match_strtod(void) {
+    LexTokens* tokens = lex_tokens_new();
+    char text[64];
+    srand(12);
+
+    // Short literals skip strtod and must still round identically
+    for (int i = 0; i < 20000; i++) {
+        int int_digits = rand() % 9, frac_digits = rand() % 9;
+        size_t n = 0;
+        for (int d = 0; d < int_digits; d++) {
+            text[n++] = (char)('0' + rand() % 10);
+        }
+        text[n++] = '.';
+        for (int d = 0; d < frac_digits; d++) {
+            text[n++] = (char)('0' + rand() % 10);
+        }
+        text[n] = '\0';
+        if (int_digits + frac_digits == 0) {
+            continue;
+        }
+        TEST_ASSERT_EQUAL(ERROR_NONE, lexer_tokenize(tokens, text, NUMBER_MODE_REAL));
+        TEST_ASSERT_EQUAL_size_t(1, tokens->count);
+        TEST_ASSERT_EQUAL_INT(LEX_NUMBER, tokens->items[0].kind);
+        double expected = strtod(text, NULL);
+        TEST_ASSERT_TRUE_MESSAGE(memcmp(&expected, &tokens->items[0].value, sizeof(double)) == 0, text);
+    }
+    TEST_ASSERT_EQUAL(ERROR_NONE, lexer_tokenize(tokens, "12345678901234567890.5", NUMBER_MODE_REAL));
+    TEST_ASSERT_EQUAL_DOUBLE(12345678901234567890.5, tokens->items[0].value);
+    TEST_ASSERT_EQUAL(ERROR_NONE, lexer_tokenize(tokens, "2.5e3", NUMBER_MODE_REAL));
+    TEST_ASSERT_EQUAL_DOUBLE(2500.0, tokens->items[0].value);
+    lex_tokens_free(tokens);
+}
+
+// Random Number Tests
+void test_random_isas_agree(void) {
+    double expected[1001], actual[1001];
+    RandomGenerator* generator = random_generator_new(42, 7);
+    TEST_ASSERT_NOT_NULL(generator);
+    RandomIsa best = random_best_isa();
+
+    TEST_ASSERT_TRUE(random_set_isa(RANDOM_ISA_SCALAR));
+    random_fill_uniform(generator, expected, 1001);
+    for (int i = 0; i < 1001; i++) {
+        TEST_ASSERT_TRUE(expected[i] >= 0.0 && expected[i] < 1.0);
+    }
+    for (int isa = RANDOM_ISA_SCALAR; isa <= (int)best; isa++) {
+        TEST_ASSERT_TRUE(random_set_isa((RandomIsa)isa));
+        random_seed(generator, 42, 7);
+        random_fill_uniform(generator, actual, 1001);
+        TEST_ASSERT_EQUAL_MEMORY(expected, actual, sizeof(expected));
+    }
+    random_set_isa(best);
+    random_generator_free(generator);
+}
+
+void test_random_streams(void) {
+    double a[64], b[64];
+    RandomGenerator* generator = random_generator_new(1, 0);
+    random_fill_normal(generator, a, 64);
+    random_seed(generator, 1, 0);
+    random_fill_normal(generator, b, 64);
+    TEST_ASSERT_EQUAL_MEMORY(a, b, sizeof(a));
+    TEST_ASSERT_EQUAL_UINT32(1, (uint32_t)random_get_seed(generator));
+    random_seed(generator, 1, 1);
+    random_fill_normal(generator, b, 64);
+    TEST_ASSERT_TRUE(memcmp(a, b, sizeof(a)) != 0);
+    random_generator_free(generator);
+
+    // Seeded calculators repeat their draws; other streams do not
+    Calculator* calc = calculator_new();
+    double first[3], value;
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, calculator_seed_random(calc, 99, 0));
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL_INT(ERROR_NONE, calculator_evaluate_value(calc, "rand()+randn()", &first[i]));
+    }
+    calculator_seed_random(calc, 99, 0);
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL_INT(ERROR_NONE, calculator_evaluate_value(calc, "rand()+randn()", &value));
+        TEST_ASSERT_EQUAL_DOUBLE(first[i], value);
+    }
+    calculator_seed_random(calc, 99, 1);
+    calculator_evaluate_value(calc, "rand()+randn()", &value);
+    TEST_ASSERT_TRUE(value != first[0]);
+
+    // Parallel pieces draw from substreams, whatever the thread count
+    int terms;
+    char* expr = build_chain("0", "+", "rand()", &terms);
+    double one = 0.0, four = 0.0;
+    calculator_seed_random(calc, 5, 0);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, parallel_evaluate(calc, expr, 1, &one));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, parallel_evaluate(calc, expr, 4, &four));
+    TEST_ASSERT_EQUAL_MEMORY(&one, &four, sizeof(double));
+    TEST_ASSERT_DOUBLE_WITHIN(terms * 0.01, terms * 0.5, one);
+    free(expr);
+    calculator_free(calc);
+}
+
+static void check_moments(const double* values, size_t count, double mean, double variance) {
+    double sum = 0.0, squares = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        sum += values[i];
+    }
+    double m = sum / (double)count;
+    for (size_t i = 0; i < count; i++) {
+        squares += (values[i] - m) * (values[i] - m);
+    }
+    // Five standard errors of the mean and a 2% band on the variance
+    TEST_ASSERT_DOUBLE_WITHIN(5.0 * sqrt(variance / (double)count), mean, m);
+    TEST_ASSERT_DOUBLE_WITHIN(0.02 * variance, variance, squares / (double)(count - 1));
+}
+
+void test_random_distributions(void) {
+    enum { SAMPLES = 200000 };
+    double* values = malloc(SAMPLES * sizeof(double));
+    RandomGenerator* generator = random_generator_new(2024, 0);
+
+    random_fill_uniform(generator, values, SAMPLES);
+    check_moments(values, SAMPLES, 0.5, 1.0 / 12.0);
+    random_fill_normal(generator, values, SAMPLES);
+    check_moments(values, SAMPLES, 0.0, 1.0);
+    random_fill_exponential(generator, values, SAMPLES);
+    check_moments(values, SAMPLES, 1.0, 1.0);
+    for (int i = 0; i < SAMPLES; i++) {
+        TEST_ASSERT_TRUE(values[i] >= 0.0);
+    }
+    const double lambdas[] = {0.5, 3.0, 9.99, 10.0, 250.0, 1e6};
+    for (size_t k = 0; k < sizeof(lambdas) / sizeof(lambdas[0]); k++) {
+        TEST_ASSERT_EQUAL_INT(ERROR_NONE, random_fill_poisson(generator, lambdas[k], values, SAMPLES));
+        check_moments(values, SAMPLES, lambdas[k], lambdas[k]);
+        for (int i = 0; i < SAMPLES; i++) {
+            TEST_ASSERT_TRUE(values[i] >= 0.0 && values[i] == floor(values[i]));
+        }
+    }
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, random_fill_poisson(generator, 0.0, values, 8));
+    TEST_ASSERT_EQUAL_DOUBLE(0.0, values[7]);
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, random_fill_poisson(generator, -1.0, values, 8));
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, random_fill_poisson(generator, NAN, values, 8));
+
+    random_generator_free(generator);
+    free(values);
+}
+
+void test_random_builtins(void) {
+    Calculator* calc = calculator_new();
+    double value;
+    calculator_seed_random(calc, 3, 0);
+    for (int i = 0; i < 1000; i++) {
+        TEST_ASSERT_EQUAL_INT(ERROR_NONE, calculator_evaluate_value(calc, "uniform(2, 5)", &value));
+        TEST_ASSERT_TRUE(value >= 2.0 && value < 5.0);
+        TEST_ASSERT_EQUAL_INT(ERROR_NONE, calculator_evaluate_value(calc, "2rand()", &value));
+        TEST_ASSERT_TRUE(value >= 0.0 && value < 2.0);
+        TEST_ASSERT_EQUAL_INT(ERROR_NONE, calculator_evaluate_value(calc, "exponential(4)", &value));
+        TEST_ASSERT_TRUE(value >= 0.0);
+        TEST_ASSERT_EQUAL_INT(ERROR_NONE, calculator_evaluate_value(calc, "poisson(2.5)", &value));
+        TEST_ASSERT_TRUE(value >= 0.0 && value == floor(value));
+    }
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, calculator_evaluate_value(calc, "normal(10, 0)", &value));
+    TEST_ASSERT_EQUAL_DOUBLE(10.0, value);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, calculator_evaluate_value(calc, "uniform(1, 1)", &value));
+    TEST_ASSERT_EQUAL_DOUBLE(1.0, value);
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, calculator_evaluate_value(calc, "uniform(5, 2)", &value));
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, calculator_evaluate_value(calc, "normal(0, -1)", &value));
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, calculator_evaluate_value(calc, "exponential(0)", &value));
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, calculator_evaluate_value(calc, "poisson(-1)", &value));
+    TEST_ASSERT_EQUAL_INT(ERROR_SYNTAX, calculator_evaluate_value(calc, "rand(5)", &value));
+    TEST_ASSERT_EQUAL_INT(ERROR_SYNTAX, calculator_evaluate_value(calc, "uniform(1)", &value));
+    TEST_ASSERT_EQUAL_INT(ERROR_SYNTAX, calculator_evaluate_value(calc, "normal([1,2], 1)", &value));
+    calculator_set_number_mode(calc, NUMBER_MODE_DECIMAL64);
+    TEST_ASSERT_EQUAL_INT(ERROR_SYNTAX, calculator_evaluate_value(calc, "rand()", &value));
+    calculator_free(calc);
+    test_expression("exponential(-2)", "Math Error: Domain error (e.g., sqrt(-1))");
+
+    // Compiled programs draw from the calculator they run on
+    char path[64];
+    make_temp_name(path, sizeof(path), "/tmp/", "programs", ".mep");
+    ProgramWriter* writer = program_writer_new();
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, program_writer_add(writer, "walk", "$x+normal(0, $step)+rand()-rand()"));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, program_writer_add(writer, "draws", "randn()^2+rand()^2"));
+    TEST_ASSERT_TRUE(program_writer_save(writer, path));
+    program_writer_free(writer);
+    ProgramLibrary* library = program_library_open(path);
+    TEST_ASSERT_NOT_NULL(library);
+    double variables[2] = {100.0, 0.0}, again;
+    calc = calculator_new();
+    long walk = program_library_find(library, "walk");
+    calculator_seed_random(calc, 8, 0);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, program_run(library, (size_t)walk, calc, variables, &value));
+    TEST_ASSERT_TRUE(value > 99.0 && value < 101.0);
+    calculator_seed_random(calc, 8, 0);
+    program_run(library, (size_t)walk, calc, variables, &again);
+    TEST_ASSERT_EQUAL_DOUBLE(value, again);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, program_run(library, (size_t)program_library_find(library, "draws"), calc, NULL, &value));
+    TEST_ASSERT_TRUE(value >= 0.0);
+    calculator_free(calc);
+    program_library_close(library);
+    unlink(path);
+}
+
+// Right-hand sides shared by the ODE tests
+static ProgramLibrary* open_ode_library(char* path, size_t size) {
+    make_temp_name(path, size, "/tmp/", "programs", ".mep");
+    ProgramWriter* writer = program_writer_new();
+    program_writer_add(writer, "decay", "sin($t)-$k*$y");
+    program_writer_add(writer, "position", "$v");
+    program_writer_add(writer, "velocity", "0-$x");
+    program_writer_add(writer, "stiff", "1000*(cos($t)-$y)-sin($t)");
+    program_writer_add(writer, "blowup", "$y^2");
+    program_writer_add(writer, "log", "ln($y-2)");
+    program_writer_save(writer, path);
+    program_writer_free(writer);
+    return program_library_open(path);
+}
+
+void test_ode_dormand_prince(void) {
+    char path[64];
+    ProgramLibrary* library = open_ode_library(path, sizeof(path));
+    TEST_ASSERT_NOT_NULL(library);
+    Calculator* calc = calculator_new();
+    calculator_toggle_angle_mode(calc);
+    TEST_ASSERT_EQUAL_INT(RAD, calculator_get_angle_mode(calc));
+
+    // dy/dt = -k y + sin t, y(0) = 1, against the closed form
+    size_t decay = (size_t)program_library_find(library, "decay");
+    const char* state[] = {"y"};
+    OdeSystem* system = ode_system_new(library, &decay, 1, state, "t");
+    TEST_ASSERT_NOT_NULL(system);
+    TEST_ASSERT_FALSE(ode_system_set_parameter(system, "y", 1.0));
+    TEST_ASSERT_TRUE(ode_system_set_parameter(system, "k", 2.0));
+    OdeOptions options;
+    ode_options_default(&options);
+    options.relative_tolerance = 1e-9;
+    options.absolute_tolerance = 1e-12;
+    double times[21], out[21], y = 1.0;
+    for (int i = 0; i < 21; i++) {
+        times[i] = 0.5 * i;
+    }
+    OdeStats stats;
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, ode_integrate(system, calc, &options, 0.0, 10.0, &y, times, 21, out, &stats));
+    TEST_ASSERT_EQUAL_size_t(21, stats.points);
+    TEST_ASSERT_TRUE(stats.steps > 10);
+    for (int i = 0; i < 21; i++) {
+        double t = times[i];
+        double exact = 1.2 * exp(-2.0 * t) + (2.0 * sin(t) - cos(t)) / 5.0;
+        TEST_ASSERT_DOUBLE_WITHIN(1e-8, exact, out[i]);
+    }
+    TEST_ASSERT_EQUAL_DOUBLE(out[20], y);
+    ode_system_free(system);
+
+    // x'' = -x as a system, forwards over one period and back again
+    size_t oscillator[] = {(size_t)program_library_find(library, "position"),
+                           (size_t)program_library_find(library, "velocity")};
+    const char* states[] = {"x", "v"};
+    system = ode_system_new(library, oscillator, 2, states, "t");
+    double xv[2] = {1.0, 0.0};
+    double quarter = M_PI / 2.0, rows[2 * 2];
+    double marks[] = {quarter, 3.0 * quarter};
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, ode_integrate(system, calc, &options, 0.0, 2.0 * M_PI, xv, marks, 2, rows, NULL));
+    TEST_ASSERT_DOUBLE_WITHIN(1e-7, 0.0, rows[0]);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-7, -1.0, rows[1]);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-7, 0.0, rows[2]);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-7, 1.0, rows[3]);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-7, 1.0, xv[0]);
+    double back[] = {M_PI};
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, ode_integrate(system, calc, &options, 2.0 * M_PI, 0.0, xv, back, 1, rows, NULL));
+    TEST_ASSERT_DOUBLE_WITHIN(1e-7, -1.0, rows[0]);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-7, 1.0, xv[0]);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-7, 0.0, xv[1]);
+    ode_system_free(system);
+
+    calculator_free(calc);
+    program_library_close(library);
+    unlink(path);
+}
+
+void test_ode_rosenbrock(void) {
+    char path[64];
+    ProgramLibrary* library = open_ode_library(path, sizeof(path));
+    TEST_ASSERT_NOT_NULL(library);
+    Calculator* calc = calculator_new();
+    calculator_toggle_angle_mode(calc);
+
+    // Accurate on a non-stiff problem too
+    size_t decay = (size_t)program_library_find(library, "decay");
+    const char* state[] = {"y"};
+    OdeSystem* system = ode_system_new(library, &decay, 1, state, "t");
+    ode_system_set_parameter(system, "k", 2.0);
+    OdeOptions options;
+    ode_options_default(&options);
+    options.method = ODE_ROSENBROCK;
+    double times[] = {1.0, 2.5, 4.0}, out[3], y = 1.0;
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, ode_integrate(system, calc, &options, 0.0, 4.0, &y, times, 3, out, NULL));
+    for (int i = 0; i < 3; i++) {
+        double t = times[i];
+        TEST_ASSERT_DOUBLE_WITHIN(1e-4, 1.2 * exp(-2.0 * t) + (2.0 * sin(t) - cos(t)) / 5.0, out[i]);
+    }
+    ode_system_free(system);
+
+    // y' = -1000 (y - cos t) - sin t stays on y = cos t; the explicit method
+    // is limited by stability, the implicit one only by accuracy
+    size_t stiff = (size_t)program_library_find(library, "stiff");
+    system = ode_system_new(library, &stiff, 1, state, "t");
+    OdeStats stats;
+    options.relative_tolerance = 1e-3;
+    options.absolute_tolerance = 1e-6;
+    double marks[10], rows[10];
+    for (int i = 0; i < 10; i++) {
+        marks[i] = i + 1.0;
+    }
+    y = 1.0;
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, ode_integrate(system, calc, &options, 0.0, 10.0, &y, marks, 10, rows, &stats));
+    TEST_ASSERT_TRUE(stats.steps < 300);
+    TEST_ASSERT_TRUE(stats.jacobians <= stats.steps);
+    for (int i = 0; i < 10; i++) {
+        TEST_ASSERT_DOUBLE_WITHIN(1e-3, cos(marks[i]), rows[i]);
+    }
+
+    options.method = ODE_DORMAND_PRINCE;
+    options.max_steps = 1000;
+    y = 1.0;
+    TEST_ASSERT_EQUAL_INT(ERROR_BUDGET_EXCEEDED, ode_integrate(system, calc, &options, 0.0, 10.0, &y, marks, 10, rows, &stats));
+    TEST_ASSERT_EQUAL_size_t(1000, stats.steps + stats.rejected);
+    // The rows written before giving up are still valid
+    TEST_ASSERT_TRUE(stats.points < 10);
+    for (size_t i = 0; i < stats.points; i++) {
+        TEST_ASSERT_DOUBLE_WITHIN(1e-3, cos(marks[i]), rows[i]);
+    }
+    ode_system_free(system);
+
+    calculator_free(calc);
+    program_library_close(library);
+    unlink(path);
+}
+
+void test_ode_errors(void) {
+    char path[64];
+    ProgramLibrary* library = open_ode_library(path, sizeof(path));
+    TEST_ASSERT_NOT_NULL(library);
+    Calculator* calc = calculator_new();
+    const char* state[] = {"y"};
+    double y, out[2];
+
+    size_t decay = (size_t)program_library_find(library, "decay");
+    OdeSystem* system = ode_system_new(library, &decay, 1, state, "t");
+    y = 1.0;
+    TEST_ASSERT_EQUAL_INT(ERROR_SYNTAX, ode_integrate(system, calc, NULL, 0.0, 1.0, &y, NULL, 0, NULL, NULL));
+    ode_system_set_parameter(system, "k", 1.0);
+    double unordered[] = {0.5, 0.25};
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, ode_integrate(system, calc, NULL, 0.0, 1.0, &y, unordered, 2, out, NULL));
+    double outside[] = {0.5, 1.5};
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, ode_integrate(system, calc, NULL, 0.0, 1.0, &y, outside, 2, out, NULL));
+    double start[] = {0.0, 0.0};
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, ode_integrate(system, calc, NULL, 0.0, 0.0, &y, start, 2, out, NULL));
+    TEST_ASSERT_EQUAL_DOUBLE(1.0, out[1]);
+    CancelToken* token = cancel_token_new();
+    cancel_token_cancel(token);
+    calculator_set_cancel_token(calc, token);
+    TEST_ASSERT_EQUAL_INT(ERROR_CANCELLED, ode_integrate(system, calc, NULL, 0.0, 1.0, &y, NULL, 0, NULL, NULL));
+    calculator_set_cancel_token(calc, NULL);
+    cancel_token_free(token);
+    ode_system_free(system);
+
+    // Errors from the right-hand side stop the integration
+    size_t log_index = (size_t)program_library_find(library, "log");
+    system = ode_system_new(library, &log_index, 1, state, "t");
+    y = 1.0;
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, ode_integrate(system, calc, NULL, 0.0, 1.0, &y, NULL, 0, NULL, NULL));
+    ode_system_free(system);
+
+    // y' = y^2 from y(0) = 1 blows up at t = 1
+    size_t blowup = (size_t)program_library_find(library, "blowup");
+    system = ode_system_new(library, &blowup, 1, state, "t");
+    double before[] = {0.5, 0.9};
+    OdeStats stats;
+    y = 1.0;
+    ErrorType err = ode_integrate(system, calc, NULL, 0.0, 2.0, &y, before, 2, out, &stats);
+    TEST_ASSERT_TRUE(err == ERROR_MATH_DOMAIN || err == ERROR_OVERFLOW);
+    TEST_ASSERT_EQUAL_size_t(2, stats.points);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-6, 2.0, out[0]);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-4, 10.0, out[1]);
+    ode_system_free(system);
+
+    calculator_free(calc);
+    program_library_close(library);
+    unlink(path);
+}
+
+void test_trace_records_steps(void) {
+    Calculator* calc = calculator_new();
+    TraceBuffer* trace = trace_buffer_new(5);
+    TEST_ASSERT_NOT_NULL(trace);
+    TEST_ASSERT_EQUAL_size_t(8, trace_buffer_capacity(trace));
+    double value;
+
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, calculator_evaluate_value(calc, "2+3*4", &value));
+    TEST_ASSERT_EQUAL_size_t(0, trace_buffer_count(trace));
+    calculator_set_trace(calc, trace);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, calculator_evaluate_value(calc, "2+3*4", &value));
+    TEST_ASSERT_EQUAL_size_t(2, trace_buffer_count(trace));
+    const TraceEvent* event = trace_buffer_event(trace, 0);
+    TEST_ASSERT_EQUAL_INT('*', event->op);
+    TEST_ASSERT_EQUAL_INT(2, event->arity);
+    TEST_ASSERT_EQUAL_DOUBLE(3.0, event->operands[0]);
+    TEST_ASSERT_EQUAL_DOUBLE(4.0, event->operands[1]);
+    TEST_ASSERT_EQUAL_DOUBLE(12.0, event->result);
+    TEST_ASSERT_EQUAL_INT(3, event->number_depth);
+    TEST_ASSERT_TRUE(event->end >= event->start);
+    event = trace_buffer_event(trace, 1);
+    TEST_ASSERT_EQUAL_INT('+', event->op);
+    TEST_ASSERT_EQUAL_DOUBLE(2.0, event->operands[0]);
+    TEST_ASSERT_EQUAL_DOUBLE(14.0, event->result);
+    TEST_ASSERT_EQUAL_INT(2, event->number_depth);
+    TEST_ASSERT_TRUE(event->start >= trace_buffer_event(trace, 0)->end);
+
+    // Functions take one operand; errors are recorded with the step
+    trace_buffer_clear(trace);
+    calculator_evaluate_value(calc, "cos(0)+1/0", &value);
+    TEST_ASSERT_EQUAL_size_t(2, trace_buffer_count(trace));
+    event = trace_buffer_event(trace, 0);
+    TEST_ASSERT_EQUAL_INT(1, event->arity);
+    TEST_ASSERT_EQUAL_DOUBLE(0.0, event->operands[0]);
+    TEST_ASSERT_TRUE(isnan(event->operands[1]));
+    TEST_ASSERT_EQUAL_DOUBLE(1.0, event->result);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, event->error);
+    TEST_ASSERT_EQUAL_INT('/', trace_buffer_event(trace, 1)->op);
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DIV_ZERO, trace_buffer_event(trace, 1)->error);
+
+    // Compiled programs go through the same path
+    char path[64];
+    make_temp_name(path, sizeof(path), "/tmp/", "programs", ".mep");
+    ProgramWriter* writer = program_writer_new();
+    program_writer_add(writer, "line", "$x*2+1");
+    TEST_ASSERT_TRUE(program_writer_save(writer, path));
+    program_writer_free(writer);
+    ProgramLibrary* library = program_library_open(path);
+    TEST_ASSERT_NOT_NULL(library);
+    double x = 5.0;
+    trace_buffer_clear(trace);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, program_run(library, 0, calc, &x, &value));
+    TEST_ASSERT_EQUAL_size_t(2, trace_buffer_count(trace));
+    TEST_ASSERT_EQUAL_DOUBLE(11.0, trace_buffer_event(trace, 1)->result);
+    program_library_close(library);
+    unlink(path);
+
+    // Once full, the oldest events are overwritten
+    trace_buffer_clear(trace);
+    calculator_evaluate_value(calc, "1+1+1+1+1+1+1+1+1+1+1", &value);
+    TEST_ASSERT_EQUAL_size_t(8, trace_buffer_count(trace));
+    TEST_ASSERT_EQUAL_UINT32(2, (uint32_t)trace_buffer_dropped(trace));
+    TEST_ASSERT_EQUAL_DOUBLE(4.0, trace_buffer_event(trace, 0)->result);
+    TEST_ASSERT_EQUAL_DOUBLE(11.0, trace_buffer_event(trace, 7)->result);
+
+    calculator_set_trace(calc, NULL);
+    calculator_evaluate_value(calc, "1+1", &value);
+    TEST_ASSERT_EQUAL_UINT32(2, (uint32_t)trace_buffer_dropped(trace));
+    trace_buffer_free(trace);
+    calculator_free(calc);
+
+    size_t length;
+    char code = calculator_named_function("median", &length);
+    TEST_ASSERT_EQUAL_STRING("median", calculator_operator_name(code));
+    TEST_ASSERT_NULL(calculator_operator_name('+'));
+}
+
+void test_trace_export(void) {
+    Calculator* calc = calculator_new();
+    TraceBuffer* trace = trace_buffer_new(4);
+    calculator_set_trace(calc, trace);
+    double value;
+    calculator_evaluate_value(calc, "1.5+2+3+4+5+6/0", &value);
+    TEST_ASSERT_EQUAL_size_t(4, trace_buffer_count(trace));
+
+    // Binary files read back event for event, across the ring's wrap
+    char path[64];
+    make_temp_name(path, sizeof(path), "/tmp/", "trace", ".bin");
+    TEST_ASSERT_TRUE(trace_export_binary(trace, path));
+    TraceBuffer* loaded = trace_import_binary(path);
+    TEST_ASSERT_NOT_NULL(loaded);
+    TEST_ASSERT_EQUAL_size_t(4, trace_buffer_count(loaded));
+    TEST_ASSERT_EQUAL_UINT32(1, (uint32_t)trace_buffer_dropped(loaded));
+    for (size_t i = 0; i < 4; i++) {
+        TEST_ASSERT_EQUAL_MEMORY(trace_buffer_event(trace, i), trace_buffer_event(loaded, i), sizeof(TraceEvent));
+    }
+    trace_buffer_free(loaded);
+    FILE* file = fopen(path, "r+b");
+    fputc('X', file);
+    fclose(file);
+    TEST_ASSERT_NULL(trace_import_binary(path));
+    file = fopen(path, "wb");
+    fclose(file);
+    TEST_ASSERT_NULL(trace_import_binary(path));
+
+    TEST_ASSERT_TRUE(trace_export_chrome(trace, path));
+    file = fopen(path, "r");
+    char text[4096];
+    size_t size = fread(text, 1, sizeof(text) - 1, file);
+    fclose(file);
+    text[size] = '\0';
+    TEST_ASSERT_NOT_NULL(strstr(text, "{\"traceEvents\":["));
+    TEST_ASSERT_NOT_NULL(strstr(text, "\"name\":\"/\",\"cat\":\"operator\",\"ph\":\"X\""));
+    TEST_ASSERT_NOT_NULL(strstr(text, "\"operand0\":6,\"operand1\":0,\"result\":\"nan\","));
+    TEST_ASSERT_NOT_NULL(strstr(text, "\"operand0\":10.5,\"operand1\":5,\"result\":15.5,"));
+    TEST_ASSERT_NOT_NULL(strstr(text, "\"error\":2}"));
+    TEST_ASSERT_NOT_NULL(strstr(text, "\"dropped\":1}"));
+    unlink(path);
+
+    trace_buffer_free(trace);
+    calculator_free(calc);
+    TEST_ASSERT_TRUE(trace_ticks_per_second() > 0.0);
+}
+
+// Largest error of a fixed-point function over a sweep, in units of the
+// last place, against libm on the exactly representable input
+static double fixed_sweep_error(char op, AngleMode angle_mode, double from, double to, double (*reference)(double)) {
+    double ulp = fixed_to_double(1), worst = 0.0;
+    for (int i = 0; i <= 20000; i++) {
+        Fixed a = fixed_from_double(from + (to - from) * i / 20000.0), r;
+        TEST_ASSERT_EQUAL_INT(ERROR_NONE, fixed_apply_unary(op, angle_mode, a, &r));
+        double error = fabs(fixed_to_double(r) - reference(fixed_to_double(a))) / ulp;
+        worst = error > worst ? error : worst;
+    }
+    return worst;
+}
+
+static double degrees_sin(double x) { return sin(x * M_PI / 180.0); }
+static double degrees_atan(double x) { return atan(x) * 180.0 / M_PI; }
+
+void test_fixed_kernels(void) {
+    Fixed r;
+    const char* end;
+    char text[32];
+
+    // Literals round to nearest and format back to the shortest equal text
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, fixed_parse("3.25e1x", &end, &r));
+    TEST_ASSERT_EQUAL_INT(32 * FIXED_ONE + FIXED_ONE / 2, r);
+    TEST_ASSERT_EQUAL_STRING("x", end);
+    fixed_format(fixed_from_double(0.1), text, sizeof(text));
+    TEST_ASSERT_EQUAL_STRING("0.1", text);
+    fixed_format(fixed_from_double(-1234.5), text, sizeof(text));
+    TEST_ASSERT_EQUAL_STRING("-1234.5", text);
+    for (Fixed v = -300000; v < 300000; v += 7) {
+        Fixed back;
+        fixed_format(v, text, sizeof(text));
+        fixed_parse(text, &end, &back);
+        TEST_ASSERT_EQUAL_INT(v, back);
+    }
+    TEST_ASSERT_EQUAL_INT(ERROR_SYNTAX, fixed_parse("e5", &end, &r));
+    TEST_ASSERT_EQUAL_INT(ERROR_OVERFLOW, fixed_parse("-1e9", &end, &r));
+    TEST_ASSERT_EQUAL_INT(FIXED_MIN, r);
+
+    // Arithmetic is exact or correctly rounded; out of range saturates
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, fixed_apply_binary('*', fixed_from_double(1.5), fixed_from_double(-2.25), &r));
+    TEST_ASSERT_EQUAL_INT(fixed_from_double(-3.375), r);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, fixed_apply_binary('/', FIXED_ONE, 3 * FIXED_ONE, &r));
+    TEST_ASSERT_EQUAL_INT(fixed_from_double(1.0 / 3.0), r);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, fixed_apply_binary('^', 3 * FIXED_ONE, 4 * FIXED_ONE, &r));
+    TEST_ASSERT_EQUAL_INT(81 * FIXED_ONE, r);
+    TEST_ASSERT_EQUAL_INT(ERROR_OVERFLOW, fixed_apply_binary('*', FIXED_MAX, 2 * FIXED_ONE, &r));
+    TEST_ASSERT_EQUAL_INT(FIXED_MAX, r);
+    TEST_ASSERT_EQUAL_INT(ERROR_OVERFLOW, fixed_apply_binary('-', FIXED_MIN, FIXED_ONE, &r));
+    TEST_ASSERT_EQUAL_INT(FIXED_MIN, r);
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DIV_ZERO, fixed_apply_binary('%', FIXED_ONE, 0, &r));
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, fixed_apply_binary('^', -FIXED_ONE, FIXED_ONE / 2, &r));
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, fixed_apply_unary('q', DEG, -1, &r));
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, fixed_apply_unary('S', DEG, FIXED_ONE + 1, &r));
+    TEST_ASSERT_EQUAL_INT(ERROR_OVERFLOW, fixed_apply_unary('E', DEG, 20 * FIXED_ONE, &r));
+
+    // Elementary functions stay within a unit in the last place
+    TEST_ASSERT_TRUE(fixed_sweep_error('s', RAD, -200.0, 200.0, sin) <= 1.0);
+    TEST_ASSERT_TRUE(fixed_sweep_error('c', RAD, -200.0, 200.0, cos) <= 1.0);
+    TEST_ASSERT_TRUE(fixed_sweep_error('s', DEG, -720.0, 720.0, degrees_sin) <= 1.0);
+    TEST_ASSERT_TRUE(fixed_sweep_error('t', RAD, -1.5, 1.5, tan) <= 16.0);
+    TEST_ASSERT_TRUE(fixed_sweep_error('S', RAD, -1.0, 1.0, asin) <= 1.0);
+    TEST_ASSERT_TRUE(fixed_sweep_error('C', RAD, -1.0, 1.0, acos) <= 1.0);
+    TEST_ASSERT_TRUE(fixed_sweep_error('T', DEG, -1000.0, 1000.0, degrees_atan) <= 1.0);
+    TEST_ASSERT_TRUE(fixed_sweep_error('l', RAD, 0.01, 30000.0, log) <= 1.0);
+    TEST_ASSERT_TRUE(fixed_sweep_error('L', RAD, 0.01, 30000.0, log10) <= 1.0);
+    TEST_ASSERT_TRUE(fixed_sweep_error('q', RAD, 0.0, 30000.0, sqrt) <= 0.5);
+    TEST_ASSERT_TRUE(fixed_sweep_error('E', RAD, -10.0, 2.0, exp) <= 1.0);
+}
+
+void test_fixed_mode(void) {
+    Calculator* calc = calculator_new();
+    double value;
+    calculator_set_number_mode(calc, NUMBER_MODE_FIXED);
+
+    calculator_evaluate(calc, "0.1+0.2");
+    TEST_ASSERT_EQUAL_STRING("0.3", calc->buffer);
+    calculator_evaluate(calc, "s(30)+C(0.5)");
+    TEST_ASSERT_EQUAL_STRING("60.5", calc->buffer);
+    calculator_evaluate(calc, "0x10+5!/4");
+    TEST_ASSERT_EQUAL_STRING("46", calc->buffer);
+    calculator_evaluate(calc, "6&3");
+    TEST_ASSERT_EQUAL_STRING("2", calc->buffer);
+    calculator_evaluate(calc, "2e3/7");
+    TEST_ASSERT_EQUAL_STRING("285.71428", calc->buffer);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, calculator_evaluate_value(calc, "2^0.5", &value));
+    TEST_ASSERT_DOUBLE_WITHIN(fixed_to_double(1), sqrt(2.0), value);
+
+    calculator_evaluate(calc, "30000*2");
+    TEST_ASSERT_EQUAL_INT(ERROR_OVERFLOW, calc->error);
+    TEST_ASSERT_EQUAL_STRING("Error: Overflow", calc->buffer);
+    calculator_evaluate(calc, "1e10");
+    TEST_ASSERT_EQUAL_INT(ERROR_OVERFLOW, calc->error);
+    calculator_evaluate(calc, "1/(2-2)");
+    TEST_ASSERT_EQUAL_STRING("Math Error: Division by zero", calc->buffer);
+    calculator_evaluate(calc, "6.5&3");
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, calc->error);
+    calculator_evaluate(calc, "[1,2]");
+    TEST_ASSERT_EQUAL_INT(ERROR_SYNTAX, calc->error);
+
+    calculator_free(calc);
+}
+
+void test_conditional_operators(void) {
+    Calculator* calc = calculator_new();
+    double value;
+
+    calculator_evaluate(calc, "3<4");
+    TEST_ASSERT_EQUAL_STRING("1", calc->buffer);
+    calculator_evaluate(calc, "3!=6");
+    TEST_ASSERT_EQUAL_STRING("1", calc->buffer);
+    calculator_evaluate(calc, "2+2==4&&5>=6||1<=1");
+    TEST_ASSERT_EQUAL_STRING("1", calc->buffer);
+    calculator_evaluate(calc, "1<<3>7");
+    TEST_ASSERT_EQUAL_STRING("1", calc->buffer);
+    calculator_evaluate(calc, "2+2=");
+    TEST_ASSERT_EQUAL_STRING("4", calc->buffer);
+    calculator_evaluate(calc, "if(2>3,10,20)+if(1,1,2)");
+    TEST_ASSERT_EQUAL_STRING("21", calc->buffer);
+    calculator_evaluate(calc, "if(0,1,if(1,2,3))*2");
+    TEST_ASSERT_EQUAL_STRING("4", calc->buffer);
+
+    // The branch not taken and the right side of && and || are not evaluated
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, calculator_evaluate_value(calc, "0&&1/0", &value));
+    TEST_ASSERT_EQUAL_DOUBLE(0.0, value);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, calculator_evaluate_value(calc, "1||l(-1)", &value));
+    TEST_ASSERT_EQUAL_DOUBLE(1.0, value);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, calculator_evaluate_value(calc, "if(0,1/0,7)", &value));
+    TEST_ASSERT_EQUAL_DOUBLE(7.0, value);
+    calculator_evaluate(calc, "1&&1/0");
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DIV_ZERO, calc->error);
+
+    calculator_evaluate(calc, "if(1,2)");
+    TEST_ASSERT_EQUAL_INT(ERROR_SYNTAX, calc->error);
+    calculator_evaluate(calc, "if(1,2,3,4)");
+    TEST_ASSERT_EQUAL_INT(ERROR_SYNTAX, calc->error);
+
+    // Element-wise on matrices: comparisons give masks, if blends
+    calculator_evaluate(calc, "[1,5,3]>[2,2,3]");
+    TEST_ASSERT_EQUAL_STRING("[0, 1, 0]", calc->buffer);
+    calculator_evaluate(calc, "if([1,0,2],[10,20,30],-1)");
+    TEST_ASSERT_EQUAL_STRING("[10, -1, 30]", calc->buffer);
+
+    calculator_set_number_mode(calc, NUMBER_MODE_DECIMAL64);
+    calculator_evaluate(calc, "0.1+0.2==0.3");
+    TEST_ASSERT_EQUAL_STRING("1", calc->buffer);
+    calculator_set_number_mode(calc, NUMBER_MODE_INT64);
+    calculator_evaluate(calc, "if(9223372036854775807>0,7,8)");
+    TEST_ASSERT_EQUAL_STRING("7", calc->buffer);
+    calculator_set_number_mode(calc, NUMBER_MODE_FIXED);
+    calculator_evaluate(calc, "0.5<0.25||0.5>=0.5");
+    TEST_ASSERT_EQUAL_STRING("1", calc->buffer);
+    calculator_set_number_mode(calc, NUMBER_MODE_COMPLEX);
+    calculator_evaluate(calc, "i==i&&1!=i");
+    TEST_ASSERT_EQUAL_STRING("1", calc->buffer);
+    calculator_evaluate(calc, "i<1");
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, calc->error);
+
+    calculator_free(calc);
+}
+
+static double run_compiled(const char* expression, double x, int rewrite, ErrorType* error) {
+    char path[64];
+    make_temp_name(path, sizeof(path), "/tmp/", "programs", ".mep");
+    Calculator* calc = calculator_new();
+    ProgramWriter* writer = program_writer_new();
+    program_writer_set_rewrite(writer, rewrite);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, program_writer_add(writer, "f", expression));
+    TEST_ASSERT_TRUE(program_writer_save(writer, path));
+    program_writer_free(writer);
+    ProgramLibrary* library = program_library_open(path);
+    TEST_ASSERT_NOT_NULL(library);
+    double value = 0.0;
+    *error = program_run(library, 0, calc, &x, &value);
+    program_library_close(library);
+    calculator_free(calc);
+    unlink(path);
+    return value;
+}
+
+void test_conditional_programs(void) {
+    ErrorType error;
+    const char* piecewise = "if($x<0,0-$x^3,if($x<1,2$x^2+$x,$x+2))";
+    for (int rewrite = 0; rewrite <= 1; rewrite++) {
+        for (double x = -2.0; x < 2.0; x += 0.25) {
+            double expected = x < 0 ? -x * x * x : x < 1 ? 2 * x * x + x : x + 2;
+            TEST_ASSERT_DOUBLE_WITHIN(TOLERANCE, expected, run_compiled(piecewise, x, rewrite, &error));
+            TEST_ASSERT_EQUAL_INT(ERROR_NONE, error);
+        }
+        TEST_ASSERT_EQUAL_DOUBLE(1.0, run_compiled("$x==0||1/$x>0.5", 0.0, rewrite, &error));
+        TEST_ASSERT_EQUAL_INT(ERROR_NONE, error);
+        TEST_ASSERT_EQUAL_DOUBLE(0.0, run_compiled("$x!=0&&l($x)>0", 0.0, rewrite, &error));
+        TEST_ASSERT_EQUAL_INT(ERROR_NONE, error);
+        TEST_ASSERT_EQUAL_DOUBLE(8.0, run_compiled("if($x,2,3)^3", 1.0, rewrite, &error));
+    }
+
+    ProgramWriter* writer = program_writer_new();
+    TEST_ASSERT_EQUAL_INT(ERROR_SYNTAX, program_writer_add(writer, "a", "if($x)"));
+    TEST_ASSERT_EQUAL_INT(ERROR_SYNTAX, program_writer_add(writer, "b", "$x&&"));
+    TEST_ASSERT_EQUAL_INT(ERROR_SYNTAX, program_writer_add(writer, "c", "if(1,2,3,4)"));
+    program_writer_free(writer);
+}
+
+void test_result_cache_hits_and_keys(void) {
+    char name[64];
+    make_temp_name(name, sizeof(name), "/", "cache", "");
+    ResultCache* cache = result_cache_open(name, 0);
+    TEST_ASSERT_NOT_NULL(cache);
+    Calculator* calc = calculator_new();
+    calculator_set_cache(calc, cache);
+    ResultCacheStats stats;
+    double value;
+
+    calculator_evaluate(calc, "s(30)*2");
+    TEST_ASSERT_EQUAL_STRING("1", calc->buffer);
+    calculator_evaluate(calc, "s(30)*2");
+    TEST_ASSERT_EQUAL_STRING("1", calc->buffer);
+    result_cache_stats(cache, &stats);
+    TEST_ASSERT_EQUAL_UINT64(2, stats.lookups);
+    TEST_ASSERT_EQUAL_UINT64(1, stats.hits);
+    TEST_ASSERT_EQUAL_UINT64(1, stats.stores);
+
+    // The angle mode, number mode and value/display form are part of the key
+    calculator_toggle_angle_mode(calc);
+    calculator_evaluate(calc, "s(30)*2");
+    TEST_ASSERT_EQUAL_STRING("-1.976063248", calc->buffer);
+    calculator_toggle_angle_mode(calc);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, calculator_evaluate_value(calc, "s(30)*2", &value));
+    TEST_ASSERT_DOUBLE_WITHIN(TOLERANCE, 1.0, value);
+    calculator_set_number_mode(calc, NUMBER_MODE_DECIMAL64);
+    calculator_evaluate(calc, "0.1+0.2-0.3");
+    TEST_ASSERT_EQUAL_STRING("0", calc->buffer);
+    calculator_set_number_mode(calc, NUMBER_MODE_REAL);
+    calculator_evaluate(calc, "0.1+0.2-0.3");
+    TEST_ASSERT_EQUAL_STRING("5.5511151231e-17", calc->buffer);
+    result_cache_stats(cache, &stats);
+    TEST_ASSERT_EQUAL_UINT64(1, stats.hits);
+
+    // Errors are cached; random numbers and matrices are not
+    calculator_evaluate(calc, "1/0");
+    calculator_evaluate(calc, "1/0");
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DIV_ZERO, calc->error);
+    TEST_ASSERT_EQUAL_STRING("Math Error: Division by zero", calc->buffer);
+    calculator_evaluate(calc, "rand()");
+    calculator_evaluate(calc, "[1,2]*2");
+    TEST_ASSERT_NOT_NULL(calculator_get_matrix(calc));
+    calculator_evaluate(calc, "[1,2]*2");
+    TEST_ASSERT_NOT_NULL(calculator_get_matrix(calc));
+    TEST_ASSERT_EQUAL_STRING("[2, 4]", calc->buffer);
+    result_cache_stats(cache, &stats);
+    TEST_ASSERT_EQUAL_UINT64(2, stats.hits);
+    TEST_ASSERT_EQUAL_UINT64(6, stats.stores);
+
+    // Another process sees the entries through its own mapping
+    pid_t child = fork();
+    if (child == 0) {
+        ResultCache* shared = result_cache_open(name, 0);
+        Calculator* other = calculator_new();
+        calculator_set_cache(other, shared);
+        calculator_evaluate(other, "s(30)*2");
+        ResultCacheStats after;
+        result_cache_stats(shared, &after);
+        _exit(after.hits == 3 && strcmp(other->buffer, "1") == 0 ? 0 : 1);
+    }
+    int status;
+    TEST_ASSERT_EQUAL_INT(child, waitpid(child, &status, 0));
+    TEST_ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    result_cache_stats(cache, &stats);
+    TEST_ASSERT_EQUAL_UINT64(3, stats.hits);
+
+    calculator_free(calc);
+    result_cache_close(cache);
+    TEST_ASSERT_TRUE(result_cache_unlink(name));
+}
+
+void test_result_cache_clock_eviction(void) {
+    char name[64], expression[32];
+    make_temp_name(name, sizeof(name), "/", "cache", "");
+    ResultCache* cache = result_cache_open(name, 8);
+    TEST_ASSERT_NOT_NULL(cache);
+    ResultCacheEntry entry = {ERROR_NONE, 1.0, "hot"}, found;
+    TEST_ASSERT_TRUE(result_cache_store(cache, "hot", DEG, 0, &entry));
+
+    // An entry hit between inserts keeps its reference bit and survives a
+    // stream of entries that are never read again
+    for (int i = 0; i < 100; i++) {
+        TEST_ASSERT_TRUE(result_cache_lookup(cache, "hot", DEG, 0, &found));
+        TEST_ASSERT_EQUAL_STRING("hot", found.text);
+        snprintf(expression, sizeof(expression), "cold%d", i);
+        snprintf(entry.text, sizeof(entry.text), "%d", i);
+        TEST_ASSERT_TRUE(result_cache_store(cache, expression, DEG, 0, &entry));
+    }
+    TEST_ASSERT_FALSE(result_cache_lookup(cache, "cold0", DEG, 0, &found));
+    TEST_ASSERT_TRUE(result_cache_lookup(cache, "cold99", DEG, 0, &found));
+    TEST_ASSERT_EQUAL_STRING("99", found.text);
+    TEST_ASSERT_FALSE(result_cache_lookup(cache, "cold99", RAD, 0, &found));
+
+    ResultCacheStats stats;
+    result_cache_stats(cache, &stats);
+    TEST_ASSERT_EQUAL_UINT64(93, stats.evictions);
+
+    // Keys and texts that do not fit are refused
+    char long_expression[RESULT_CACHE_MAX_EXPRESSION + 1];
+    memset(long_expression, '1', sizeof(long_expression) - 1);
+    long_expression[sizeof(long_expression) - 1] = '\0';
+    TEST_ASSERT_FALSE(result_cache_store(cache, long_expression, DEG, 0, &entry));
+    memset(entry.text, 'x', sizeof(entry.text));
+    TEST_ASSERT_FALSE(result_cache_store(cache, "x", DEG, 0, &entry));
+
+    result_cache_close(cache);
+    result_cache_unlink(name);
+}
+
+void test_result_cache_survives_killed_writers(void) {
+    char name[64], expression[32];
+    make_temp_name(name, sizeof(name), "/", "cache", "");
+    ResultCache* cache = result_cache_open(name, 1024);
+    TEST_ASSERT_NOT_NULL(cache);
+    ResultCacheEntry entry, found;
+
+    // Writers killed at arbitrary points, most likely in the middle of a store
+    for (int round = 0; round < 20; round++) {
+        pid_t child = fork();
+        if (child == 0) {
+            ResultCache* shared = result_cache_open(name, 0);
+            for (unsigned i = 0;; i = (i + 1) % 200) {
+                snprintf(expression, sizeof(expression), "k%u", i);
+                snprintf(entry.text, sizeof(entry.text), "%u", i * i);
+                entry.error = ERROR_NONE;
+                entry.value = (double)i;
+                result_cache_store(shared, expression, RAD, 0, &entry);
+            }
+        }
+        usleep(1000 + 250 * round);
+        kill(child, SIGKILL);
+        waitpid(child, NULL, 0);
+    }
+
+    // Every hit is intact, and after storing again every key is present
+    char text[16];
+    for (int pass = 0; pass < 2; pass++) {
+        for (unsigned i = 0; i < 200; i++) {
+            snprintf(expression, sizeof(expression), "k%u", i);
+            snprintf(text, sizeof(text), "%u", i * i);
+            if (result_cache_lookup(cache, expression, RAD, 0, &found)) {
+                TEST_ASSERT_EQUAL_STRING(text, found.text);
+                TEST_ASSERT_EQUAL_DOUBLE((double)i, found.value);
+            } else {
+                TEST_ASSERT_EQUAL_INT(0, pass);
+            }
+            entry.error = ERROR_NONE;
+            entry.value = (double)i;
+            snprintf(entry.text, sizeof(entry.text), "%s", text);
+            if (pass == 0) {
+                TEST_ASSERT_TRUE(result_cache_store(cache, expression, RAD, 0, &entry));
+            }
+        }
+    }
+
+    result_cache_close(cache);
+    result_cache_unlink(name);
+}
+
+void test_rational_kernels(void) {
+    MatrixArena* arena = matrix_arena_new(0);
+    Rational a, b, c, r;
+    const char* end;
+    char text[64];
+
+    // Literals are exact and reduced
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, rational_parse(arena, "-1.25e-1x", &end, &r));
+    TEST_ASSERT_EQUAL_STRING("x", end);
+    rational_format(&r, text, sizeof(text));
+    TEST_ASSERT_EQUAL_STRING("-1/8", text);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, rational_parse(arena, "0.1", &end, &a));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, rational_parse(arena, "0.2", &end, &b));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, rational_parse(arena, "0.3", &end, &c));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, rational_apply_binary(arena, '+', &a, &b, &r));
+    TEST_ASSERT_EQUAL_INT(0, rational_compare(&r, &c));
+    TEST_ASSERT_EQUAL_INT(0, rational_format(&r, text, 3));
+
+    // Past 128 bits the value goes big and comes back once it is small again
+    a = rational_from_integer(2);
+    b = rational_from_integer(300);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, rational_apply_binary(arena, '^', &a, &b, &r));
+    TEST_ASSERT_NOT_NULL(r.big);
+    TEST_ASSERT_EQUAL_DOUBLE(ldexp(1.0, 300), rational_to_double(&r));
+    c = rational_from_integer(299);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, rational_apply_binary(arena, '^', &a, &c, &c));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, rational_apply_binary(arena, '/', &r, &c, &r));
+    TEST_ASSERT_NULL(r.big);
+    rational_format(&r, text, sizeof(text));
+    TEST_ASSERT_EQUAL_STRING("2", text);
+    b = rational_from_integer(RATIONAL_MAX_BITS + 1);
+    TEST_ASSERT_EQUAL_INT(ERROR_OVERFLOW, rational_apply_binary(arena, '^', &a, &b, &r));
+
+    // Sums and products of random 64-bit fractions undo exactly, whichever
+    // path each step takes
+    uint64_t state = 0x9e3779b97f4a7c15u;
+    for (int i = 0; i < 2000; i++) {
+        Integer n[4];
+        for (int k = 0; k < 4; k++) {
+            state = state * 6364136223846793005u + 1442695040888963407u;
+            // Widths from a few bits up to 63
+            n[k] = (Integer)(state >> (1 + (state >> 58) % 60)) | 1;
+        }
+        Rational p = rational_from_integer(n[0]), q = rational_from_integer(n[1]);
+        Rational x, y, back;
+        TEST_ASSERT_EQUAL_INT(ERROR_NONE, rational_apply_binary(arena, '/', &p, &q, &x));
+        p = rational_from_integer(-n[2]);
+        q = rational_from_integer(n[3]);
+        TEST_ASSERT_EQUAL_INT(ERROR_NONE, rational_apply_binary(arena, '/', &p, &q, &y));
+        TEST_ASSERT_EQUAL_INT(ERROR_NONE, rational_apply_binary(arena, '*', &x, &y, &r));
+        TEST_ASSERT_EQUAL_INT(ERROR_NONE, rational_apply_binary(arena, '*', &r, &r, &r));
+        TEST_ASSERT_EQUAL_INT(ERROR_NONE, rational_apply_binary(arena, '/', &r, &y, &back));
+        TEST_ASSERT_EQUAL_INT(ERROR_NONE, rational_apply_binary(arena, '/', &back, &y, &back));
+        TEST_ASSERT_EQUAL_INT(ERROR_NONE, rational_apply_binary(arena, '/', &back, &x, &back));
+        TEST_ASSERT_EQUAL_INT(0, rational_compare(&back, &x));
+        TEST_ASSERT_EQUAL_INT(ERROR_NONE, rational_apply_binary(arena, '+', &r, &y, &back));
+        TEST_ASSERT_EQUAL_INT(ERROR_NONE, rational_apply_binary(arena, '-', &back, &r, &back));
+        TEST_ASSERT_EQUAL_INT(0, rational_compare(&back, &y));
+        TEST_ASSERT_EQUAL_INT(rational_to_double(&x) < rational_to_double(&y) ? -1 : 1, rational_compare(&x, &y));
+        matrix_arena_reset(arena);
+    }
+
+    a = rational_from_integer(1);
+    b = rational_from_integer(0);
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DIV_ZERO, rational_apply_binary(arena, '/', &a, &b, &r));
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DIV_ZERO, rational_apply_unary(arena, 'R', &b, &r));
+    TEST_ASSERT_EQUAL_INT(ERROR_SYNTAX, rational_apply_binary(arena, 's', &a, &a, &r));
+    matrix_arena_free(arena);
+}
+
+void test_rational_mode(void) {
+    Calculator* calc = calculator_new();
+    double value;
+    calculator_set_number_mode(calc, NUMBER_MODE_RATIONAL);
+
+    calculator_evaluate(calc, "1/3+1/6");
+    TEST_ASSERT_EQUAL_STRING("1/2", calc->buffer);
+    calculator_evaluate(calc, "0.1+0.2==0.3");
+    TEST_ASSERT_EQUAL_STRING("1", calc->buffer);
+    calculator_evaluate(calc, "(2/3)^10*2^-3");
+    TEST_ASSERT_EQUAL_STRING("128/59049", calc->buffer);
+    calculator_evaluate(calc, "30!/28!");
+    TEST_ASSERT_EQUAL_STRING("870", calc->buffer);
+    calculator_evaluate(calc, "2^300+1-2^300");
+    TEST_ASSERT_EQUAL_STRING("1", calc->buffer);
+    calculator_evaluate(calc, "1/(2^128)");
+    TEST_ASSERT_EQUAL_STRING("1/340282366920938463463374607431768211456", calc->buffer);
+    calculator_evaluate(calc, "0x10/3+R(4)");
+    TEST_ASSERT_EQUAL_STRING("67/12", calc->buffer);
+    calculator_evaluate(calc, "if(1/3>0.3,1/7,2)");
+    TEST_ASSERT_EQUAL_STRING("1/7", calc->buffer);
+    calculator_evaluate(calc, "7%3+(6&3)");
+    TEST_ASSERT_EQUAL_STRING("3", calc->buffer);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, calculator_evaluate_value(calc, "2/3", &value));
+    TEST_ASSERT_EQUAL_DOUBLE(2.0 / 3.0, value);
+
+    // No exact result: the value carries on as a double
+    calculator_evaluate(calc, "s(30)+1/3");
+    TEST_ASSERT_EQUAL_STRING("0.8333333333", calc->buffer);
+    calculator_evaluate(calc, "7.5%2");
+    TEST_ASSERT_EQUAL_STRING("1.5", calc->buffer);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, calculator_evaluate_value(calc, "2^0.5", &value));
+    TEST_ASSERT_DOUBLE_WITHIN(TOLERANCE, sqrt(2.0), value);
+    calculator_evaluate(calc, "3^2000/3^1999");
+    TEST_ASSERT_EQUAL_STRING("3", calc->buffer);
+    calculator_evaluate(calc, "2^5000");
+    TEST_ASSERT_EQUAL_STRING("Error: Overflow", calc->buffer);
+    TEST_ASSERT_EQUAL_INT(ERROR_OVERFLOW, calc->error);
+    // Past the limit a result a double rounds to zero is an overflow too
+    calculator_evaluate(calc, "2^-5000");
+    TEST_ASSERT_EQUAL_INT(ERROR_OVERFLOW, calc->error);
+
+    // Exact values too long to show whole are rounded from their digits,
+    // even past the double range
+    calculator_evaluate(calc, "2^4000");
+    TEST_ASSERT_EQUAL_STRING("1.3182040934e+1204", calc->buffer);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, calc->error);
+    calculator_evaluate(calc, "2^-4000");
+    TEST_ASSERT_EQUAL_STRING("7.5860787035e-1205", calc->buffer);
+    calculator_evaluate(calc, "0-(10^300)^4/3");
+    TEST_ASSERT_EQUAL_STRING("-3.3333333333e+1199", calc->buffer);
+    calculator_evaluate(calc, "999999999995^100");
+    TEST_ASSERT_EQUAL_STRING("9.9999999950e+1199", calc->buffer);
+
+    calculator_evaluate(calc, "1/(1-1)");
+    TEST_ASSERT_EQUAL_STRING("Math Error: Division by zero", calc->buffer);
+    calculator_evaluate(calc, "3.5!");
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, calc->error);
+    calculator_evaluate(calc, "1/2&1");
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, calc->error);
+    calculator_evaluate(calc, "[1,2]");
+    TEST_ASSERT_EQUAL_INT(ERROR_SYNTAX, calc->error);
+
+    calculator_free(calc);
+}
+
+void test_sheet_incremental(void) {
+    Sheet* sheet = sheet_new();
+    SheetStats stats;
+    double value = 0.0;
+
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_set(sheet, "total", "$net*(1+$tax)"));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_set(sheet, "net", "$price*$quantity-$discount"));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_set_value(sheet, "price", 12.5));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_set_value(sheet, "quantity", 4));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_set_value(sheet, "tax", 0.2));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_set(sheet, "label", "s(90)"));
+    TEST_ASSERT_EQUAL_INT(7, sheet_cell_count(sheet));
+
+    // discount is referenced but not defined, so net and total fail with it
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_recalculate(sheet, NULL, 1, &stats));
+    TEST_ASSERT_EQUAL_INT(6, stats.recomputed);
+    TEST_ASSERT_EQUAL_INT(ERROR_SYNTAX, sheet_get(sheet, "total", &value));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_get(sheet, "label", &value));
+    TEST_ASSERT_EQUAL_DOUBLE(1.0, value);
+
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_set_value(sheet, "discount", 5));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_recalculate(sheet, NULL, 1, &stats));
+    TEST_ASSERT_EQUAL_INT(3, stats.recomputed);
+    TEST_ASSERT_EQUAL_INT(3, stats.depth);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_get(sheet, "total", &value));
+    TEST_ASSERT_DOUBLE_WITHIN(TOLERANCE, 54.0, value);
+
+    // Only the changed input and what depends on it run again
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_set_value(sheet, "tax", 0.5));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_recalculate(sheet, NULL, 1, &stats));
+    TEST_ASSERT_EQUAL_INT(2, stats.recomputed);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_get(sheet, "total", &value));
+    TEST_ASSERT_DOUBLE_WITHIN(TOLERANCE, 67.5, value);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_recalculate(sheet, NULL, 1, &stats));
+    TEST_ASSERT_EQUAL_INT(0, stats.recomputed);
+
+    // Redefining moves the edges: total no longer follows net
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_set(sheet, "total", "$price*2"));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_set_value(sheet, "discount", 0));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_recalculate(sheet, NULL, 1, &stats));
+    TEST_ASSERT_EQUAL_INT(3, stats.recomputed);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_get(sheet, "total", &value));
+    TEST_ASSERT_DOUBLE_WITHIN(TOLERANCE, 25.0, value);
+
+    // Errors propagate downstream and clear once the input is fixed
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_set(sheet, "ratio", "$net/$discount"));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_set(sheet, "scaled", "$ratio*10"));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_recalculate(sheet, NULL, 1, &stats));
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DIV_ZERO, sheet_get(sheet, "scaled", &value));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_set_value(sheet, "discount", 10));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_recalculate(sheet, NULL, 1, &stats));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_get(sheet, "scaled", &value));
+    TEST_ASSERT_DOUBLE_WITHIN(TOLERANCE, 40.0, value);
+
+    // The angle mode comes from the settings
+    Calculator* settings = calculator_new();
+    settings->angle_mode = RAD;
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_set(sheet, "label", "s(p/2)+0*$tax"));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_recalculate(sheet, settings, 1, &stats));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_get(sheet, "label", &value));
+    TEST_ASSERT_DOUBLE_WITHIN(TOLERANCE, 1.0, value);
+
+    TEST_ASSERT_EQUAL_INT(ERROR_SYNTAX, sheet_get(sheet, "missing", &value));
+    TEST_ASSERT_EQUAL_INT(ERROR_SYNTAX, sheet_set(sheet, "bad name", "1"));
+    TEST_ASSERT_EQUAL_INT(ERROR_SYNTAX, sheet_set(sheet, "m", "[1,2]"));
+    calculator_free(settings);
+    sheet_free(sheet);
+}
+
+void test_sheet_cycles(void) {
+    Sheet* sheet = sheet_new();
+    double value = 0.0;
+
+    TEST_ASSERT_EQUAL_INT(ERROR_CIRCULAR_REFERENCE, sheet_set(sheet, "a", "$a+1"));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_set(sheet, "b", "$a*2"));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_set(sheet, "c", "$b+$a"));
+    TEST_ASSERT_EQUAL_INT(ERROR_CIRCULAR_REFERENCE, sheet_set(sheet, "a", "$c-1"));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_set(sheet, "a", "3"));
+    // A refused definition leaves the old one in place
+    TEST_ASSERT_EQUAL_INT(ERROR_CIRCULAR_REFERENCE, sheet_set(sheet, "b", "$c"));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_recalculate(sheet, NULL, 1, NULL));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_get(sheet, "c", &value));
+    TEST_ASSERT_DOUBLE_WITHIN(TOLERANCE, 9.0, value);
+    // Reversing an edge is fine once the old one is gone
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_set(sheet, "c", "4"));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_set(sheet, "a", "$c-1"));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_recalculate(sheet, NULL, 1, NULL));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_get(sheet, "b", &value));
+    TEST_ASSERT_DOUBLE_WITHIN(TOLERANCE, 6.0, value);
+    sheet_free(sheet);
+}
+
+// Builds `chains` independent chains of `length` cells over a shared input;
+// cell c<i>_<k> is the previous cell of its chain scaled and shifted
+static void build_sheet_chains(Sheet* sheet, int chains, int length) {
+    char name[32], expression[96];
+    sheet_set_value(sheet, "x", 1.0);
+    for (int i = 0; i < chains; i++) {
+        for (int k = 0; k < length; k++) {
+            snprintf(name, sizeof(name), "c%d_%d", i, k);
+            if (k == 0) {
+                snprintf(expression, sizeof(expression), "$x*%d+c(%d)", i + 1, i);
+            } else {
+                snprintf(expression, sizeof(expression), "$c%d_%d*0.5+s($x*%d)", i, k - 1, k);
+            }
+            TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_set(sheet, name, expression));
+        }
+    }
+}
+
+void test_sheet_parallel_matches_serial(void) {
+    Sheet* serial = sheet_new();
+    Sheet* parallel = sheet_new();
+    SheetStats stats;
+    char name[32];
+    double a = 0.0, b = 0.0;
+
+    build_sheet_chains(serial, 40, 25);
+    build_sheet_chains(parallel, 40, 25);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_recalculate(serial, NULL, 1, &stats));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_recalculate(parallel, NULL, 4, &stats));
+    TEST_ASSERT_EQUAL_INT(1001, stats.recomputed);
+    TEST_ASSERT_EQUAL_INT(26, stats.depth);
+    TEST_ASSERT_EQUAL_INT(4, stats.threads);
+
+    // Change the shared input, then one chain's head only
+    for (int round = 0; round < 2; round++) {
+        if (round == 0) {
+            sheet_set_value(serial, "x", 2.5);
+            sheet_set_value(parallel, "x", 2.5);
+        } else {
+            sheet_set(serial, "c7_0", "$x-1");
+            sheet_set(parallel, "c7_0", "$x-1");
+        }
+        TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_recalculate(serial, NULL, 1, NULL));
+        TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_recalculate(parallel, NULL, 4, &stats));
+        TEST_ASSERT_EQUAL_INT(round == 0 ? 1001 : 25, stats.recomputed);
+        for (int i = 0; i < 40; i++) {
+            for (int k = 0; k < 25; k++) {
+                snprintf(name, sizeof(name), "c%d_%d", i, k);
+                TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_get(serial, name, &a));
+                TEST_ASSERT_EQUAL_INT(ERROR_NONE, sheet_get(parallel, name, &b));
+                TEST_ASSERT_EQUAL_DOUBLE(a, b);
+            }
+        }
+    }
+    sheet_free(serial);
+    sheet_free(parallel);
+}
+
+#define SPECIAL_TEST_COUNT 2000
+
+void test_special_functions_vs_libm(void) {
+    for (int i = 0; i <= SPECIAL_TEST_COUNT; i++) {
+        double x = -6.0 + 12.0 * i / SPECIAL_TEST_COUNT;
+        TEST_ASSERT_TRUE(ulp_distance(special_erf(x), erf(x)) <= 6.0);
+        TEST_ASSERT_TRUE(ulp_distance(special_erfc(x), erfc(x)) <= 6.0);
+        double t = 27.0 * i / SPECIAL_TEST_COUNT;
+        TEST_ASSERT_TRUE(ulp_distance(special_erfc(t), erfc(t)) <= 6.0);
+        double g = 170.0 * i / SPECIAL_TEST_COUNT + 0.01;
+        TEST_ASSERT_TRUE(ulp_distance(special_gamma(g), tgamma(g)) <= 12.0);
+        TEST_ASSERT_TRUE(ulp_distance(special_gamma(-g), tgamma(-g)) <= 12.0);
+        TEST_ASSERT_TRUE(ulp_distance(special_lgamma(g), lgamma(g)) <= 6.0);
+        double b = 20.0 * i / SPECIAL_TEST_COUNT;
+        for (int n = -3; n <= 5; n++) {
+            TEST_ASSERT_DOUBLE_WITHIN(2e-15, jn(n, b), special_bessel_j(n, b));
+            if (b >= 1.0) {
+                double y = yn(n, b);
+                TEST_ASSERT_DOUBLE_WITHIN(2e-15 * fmax(1.0, fabs(y)), y, special_bessel_y(n, b));
+            }
+        }
+    }
+    // Integers give their factorial exactly
+    TEST_ASSERT_EQUAL_DOUBLE(2432902008176640000.0, special_gamma(21.0));
+    TEST_ASSERT_TRUE(ulp_distance(special_gamma(0.5), sqrt(M_PI)) <= 2.0);
+    TEST_ASSERT_TRUE(ulp_distance(special_beta(2.0, 3.0), 1.0 / 12.0) <= 2.0);
+    // Far past where the gamma functions overflow
+    TEST_ASSERT_DOUBLE_WITHIN(1e-10, lgamma(300.0) + lgamma(500.0) - lgamma(800.0), log(special_beta(300.0, 500.0)));
+    TEST_ASSERT_TRUE(ulp_distance(special_beta(3.0, 1e6), 2.0 / (1e6 * (1e6 + 1.0) * (1e6 + 2.0))) <= 8.0);
+    // At the double nearest the first zero of J0
+    TEST_ASSERT_DOUBLE_WITHIN(1e-30, -6.108765259736730e-17, special_bessel_j(0, 2.404825557695773));
+
+    // Poles and domains
+    TEST_ASSERT_TRUE(isnan(special_gamma(0.0)));
+    TEST_ASSERT_TRUE(isnan(special_gamma(-3.0)));
+    TEST_ASSERT_TRUE(isinf(special_gamma(172.0)));
+    TEST_ASSERT_TRUE(isnan(special_lgamma(-2.0)));
+    TEST_ASSERT_TRUE(isnan(special_beta(-1.0, 2.0)));
+    TEST_ASSERT_TRUE(isnan(special_bessel_y(0, -1.0)));
+    TEST_ASSERT_TRUE(isnan(special_normal_quantile(1.5)));
+    TEST_ASSERT_TRUE(isnan(special_lambert_w(-1.0)));
+    TEST_ASSERT_TRUE(isnan(special_eval(SPECIAL_BESSEL_J, 0.5, 1.0)));
+    TEST_ASSERT_TRUE(isnan(special_eval(SPECIAL_BESSEL_J, SPECIAL_BESSEL_MAX_ORDER + 1, 1.0)));
+}
+
+void test_special_functions_identities(void) {
+    // The normal distribution against erfc, and the quantile against both,
+    // down to the smallest double
+    for (int i = 0; i <= SPECIAL_TEST_COUNT; i++) {
+        double x = -37.0 + 45.0 * i / SPECIAL_TEST_COUNT;
+        // erfc magnifies the rounding of x/sqrt(2) by about x^2
+        double expected = 0.5 * erfc(-x / sqrt(2.0));
+        TEST_ASSERT_DOUBLE_WITHIN(1e-15 * (2.0 + x * x) * expected, expected, special_normal_cdf(x));
+        double p = pow(10.0, -320.0 * i / SPECIAL_TEST_COUNT) * 0.5;
+        double q = special_normal_quantile(p);
+        // As above, with the rounding of q
+        TEST_ASSERT_DOUBLE_WITHIN(1e-15 * (2.0 + q * q) * p, p, special_normal_cdf(q));
+    }
+    TEST_ASSERT_EQUAL_DOUBLE(0.0, special_normal_quantile(0.5));
+    TEST_ASSERT_EQUAL_DOUBLE(-special_normal_quantile(0.25), special_normal_quantile(0.75));
+    TEST_ASSERT_DOUBLE_WITHIN(2e-15, 1.959963984540054, special_normal_quantile(0.975));
+    TEST_ASSERT_TRUE(isinf(special_normal_quantile(0.0)) && special_normal_quantile(0.0) < 0.0);
+
+    // w e^w gives back x
+    for (int i = 1; i <= SPECIAL_TEST_COUNT; i++) {
+        double x = -0.35 + pow(1.2, i / 10.0) - 1.0;
+        double w = special_lambert_w(x);
+        TEST_ASSERT_DOUBLE_WITHIN(4e-16 * fabs(x) * fmax(1.0, w), x, w * exp(w));
+    }
+    TEST_ASSERT_EQUAL_DOUBLE(1.0, special_lambert_w(M_E));
+    TEST_ASSERT_EQUAL_DOUBLE(-1.0, special_lambert_w(-1.0 / M_E));
+    TEST_ASSERT_TRUE(ulp_distance(special_lambert_w(1.0), 0.56714329040978387) <= 2.0);
+    TEST_ASSERT_EQUAL_DOUBLE(1e-300, special_lambert_w(1e-300));
+
+    // Zeros keep their relative accuracy: lgamma(1 + h) = -gamma h + pi^2/12 h^2 + ...
+    double h = (1.0 + 1e-10) - 1.0;
+    TEST_ASSERT_DOUBLE_WITHIN(1e-25, -0.5772156649015329 * h + 0.8224670334241132 * h * h, special_lgamma(1.0 + h));
+    TEST_ASSERT_EQUAL_DOUBLE(0.0, special_lgamma(2.0));
+
+    // The batch kernel matches the scalar functions
+    double x[64], y[64], out[64];
+    for (int i = 0; i < 64; i++) {
+        x[i] = (i - 20) * 0.37;
+        y[i] = i % 7 - 3;
+    }
+    for (SpecialFunction f = SPECIAL_ERF; f <= SPECIAL_NORMAL_QUANTILE; f++) {
+        const double* first = special_arity(f) == 2 && f != SPECIAL_BETA ? y : x;
+        const double* second = special_arity(f) == 2 && f != SPECIAL_BETA ? x : y;
+        special_apply(f, first, second, out, 64);
+        for (int i = 0; i < 64; i++) {
+            TEST_ASSERT_TRUE(ulp_distance(out[i], special_eval(f, first[i], second[i])) == 0.0);
+        }
+    }
+}
+
+void test_special_builtins(void) {
+    Calculator* calc = calculator_new();
+    double value;
+    test_expression("gamma(5)", "24");
+    test_expression("erf(0)", "0");
+    test_expression("besselj(0, 0)", "1");
+    test_expression("lambertw(e)", "1");
+    test_expression("normcdf(0)", "0.5");
+    test_expression_float("beta(2, 3)", 1.0 / 12.0);
+    test_expression_float("norminv(normcdf(1.5))", 1.5);
+    test_expression_float("erfc(1)+erf(1)", 1.0);
+    test_expression_float("2*gamma(0.5)^2", 2.0 * M_PI);
+    test_expression_float("bessely(1, 2.5)", y1(2.5));
+    test_expression_float("E(lgamma(10))", 362880.0);
+    test_expression("gamma(200)", "Error: Overflow");
+    test_expression("gamma(0)", "Math Error: Domain error (e.g., sqrt(-1))");
+
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, calculator_evaluate_value(calc, "gamma(0-2)", &value));
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, calculator_evaluate_value(calc, "besselj(0.5, 1)", &value));
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, calculator_evaluate_value(calc, "bessely(1, 0-1)", &value));
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, calculator_evaluate_value(calc, "beta(0, 1)", &value));
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, calculator_evaluate_value(calc, "norminv(2)", &value));
+    TEST_ASSERT_EQUAL_INT(ERROR_SYNTAX, calculator_evaluate_value(calc, "beta(1)", &value));
+    // Only the branch taken is evaluated
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, calculator_evaluate_value(calc, "if(1, 2, gamma(0))", &value));
+    TEST_ASSERT_EQUAL_DOUBLE(2.0, value);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, calculator_evaluate_value(calc, "0 && beta(1, 0-1)", &value));
+
+    // Element-wise on matrices, with a scalar argument broadcast
+    calculator_evaluate(calc, "besselj(1, [[0.5, 2], [7, 30]])");
+    const Matrix* m = calculator_get_matrix(calc);
+    TEST_ASSERT_NOT_NULL(m);
+    TEST_ASSERT_EQUAL_DOUBLE(special_bessel_j(1, 7.0), m->data[2]);
+    TEST_ASSERT_EQUAL_DOUBLE(special_bessel_j(1, 30.0), m->data[3]);
+    calculator_evaluate(calc, "beta([[1, 2, 3]], [[4, 5, 6]])+erf([[0.1, 0.2, 0.3]])");
+    m = calculator_get_matrix(calc);
+    TEST_ASSERT_NOT_NULL(m);
+    TEST_ASSERT_EQUAL_DOUBLE(special_beta(3.0, 6.0) + special_erf(0.3), m->data[2]);
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, calculator_evaluate_value(calc, "gamma([[1, 0]])", &value));
+
+    calculator_set_number_mode(calc, NUMBER_MODE_DECIMAL64);
+    TEST_ASSERT_EQUAL_INT(ERROR_SYNTAX, calculator_evaluate_value(calc, "erf(1)", &value));
+    calculator_free(calc);
+
+    // Compiled programs, with and without the rewriter
+    ErrorType error;
+    for (int rewrite = 0; rewrite <= 1; rewrite++) {
+        for (double x = 0.25; x < 4.0; x += 0.25) {
+            double expected = special_normal_cdf(x) + special_erf(x) * special_gamma(x + 1.0) + special_bessel_j(2, x);
+            TEST_ASSERT_EQUAL_DOUBLE(expected, run_compiled("normcdf($x)+erf($x)*gamma($x+1)+besselj(2, $x)", x, rewrite, &error));
+            TEST_ASSERT_EQUAL_INT(ERROR_NONE, error);
+        }
+        run_compiled("lgamma($x-1)", 1.0, rewrite, &error);
+        TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, error);
+    }
+}
+
+#define NUMTHEORY_TEST_COUNT 2000
+#define NUMTHEORY_SIEVE_LIMIT 100000
+
+// Product of the factors, checking each is prime
+static unsigned __int128 factor_product(const uint64_t* factors, int count) {
+    unsigned __int128 product = 1;
+    for (int i = 0; i < count; i++) {
+        TEST_ASSERT_TRUE(numtheory_is_prime(factors[i]));
+        TEST_ASSERT_TRUE(i == 0 || factors[i - 1] <= factors[i]);
+        product *= factors[i];
+    }
+    return product;
+}
+
+void test_number_theory(void) {
+    static char composite[NUMTHEORY_SIEVE_LIMIT];
+    for (int i = 2; i < NUMTHEORY_SIEVE_LIMIT; i++) {
+        for (int j = 2 * i; !composite[i] && j < NUMTHEORY_SIEVE_LIMIT; j += i) {
+            composite[j] = 1;
+        }
+    }
+    for (int i = 0; i < NUMTHEORY_SIEVE_LIMIT; i++) {
+        TEST_ASSERT_EQUAL_INT(i >= 2 && !composite[i], numtheory_is_prime((uint64_t)i));
+    }
+
+    // Strong pseudoprimes to several small bases, Carmichael numbers and the
+    // largest primes below 2^63 and 2^64
+    TEST_ASSERT_FALSE(numtheory_is_prime(2047));
+    TEST_ASSERT_FALSE(numtheory_is_prime(3215031751ULL));
+    TEST_ASSERT_FALSE(numtheory_is_prime(3825123056546413051ULL));
+    TEST_ASSERT_FALSE(numtheory_is_prime(41041));
+    TEST_ASSERT_TRUE(numtheory_is_prime(9223372036854775783ULL));
+    TEST_ASSERT_TRUE(numtheory_is_prime(18446744073709551557ULL));
+    TEST_ASSERT_TRUE(numtheory_is_prime((1ULL << 61) - 1));
+    TEST_ASSERT_FALSE(numtheory_is_prime(UINT64_MAX));
+
+    uint64_t factors[NUMTHEORY_MAX_FACTORS];
+    static const uint64_t fermat[] = {3, 5, 17, 257, 641, 65537, 6700417};
+    TEST_ASSERT_EQUAL_INT(7, numtheory_factor(UINT64_MAX, factors));
+    for (int i = 0; i < 7; i++) {
+        TEST_ASSERT_EQUAL_UINT64(fermat[i], factors[i]);
+    }
+    // Semiprimes and a square of two 32-bit primes
+    TEST_ASSERT_EQUAL_INT(2, numtheory_factor(4294967279ULL * 4294967291ULL, factors));
+    TEST_ASSERT_EQUAL_UINT64(4294967279ULL, factors[0]);
+    TEST_ASSERT_EQUAL_UINT64(4294967291ULL, factors[1]);
+    TEST_ASSERT_EQUAL_INT(2, numtheory_factor(4294967291ULL * 4294967291ULL, factors));
+    TEST_ASSERT_EQUAL_UINT64(4294967291ULL, factors[1]);
+    TEST_ASSERT_EQUAL_INT(63, numtheory_factor(1ULL << 63, factors));
+    TEST_ASSERT_EQUAL_INT(0, numtheory_factor(1, factors));
+
+    TEST_ASSERT_EQUAL_UINT64(0, numtheory_gcd(0, 0));
+    TEST_ASSERT_EQUAL_UINT64(7, numtheory_gcd(0, 7));
+    TEST_ASSERT_EQUAL_UINT64(1ULL << 40, numtheory_gcd(3ULL << 40, 5ULL << 41));
+    TEST_ASSERT_EQUAL_UINT64(1, numtheory_powmod(0, 0, 7));
+    TEST_ASSERT_EQUAL_UINT64(0, numtheory_powmod(5, 3, 1));
+
+    srand(48);
+    for (int i = 0; i < NUMTHEORY_TEST_COUNT; i++) {
+        uint64_t n = ((uint64_t)rand() << 42) ^ ((uint64_t)rand() << 21) ^ (uint64_t)rand();
+        uint64_t base = ((uint64_t)rand() << 33) ^ (uint64_t)rand();
+        uint64_t exponent = (uint64_t)rand() % 100;
+        n |= 2;
+        int count = numtheory_factor(n, factors);
+        TEST_ASSERT_TRUE(factor_product(factors, count) == n);
+
+        // Against repeated multiplication, for an even and an odd modulus
+        uint64_t moduli[2] = {n & ~1ULL, n | 1};
+        for (int j = 0; j < 2; j++) {
+            uint64_t expected = 1;
+            for (uint64_t k = 0; k < exponent; k++) {
+                expected = numtheory_mulmod(expected, base % moduli[j], moduli[j]);
+            }
+            TEST_ASSERT_EQUAL_UINT64(expected, numtheory_powmod(base, exponent, moduli[j]));
+        }
+        // Fermat's little theorem for the large prime
+        TEST_ASSERT_EQUAL_UINT64(1, numtheory_powmod(base, 18446744073709551556ULL, 18446744073709551557ULL));
+    }
+}
+
+void test_number_theory_builtins(void) {
+    Calculator* calc = calculator_new();
+    double value;
+    test_expression("gcd(12, 18)", "6");
+    test_expression("lcm(4, 6)", "12");
+    test_expression("gcd(0-12, 18)+lcm(0, 5)", "6");
+    test_expression("powmod(2, 10, 1000)", "24");
+    test_expression("powmod(0-2, 3, 7)", "6");
+    test_expression("isprime(97)+isprime(91)+isprime(0-7)", "1");
+    test_expression("factor(360)", "[2, 2, 2, 3, 3, 5]");
+    test_expression("factor(0-12)", "[-1, 2, 2, 3]");
+    test_expression("factor(1)", "[1]");
+    test_expression("factor(0)", "Math Error: Domain error (e.g., sqrt(-1))");
+    test_expression("gcd(1.5, 2)", "Math Error: Domain error (e.g., sqrt(-1))");
+    test_expression("powmod(2, 0-1, 5)", "Math Error: Domain error (e.g., sqrt(-1))");
+    TEST_ASSERT_EQUAL_INT(ERROR_SYNTAX, calculator_evaluate_value(calc, "gcd(12)", &value));
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, calculator_evaluate_value(calc, "powmod(2, 3, 0)", &value));
+
+    // Integer literals run on the exact integer path, so 64-bit operands are
+    // not rounded
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, calculator_evaluate_value(calc, "powmod(3, 9223372036854775806, 9223372036854775783)", &value));
+    TEST_ASSERT_EQUAL_DOUBLE(282429536481.0, value);
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, calculator_evaluate_value(calc, "isprime(9223372036854775783)", &value));
+    TEST_ASSERT_EQUAL_DOUBLE(1.0, value);
+    // Wide literals keep their digits; a computed double past 2^53 may
+    // have been rounded, so it is refused
+    test_expression("factor(9007199254740993)", "[3, 107, 28059810762433]");
+    test_expression("factor(18446744073709551615)", "[3, 5, 17, 257, 641, 65537, 6700417]");
+    test_expression("isprime(18446744073709551557)", "1");
+    test_expression("powmod(2, 100, 18446744073709551557)-4054449127424", "0");
+    test_expression("factor(18446744073709551616)", "Math Error: Domain error (e.g., sqrt(-1))");
+    test_expression("factor(2^53+1)", "Math Error: Domain error (e.g., sqrt(-1))");
+    test_expression("factor(9007199254740993.0)", "Math Error: Domain error (e.g., sqrt(-1))");
+    calculator_evaluate(calc, "factor(2^50*3)");
+    const Matrix* m = calculator_get_matrix(calc);
+    TEST_ASSERT_NOT_NULL(m);
+    TEST_ASSERT_EQUAL_INT(51, m->cols);
+    TEST_ASSERT_EQUAL_DOUBLE(3.0, m->data[50]);
+    calculator_evaluate(calc, "factor(1e10)");
+    TEST_ASSERT_EQUAL_STRING("[2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5]", calculator_get_display(calc));
+
+    calculator_set_number_mode(calc, NUMBER_MODE_INT128);
+    calculator_evaluate(calc, "powmod(123456789, 987654321, 18446744073709551557)");
+    TEST_ASSERT_EQUAL_STRING("13340410239862665191", calculator_get_display(calc));
+    calculator_evaluate(calc, "isprime(18446744073709551557)*lcm(9223372036854775783, 9223372036854775782)");
+    TEST_ASSERT_EQUAL_STRING("85070591730234615395451677978348487306", calculator_get_display(calc));
+    // factor gives its vector in the exact modes too, but no operator there
+    // takes it
+    calculator_evaluate(calc, "factor(9223372036854775783*2)");
+    TEST_ASSERT_EQUAL_STRING("[2, 9223372036854775783]", calculator_get_display(calc));
+    TEST_ASSERT_EQUAL_INT(ERROR_SYNTAX, calculator_evaluate_value(calc, "factor(12)", &value));
+    calculator_evaluate(calc, "factor(12)+1");
+    TEST_ASSERT_EQUAL_STRING("Syntax Error: Mismatched parentheses", calculator_get_display(calc));
+    calculator_set_number_mode(calc, NUMBER_MODE_INT64);
+    calculator_evaluate(calc, "factor(2^60*3)");
+    TEST_ASSERT_EQUAL_INT(61, calculator_get_matrix(calc)->cols);
+    calculator_evaluate(calc, "factor(0-9223372036854775783)");
+    TEST_ASSERT_EQUAL_STRING("[-1, 9223372036854775783]", calculator_get_display(calc));
+    TEST_ASSERT_EQUAL_INT(ERROR_OVERFLOW, calculator_evaluate_value(calc, "lcm(9223372036854775783, 2)", &value));
+    TEST_ASSERT_EQUAL_INT(ERROR_OVERFLOW, calculator_evaluate_value(calc, "gcd(0-9223372036854775807-1, 0)", &value));
+    calculator_set_number_mode(calc, NUMBER_MODE_RATIONAL);
+    calculator_evaluate(calc, "gcd(6/2, 9)+lcm(2^40, 3^25)/3^25");
+    TEST_ASSERT_EQUAL_STRING("1099511627779", calculator_get_display(calc));
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, calculator_evaluate_value(calc, "gcd(1/2, 3)", &value));
+    calculator_evaluate(calc, "factor(18446744073709551615)");
+    TEST_ASSERT_EQUAL_STRING("[3, 5, 17, 257, 641, 65537, 6700417]", calculator_get_display(calc));
+    calculator_set_number_mode(calc, NUMBER_MODE_DECIMAL64);
+    TEST_ASSERT_EQUAL_INT(ERROR_SYNTAX, calculator_evaluate_value(calc, "gcd(4, 6)", &value));
+    calculator_free(calc);
+
+    // Compiled programs, with and without the rewriter; factor gives a
+    // vector, which a program cannot hold
+    ProgramWriter* writer = program_writer_new();
+    TEST_ASSERT_EQUAL_INT(ERROR_SYNTAX, program_writer_add(writer, "f", "factor($x)"));
+    program_writer_free(writer);
+    ErrorType error;
+    for (int rewrite = 0; rewrite <= 1; rewrite++) {
+        for (double x = 1.0; x < 40.0; x += 1.0) {
+            double expected = (double)numtheory_gcd((uint64_t)x, 36) + (double)numtheory_powmod((uint64_t)x, 5, 101) +
+                              numtheory_is_prime((uint64_t)(x * x + 1.0));
+            TEST_ASSERT_EQUAL_DOUBLE(expected, run_compiled("gcd($x, 36)+powmod($x, 2+3, 101)+isprime($x^2+1)", x, rewrite, &error));
+            TEST_ASSERT_EQUAL_INT(ERROR_NONE, error);
+        }
+        run_compiled("lcm($x/2, 3)", 1.0, rewrite, &error);
+        TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, error);
+    }
+}
+
+// Replay Tests
+
+void test_replay_script_parse(void) {
+    size_t error_line;
+    ReplayScript* script = replay_script_parse("# warm up\n"
+                                               "  button sin⁻¹\n"
+                                               "\n"
+                                               "type 2 √\n"
+                                               "key BackSpace\r\n"
+                                               "wait 250\n"
+                                               "loop 3",
+                                               &error_line);
+    TEST_ASSERT_NOT_NULL(script);
+    TEST_ASSERT_EQUAL_INT(0, error_line);
+    TEST_ASSERT_EQUAL_INT(3, script->loops);
+    TEST_ASSERT_EQUAL_INT(6, script->count);
+    TEST_ASSERT_EQUAL_INT(REPLAY_BUTTON, script->events[0].kind);
+    TEST_ASSERT_EQUAL_STRING("sin⁻¹", script->events[0].text);
+    // Typed text keeps its spaces and splits on UTF-8 characters
+    TEST_ASSERT_EQUAL_STRING("2", script->events[1].text);
+    TEST_ASSERT_EQUAL_STRING(" ", script->events[2].text);
+    TEST_ASSERT_EQUAL_INT(REPLAY_KEY, script->events[3].kind);
+    TEST_ASSERT_EQUAL_STRING("√", script->events[3].text);
+    TEST_ASSERT_EQUAL_STRING("BackSpace", script->events[4].text);
+    TEST_ASSERT_EQUAL_INT(REPLAY_WAIT, script->events[5].kind);
+    TEST_ASSERT_EQUAL_INT(250, script->events[5].wait_ms);
+    replay_script_free(script);
+
+    const char* malformed[] = {"button 1\nclick 2", "button 1\nkey Tab", "wait 0", "wait 1x",
+                               "loop 2\nloop 3", "type", "button 0123456789abcdef"};
+    size_t lines[] = {2, 2, 1, 1, 2, 1, 1};
+    for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++) {
+        TEST_ASSERT_NULL(replay_script_parse(malformed[i], &error_line));
+        TEST_ASSERT_EQUAL_INT(lines[i], error_line);
+    }
+
+    // The script `make replay` plays
+    script = replay_script_load("calculator_replay_sample.txt", &error_line);
+    TEST_ASSERT_NOT_NULL(script);
+    TEST_ASSERT_EQUAL_INT(50, script->loops);
+    replay_script_free(script);
+}
+
+void test_replay_stats_report(void) {
+    ReplayStats* stats = replay_stats_new();
+    for (int i = 1; i <= 100; i++) {
+        replay_stats_add(stats, REPLAY_SERIES_BUTTON, (double)i);
+    }
+    replay_stats_add(stats, REPLAY_SERIES_FRAME, 4.0);
+    TEST_ASSERT_EQUAL_INT(100, replay_stats_count(stats, REPLAY_SERIES_BUTTON));
+    TEST_ASSERT_EQUAL_INT(0, replay_stats_count(stats, REPLAY_SERIES_KEY));
+
+    char* report = NULL;
+    size_t size = 0;
+    FILE* out = open_memstream(&report, &size);
+    replay_stats_print(stats, out);
+    fclose(out);
+    char* line = strstr(report, "button handler");
+    TEST_ASSERT_NOT_NULL(line);
+    size_t count;
+    double mean, p50, p95, p99, max;
+    TEST_ASSERT_EQUAL_INT(6, sscanf(line + strlen("button handler"), "%zu %lf %lf %lf %lf %lf", &count, &mean, &p50, &p95,
+                                    &p99, &max));
+    TEST_ASSERT_EQUAL_INT(100, count);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-9, 50.5, mean);
+    TEST_ASSERT_DOUBLE_WITHIN(1.0, 50.5, p50);
+    TEST_ASSERT_DOUBLE_WITHIN(1.0, 95.0, p95);
+    TEST_ASSERT_DOUBLE_WITHIN(1.0, 99.0, p99);
+    TEST_ASSERT_EQUAL_DOUBLE(100.0, max);
+    TEST_ASSERT_NOT_NULL(strstr(report, "key handler"));
+    free(report);
+    replay_stats_free(stats);
+}
+
+// Rolling Window Tests
+
+// The aggregates of the last `length` of `samples[0..end)`, recomputed
+// from scratch
+static void naive_window(const double* samples, size_t end, size_t length, double* mean, double* sd, double* min,
+                         double* max) {
+    size_t first = end > length ? end - length : 0, n = end - first;
+    double sum = 0.0, squares = 0.0;
+    *min = INFINITY;
+    *max = -INFINITY;
+    for (size_t i = first; i < end; i++) {
+        sum += samples[i];
+        *min = fmin(*min, samples[i]);
+        *max = fmax(*max, samples[i]);
+    }
+    *mean = sum / (double)n;
+    for (size_t i = first; i < end; i++) {
+        squares += (samples[i] - *mean) * (samples[i] - *mean);
+    }
+    *sd = sqrt(squares / (double)(n - 1));
+}
+
+void test_rolling_window_matches_naive(void) {
+    enum { SAMPLES = 20000, LENGTH = 37 };
+    double* samples = malloc(SAMPLES * sizeof(double));
+    RollingWindow* window = rolling_window_new(LENGTH, 0.25);
+    double value, mean, sd, min, max, ewma = 0.0;
+
+    TEST_ASSERT_NULL(rolling_window_new(0, 0.5));
+    TEST_ASSERT_NULL(rolling_window_new(4, 0.0));
+    TEST_ASSERT_NULL(rolling_window_new(4, 1.5));
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, rolling_window_get(window, ROLLING_MEAN, &value));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, rolling_window_get(window, ROLLING_COUNT, &value));
+    TEST_ASSERT_EQUAL_DOUBLE(0.0, value);
+
+    // A large, drifting offset with small noise is where running sums lose
+    // the variance to cancellation
+    srand(7);
+    for (size_t i = 0; i < SAMPLES; i++) {
+        samples[i] = 1e8 + (double)i * 0.5 + (double)rand() / RAND_MAX;
+        rolling_window_push(window, samples[i]);
+        ewma = i == 0 ? samples[i] : ewma + 0.25 * (samples[i] - ewma);
+        if (i == 0) {
+            TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, rolling_window_get(window, ROLLING_STDDEV, &value));
+            continue;
+        }
+        naive_window(samples, i + 1, LENGTH, &mean, &sd, &min, &max);
+        TEST_ASSERT_EQUAL_INT(i + 1 < LENGTH ? i + 1 : LENGTH, rolling_window_count(window));
+        rolling_window_get(window, ROLLING_MEAN, &value);
+        TEST_ASSERT_DOUBLE_WITHIN(1e-15 * mean, mean, value);
+        rolling_window_get(window, ROLLING_STDDEV, &value);
+        TEST_ASSERT_DOUBLE_WITHIN(1e-6 * sd, sd, value);
+        rolling_window_get(window, ROLLING_MIN, &value);
+        TEST_ASSERT_EQUAL_DOUBLE(min, value);
+        rolling_window_get(window, ROLLING_MAX, &value);
+        TEST_ASSERT_EQUAL_DOUBLE(max, value);
+        rolling_window_get(window, ROLLING_EWMA, &value);
+        TEST_ASSERT_EQUAL_DOUBLE(ewma, value);
+    }
+    rolling_window_get(window, ROLLING_SUM, &value);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-15 * mean * LENGTH, mean * LENGTH, value);
+
+    // A NaN fails the window aggregates until it slides out; the EWMA skips it
+    rolling_window_clear(window);
+    for (int i = 1; i <= 5; i++) {
+        rolling_window_push(window, (double)i);
+    }
+    rolling_window_push(window, NAN);
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, rolling_window_get(window, ROLLING_MIN, &value));
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, rolling_window_get(window, ROLLING_EWMA, &value));
+    TEST_ASSERT_FALSE(isnan(value));
+    for (int i = 0; i < LENGTH; i++) {
+        rolling_window_push(window, 3.0);
+    }
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, rolling_window_get(window, ROLLING_VARIANCE, &value));
+    TEST_ASSERT_EQUAL_DOUBLE(0.0, value);
+    rolling_window_get(window, ROLLING_MAX, &value);
+    TEST_ASSERT_EQUAL_DOUBLE(3.0, value);
+    rolling_window_free(window);
+    free(samples);
+}
+
+void test_rolling_binding(void) {
+    ProgramWriter* writer = program_writer_new();
+    TEST_ASSERT_EQUAL_INT(ERROR_NONE, program_writer_add(writer, "z", "($temp-$temp_mean)/$temp_sd+$k*$load_max"));
+    ProgramLibrary* library = program_writer_load(writer);
+    program_writer_free(writer);
+    size_t index = (size_t)program_library_find(library, "z");
+    Calculator* calc = calculator_new();
+    RollingWindow* temp = rolling_window_new(4, 1.0);
+    RollingWindow* load = rolling_window_new(2, 1.0);
+    RollingBinding* binding = rolling_binding_new(library, index);
+    double* variables = calloc(program_variable_count(library, index), sizeof(double));
+    double value;
+
+    TEST_ASSERT_EQUAL_INT(3, rolling_binding_add(binding, "temp", temp));
+    TEST_ASSERT_EQUAL_INT(1, rolling_binding_add(binding, "load", load));
+    TEST_ASSERT_EQUAL_INT(0, rolling_binding_add(binding, "te", load));
+    TEST_ASSERT_EQUAL_INT(ERROR_MATH_DOMAIN, rolling_binding_update(binding, variables));
+
+    long k = -1;
+    for (size_t slot = 0; slot < program_variable_count(library, index); slot++) {
+        if (strcmp(program_variable_name(library, index, slot), "k") == 0) {
+            k = (long)slot;
+        }
+    }
+    TEST_ASSERT_TRUE(k >= 0);
+    variables[k] = 10.0;
+
+    const double temps[] = {20.0, 22.0, 21.0, 25.0, 23.0}, loads[] = {0.5, 0.9, 0.2, 0.1, 0.4};
+    for (int tick = 0; tick < 5; tick++) {
+        rolling_window_push(temp, temps[tick]);
+        rolling_window_push(load, loads[tick]);
+        if (tick == 0) {
+            continue;
+        }
+        TEST_ASSERT_EQUAL_INT(ERROR_NONE, rolling_binding_update(binding, variables));
+        TEST_ASSERT_EQUAL_DOUBLE(10.0, variables[k]);
+        TEST_ASSERT_EQUAL_INT(ERROR_NONE, program_run(library, index, calc, variables, &value));
+        double mean, sd, min, max;
+        naive_window(temps, (size_t)tick + 1, 4, &mean, &sd, &min, &max);
+        double expected = (temps[tick] - mean) / sd + 10.0 * fmax(loads[tick], loads[tick - 1]);
+        TEST_ASSERT_DOUBLE_WITHIN(TOLERANCE, expected, value);
+    }
+
+    free(variables);
+    rolling_binding_free(binding);
+    rolling_window_free(temp);
+    rolling_window_free(load);
+    calculator_free(calc);
+    program_library_close(library);
+}
+
+// Unity Setup and Runner
+void setUp(void) {
+    // Called before each test
+}
+
+void tearDown(void) {
+    // Called after each test
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    
+    // Basic Arithmetic
+    RUN_TEST(test_addition);
+    RUN_TEST(test_subtraction);
+    RUN_TEST(test_multiplication);
+    RUN_TEST(test_division);
+    RUN_TEST(test_division_by_zero);
+    
+    // Precedence and Parentheses
+    RUN_TEST(test_operator_precedence);
+    RUN_TEST(test_parentheses_simple);
+    RUN_TEST(test_nested_parentheses);
+    RUN_TEST(test_complex_expressions);
+    
+    // Trigonometry (Degrees)
+    RUN_TEST(test_sine_deg);
+    RUN_TEST(test_cosine_deg);
+    RUN_TEST(test_tangent_deg);
+    
+    // Trigonometry (Radians)
+    RUN_TEST(test_sine_rad);
+    RUN_TEST(test_cosine_rad);
+    RUN_TEST(test_tangent_rad);
+    
+    // Inverse Trigonometry
+    RUN_TEST(test_arcsine);
+    RUN_TEST(test_arccosine);
+    RUN_TEST(test_arctangent);
+    
+    // Logarithms and Exponents
+    RUN_TEST(test_natural_logarithm);
+    RUN_TEST(test_common_logarithm);
+    RUN_TEST(test_exponential);
+    RUN_TEST(test_power_operator);
+    
+    // Other Functions
+    RUN_TEST(test_factorial);
+    RUN_TEST(test_reciprocal);
+    RUN_TEST(test_negation);
+    RUN_TEST(test_modulo);
+    RUN_TEST(test_square_root);
+    
+    // Constants
+    RUN_TEST(test_pi_constant);
+    RUN_TEST(test_e_constant);
+    
+    // Error Handling
+    RUN_TEST(test_domain_errors);
+    RUN_TEST(test_syntax_errors);
+    RUN_TEST(test_mismatched_parentheses);
+    RUN_TEST(test_stack_overflow);
+    
+    // Calculator State
+    RUN_TEST(test_calculator_clear);
+    RUN_TEST(test_angle_mode_toggle);
+    
+    // Combined Operations
+    RUN_TEST(test_combined_functions);
+    RUN_TEST(test_functions_with_parentheses);
+    RUN_TEST(test_chained_operations);
+    
+    // Edge Cases
+    RUN_TEST(test_very_small_numbers);
+    RUN_TEST(test_very_large_numbers);
+    RUN_TEST(test_negative_number_operations);
+    RUN_TEST(test_zero_operations);
+
+    // Complex Mode
+    RUN_TEST(test_complex_mode_toggle);
+    RUN_TEST(test_complex_arithmetic);
+    RUN_TEST(test_complex_domain_extensions);
+    RUN_TEST(test_complex_inverse_trig_principal_branch);
+    RUN_TEST(test_complex_batch_kernels);
+
+    // Matrices
+    RUN_TEST(test_matrix_literals);
+    RUN_TEST(test_matrix_elementwise);
+    RUN_TEST(test_matrix_functions);
+    RUN_TEST(test_matrix_result_accessor);
+    RUN_TEST(test_matrix_blocked_kernels);
+    RUN_TEST(test_matrix_elementwise_vectorized);
+
+    // History
+    RUN_TEST(test_history_append_and_reopen);
+    RUN_TEST(test_history_growth_and_search);
+    RUN_TEST(test_history_rebuilds_lost_index);
+    RUN_TEST(test_history_rejects_damaged_records);
+    RUN_TEST(test_history_search_index);
+
+    // Vectorized Kernels
+    RUN_TEST(test_vecmath_accuracy_vs_libm);
+    RUN_TEST(test_vecmath_degree_variants);
+    
+    // Parallel Evaluation
+    RUN_TEST(test_parallel_large_sum);
+    RUN_TEST(test_parallel_nested_and_errors);
+    RUN_TEST(test_parallel_thread_count_independent);
+    
+    // Precompiled Programs
+    RUN_TEST(test_program_compile_and_run);
+    RUN_TEST(test_program_rejects_corrupt_files);
+    RUN_TEST(test_program_strength_reduction);
+    
+    // Budgets and Cancellation
+    RUN_TEST(test_budget_limits);
+    RUN_TEST(test_cancel_token);
+    
+    // Decimal Modes
+    RUN_TEST(test_decimal_exact_arithmetic);
+    RUN_TEST(test_decimal_rounding_and_errors);
+    RUN_TEST(test_decimal_encoding_round_trip);
+    
+    // Integer Modes
+    RUN_TEST(test_integer_fast_path_is_exact);
+    RUN_TEST(test_integer_modes);
+    RUN_TEST(test_integer_literals_and_formatting);
+    
+    // Statistics
+    RUN_TEST(test_stats_of_lists);
+    RUN_TEST(test_stats_column_file);
+    RUN_TEST(test_stats_merge_matches_single_pass);
+    
+    // Lexer
+    RUN_TEST(test_lexer_token_array);
+    RUN_TEST(test_lexer_isas_agree);
+    RUN_TEST(test_lexer_numbers_match_strtod);
+    
+    // Random Numbers
+    RUN_TEST(test_random_isas_agree);
+    RUN_TEST(test_random_streams);
+    RUN_TEST(test_random_distributions);
+    RUN_TEST(test_random_builtins);
+    
+    // ODE Integration
+    RUN_TEST(test_ode_dormand_prince);
+    RUN_TEST(test_ode_rosenbrock);
+    RUN_TEST(test_ode_errors);
+    
+    // Tracing
+    RUN_TEST(test_trace_records_steps);
+    RUN_TEST(test_trace_export);
+    
+    // Fixed Point
+    RUN_TEST(test_fixed_kernels);
+    RUN_TEST(test_fixed_mode);
+    
+    // Conditionals
+    RUN_TEST(test_conditional_operators);
+    RUN_TEST(test_conditional_programs);
+    
+    // Shared Result Cache
+    RUN_TEST(test_result_cache_hits_and_keys);
+    RUN_TEST(test_result_cache_clock_eviction);
+    RUN_TEST(test_result_cache_survives_killed_writers);
+    
+    // Rational Mode
+    RUN_TEST(test_rational_kernels);
+    RUN_TEST(test_rational_mode);
+    
+    // Sheets
+    RUN_TEST(test_sheet_incremental);
+    RUN_TEST(test_sheet_cycles);
+    RUN_TEST(test_sheet_parallel_matches_serial);
+    
+    // Special Functions
+    RUN_TEST(test_special_functions_vs_libm);
+    RUN_TEST(test_special_functions_identities);
+    RUN_TEST(test_special_builtins);
+    
+    // Number Theory
+    RUN_TEST(test_number_theory);
+    RUN_TEST(test_number_theory_builtins);
+    
+    // Replay
+    RUN_TEST(test_replay_script_parse);
+    RUN_TEST(test_replay_stats_report);
+    
+    // Rolling Windows
+    RUN_TEST(test_rolling_window_matches_naive);
+    RUN_TEST(test_rolling_binding);
     
     return UNITY_END();
 }